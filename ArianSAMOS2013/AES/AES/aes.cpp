@@ -16,12 +16,42 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
-#include <CL/cl.h>
 #include <stdlib.h>
-#include <omp.h>
+#include <limits.h>
+#ifndef CPU_ONLY
+ #include <CL/cl.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
 
 
 #include "data.h"
+#include "aesni.h"
+#include "aesbs.h"
+#ifndef CPU_ONLY
+ #include "oclRuntime.h"
+ #include "oclProgramCache.h"
+ #include "oclHostMem.h"
+ #include "oclMemPool.h"
+ #include "oclPipeline.h"
+ #include "oclCoop.h"
+ #include "oclTune.h"
+ #include "oclRoofline.h"
+ #include "oclTrace.h"
+ #include "oclHandles.h"
+ #ifdef SAMOS_EMBED_KERNELS
+  #include "samosKernels.h"
+ #endif
+#endif
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchSweep.h"
+#include "benchServe.h"
+#include "benchArena.h"
+#include "benchScaling.h"
 
 // Include sys/time.h in Linux environments
 // #include <sys/time.h>
@@ -38,23 +68,11 @@
 #endif
 
 // OpenCL Definitions
-// #define FERMI
+// The platform and device are picked at run time, see ../../common/oclRuntime.h
 // #define VIVANTE
 
 // #define LOCALMEM    // use this #def if you want to check the version that does not uses local memory    
 
-#ifdef FERMI 
-
- #define PLATFORMS_IDS 3 // on the Fermi machine at IDA
- #define THIS_PLATFORM_ID 1
-#else
-
- #define PLATFORMS_IDS 1 // on Unmesh's local desktop
- #define THIS_PLATFORM_ID 0
-#endif
-
-
-#define NUM_CORES		1
 
 #define PLATFORM		0
 #define DEVICE			1
@@ -68,6 +86,16 @@
 #define RDDEV			9
 #define CPU				10
 #define GPU_SEQ			11
+#define WRDEV_COPY		12		// copy path reference for --mem-mode alloc/use
+#define RDDEV_COPY		13
+#define PIPELINE		14		// WRDEV + KERNEL_EXEC + RDDEV overlapped, with --pipeline
+#define COOP			15		// one job shared by the device and the CPU, with --coop
+#define BATCH			16		// one round trip of a message batch, descriptors and text in and text out, with --batch
+#define NUM_PHASES		17
+
+const char *phaseNames[NUM_PHASES] = {"PLATFORM", "DEVICE", "CONTEXT", "CMDQ", "PGM", "KERNEL",
+									  "KERNEL_EXEC", "BUFF", "WRDEV", "RDDEV", "CPU", "GPU_SEQ",
+									  "WRDEV_COPY", "RDDEV_COPY", "PIPELINE", "COOP", "BATCH"};
 
 #ifdef VIVANTE
 #define CL_GLOBAL_SIZE_0		(32*1024)
@@ -79,149 +107,177 @@
 	#define WORK_GROUP_SIZE	256
 #endif
 
-cl_program 			clProgram;
+#ifndef CPU_ONLY
+ocl_handle<cl_program>	clProgram;
 cl_device_id 		clDeviceId;
 cl_context 			clContext;
-cl_kernel 			clKernel1;
+ocl_handle<cl_kernel>	clKernel1;
 cl_command_queue 	clCommandQueue;
 cl_int 				clErr;
-cl_mem				clPlainTextBuff, clCipherTextBuff, clKeysBuff, clIVBuff;
-cl_event			prof_event;
+ocl_buffer<unsigned char>	clPlainTextBuff, clCipherTextBuff;
+ocl_buffer<int>		clKeysBuff;
+ocl_runtime			clRuntime;
+ocl_pipeline		clPipeline;
+ocl_coop			clCoop;
+ocl_launch			aesLaunch = {{WORK_GROUP_SIZE, 1}, 0, 0.0, OCL_TUNE_DEFAULT};
+#endif
 
-struct timeval 		start[15];
-struct timeval 		stop[15];
-float 				timeRes[15] = {0};
-FILE 				*fp;
+float 				timeRes[BENCH_MAX_PHASES] = {0};
 FILE 				*fio;
 char 				buff[256];
-char 				*kernelSrc;
 char 				description[256] = "AES";
 size_t 				clLocalSize;
 size_t 				clGlobalSize;
 
-#ifdef FERMI
-cl_platform_id 		clPlatformId[3];
-#else
-cl_platform_id		clPlatformId;
-#endif
-
 //Application Definitions
 #define AES_BLOCK_SIZE	16
 #define MB				1024 * 1024
 
+// block cipher modes, --mode ecb|ctr (or SAMOS_AES_MODE)
+#define AES_MODE_ECB	0		// every block encrypted on its own, the kernel of the SAMOS 2013 paper
+#define AES_MODE_CTR	1		// NIST SP 800-38A counter mode
+const char *aesModeNames[] = {"ECB", "CTR"};
+int 				aesMode = AES_MODE_CTR;
+
+// kernels of kernel.cl per mode, --kernel ttable|bitsliced (or SAMOS_AES_KERNEL)
+#define AES_KERNEL_TTABLE		0		// Te tables in local memory, one block per work-item
+#define AES_KERNEL_BITSLICED	1		// the circuit of aesbs.h, AES_BS_BLOCKS blocks per work-item
+#define AES_NUM_KERNELS			2
+#define AES_BS_BLOCKS			4
+const char *aesKernelNames[AES_NUM_KERNELS][2] = {{"AES_encrypt_local", "AES_ctr_local"}, {"AES_encrypt_bs", "AES_ctr_bs"}};
+const char *aesKernelVariants[] = {"T-table", "bitsliced"};
+int 				aesKernel = AES_KERNEL_TTABLE;
+
+// the key, --key-bits 128|192|256 (or SAMOS_AES_KEY_BITS) of the bytes 00 01 02 ...; --keys <n> (or SAMOS_AES_KEYS)
+// adds a batch of n random keys of that length, expanded on the host and by AES_expand_keys, see aes_key_batch
+#define AES_KEY_WORDS		60		// words per schedule in a key batch, the size of AES-256
+const char *aesKeyedNames[] = {"AES_encrypt_keyed", "AES_ctr_keyed"};
+int 				aesKeyBits = 256;
+int 				aesNumKeys = 0;
+
+// --batch, messages per batch of the packet workload, 0 runs the file; the descriptors hold 32-bit offsets, so
+// a batch of the longest messages in whole blocks has to stay within 4 GB
+#define AES_BATCH_MAX_LEN	1500
+#define AES_BATCH_SLOT		((AES_BATCH_MAX_LEN + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE)
+#define AES_BATCH_MAX_MSGS	(UINT_MAX / AES_BATCH_SLOT)
+const char *aesBatchNames[] = {"AES_encrypt_batch", "AES_ctr_batch"};
+int 				aesBatchMsgs = 0;
+
+// engines of the CPU path, --cpu-engine auto|aesni|bitsliced|ttable (or SAMOS_AES_ENGINE)
+#define AES_ENGINE_TTABLE		0		// AESEncryptTable lookups, any CPU
+#define AES_ENGINE_AESNI		1		// the x86 AES instructions, AESNI_LANES blocks in flight (aesni.h)
+#define AES_ENGINE_BITSLICED	2		// constant time, aesbsBlocks() blocks per step (aesbs.h)
+#define AES_NUM_ENGINES			3
+#define AES_CPU_CHUNK			(256 * AES_BLOCK_SIZE)		// bytes per OpenMP iteration of the AES-NI and bitsliced engines
+const char *aesEngineNames[] = {"T-table", "AES-NI", "bitsliced"};
+int 				aesEngine = AES_ENGINE_TTABLE;
+
+// a CTR counter block as a 128-bit big-endian number; the benchmark puts a nonce in hi and counts blocks in lo
+struct aes_ctr
+{
+	unsigned long long	hi;
+	unsigned long long	lo;
+};
+aes_ctr 			aesCtr;		// the initial counter block of the text being encrypted
+
+// the counter block n blocks after ctr, the 128-bit sum wraps around like in SP 800-38A
+static aes_ctr aes_ctr_add(const aes_ctr *ctr, unsigned long long n)
+{
+	aes_ctr c = {ctr->hi, ctr->lo + n};
+	c.hi += (c.lo < n);
+	return c;
+}
+
 void start_measure_time(int seg)
 {
-    gettimeofday(&start[seg], NULL);
+	benchStart(seg);
 }
 
 void stop_measure_time(int seg)
 {
-    gettimeofday(&stop[seg], NULL);
-    timeRes[seg] = 1000 * ((float)(float)(stop[seg].tv_sec  - start[seg].tv_sec) + 1.0e-6 * (stop[seg].tv_usec - start[seg].tv_usec));
+	benchStop(seg);
 }
 
-void oclInit()
+#ifndef CPU_ONLY
+void oclInit(const aes_key *eks)
 {
+	char options[OCL_OPTIONS_LEN] = "";
+
 	/*-----------------------get platform---------------------------*/
 	start_measure_time(PLATFORM);
-	#ifdef FERMI
-		if (clGetPlatformIDs(3, (cl_platform_id *)&clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId[1], CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#else
-		if (clGetPlatformIDs(1, &clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId, CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#endif
+	if (oclGetPlatforms(&clRuntime) == 0)
+		exit(1);
 	stop_measure_time(PLATFORM);
 
 	/*-----------------------get device-----------------------------*/
 	start_measure_time(DEVICE);
-	#ifdef FERMI
-		if (clGetDeviceIDs(clPlatformId[1], CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#else
-		if (clGetDeviceIDs(clPlatformId, CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#endif
-		else
-		{
-			clGetDeviceInfo(clDeviceId, CL_DEVICE_NAME, 200, buff, NULL);
-			printf("Device name: %s \n", buff);
-		}
+	if (oclSelectDevice(&clRuntime) != 0)
+		exit(1);
+	clDeviceId = clRuntime.device;
 	stop_measure_time(DEVICE);
 
 	/*-----------------------create context-------------------------*/
 	start_measure_time(CONTEXT);
-	clContext = clCreateContext(0, 1, (cl_device_id *) &clDeviceId, NULL, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating context!, clErr=%i \n", clErr);
-	else
-		printf("Context created! \n");
+	oclCreateContext(&clRuntime);
+	clContext = clRuntime.context;
 	stop_measure_time(CONTEXT);
 
 	/*---------------------create command queue---------------------*/
 	start_measure_time(CMDQ);
-	clCommandQueue = clCreateCommandQueue(clContext, clDeviceId, CL_QUEUE_PROFILING_ENABLE, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating command queue!, clErr=%i \n", clErr);
-	else
-		printf("Command queue created! \n");
+	oclCreateQueue(&clRuntime, CL_QUEUE_PROFILING_ENABLE);
+	clCommandQueue = clRuntime.queue;
+	if (oclPipelineCreate(&clRuntime, &clPipeline) != 0)
+		exit(1);
 	stop_measure_time(CMDQ);
 
 	/*------------------create and build program--------------------*/
+#ifdef SAMOS_EMBED_KERNELS
+	oclEmbedKernelSources(samosKernelSources);
+#endif
+	// a constant round count lets the compiler unroll the rounds
+	if (oclSpecializeEnabled())
+		oclDefine(options, "AES_ROUNDS", eks->rounds);
 	start_measure_time(PGM);
-	int filelen;
-	int readlen;
-
-	fp = fopen("kernel.cl", "r");
-	// getting size of the file
-	fseek(fp, 0, SEEK_END);  //set position indicator to the end of file
-	filelen = ftell(fp);	//return the current value of position indicator
-	rewind(fp);	//set position indicator to the beginning
-
-	kernelSrc = (char*) malloc(sizeof(char) * (filelen + 1));
-	readlen = fread(kernelSrc, 1, filelen, fp);
-	if (readlen < filelen)
-		kernelSrc[readlen] = '\0';
-	else
-		kernelSrc[filelen] = '\0';
-
-	clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program!, clErr=%i \n", clErr);
-	else
-		printf("Program created! \n");
-
-	clErr = clBuildProgram(clProgram, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 1!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program built! \n");
+	clProgram.reset(oclBuildVariant(&clRuntime, "kernel.cl", options));
+	if (clProgram == NULL)
+		exit(1);
 	stop_measure_time(PGM);
 
 	/*-----------------------create kernel------------------------*/
 	start_measure_time(KERNEL);
 //	clKernel1 = clCreateKernel(clProgram, "AES_encryption", &clErr);
-	clKernel1 = clCreateKernel(clProgram, "AES_encrypt_local", &clErr);
+	clKernel1.reset(clCreateKernel(clProgram, aesKernelNames[aesKernel][aesMode], &clErr));
 	if (clErr != CL_SUCCESS)
 			printf("Error in creating kernel!, clErr=%i \n", clErr);
 	else printf("Kernel created! \n");
-	fclose(fp);
-	free(kernelSrc);
 	stop_measure_time(KERNEL);
+
+	oclCoopInit(&clCoop);
+	oclRooflineMeasure(&clRuntime);
+}
+
+// ints of round keys the kernel reads: the rd_key words, or 8 ulongs per round for the bitsliced kernels
+static size_t aes_key_words(int kernel, const aes_key *eks)
+{
+	return (kernel == AES_KERNEL_BITSLICED ? 16 : 4) * (eks->rounds + 1);
+}
+
+// writes the round keys in the form of the kernel into keys
+ocl_future aes_write_keys(const ocl_buffer<int> &keys, int kernel, const aes_key *eks, const char *name)
+{
+	static unsigned long long skey[8 * 15];
+
+	if (kernel != AES_KERNEL_BITSLICED)
+		return oclWriteAsync(clCommandQueue, keys, eks->rd_key, aes_key_words(kernel, eks), ocl_after(), name);
+	// the buffer is read after the call returns, so the words stay in skey
+	aesbsExpandKey(eks->rd_key, eks->rounds, skey);
+	return oclWriteAsync(clCommandQueue, keys, (const int *)skey, aes_key_words(kernel, eks), ocl_after(), name);
+}
+
+// work-items for blocks blocks, the bitsliced kernels take AES_BS_BLOCKS each
+static size_t aes_work_items(int kernel, size_t blocks)
+{
+	return (kernel == AES_KERNEL_BITSLICED) ? (blocks + AES_BS_BLOCKS - 1) / AES_BS_BLOCKS : blocks;
 }
 
 void oclBuffer(const unsigned char *plainText, const aes_key *eks, size_t filelen)
@@ -229,53 +285,211 @@ void oclBuffer(const unsigned char *plainText, const aes_key *eks, size_t filele
 	/*-----------------------create buffer------------------------*/
 	start_measure_time(BUFF);
 	// filelen = 10205240; 
-	clPlainTextBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(unsigned char) * (filelen), NULL, &clErr);
-	clCipherTextBuff = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(unsigned char) * filelen, NULL, &clErr);
-	clKeysBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(unsigned int) * 4 * (eks->rounds + 1), NULL, &clErr);
+	// with --mem-mode alloc/use the plaintext is placed in host-visible memory here, once
+	clPlainTextBuff.reset(oclPoolBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(unsigned char) * (filelen), plainText, &clErr), filelen);
+	clCipherTextBuff.reset(oclPoolBuffer(&clRuntime, CL_MEM_WRITE_ONLY, sizeof(unsigned char) * filelen, NULL, &clErr), filelen);
+	clKeysBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(int) * aes_key_words(aesKernel, eks), &clErr),
+					 aes_key_words(aesKernel, eks));
 	stop_measure_time(BUFF);
+}
 
+void oclWrite(const unsigned char *plainText, const aes_key *eks, size_t filelen)
+{
 	/*-----------------------write into device--------------------*/
 	start_measure_time(WRDEV);
-	clErr  = clEnqueueWriteBuffer(clCommandQueue, clPlainTextBuff, true, 0, sizeof(unsigned char) * (filelen), plainText, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing buffer (clPlainTextBuff)!, clErr=%i \n", clErr);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, clKeysBuff, true, 0, sizeof(unsigned int) * 4 * (eks->rounds + 1), eks->rd_key, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing buffer (clKeysBuff)!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+	ocl_future text;
+	if (oclHostMemMode() == OCL_MEM_COPY)
+		text = oclWriteAsync(clCommandQueue, clPlainTextBuff, plainText, filelen, ocl_after(), "WRDEV plaintext");
+	else
+		oclHandOverBuffer(&clRuntime, clPlainTextBuff, CL_MAP_WRITE, sizeof(unsigned char) * filelen);
+	ocl_future keys = aes_write_keys(clKeysBuff, aesKernel, eks, "WRDEV keys");
+	text.wait();
+	keys.wait();
 	stop_measure_time(WRDEV);
 }
 
+void oclReleaseBuffers()
+{
+	clPlainTextBuff.reset();
+	clCipherTextBuff.reset();
+	clKeysBuff.reset();
+}
+
 void oclClean()
 {
-	clReleaseContext(clContext);
-	clReleaseCommandQueue(clCommandQueue);
-	clReleaseProgram(clProgram);
-	clReleaseMemObject(clPlainTextBuff);
-	clReleaseMemObject(clCipherTextBuff);
-	clReleaseMemObject(clKeysBuff);
-	clReleaseKernel(clKernel1);
+	clKernel1.reset();
+	clProgram.reset();
+	oclPipelineRelease(&clPipeline);
+	oclRelease(&clRuntime);
 }
 
-void ocl_AES_cbc_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+// the counter block as the CTR kernels take it, four big-endian words
+static cl_uint4 aes_ctr_words(const aes_ctr *ctr)
 {
-	oclInit();
-	oclBuffer(plainText, eks, filelen);
+	cl_uint4 c;
+	c.s[0] = (cl_uint)(ctr->hi >> 32);
+	c.s[1] = (cl_uint)ctr->hi;
+	c.s[2] = (cl_uint)(ctr->lo >> 32);
+	c.s[3] = (cl_uint)ctr->lo;
+	return c;
+}
+
+// start to end of a kernel's event in msecs
+static double aes_event_ms(cl_event ev)
+{
+	cl_ulong start = 0, end = 0;
+	clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	return (end - start) * 1.0e-6;
+}
+
+// The arguments of the mode's kernel k of variant kernel for a text of len bytes; the CTR kernels also take
+// the counter block of block 0 as four big-endian words, and all but AES_encrypt_local the length
+void aes_set_kernel_args(cl_kernel k, int kernel, const ocl_buffer<unsigned char> &in, const ocl_buffer<unsigned char> &out,
+						 const ocl_buffer<int> &keys, const aes_key *eks, const aes_ctr *ctr, size_t len)
+{
+	cl_uint4 c = aes_ctr_words(ctr);
+	if (kernel == AES_KERNEL_BITSLICED && aesMode == AES_MODE_CTR)
+		oclSetArgs(k, in, out, keys, (unsigned int)eks->rounds, c, (unsigned int)len);
+	else if (kernel == AES_KERNEL_BITSLICED)
+		oclSetArgs(k, in, out, keys, (unsigned int)eks->rounds, (unsigned int)len);
+	else if (aesMode == AES_MODE_CTR)
+		oclSetArgs(k, in, out, keys, (unsigned int)eks->rounds, c, (unsigned int)len);
+	else
+		oclSetArgs(k, in, out, keys, (unsigned int)eks->rounds);
+}
+
+void aes_set_args(const ocl_buffer<unsigned char> &in, const ocl_buffer<unsigned char> &out, const ocl_buffer<int> &keys,
+				  const aes_key *eks, const aes_ctr *ctr, size_t len)
+{
+	aes_set_kernel_args(clKernel1, aesKernel, in, out, keys, eks, ctr, len);
+}
+
+// the kernel's name in the tuning profile, aes.<kernel>
+const char *aes_tune_name()
+{
+	static char name[64];
+	sprintf(name, "aes.%s", aesKernelNames[aesKernel][aesMode]);
+	return name;
+}
+
+// one chunk of the pipelined path is a range of blocks in the full-size buffers
+struct aes_pipe_job
+{
+	const unsigned char	*plainText;
+	unsigned char		*cipherText;
+	size_t				filelen;
+	size_t				chunkLen;
+};
+
+static cl_int aes_tune_launch(void *user, cl_command_queue q, const ocl_launch *l, cl_event *ev)
+{
+	size_t clGlobalSize = *(size_t *)user;
+	return clEnqueueNDRangeKernel(q, clKernel1, 1, NULL, &clGlobalSize, l->local, 0, NULL, ev);
+}
+
+// Picks the work-group size of the encryption kernel, see ../../common/oclTune.h. The kernel is indexed
+// by get_global_id(0) only, so only 1D launches are candidates.
+void aes_tune(size_t filelen, const aes_key *eks)
+{
+	ocl_launch cand[OCL_TUNE_MAX_CAND];
+	int numCand = 0;
+	// the same work-items for every candidate, a multiple of the largest work-group and within the buffers
+	size_t items = aes_work_items(aesKernel, filelen / AES_BLOCK_SIZE) / 1024 * 1024;
+
+	for (size_t local = 32; local <= 1024; local *= 2)
+	{
+		ocl_launch c = {{local, 1}, 0, 0.0, OCL_TUNE_DEFAULT};
+		cand[numCand++] = c;
+	}
+	if (items == 0)
+	{
+		printf("Input too small to tune, keeping work-groups of %i \n", WORK_GROUP_SIZE);
+		return;
+	}
+	aes_write_keys(clKeysBuff, aesKernel, eks, "tuning keys").wait();
+	aes_set_args(clPlainTextBuff, clCipherTextBuff, clKeysBuff, eks, &aesCtr, filelen);
+	oclTuneLaunch(&clRuntime, clKernel1, aes_tune_name(), cand, numCand, aes_tune_launch, &items, &aesLaunch);
+}
+
+static size_t chunk_len(const aes_pipe_job *job, int chunk)
+{
+	size_t offset = chunk * job->chunkLen;
+	return (offset + job->chunkLen > job->filelen) ? job->filelen - offset : job->chunkLen;
+}
+
+static cl_int aes_upload(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	aes_pipe_job *job = (aes_pipe_job *)user;
+	size_t offset = chunk * job->chunkLen;
+	return clEnqueueWriteBuffer(q, clPlainTextBuff, CL_FALSE, offset, chunk_len(job, chunk), job->plainText + offset, numWait, wait, done);
+}
+
+static cl_int aes_execute(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	aes_pipe_job *job = (aes_pipe_job *)user;
+	size_t clLocalSize = aesLaunch.local[0];
+	// chunks are whole work-groups of work-items, so their first block is a multiple of AES_BS_BLOCKS
+	size_t clGlobalOffset = aes_work_items(aesKernel, chunk * job->chunkLen / AES_BLOCK_SIZE);
+	size_t clGlobalSize = aes_work_items(aesKernel, (chunk_len(job, chunk) + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE);
+	clGlobalSize = (clGlobalSize + aesLaunch.local[0] - 1) / aesLaunch.local[0] * aesLaunch.local[0];
+	return clEnqueueNDRangeKernel(q, clKernel1, 1, &clGlobalOffset, &clGlobalSize, &clLocalSize, numWait, wait, done);
+}
+
+static cl_int aes_readback(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	aes_pipe_job *job = (aes_pipe_job *)user;
+	size_t offset = chunk * job->chunkLen;
+	return clEnqueueReadBuffer(q, clCipherTextBuff, CL_FALSE, offset, chunk_len(job, chunk), job->cipherText + offset, numWait, wait, done);
+}
+
+// --pipeline: chunk i+1 is written while chunk i is encrypted and chunk i-1 read back
+void ocl_AES_pipelined(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+{
+	aes_pipe_job job = {plainText, cipherText, filelen, 0};
+	ocl_pipe_stages stages = {aes_upload, aes_execute, aes_readback, 0, &job};
+
+	// whole work-groups of work-items per chunk, so every chunk starts at a work-group boundary and a chunk's
+	// launch, rounded up to the work-group, ends where the next chunk starts
+	size_t granule = AES_BLOCK_SIZE * ((aesKernel == AES_KERNEL_BITSLICED) ? AES_BS_BLOCKS : 1) * aesLaunch.local[0];
+	job.chunkLen = oclPipelineChunkSize(filelen, granule);
+#ifdef VIVANTE
+	// chunks are launched 1D, so keep them within the CL_GLOBAL_SIZE_0 limit the 2D launch works around
+	if (job.chunkLen > CL_GLOBAL_SIZE_0 * AES_BLOCK_SIZE)
+		job.chunkLen = (CL_GLOBAL_SIZE_0 * AES_BLOCK_SIZE >= granule) ? CL_GLOBAL_SIZE_0 * AES_BLOCK_SIZE / granule * granule : granule;
+#endif
+	int numChunks = (int)((filelen + job.chunkLen - 1) / job.chunkLen);
+
+	start_measure_time(PIPELINE);
+	aes_write_keys(clKeysBuff, aesKernel, eks, "WRDEV keys").wait();
+	aes_set_args(clPlainTextBuff, clCipherTextBuff, clKeysBuff, eks, &aesCtr, filelen);
+	oclPipelineRun(&clPipeline, numChunks, &stages);
+	stop_measure_time(PIPELINE);
+}
+
+void ocl_AES_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+{
+	if (clPipeline.numQueues > 0)
+	{
+		ocl_AES_pipelined(plainText, cipherText, filelen, eks);
+		return;
+	}
+
+	oclWrite(plainText, eks, filelen);
 
 	int mod = filelen % AES_BLOCK_SIZE;
-	int numofWorkItems = (mod == 0 ? filelen/AES_BLOCK_SIZE : (filelen/AES_BLOCK_SIZE)+1);
-	mod = numofWorkItems % WORK_GROUP_SIZE;
+	int numofBlocks = (mod == 0 ? filelen/AES_BLOCK_SIZE : (filelen/AES_BLOCK_SIZE)+1);
+	int numofWorkItems = (int)aes_work_items(aesKernel, numofBlocks);
+	mod = numofWorkItems % aesLaunch.local[0];
 	if (mod != 0)
-		numofWorkItems = numofWorkItems + WORK_GROUP_SIZE - mod;
+		numofWorkItems = numofWorkItems + aesLaunch.local[0] - mod;
 
-	clSetKernelArg(clKernel1, 0, sizeof(cl_mem), &clPlainTextBuff);
-	clSetKernelArg(clKernel1, 1, sizeof(cl_mem), &clCipherTextBuff);
-	clSetKernelArg(clKernel1, 2, sizeof(cl_mem), &clKeysBuff);
-	clSetKernelArg(clKernel1, 3, sizeof(unsigned int), &eks->rounds);
+	aes_set_args(clPlainTextBuff, clCipherTextBuff, clKeysBuff, eks, &aesCtr, filelen);
 
 	#ifdef VIVANTE
+		cl_uint dims = 2;
 		size_t clGlobalSize[2];
-		size_t clLocalSize[2] = {WORK_GROUP_SIZE, 1};
+		size_t clLocalSize[2] = {aesLaunch.local[0], 1};
 		if (numofWorkItems > CL_GLOBAL_SIZE_0)
 		{
 			clGlobalSize[0] = CL_GLOBAL_SIZE_0;
@@ -287,34 +501,25 @@ void ocl_AES_cbc_encryption(const unsigned char *plainText, unsigned char *ciphe
 			clGlobalSize[0] = numofWorkItems;
 			clGlobalSize[1] = 1;
 		}
-		start_measure_time(KERNEL_EXEC);
-//		while(1)
-//		{
-		clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel1, 2, NULL, clGlobalSize, clLocalSize, 0, NULL, &prof_event);
-
 	#else
-		size_t clLocalSize = WORK_GROUP_SIZE;
-		size_t clGlobalSize = numofWorkItems;
-		start_measure_time(KERNEL_EXEC);
-		clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel1, 1, NULL, &clGlobalSize, &clLocalSize, 0, NULL, &prof_event);
+		cl_uint dims = 1;
+		size_t clLocalSize[1] = {aesLaunch.local[0]};
+		size_t clGlobalSize[1] = {(size_t)numofWorkItems};
 	#endif
-
-	if (clErr != CL_SUCCESS)
-		printf("Error in launching kernel!, clErr=%i \n", clErr);
-	else
+	start_measure_time(KERNEL_EXEC);
+	ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel1, dims, clGlobalSize, clLocalSize, ocl_after(), aesKernelNames[aesKernel][aesMode]);
+	if (exec.ok())
 		printf("Kernel launched successfully! \n");
-
-		clFinish(clCommandQueue);
-//		}
+	exec.wait();
 	stop_measure_time(KERNEL_EXEC);
 	start_measure_time(RDDEV);
-	clErr = clEnqueueReadBuffer(clCommandQueue, clCipherTextBuff, CL_TRUE, 0, sizeof(unsigned char) * filelen, cipherText, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in reading buffer!, clErr=%i \n", clErr);
-
-	clFinish(clCommandQueue);
+	if (oclHostMemMode() == OCL_MEM_COPY)
+		oclReadAsync(clCommandQueue, clCipherTextBuff, cipherText, filelen, ocl_after(exec), "RDDEV ciphertext").wait();
+	else
+		oclHandOverBuffer(&clRuntime, clCipherTextBuff, CL_MAP_READ, sizeof(unsigned char) * filelen);
 	stop_measure_time(RDDEV);
 }
+#endif /* CPU_ONLY */
 
 void XorBlock(AESData *a, const AESData *b, const AESData *c)
 {
@@ -324,66 +529,1139 @@ void XorBlock(AESData *a, const AESData *b, const AESData *c)
 	a->w[3] = b->w[3] ^ c->w[3];
 }
 
-void cpu_AES_cbc_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+// one block through the T-table rounds, the same tables as Te0..Te3 of kernel.cl
+static inline void aes_encrypt_block(AESData *out, const AESData *inp, const aes_key *eks)
 {
-	AESData *inp;
-	AESData *out;
-	AESData *rkey;
+	const AESData *rkey = (const AESData *)eks->rd_key;
+	const Word (*T)[256] = AESEncryptTable;
 	AESData state;
-	const Word (*T)[256];
 
 	union word4{ Word w; Byte b[4]; };
 	word4 w0, w1, w2, w3;
 
-//	while(1)
-//	{
-	omp_set_num_threads(NUM_CORES);
-	#pragma omp parallel default(none) private(state, rkey, inp, out, T, w0, w1, w2, w3) shared(filelen, plainText, cipherText, eks, AESEncryptTable, AESSubBytesWordTable)
+	XorBlock(&state, inp, rkey);
+
+	for (int round = 1; round < eks->rounds; ++round)
+	{
+		++rkey;
+
+		w0.w = state.w[0];
+		w1.w = state.w[1];
+		w2.w = state.w[2];
+		w3.w = state.w[3];
+
+		state.w[0] = rkey->w[0] ^ T[0][w0.b[0]] ^ T[1][w1.b[1]] ^ T[2][w2.b[2]] ^ T[3][w3.b[3]];
+		state.w[1] = rkey->w[1] ^ T[0][w1.b[0]] ^ T[1][w2.b[1]] ^ T[2][w3.b[2]] ^ T[3][w0.b[3]];
+		state.w[2] = rkey->w[2] ^ T[0][w2.b[0]] ^ T[1][w3.b[1]] ^ T[2][w0.b[2]] ^ T[3][w1.b[3]];
+		state.w[3] = rkey->w[3] ^ T[0][w3.b[0]] ^ T[1][w0.b[1]] ^ T[2][w1.b[2]] ^ T[3][w2.b[3]];
+	}
+
+	T = AESSubBytesWordTable;
+	++rkey;
+
+	w0.w = state.w[0];
+	w1.w = state.w[1];
+	w2.w = state.w[2];
+	w3.w = state.w[3];
+
+	out->w[0] = rkey->w[0] ^ T[0][w0.b[0]] ^ T[1][w1.b[1]] ^ T[2][w2.b[2]] ^ T[3][w3.b[3]];
+	out->w[1] = rkey->w[1] ^ T[0][w1.b[0]] ^ T[1][w2.b[1]] ^ T[2][w3.b[2]] ^ T[3][w0.b[3]];
+	out->w[2] = rkey->w[2] ^ T[0][w2.b[0]] ^ T[1][w3.b[1]] ^ T[2][w0.b[2]] ^ T[3][w1.b[3]];
+	out->w[3] = rkey->w[3] ^ T[0][w3.b[0]] ^ T[1][w0.b[1]] ^ T[2][w1.b[2]] ^ T[3][w2.b[3]];
+}
+
+void cpu_AES_ecb_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks, int numThreads)
+{
+	benchSetThreads(numThreads);
+	if (aesEngine != AES_ENGINE_TTABLE)
+	{
+		long long numChunks = (filelen + AES_CPU_CHUNK - 1) / AES_CPU_CHUNK;
+		#pragma omp parallel for default(none) shared(numChunks, filelen, plainText, cipherText, eks, aesEngine)
+		for (long long c=0; c < numChunks; c++)
+		{
+			size_t offset = (size_t)c * AES_CPU_CHUNK;
+			size_t len = (filelen - offset < AES_CPU_CHUNK) ? filelen - offset : AES_CPU_CHUNK;
+			if (aesEngine == AES_ENGINE_AESNI)
+				aesniEncryptECB(plainText + offset, cipherText + offset, len / AES_BLOCK_SIZE, eks->rd_key, eks->rounds);
+			else
+				aesbsEncryptECB(plainText + offset, cipherText + offset, len / AES_BLOCK_SIZE, eks->rd_key, eks->rounds);
+		}
+		return;
+	}
+	#pragma omp parallel for default(none) shared(filelen, plainText, cipherText, eks)
+	for(size_t i=0; i < (filelen / AES_BLOCK_SIZE); i++)
+		aes_encrypt_block((AESData *)cipherText + i, (const AESData *)plainText + i, eks);
+}
+
+// block i of a CTR text of filelen bytes through the T-table rounds, xored with the encryption of ctr + i
+static inline void aes_ctr_block(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks,
+								 const aes_ctr *ctr, long long i)
+{
+	aes_ctr c = aes_ctr_add(ctr, (unsigned long long)i);
+	AESData counter, key;
+
+	for (int b=0; b<8; b++)
+	{
+		counter.b[b] = (Byte)(c.hi >> (56 - 8 * b));
+		counter.b[8 + b] = (Byte)(c.lo >> (56 - 8 * b));
+	}
+	aes_encrypt_block(&key, &counter, eks);
+
+	if ((size_t)(i + 1) * AES_BLOCK_SIZE <= filelen)
+		XorBlock((AESData *)cipherText + i, (const AESData *)plainText + i, &key);
+	else
+		for (size_t b = (size_t)i * AES_BLOCK_SIZE; b < filelen; b++)
+			cipherText[b] = plainText[b] ^ key.b[b % AES_BLOCK_SIZE];
+}
+
+// CTR keystream: block i is xored with the encryption of ctr + i, a last partial block with the start of it
+void cpu_AES_ctr_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks,
+							const aes_ctr *ctr, int numThreads)
+{
+	long long numBlocks = (filelen + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+
+	benchSetThreads(numThreads);
+	if (aesEngine != AES_ENGINE_TTABLE)
+	{
+		long long numChunks = (filelen + AES_CPU_CHUNK - 1) / AES_CPU_CHUNK;
+		#pragma omp parallel for default(none) shared(numChunks, filelen, plainText, cipherText, eks, ctr, aesEngine)
+		for (long long c=0; c < numChunks; c++)
+		{
+			size_t offset = (size_t)c * AES_CPU_CHUNK;
+			size_t len = (filelen - offset < AES_CPU_CHUNK) ? filelen - offset : AES_CPU_CHUNK;
+			aes_ctr first = aes_ctr_add(ctr, offset / AES_BLOCK_SIZE);
+			if (aesEngine == AES_ENGINE_AESNI)
+				aesniEncryptCTR(plainText + offset, cipherText + offset, len, eks->rd_key, eks->rounds, first.hi, first.lo);
+			else
+				aesbsEncryptCTR(plainText + offset, cipherText + offset, len, eks->rd_key, eks->rounds, first.hi, first.lo);
+		}
+		return;
+	}
+	#pragma omp parallel for default(none) shared(numBlocks, filelen, plainText, cipherText, eks, ctr)
+	for (long long i=0; i < numBlocks; i++)
+		aes_ctr_block(plainText, cipherText, filelen, eks, ctr, i);
+}
+
+// the CPU path of the mode; ctr is the counter block of the first block of plainText, unused by ECB
+void cpu_AES_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks,
+						const aes_ctr *ctr, int numThreads)
+{
+	if (aesMode == AES_MODE_CTR)
+		cpu_AES_ctr_encryption(plainText, cipherText, filelen, eks, ctr, numThreads);
+	else
+		cpu_AES_ecb_encryption(plainText, cipherText, filelen, eks, numThreads);
+}
+
+// len bytes with one key on the calling thread, in the mode and engine of the run; ECB takes whole blocks only
+static void aes_encrypt_range(const unsigned char *plainText, unsigned char *cipherText, size_t len, const aes_key *eks, const aes_ctr *ctr)
+{
+	if (aesMode == AES_MODE_CTR && aesEngine == AES_ENGINE_AESNI)
+		aesniEncryptCTR(plainText, cipherText, len, eks->rd_key, eks->rounds, ctr->hi, ctr->lo);
+	else if (aesMode == AES_MODE_CTR && aesEngine == AES_ENGINE_BITSLICED)
+		aesbsEncryptCTR(plainText, cipherText, len, eks->rd_key, eks->rounds, ctr->hi, ctr->lo);
+	else if (aesMode == AES_MODE_CTR)
+		for (size_t i=0; i < (len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE; i++)
+			aes_ctr_block(plainText, cipherText, len, eks, ctr, (long long)i);
+	else if (aesEngine == AES_ENGINE_AESNI)
+		aesniEncryptECB(plainText, cipherText, len / AES_BLOCK_SIZE, eks->rd_key, eks->rounds);
+	else if (aesEngine == AES_ENGINE_BITSLICED)
+		aesbsEncryptECB(plainText, cipherText, len / AES_BLOCK_SIZE, eks->rd_key, eks->rounds);
+	else
+		for (size_t i=0; i < len / AES_BLOCK_SIZE; i++)
+			aes_encrypt_block((AESData *)cipherText + i, (const AESData *)plainText + i, eks);
+}
+
+// Block i with keys[keyIndex[i]]: the runs of blocks with the same key of every chunk go through the engine
+// in one call. In CTR mode the counter block of block i is ctr + i whatever its key.
+void cpu_AES_keyed_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *keys,
+							  const unsigned int *keyIndex, const aes_ctr *ctr, int numThreads)
+{
+	long long numChunks = (filelen + AES_CPU_CHUNK - 1) / AES_CPU_CHUNK;
+
+	benchSetThreads(numThreads);
+	#pragma omp parallel for default(none) shared(numChunks, filelen, plainText, cipherText, keys, keyIndex, ctr)
+	for (long long c=0; c < numChunks; c++)
+	{
+		size_t first = (size_t)c * AES_CPU_CHUNK / AES_BLOCK_SIZE;
+		size_t end = ((size_t)c * AES_CPU_CHUNK + AES_CPU_CHUNK < filelen) ? first + AES_CPU_CHUNK / AES_BLOCK_SIZE
+																		   : (filelen + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+		while (first < end)
+		{
+			size_t last = first + 1;
+			while (last < end && keyIndex[last] == keyIndex[first])
+				last++;
+			size_t len = (last * AES_BLOCK_SIZE < filelen ? last * AES_BLOCK_SIZE : filelen) - first * AES_BLOCK_SIZE;
+			aes_ctr from = aes_ctr_add(ctr, first);
+			aes_encrypt_range(plainText + first * AES_BLOCK_SIZE, cipherText + first * AES_BLOCK_SIZE, len, &keys[keyIndex[first]], &from);
+			first = last;
+		}
+	}
+}
+
+// A message of a batch, the layout of aes_msg in kernel.cl: length bytes at offset of the text under schedule key,
+// counted from block firstBlock of the batch; in CTR mode its block j is xored with the encryption of iv + j
+struct aes_msg_desc
+{
+	unsigned int	offset;			// a multiple of AES_BLOCK_SIZE
+	unsigned int	length;			// whole blocks in ECB mode
+	unsigned int	key;
+	unsigned int	firstBlock;
+	unsigned int	iv[4];			// four big-endian words, iv[0] the most significant
+};
+
+// numMsgs messages over the threads, every message on one thread in one call of the engine; the
+// messages are short, so the dynamic schedule hands them out in groups
+void cpu_AES_batch_encryption(const unsigned char *plainText, unsigned char *cipherText, const aes_msg_desc *msgs, int numMsgs,
+							  const aes_key *keys, int numThreads)
+{
+	benchSetThreads(numThreads);
+	#pragma omp parallel for default(none) shared(numMsgs, plainText, cipherText, msgs, keys) schedule(dynamic, 16)
+	for (int m=0; m<numMsgs; m++)
 	{
-		#pragma omp for
-			for(int i=0; i < (filelen / AES_BLOCK_SIZE); i++)
+		const aes_msg_desc *d = &msgs[m];
+		aes_ctr iv = {(unsigned long long)d->iv[0] << 32 | d->iv[1], (unsigned long long)d->iv[2] << 32 | d->iv[3]};
+		aes_encrypt_range(plainText + d->offset, cipherText + d->offset, d->length, &keys[d->key], &iv);
+	}
+}
+
+// the encryption key schedule of a 128, 192 or 256-bit key, in the word order of roundKey (data.h)
+void aes_set_encrypt_key(const Byte *key, int bits, aes_key *eks)
+{
+	static const Word rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+	const Word *S = AESSubBytesWordTable[0];
+	Word *w = (Word *)eks->rd_key;
+	int nk = bits / 32;
+
+	eks->rounds = nk + 6;
+	for (int i=0; i<nk; i++)
+		w[i] = key[4*i] | (key[4*i+1] << 8) | (key[4*i+2] << 16) | ((Word)key[4*i+3] << 24);
+	for (int i=nk; i<4*(eks->rounds+1); i++)
+	{
+		Word t = w[i-1];
+		// the first key byte is the low byte of a word, so RotWord is a rotation to the right
+		if (i % nk == 0)
+			t = (S[(t >> 8) & 0xff] | (S[(t >> 16) & 0xff] << 8) | (S[t >> 24] << 16) | (S[t & 0xff] << 24)) ^ rcon[i / nk - 1];
+		else if (nk > 6 && i % nk == 4)
+			t = S[t & 0xff] | (S[(t >> 8) & 0xff] << 8) | (S[(t >> 16) & 0xff] << 16) | (S[t >> 24] << 24);
+		w[i] = w[i-nk] ^ t;
+	}
+}
+
+// NIST SP 800-38A F.5.1, F.5.3 and F.5.5, CTR-AES128/192/256.Encrypt: four blocks from the counter f0f1...feff
+struct aes_ctr_vector
+{
+	const char	*key;
+	const char	*cipherText;
+};
+
+static const char			*nistPlainText = "6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+											 "30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710";
+static const aes_ctr_vector	nistCtr[3] = {
+	{"2b7e151628aed2a6abf7158809cf4f3c",
+	 "874d6191b620e3261bef6864990db6ce" "9806f66b7970fdff8617187bb9fffdff" "5ae4df3edbd5d35e5b4f09020db03eab" "1e031dda2fbe03d1792170a0f3009cee"},
+	{"8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b",
+	 "1abc932417521ca24f2b0459fe7e6e0b" "090339ec0aa6faefd5ccc2c6f4ce8e94" "1e36b26bd1ebc670d1bd1d665620abf7" "4f78a7f6d29809585a97daec58c6b050"},
+	{"603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+	 "601ec313775789a5b7a7f504bbf3d228" "f443e3ca4d62b59aca84e990cacaf5c5" "2b0930daa23de94ce87017ba2d84988d" "dfc9c58db67aada613c2dd08457941a6"}};
+static const aes_ctr		nistCounter = {0xf0f1f2f3f4f5f6f7ULL, 0xf8f9fafbfcfdfeffULL};
+// FIPS-197 C.3, AES-256 of one block under the key 00 01 ... 1f, the schedule in roundKey
+static const char			*fipsPlainText = "00112233445566778899aabbccddeeff";
+static const char			*fipsCipherText = "8ea2b7ca516745bfeafc49904b496089";
+
+int 				aesCheckCpu = -1;		// the self-checks, 1 passed, 0 failed, -1 not run
+int 				aesCheckDevice = -1;
+
+static void aes_hex(const char *hex, Byte *out)
+{
+	for (int i=0; hex[2*i] != '\0'; i++)
+	{
+		unsigned int v;
+		sscanf(hex + 2*i, "%2x", &v);
+		out[i] = (Byte)v;
+	}
+}
+
+// the key schedule, plaintext and ciphertext of vector v
+static void aes_nist_vector(int v, aes_key *eks, AESData *plainText, AESData *cipherText)
+{
+	Byte key[32];
+
+	aes_hex(nistCtr[v].key, key);
+	aes_set_encrypt_key(key, (int)strlen(nistCtr[v].key) * 4, eks);
+	aes_hex(nistPlainText, plainText->b);
+	aes_hex(nistCtr[v].cipherText, cipherText->b);
+}
+
+// The key schedule, then every CPU engine the CPU has: CTR against the NIST vectors, also with a partial last
+// block, ECB against FIPS-197 on more blocks than any engine encrypts at once, and CTR against the T-table
+// engine on a text that ends in a partial block
+int cpu_AES_selfcheck()
+{
+	AESData plainText[4], expect[4], cipherText[4];
+	AESData block[AESBS_MAX_BLOCKS + 1], fips;
+	unsigned char text[1000], ref[1000], out[1000];
+	Byte key[32];
+	aes_key eks, fipsKey;
+	int engine = aesEngine;
+
+	// roundKey is the schedule of the key 00 01 ... 1f
+	for (int i=0; i<32; i++)
+		key[i] = (Byte)i;
+	aes_set_encrypt_key(key, 256, &fipsKey);
+	int ok = (memcmp(fipsKey.rd_key, roundKey, sizeof(roundKey)) == 0);
+	aes_hex(fipsCipherText, fips.b);
+	for (size_t i=0; i<sizeof(text); i++)
+		text[i] = (unsigned char)(i * 7);
+
+	for (aesEngine = 0; aesEngine < AES_NUM_ENGINES; aesEngine++)
+	{
+		if (aesEngine == AES_ENGINE_AESNI && !aesniAvailable())
+			continue;
+		for (int v=0; v<3; v++)
+		{
+			aes_nist_vector(v, &eks, plainText, expect);
+			cpu_AES_ctr_encryption(plainText->b, cipherText->b, sizeof(cipherText), &eks, &nistCounter, benchCpuThreads());
+			ok &= (memcmp(cipherText, expect, sizeof(expect)) == 0);
+			memset(cipherText, 0, sizeof(cipherText));
+			cpu_AES_ctr_encryption(plainText->b, cipherText->b, sizeof(cipherText) - 7, &eks, &nistCounter, 1);
+			ok &= (memcmp(cipherText, expect, sizeof(expect) - 7) == 0 && cipherText[3].b[AES_BLOCK_SIZE - 1] == 0);
+		}
+		for (int b=0; b<AESBS_MAX_BLOCKS + 1; b++)
+			aes_hex(fipsPlainText, block[b].b);
+		cpu_AES_ecb_encryption(block->b, block->b, sizeof(block), &fipsKey, 1);
+		for (int b=0; b<AESBS_MAX_BLOCKS + 1; b++)
+			ok &= (memcmp(&block[b], &fips, sizeof(fips)) == 0);
+		cpu_AES_ctr_encryption(text, aesEngine == AES_ENGINE_TTABLE ? ref : out, sizeof(text), &fipsKey, &nistCounter, 1);
+		if (aesEngine != AES_ENGINE_TTABLE)
+			ok &= (memcmp(ref, out, sizeof(out)) == 0);
+	}
+	aesEngine = engine;
+	return ok;
+}
+
+#ifndef CPU_ONLY
+// the NIST vector of the kernel's round count through the CTR kernel, one work-group on buffers of its own
+int ocl_AES_ctr_selfcheck(int rounds)
+{
+	size_t clLocalSize = aesLaunch.local[0];
+	size_t clGlobalSize = aesLaunch.local[0];
+	AESData plainText[4], expect[4], cipherText[4];
+	ocl_buffer<unsigned char> in, out;
+	ocl_buffer<int> keys;
+	aes_key eks;
+	int v;
+
+	for (v=0; v<3; v++)
+	{
+		aes_nist_vector(v, &eks, plainText, expect);
+		if (eks.rounds == rounds)
+			break;
+	}
+	if (v == 3)
+		return -1;
+	// the CTR kernels stop at the end of the text, the buffers hold the four blocks only
+	in.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(plainText), &clErr), sizeof(plainText));
+	out.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_WRITE_ONLY, sizeof(cipherText), &clErr), sizeof(cipherText));
+	keys.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(int) * aes_key_words(aesKernel, &eks), &clErr),
+			   aes_key_words(aesKernel, &eks));
+	if (in.get() == NULL || out.get() == NULL || keys.get() == NULL)
+		return 0;
+
+	ocl_future text = oclWriteAsync(clCommandQueue, in, plainText->b, sizeof(plainText), ocl_after(), NULL);
+	ocl_future key = aes_write_keys(keys, aesKernel, &eks, NULL);
+	aes_set_args(in, out, keys, &eks, &nistCounter, sizeof(plainText));
+	ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel1, 1, &clGlobalSize, &clLocalSize, ocl_after(text, key), NULL);
+	if (oclReadAsync(clCommandQueue, out, cipherText->b, sizeof(cipherText), ocl_after(exec), NULL).wait() != CL_SUCCESS)
+		return 0;
+	return memcmp(cipherText, expect, sizeof(expect)) == 0;
+}
+#endif /* CPU_ONLY */
+
+void aes_print_selfcheck(FILE *fout)
+{
+	static const char *result[] = {"not run", "FAILED", "passed"};
+	fprintf(fout, "NIST SP 800-38A CTR and FIPS-197 vectors: CPU %s (T-table, bitsliced%s), device %s (%s kernel) \n",
+			result[aesCheckCpu + 1], aesniAvailable() ? " and AES-NI" : "", result[aesCheckDevice + 1], aesKernelVariants[aesKernel]);
+}
+
+// the mode's throughput in GB/s of 1e9 bytes, like the roofline table; times of 0 are left out
+void aes_print_throughput(FILE *fout, size_t filelen, float kernelMs, float gpuMs, float cpuMs)
+{
+	fprintf(fout, "%s throughput: \n", description);
+	if (kernelMs > 0.0f)
+		fprintf(fout, "	GPU kernel = \t%10.2f GB/s \n", filelen / (kernelMs * 1.0e6));
+	if (gpuMs > 0.0f)
+		fprintf(fout, "	GPU exec = \t%10.2f GB/s \n", filelen / (gpuMs * 1.0e6));
+	if (cpuMs > 0.0f)
+		fprintf(fout, "	CPU = \t\t%10.2f GB/s on %i thread(s), %s \n", filelen / (cpuMs * 1.0e6), benchCpuThreads(), aesEngineNames[aesEngine]);
+	fprintf(fout, "\n");
+}
+
+#ifndef CPU_ONLY
+// --coop: the device encrypts the first part of the text while the CPU threads encrypt the rest
+void coop_AES_encryption(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+{
+	ocl_future keys, last;
+	size_t gpuLen = oclCoopSplit(&clCoop, filelen, AES_BLOCK_SIZE * aesLaunch.local[0]);
+
+	start_measure_time(COOP);
+	if (gpuLen > 0)
+	{
+		size_t clLocalSize = aesLaunch.local[0];
+		size_t clGlobalSize = aes_work_items(aesKernel, (gpuLen + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE);
+		clGlobalSize = (clGlobalSize + aesLaunch.local[0] - 1) / aesLaunch.local[0] * aesLaunch.local[0];
+
+		keys = aes_write_keys(clKeysBuff, aesKernel, eks, "coop write keys");
+		ocl_future text = oclWriteAsync(clCommandQueue, clPlainTextBuff, plainText, gpuLen, ocl_after(), "coop write plaintext");
+		aes_set_args(clPlainTextBuff, clCipherTextBuff, clKeysBuff, eks, &aesCtr, gpuLen);
+		ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel1, 1, &clGlobalSize, &clLocalSize, ocl_after(keys, text), "coop encrypt");
+		last = oclReadAsync(clCommandQueue, clCipherTextBuff, cipherText, gpuLen, ocl_after(exec), "coop read ciphertext");
+		clFlush(clCommandQueue);
+	}
+
+	aes_ctr cpuCtr = aes_ctr_add(&aesCtr, gpuLen / AES_BLOCK_SIZE);
+	unsigned long long cpuStart = benchNowNs();
+	cpu_AES_encryption(plainText + gpuLen, cipherText + gpuLen, filelen - gpuLen, eks, &cpuCtr, oclCoopThreads());
+	double cpuMs = (benchNowNs() - cpuStart) * 1.0e-6;
+
+	last.wait();
+	stop_measure_time(COOP);
+
+	oclCoopUpdate(&clCoop, gpuLen, oclCoopEventMs(keys.get(), last.get()), filelen - gpuLen, cpuMs);
+}
+#endif /* CPU_ONLY */
+
+// --keys: what the key batch measured, times in msecs; the matches are 1 when the device agrees with the host, -1 when not run
+#ifndef CPU_ONLY
+// the bytes the GPU and CPU texts are compared on, ECB leaves a last partial block alone on both sides
+static size_t aes_text_len(size_t filelen)
+{
+	return (aesMode == AES_MODE_ECB) ? filelen / AES_BLOCK_SIZE * AES_BLOCK_SIZE : filelen;
+}
+#endif
+
+struct aes_key_batch_result
+{
+	int		numKeys;
+	size_t	filelen;
+	double	hostMs;			// expansion of all keys
+	double	deviceMs;
+	int		schedulesMatch;
+	double	cpuMs;			// the text with a key per block
+	double	kernelMs;
+	int		textMatch;
+};
+aes_key_batch_result	aesBatch = {0, 0, 0.0, 0.0, -1, 0.0, 0.0, -1};
+
+// Packets of 64 to 1500 bytes, each under a random key of a batch of aesNumKeys: the keys are expanded on the
+// host and by AES_expand_keys, then the text is encrypted with its key index per block by the CPU engine of the
+// run and by the keyed kernel of the mode
+void aes_key_batch(const unsigned char *plainText, unsigned char *gpuCipherText, unsigned char *cpuCipherText, size_t filelen)
+{
+	int n = aesNumKeys, keyBytes = aesKeyBits / 8;
+	size_t numBlocks = (filelen + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+	Byte *key = (Byte *)malloc((size_t)n * keyBytes);
+	aes_key *keys = (aes_key *)malloc((size_t)n * sizeof(aes_key));
+	unsigned int *keyIndex = (unsigned int *)malloc(numBlocks * sizeof(unsigned int));
+	int *schedules = (int *)malloc((size_t)n * AES_KEY_WORDS * sizeof(int));
+	aes_key_batch_result r = {n, filelen, 0.0, 0.0, -1, 0.0, 0.0, -1};
+
+	if (key == NULL || keys == NULL || keyIndex == NULL || schedules == NULL)
+	{
+		printf("Out of memory for a batch of %i keys \n", n);
+		free(key);
+		free(keys);
+		free(keyIndex);
+		free(schedules);
+		return;
+	}
+	for (size_t i=0; i<(size_t)n * keyBytes; i++)
+		key[i] = (Byte)rand();
+	for (size_t b=0; b<numBlocks; )
+	{
+		size_t end = b + 4 + rand() % 91;
+		unsigned int k = (unsigned int)(rand() % n);
+		for (; b < end && b < numBlocks; b++)
+			keyIndex[b] = k;
+	}
+
+	unsigned long long start = benchNowNs();
+	for (int k=0; k<n; k++)
+		aes_set_encrypt_key(key + (size_t)k * keyBytes, aesKeyBits, &keys[k]);
+	r.hostMs = (benchNowNs() - start) * 1.0e-6;
+
+	// the fastest of three calls, the first also pulls the schedules into the cache
+	for (int run=0; run<3; run++)
+	{
+		start = benchNowNs();
+		cpu_AES_keyed_encryption(plainText, cpuCipherText, filelen, keys, keyIndex, &aesCtr, benchCpuThreads());
+		double ms = (benchNowNs() - start) * 1.0e-6;
+		if (run == 0 || ms < r.cpuMs)
+			r.cpuMs = ms;
+	}
+
+#ifndef CPU_ONLY
+	ocl_handle<cl_kernel> expand(clCreateKernel(clProgram, "AES_expand_keys", &clErr));
+	ocl_handle<cl_kernel> keyed(clCreateKernel(clProgram, aesKeyedNames[aesMode], &clErr));
+	ocl_buffer<Byte> keyBuff;
+	ocl_buffer<int> schedBuff;
+	ocl_buffer<unsigned int> indexBuff;
+	size_t clLocalSize = aesLaunch.local[0];
+	size_t clGlobalSize = ((size_t)n + clLocalSize - 1) / clLocalSize * clLocalSize;
+
+	keyBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, (size_t)n * keyBytes, &clErr), (size_t)n * keyBytes);
+	schedBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_WRITE, sizeof(int) * n * AES_KEY_WORDS, &clErr), (size_t)n * AES_KEY_WORDS);
+	indexBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(unsigned int) * numBlocks, &clErr), numBlocks);
+	if (expand.get() != NULL && keyed.get() != NULL && keyBuff.get() != NULL && schedBuff.get() != NULL && indexBuff.get() != NULL)
+	{
+		ocl_future keyWrite = oclWriteAsync(clCommandQueue, keyBuff, key, keyBuff.size(), ocl_after(), "batch keys");
+		oclSetArgs(expand, keyBuff, schedBuff, (unsigned int)(aesKeyBits / 32), (unsigned int)n);
+		ocl_future exec = oclLaunchAsync(clCommandQueue, expand, 1, &clGlobalSize, &clLocalSize, ocl_after(keyWrite), "AES_expand_keys");
+		if (oclReadAsync(clCommandQueue, schedBuff, schedules, schedBuff.size(), ocl_after(exec), "batch schedules").wait() == CL_SUCCESS)
+		{
+			r.deviceMs = aes_event_ms(exec.get());
+			r.schedulesMatch = 1;
+			for (int k=0; k<n; k++)
+				if (memcmp(schedules + (size_t)k * AES_KEY_WORDS, keys[k].rd_key, sizeof(int) * 4 * (keys[k].rounds + 1)) != 0)
+					r.schedulesMatch = 0;
+		}
+
+		// the plaintext again, --coop leaves only the device share in the buffer
+		ocl_future text;
+		if (oclHostMemMode() == OCL_MEM_COPY)
+			text = oclWriteAsync(clCommandQueue, clPlainTextBuff, plainText, filelen, ocl_after(), "batch plaintext");
+		else
+			oclHandOverBuffer(&clRuntime, clPlainTextBuff, CL_MAP_WRITE, sizeof(unsigned char) * filelen);
+		ocl_future index = oclWriteAsync(clCommandQueue, indexBuff, keyIndex, numBlocks, ocl_after(), "batch key index");
+		if (aesMode == AES_MODE_CTR)
+			oclSetArgs(keyed, clPlainTextBuff, clCipherTextBuff, schedBuff, (unsigned int)keys[0].rounds, aes_ctr_words(&aesCtr),
+					   indexBuff, (unsigned int)filelen);
+		else
+			oclSetArgs(keyed, clPlainTextBuff, clCipherTextBuff, schedBuff, (unsigned int)keys[0].rounds, indexBuff, (unsigned int)filelen);
+		clGlobalSize = (numBlocks + clLocalSize - 1) / clLocalSize * clLocalSize;
+		exec = oclLaunchAsync(clCommandQueue, keyed, 1, &clGlobalSize, &clLocalSize, ocl_after(text, index), aesKeyedNames[aesMode]);
+		if (exec.wait() == CL_SUCCESS)
+		{
+			r.kernelMs = aes_event_ms(exec.get());
+			if (oclHostMemMode() == OCL_MEM_COPY)
+				oclReadAsync(clCommandQueue, clCipherTextBuff, gpuCipherText, filelen, ocl_after(), "batch ciphertext").wait();
+			else
+				oclReadHostBuffer(&clRuntime, clCipherTextBuff, gpuCipherText, filelen);
+			r.textMatch = (memcmp(gpuCipherText, cpuCipherText, aes_text_len(filelen)) == 0);
+		}
+	}
+#endif
+
+	aesBatch = r;
+	free(key);
+	free(keys);
+	free(keyIndex);
+	free(schedules);
+}
+
+void aes_print_key_batch(FILE *fout)
+{
+#ifndef CPU_ONLY
+	static const char *schedules[] = {"not run", "differ from the host", "match the host"};
+	static const char *text[] = {"not run", "differs from the CPU", "matches the CPU"};
+#endif
+
+	if (aesBatch.numKeys == 0)
+		return;
+	fprintf(fout, "Key batch: %i AES-%i keys, packets of 64 to 1500 bytes under a random key each \n", aesBatch.numKeys, aesKeyBits);
+	fprintf(fout, "	host expansion = \t%10.3f msecs, %10.2f Mkeys/s \n", aesBatch.hostMs, aesBatch.numKeys / (aesBatch.hostMs * 1.0e3));
+#ifndef CPU_ONLY
+	fprintf(fout, "	device expansion = \t%10.3f msecs, %10.2f Mkeys/s, schedules %s \n", aesBatch.deviceMs,
+			aesBatch.numKeys / (aesBatch.deviceMs * 1.0e3), schedules[aesBatch.schedulesMatch + 1]);
+	fprintf(fout, "	GPU keyed kernel = \t%10.2f GB/s, %s \n", aesBatch.filelen / (aesBatch.kernelMs * 1.0e6), text[aesBatch.textMatch + 1]);
+#endif
+	fprintf(fout, "	CPU keyed = \t\t%10.2f GB/s on %i thread(s), %s \n\n", aesBatch.filelen / (aesBatch.cpuMs * 1.0e6), benchCpuThreads(),
+			aesEngineNames[aesEngine]);
+}
+
+// The results key of the run, what compareResults keeps apart: mode, key length, CPU engine and kernel, then
+// how the GPU path ran, e.g. ctr-aes256-aesni-ttable/copy; the CPU-only build has no kernel or GPU path
+const char *aes_variant()
+{
+	static const char *modes[] = {"ecb", "ctr"};
+	static const char *engines[] = {"ttable", "aesni", "bitsliced"};
+	static char variant[128];
+#ifndef CPU_ONLY
+	static const char *kernels[] = {"ttable", "bitsliced"};
+	const char *path = oclCoopName() ? oclCoopName() : oclPipelineName() ? oclPipelineName() : oclHostMemModeName(oclHostMemMode());
+	snprintf(variant, sizeof(variant), "%s-aes%i-%s-%s/%s", modes[aesMode], aesKeyBits, engines[aesEngine], kernels[aesKernel], path);
+#else
+	snprintf(variant, sizeof(variant), "%s-aes%i-%s", modes[aesMode], aesKeyBits, engines[aesEngine]);
+#endif
+	return variant;
+}
+
+// the measured loop, the same for the input file and every sweep size
+void aes_run(const unsigned char *plainText, unsigned char *gpuCipherText, unsigned char *cpuCipherText, size_t filelen, const aes_key *eks)
+{
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		benchBeginIteration(it);
+#ifndef CPU_ONLY
+		if (oclCoopEnabled())
+			coop_AES_encryption(plainText, gpuCipherText, filelen, eks);
+		else
+			ocl_AES_encryption(plainText, gpuCipherText, filelen, eks);
+#endif
+
+		start_measure_time(CPU);
+		cpu_AES_encryption(plainText, cpuCipherText, filelen, eks, &aesCtr, benchCpuThreads());
+		stop_measure_time(CPU);
+		benchEndIteration();
+	}
+}
+
+// --scaling: the CPU path of the measured loop on every thread count, see ../../common/benchScaling.h
+struct aes_scaling_job
+{
+	const unsigned char	*plainText;
+	unsigned char		*cipherText;
+	size_t				filelen;
+	const aes_key		*eks;
+};
+
+static void aes_scaling_call(void *user, int numThreads)
+{
+	const aes_scaling_job *job = (const aes_scaling_job *)user;
+	cpu_AES_encryption(job->plainText, job->cipherText, job->filelen, job->eks, &aesCtr, numThreads);
+}
+
+// --sweep also times every CPU engine and both kernels on each size, in GB/s of 1e9 bytes and the fastest of
+// AES_COMPARE_RUNS calls; 0 where an engine does not run
+#define AES_COMPARE_RUNS	3
+#define AES_COMPARE_COLS	(AES_NUM_ENGINES + AES_NUM_KERNELS)
+static double		aesCompare[BENCH_SWEEP_MAX][AES_COMPARE_COLS];
+static long long	aesCompareSizes[BENCH_SWEEP_MAX];
+static int			aesCompareNum = 0;
+
+// the CPU path with engine on the threads of the run, in msecs
+static double aes_time_cpu(int engine, const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+{
+	int current = aesEngine;
+	double best = 0.0;
+
+	aesEngine = engine;
+	for (int r=0; r<AES_COMPARE_RUNS; r++)
+	{
+		unsigned long long start = benchNowNs();
+		cpu_AES_encryption(plainText, cipherText, filelen, eks, &aesCtr, benchCpuThreads());
+		double ms = (benchNowNs() - start) * 1.0e-6;
+		if (best == 0.0 || ms < best)
+			best = ms;
+	}
+	aesEngine = current;
+	return best;
+}
+
+#ifndef CPU_ONLY
+// the kernel of the variant on the text in clPlainTextBuff, start to end of its event in msecs; 0 when it fails
+static double aes_time_kernel(int kernel, size_t filelen, const aes_key *eks)
+{
+	ocl_handle<cl_kernel> k(clCreateKernel(clProgram, aesKernelNames[kernel][aesMode], &clErr));
+	ocl_buffer<int> keys;
+	size_t numBlocks = filelen / AES_BLOCK_SIZE;
+	size_t clLocalSize = aesLaunch.local[0];
+	size_t clGlobalSize = (aes_work_items(kernel, numBlocks) + clLocalSize - 1) / clLocalSize * clLocalSize;
+	double best = 0.0;
+
+	if (clErr != CL_SUCCESS)
+		return 0.0;
+	keys.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(int) * aes_key_words(kernel, eks), &clErr), aes_key_words(kernel, eks));
+	if (keys.get() == NULL || aes_write_keys(keys, kernel, eks, NULL).wait() != CL_SUCCESS)
+		return 0.0;
+	aes_set_kernel_args(k, kernel, clPlainTextBuff, clCipherTextBuff, keys, eks, &aesCtr, filelen);
+	for (int r=0; r<AES_COMPARE_RUNS; r++)
+	{
+		ocl_future exec = oclLaunchAsync(clCommandQueue, k, 1, &clGlobalSize, &clLocalSize, ocl_after(), NULL);
+		if (exec.wait() != CL_SUCCESS)
+			return 0.0;
+		double ms = aes_event_ms(exec.get());
+		if (best == 0.0 || ms < best)
+			best = ms;
+	}
+	return best;
+}
+#endif /* CPU_ONLY */
+
+// one row of the engine table; the device buffers hold this size and its plaintext
+static void aes_compare(const unsigned char *plainText, unsigned char *cipherText, size_t filelen, const aes_key *eks)
+{
+	double *row = aesCompare[aesCompareNum];
+
+	for (int c=0; c<AES_COMPARE_COLS; c++)
+	{
+		double ms = 0.0;
+		if (c < AES_NUM_ENGINES && (c != AES_ENGINE_AESNI || aesniAvailable()))
+			ms = aes_time_cpu(c, plainText, cipherText, filelen, eks);
+#ifndef CPU_ONLY
+		else if (c >= AES_NUM_ENGINES)
+			ms = aes_time_kernel(c - AES_NUM_ENGINES, filelen, eks);
+#endif
+		row[c] = (ms > 0.0) ? filelen / (ms * 1.0e6) : 0.0;
+	}
+	aesCompareSizes[aesCompareNum++] = (long long)filelen;
+}
+
+static void aes_print_compare(FILE *fout)
+{
+	char name[32];
+
+	fprintf(fout, "\nEngines in GB/s, fastest of %i calls (CPU on %i thread(s), kernels start to end): \n", AES_COMPARE_RUNS, benchCpuThreads());
+	fprintf(fout, "	%12s", "bytes");
+	for (int c=0; c<AES_COMPARE_COLS; c++)
+	{
+		if (c < AES_NUM_ENGINES)
+			sprintf(name, "%s", aesEngineNames[c]);
+		else
+			sprintf(name, "%s kernel", aesKernelVariants[c - AES_NUM_ENGINES]);
+		fprintf(fout, " %17s", name);
+	}
+	fprintf(fout, " \n");
+	for (int s=0; s<aesCompareNum; s++)
+	{
+		fprintf(fout, "	%12lld", aesCompareSizes[s]);
+		for (int c=0; c<AES_COMPARE_COLS; c++)
+			if (aesCompare[s][c] > 0.0)
+				fprintf(fout, " %17.3f", aesCompare[s][c]);
+			else
+				fprintf(fout, " %17s", "-");
+		fprintf(fout, " \n");
+	}
+	fprintf(fout, "\n");
+}
+
+// --sweep: random plaintexts of every size instead of input.txt, see ../../common/benchSweep.h
+void aes_sweep(const char *hostName, const aes_key *eks)
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ, PGM, KERNEL};
+	long long sizes[BENCH_SWEEP_MAX];
+	// whole blocks for the largest work-group the tuner tries, the kernel has no bounds check
+	int numSizes = benchSweepSizes(sizes, 16 * 1024, 256 * MB, AES_BLOCK_SIZE * 1024);
+
+	for (int s=0; s<numSizes; s++)
+	{
+		size_t filelen = (size_t)sizes[s];
+		unsigned char *plainText = (unsigned char*) malloc(filelen);
+		unsigned char *cpuCipherText = (unsigned char*) malloc(filelen);
+		unsigned char *gpuCipherText = (unsigned char*) malloc(filelen);
+		if (plainText == NULL || cpuCipherText == NULL || gpuCipherText == NULL)
+		{
+			printf("Out of memory at a sweep size of %lu bytes \n", (unsigned long)filelen);
+			free(plainText);
+			free(cpuCipherText);
+			free(gpuCipherText);
+			break;
+		}
+		for (size_t i=0; i<filelen; i++)
+			plainText[i] = (unsigned char)rand();
+
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+#ifndef CPU_ONLY
+		oclBuffer(plainText, eks, filelen);
+		aes_tune(filelen, eks);
+#endif
+		aes_run(plainText, gpuCipherText, cpuCipherText, filelen, eks);
+		benchSummary(timeRes);
+
+		float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+		float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + total_GPU_fair_time;
+#ifdef CPU_ONLY
+		total_GPU_fair_time = total_GPU_time = 0.0f;
+#endif
+		benchSweepAdd(sizes[s], timeRes[CPU], total_GPU_fair_time, total_GPU_time);
+
+		bench_result res;
+		char workGroup[16];
+#ifndef CPU_ONLY
+		sprintf(workGroup, "%lu", (unsigned long)aesLaunch.local[0]);
+#else
+		sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+#endif
+		resultsInit(&res, "aes");
+		res.description = description;
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.gpuMs = total_GPU_fair_time;
+		res.gpuTotalMs = total_GPU_time;
+		res.gpuThroughput = filelen / (1024.0 * 1024.0) / (total_GPU_fair_time * 1.0e-3);
+		res.speedup = timeRes[CPU] / total_GPU_fair_time;
+#else
+		resultsSetHostDevice(&res);
+#endif
+		res.variant = aes_variant();
+		res.problemSize = filelen;
+		res.problemUnit = "bytes";
+		res.workGroup = workGroup;
+		res.cpuMs = timeRes[CPU];
+		res.cpuThroughput = filelen / (1024.0 * 1024.0) / (timeRes[CPU] * 1.0e-3);
+		res.throughputUnit = "MB/s";
+#ifndef CPU_ONLY
+		if (oclHostMemMode() != OCL_MEM_COPY)
+			oclReadHostBuffer(&clRuntime, clCipherTextBuff, gpuCipherText, filelen);
+		res.verified = (memcmp(cpuCipherText, gpuCipherText, aes_text_len(filelen)) == 0);
+#endif
+		resultsWrite(&res);
+		aes_compare(plainText, cpuCipherText, filelen, eks);
+
+#ifndef CPU_ONLY
+		oclReleaseBuffers();
+#endif
+		free(plainText);
+		free(cpuCipherText);
+		free(gpuCipherText);
+	}
+
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, size sweep on random plaintext \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintSweepReport(fio, "bytes", "MB/s", 1.0 / (1024.0 * 1024.0));
+	aes_print_compare(fio);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+// --serve: every request is a plaintext of whole blocks encrypted with the benchmark's key, see ../../common/benchServe.h
+static const aes_key	*serveKey;
+#ifndef CPU_ONLY
+static size_t			serveCap = 0;		// bytes the device buffers hold, they only grow
+#endif
+static aes_ctr			serveNonce;
+static unsigned long long	serveBlocks = 0;	// counter blocks handed out so far
+
+static int aes_serve_request(const bench_serve_request *req, const void *payload)
+{
+	size_t filelen = (size_t)req->length;
+
+	if (filelen == 0 || filelen % AES_BLOCK_SIZE != 0)
+		return BENCH_SERVE_BAD_REQUEST;
+	unsigned char *cipherText = (unsigned char *)benchServeReply(filelen);
+	if (cipherText == NULL)
+		return BENCH_SERVE_NO_MEMORY;
+	// in CTR mode every request gets counter blocks of its own, no keystream is used twice under the key
+	aesCtr = aes_ctr_add(&serveNonce, serveBlocks);
+	serveBlocks += filelen / AES_BLOCK_SIZE;
+#ifndef CPU_ONLY
+	if (filelen > serveCap)
+	{
+		// whole blocks for the largest work-group, the kernel has no bounds check
+		if (serveCap > 0)
+			oclReleaseBuffers();
+		serveCap = (filelen + AES_BLOCK_SIZE * 1024 - 1) / (AES_BLOCK_SIZE * 1024) * (AES_BLOCK_SIZE * 1024);
+		oclBuffer(NULL, serveKey, serveCap);
+		if (clErr != CL_SUCCESS)
+		{
+			oclReleaseBuffers();
+			serveCap = 0;
+			return BENCH_SERVE_NO_MEMORY;
+		}
+	}
+	clErr = CL_SUCCESS;
+	if (oclCoopEnabled())
+		coop_AES_encryption((const unsigned char *)payload, cipherText, filelen, serveKey);
+	else
+		ocl_AES_encryption((const unsigned char *)payload, cipherText, filelen, serveKey);
+	return (clErr == CL_SUCCESS) ? BENCH_SERVE_OK : BENCH_SERVE_FAILED;
+#else
+	start_measure_time(CPU);
+	cpu_AES_encryption((const unsigned char *)payload, cipherText, filelen, serveKey, &aesCtr, benchCpuThreads());
+	stop_measure_time(CPU);
+	return BENCH_SERVE_OK;
+#endif
+}
+
+void aes_serve(const char *hostName, const aes_key *eks)
+{
+	serveKey = eks;
+	serveNonce = aesCtr;
+	if (benchServe(BENCH_OP_AES, aes_serve_request) < 0)
+		return;
+	benchSummary(timeRes);
+#ifndef CPU_ONLY
+	if (serveCap > 0)
+		oclReleaseBuffers();
+	serveCap = 0;
+#endif
+
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, service of encryption requests \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintServeReport(fio);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+// --batch: batches of aesBatchMsgs packets of every mix of lengths, each packet under its own key and initial
+// counter block, encrypted by one launch of the batch kernel and by the CPU engine with a message per call
+#define AES_BATCH_MIXES		5
+static const char *batchMixNames[AES_BATCH_MIXES] = {"64B", "576B", "1500B", "IMIX", "uniform"};
+
+struct aes_batch_row
+{
+	double	bytes;				// mean message length
+	double	gpuMs, gpuP99Ms;	// median and 99th percentile of a round trip
+	double	kernelMs;
+	double	cpuMs, cpuP99Ms;
+	int		verified;			// 1 when every message matches the CPU, -1 when not run
+};
+static aes_batch_row	batchRows[AES_BATCH_MIXES];
+
+// the length of a message of mix: one size, the simple IMIX of 7 64-byte, 4 576-byte and 1 1500-byte packets,
+// or any length from 64 to 1500 bytes
+static unsigned int aes_batch_length(int mix)
+{
+	static const unsigned int imix[12] = {64, 64, 64, 64, 64, 64, 64, 576, 576, 576, 576, 1500};
+	if (mix == 0)
+		return 64;
+	if (mix == 1)
+		return 576;
+	if (mix == 2)
+		return AES_BATCH_MAX_LEN;
+	if (mix == 3)
+		return imix[rand() % 12];
+	return 64 + rand() % (AES_BATCH_MAX_LEN - 64 + 1);
+}
+
+static unsigned int aes_rand32()
+{
+	return ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+}
+
+static void aes_print_batch(FILE *fout, int numKeys)
+{
+#ifndef CPU_ONLY
+	static const char *match[] = {"not run", "differ", "match"};
+#endif
+
+	fprintf(fout, "Message batches: %i messages per batch, %i key(s), CPU on %i thread(s), %s engine \n", aesBatchMsgs, numKeys,
+			benchCpuThreads(), aesEngineNames[aesEngine]);
+#ifndef CPU_ONLY
+	fprintf(fout, "	mix \t  bytes  GPU msgs/s  median ms     p99 ms  kernel ms  CPU msgs/s  median ms     p99 ms  messages \n");
+	for (int m=0; m<AES_BATCH_MIXES; m++)
+	{
+		const aes_batch_row *r = &batchRows[m];
+		fprintf(fout, "	%-7s %7.0f  %10.0f %10.3f %10.3f %10.3f  %10.0f %10.3f %10.3f  %s \n", batchMixNames[m], r->bytes,
+				r->gpuMs > 0.0 ? aesBatchMsgs / (r->gpuMs * 1.0e-3) : 0.0, r->gpuMs, r->gpuP99Ms, r->kernelMs,
+				aesBatchMsgs / (r->cpuMs * 1.0e-3), r->cpuMs, r->cpuP99Ms, match[r->verified + 1]);
+	}
+#else
+	fprintf(fout, "	mix \t  bytes  CPU msgs/s  median ms     p99 ms \n");
+	for (int m=0; m<AES_BATCH_MIXES; m++)
+		fprintf(fout, "	%-7s %7.0f  %10.0f %10.3f %10.3f \n", batchMixNames[m], batchRows[m].bytes,
+				aesBatchMsgs / (batchRows[m].cpuMs * 1.0e-3), batchRows[m].cpuMs, batchRows[m].cpuP99Ms);
+#endif
+	fprintf(fout, "\n");
+}
+
+void aes_batch(const char *hostName, const aes_key *eks)
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ, PGM, KERNEL};
+	int n = aesBatchMsgs;
+	int numKeys = (aesNumKeys > 0) ? aesNumKeys : 1;
+	size_t maxLen = (size_t)n * AES_BATCH_SLOT;
+	unsigned char *plainText = (unsigned char *)malloc(maxLen);
+	unsigned char *cpuCipherText = (unsigned char *)malloc(maxLen);
+	unsigned char *gpuCipherText = (unsigned char *)malloc(maxLen);
+	aes_msg_desc *msgs = (aes_msg_desc *)malloc((size_t)n * sizeof(aes_msg_desc));
+	aes_key *keys = (aes_key *)malloc((size_t)numKeys * sizeof(aes_key));
+	int *schedules = (int *)calloc((size_t)numKeys * AES_KEY_WORDS, sizeof(int));
+
+	if (plainText == NULL || cpuCipherText == NULL || gpuCipherText == NULL || msgs == NULL || keys == NULL || schedules == NULL)
+	{
+		printf("Out of memory for batches of %i messages \n", n);
+		free(plainText);
+		free(cpuCipherText);
+		free(gpuCipherText);
+		free(msgs);
+		free(keys);
+		free(schedules);
+		return;
+	}
+	for (size_t i=0; i<maxLen; i++)
+		plainText[i] = (unsigned char)rand();
+	// --keys gives a batch of random keys of --key-bits, else every message has the key of the run
+	keys[0] = *eks;
+	for (int k=0; k<numKeys && aesNumKeys > 0; k++)
+	{
+		Byte key[32];
+		for (int i=0; i<aesKeyBits / 8; i++)
+			key[i] = (Byte)rand();
+		aes_set_encrypt_key(key, aesKeyBits, &keys[k]);
+	}
+	for (int k=0; k<numKeys; k++)
+		memcpy(schedules + (size_t)k * AES_KEY_WORDS, keys[k].rd_key, sizeof(int) * 4 * (keys[k].rounds + 1));
+
+#ifndef CPU_ONLY
+	// the text is always copied, the descriptors change with every batch
+	ocl_handle<cl_kernel> batch(clCreateKernel(clProgram, aesBatchNames[aesMode], &clErr));
+	ocl_buffer<int> schedBuff;
+	ocl_buffer<aes_msg_desc> msgBuff;
+	ocl_buffer<unsigned char> inBuff, outBuff;
+	schedBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(int) * numKeys * AES_KEY_WORDS, &clErr), (size_t)numKeys * AES_KEY_WORDS);
+	msgBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(aes_msg_desc) * n, &clErr), (size_t)n);
+	inBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, maxLen, &clErr), maxLen);
+	outBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_WRITE_ONLY, maxLen, &clErr), maxLen);
+	int deviceReady = (batch.get() != NULL && schedBuff.get() != NULL && msgBuff.get() != NULL && inBuff.get() != NULL && outBuff.get() != NULL);
+	if (deviceReady)
+		deviceReady = (oclWriteAsync(clCommandQueue, schedBuff, schedules, schedBuff.size(), ocl_after(), "batch schedules").wait() == CL_SUCCESS);
+	if (!deviceReady)
+		printf("Could not set up the batch kernel %s, running the CPU only \n", aesBatchNames[aesMode]);
+#endif
+
+	for (int mix=0; mix<AES_BATCH_MIXES; mix++)
+	{
+		aes_batch_row r = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1};
+		unsigned int offset = 0, numBlocks = 0;
+		for (int m=0; m<n; m++)
+		{
+			unsigned int len = aes_batch_length(mix);
+			if (aesMode == AES_MODE_ECB)
+				len = (len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+			msgs[m].offset = offset;
+			msgs[m].length = len;
+			msgs[m].key = (unsigned int)(rand() % numKeys);
+			msgs[m].firstBlock = numBlocks;
+			for (int w=0; w<4; w++)
+				msgs[m].iv[w] = aes_rand32();
+			numBlocks += (len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+			offset = numBlocks * AES_BLOCK_SIZE;
+			r.bytes += (double)len / n;
+		}
+
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+		for (int it=0; it<benchTotalIterations(); it++)
+		{
+			benchBeginIteration(it);
+#ifndef CPU_ONLY
+			if (deviceReady)
 			{
-				inp = (AESData *)plainText + i;
-				out = (AESData *)cipherText + i;
-				rkey = (AESData *)eks->rd_key;
-				XorBlock(&state, inp, rkey);
-				T = AESEncryptTable;
-
-				for (int round = 1; round < eks->rounds; ++round)
-				{
-					++rkey;
-
-					w0.w = state.w[0];
-					w1.w = state.w[1];
-					w2.w = state.w[2];
-					w3.w = state.w[3];
-
-					state.w[0] = rkey->w[0] ^ T[0][w0.b[0]] ^ T[1][w1.b[1]] ^ T[2][w2.b[2]] ^ T[3][w3.b[3]];
-					state.w[1] = rkey->w[1] ^ T[0][w1.b[0]] ^ T[1][w2.b[1]] ^ T[2][w3.b[2]] ^ T[3][w0.b[3]];
-					state.w[2] = rkey->w[2] ^ T[0][w2.b[0]] ^ T[1][w3.b[1]] ^ T[2][w0.b[2]] ^ T[3][w1.b[3]];
-					state.w[3] = rkey->w[3] ^ T[0][w3.b[0]] ^ T[1][w0.b[1]] ^ T[2][w1.b[2]] ^ T[3][w2.b[3]];
-				}
-
-				T = AESSubBytesWordTable;
-				++rkey;
-
-				w0.w = state.w[0];
-				w1.w = state.w[1];
-				w2.w = state.w[2];
-				w3.w = state.w[3];
-
-				state.w[0] = rkey->w[0] ^ T[0][w0.b[0]] ^ T[1][w1.b[1]] ^ T[2][w2.b[2]] ^ T[3][w3.b[3]];
-				state.w[1] = rkey->w[1] ^ T[0][w1.b[0]] ^ T[1][w2.b[1]] ^ T[2][w3.b[2]] ^ T[3][w0.b[3]];
-				state.w[2] = rkey->w[2] ^ T[0][w2.b[0]] ^ T[1][w3.b[1]] ^ T[2][w0.b[2]] ^ T[3][w1.b[3]];
-				state.w[3] = rkey->w[3] ^ T[0][w3.b[0]] ^ T[1][w0.b[1]] ^ T[2][w1.b[2]] ^ T[3][w2.b[3]];
-
-				*out = state;
+				size_t clLocalSize = aesLaunch.local[0];
+				size_t clGlobalSize = (numBlocks + clLocalSize - 1) / clLocalSize * clLocalSize;
+				start_measure_time(BATCH);
+				ocl_future text = oclWriteAsync(clCommandQueue, inBuff, plainText, offset, ocl_after(), "batch text");
+				ocl_future desc = oclWriteAsync(clCommandQueue, msgBuff, msgs, (size_t)n, ocl_after(), "batch descriptors");
+				oclSetArgs(batch, inBuff, outBuff, schedBuff, (unsigned int)keys[0].rounds, msgBuff, (unsigned int)n, numBlocks);
+				ocl_future exec = oclLaunchAsync(clCommandQueue, batch, 1, &clGlobalSize, &clLocalSize, ocl_after(text, desc), aesBatchNames[aesMode]);
+				clErr = oclReadAsync(clCommandQueue, outBuff, gpuCipherText, offset, ocl_after(exec), "batch ciphertext").wait();
+				stop_measure_time(BATCH);
+				if (clErr == CL_SUCCESS)
+					benchAddNs(KERNEL_EXEC, (unsigned long long)(aes_event_ms(exec.get()) * 1.0e6));
 			}
+#endif
+			start_measure_time(CPU);
+			cpu_AES_batch_encryption(plainText, cpuCipherText, msgs, n, keys, benchCpuThreads());
+			stop_measure_time(CPU);
+			benchEndIteration();
+		}
+
+		const bench_stats *cpu = benchPhaseStats(CPU);
+		r.cpuMs = cpu->median;
+		r.cpuP99Ms = cpu->p99;
+#ifndef CPU_ONLY
+		if (deviceReady)
+		{
+			r.gpuMs = benchPhaseStats(BATCH)->median;
+			r.gpuP99Ms = benchPhaseStats(BATCH)->p99;
+			r.kernelMs = benchPhaseStats(KERNEL_EXEC)->median;
+			// only the bytes of the messages, the padding between them is nobody's
+			r.verified = 1;
+			for (int m=0; m<n; m++)
+				if (memcmp(gpuCipherText + msgs[m].offset, cpuCipherText + msgs[m].offset, msgs[m].length) != 0)
+					r.verified = 0;
+		}
+#endif
+		batchRows[mix] = r;
+
+		bench_result res;
+		char workGroup[16], variant[160];
+#ifndef CPU_ONLY
+		sprintf(workGroup, "%lu", (unsigned long)aesLaunch.local[0]);
+#else
+		sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+#endif
+		resultsInit(&res, "aes");
+		res.description = description;
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.gpuMs = r.gpuMs;
+		res.gpuTotalMs = r.gpuMs;
+		res.gpuThroughput = (r.gpuMs > 0.0) ? n / (r.gpuMs * 1.0e-3) : 0.0;
+		res.speedup = (r.gpuMs > 0.0) ? r.cpuMs / r.gpuMs : 0.0;
+		res.verified = (r.verified == 1);
+#else
+		resultsSetHostDevice(&res);
+#endif
+		// the mode, key and engine of the main path, so batches of different configurations do not compare
+		snprintf(variant, sizeof(variant), "%s/batch-%s", aes_variant(), batchMixNames[mix]);
+		res.variant = variant;
+		res.problemSize = n;
+		res.problemUnit = "messages";
+		res.workGroup = workGroup;
+		res.cpuMs = r.cpuMs;
+		res.cpuThroughput = n / (r.cpuMs * 1.0e-3);
+		res.throughputUnit = "msgs/s";
+		resultsWrite(&res);
 	}
-//	}
+
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, message batches \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s), kernel %s \n\n", clRuntime.deviceName, clRuntime.platformName, aesBatchNames[aesMode]);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	aes_print_batch(fio, numKeys);
+	benchPrintAllocReport(fio);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+
+	free(plainText);
+	free(cpuCipherText);
+	free(gpuCipherText);
+	free(msgs);
+	free(keys);
+	free(schedules);
 }
 
-int main()
+int main(int argc, char **argv)
 {
 	char hostName[50];
 	unsigned char  *plainText , *cpuCipherText, *gpuCipherText;
@@ -391,7 +1669,122 @@ int main()
 	FILE * i_file;
 	aes_key eks;
 
+#ifndef CPU_ONLY
+	oclParseArgs(&argc, argv);
+#endif
+	benchParseArgs(&argc, argv);
+	resultsParseArgs(&argc, argv);
+	benchInit(phaseNames, NUM_PHASES);
 	gethostname(hostName, 50);
+
+	// --mode, from what the common parsers left of the command line
+	const char *mode = getenv("SAMOS_AES_MODE");
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+			mode = argv[++i];
+	if (mode != NULL && strcmp(mode, "ecb") == 0)
+		aesMode = AES_MODE_ECB;
+	else if (mode != NULL && mode[0] != '\0' && strcmp(mode, "ctr") != 0)
+		printf("Bad --mode \"%s\", expected ecb or ctr, running CTR \n", mode);
+
+	// --cpu-engine, auto takes AES-NI when CPUID reports the AES instructions and else the portable T-table
+	// engine; the constant-time bitsliced engine only runs when asked for
+	const char *engine = getenv("SAMOS_AES_ENGINE");
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--cpu-engine") == 0 && i + 1 < argc)
+			engine = argv[++i];
+	aesEngine = aesniAvailable() ? AES_ENGINE_AESNI : AES_ENGINE_TTABLE;
+	if (engine != NULL && strcmp(engine, "ttable") == 0)
+		aesEngine = AES_ENGINE_TTABLE;
+	else if (engine != NULL && strcmp(engine, "bitsliced") == 0)
+		aesEngine = AES_ENGINE_BITSLICED;
+	else if (engine != NULL && strcmp(engine, "aesni") == 0 && !aesniAvailable())
+		printf("The CPU has no AES instructions, running the T-table engine \n");
+	else if (engine != NULL && engine[0] != '\0' && strcmp(engine, "aesni") != 0 && strcmp(engine, "auto") != 0)
+		printf("Bad --cpu-engine \"%s\", expected auto, aesni, bitsliced or ttable \n", engine);
+
+	// --kernel, the T-table kernels of the SAMOS 2013 paper unless the bitsliced ones are asked for
+	const char *kernel = getenv("SAMOS_AES_KERNEL");
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+			kernel = argv[++i];
+	if (kernel != NULL && strcmp(kernel, "bitsliced") == 0)
+		aesKernel = AES_KERNEL_BITSLICED;
+	else if (kernel != NULL && kernel[0] != '\0' && strcmp(kernel, "ttable") != 0)
+		printf("Bad --kernel \"%s\", expected ttable or bitsliced, running the T-table kernel \n", kernel);
+
+	// --key-bits and --keys
+	const char *keyBits = getenv("SAMOS_AES_KEY_BITS");
+	const char *numKeys = getenv("SAMOS_AES_KEYS");
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--key-bits") == 0 && i + 1 < argc)
+			keyBits = argv[++i];
+		else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc)
+			numKeys = argv[++i];
+	if (keyBits != NULL && (atoi(keyBits) == 128 || atoi(keyBits) == 192 || atoi(keyBits) == 256))
+		aesKeyBits = atoi(keyBits);
+	else if (keyBits != NULL && keyBits[0] != '\0')
+		printf("Bad --key-bits \"%s\", expected 128, 192 or 256, running AES-256 \n", keyBits);
+	if (numKeys != NULL && atoi(numKeys) > 0)
+		aesNumKeys = atoi(numKeys);
+
+	// --batch
+	const char *batch = getenv("SAMOS_AES_BATCH");
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			batch = argv[++i];
+	if (batch != NULL && atoi(batch) > 0 && (unsigned int)atoi(batch) <= AES_BATCH_MAX_MSGS)
+		aesBatchMsgs = atoi(batch);
+	else if (batch != NULL && atoi(batch) > 0)
+		printf("Bad --batch \"%s\", at most %u messages fit the 32-bit offsets, running the input file \n", batch, AES_BATCH_MAX_MSGS);
+	else if (batch != NULL && batch[0] != '\0')
+		printf("Bad --batch \"%s\", expected a number of messages, running the input file \n", batch);
+
+	benchTraceBegin("key setup");
+	// the key bytes are 00 01 02 ..., for AES-256 that is the schedule in roundKey (data.h)
+	Byte key[32];
+	for (int i=0; i<32; i++)
+		key[i] = (Byte)i;
+	aes_set_encrypt_key(key, aesKeyBits, &eks);
+	// a nonce of the run in the upper half of the counter block, the lower half counts the blocks
+	aesCtr.hi = benchNowNs();
+	aesCtr.lo = 0;
+	benchTraceEnd();
+	sprintf(description, "AES-%i %s", 32 * (eks.rounds - 6), aesModeNames[aesMode]);
+
+	aesCheckCpu = cpu_AES_selfcheck();
+#ifndef CPU_ONLY
+	oclInit(&eks);
+	if (aesMode == AES_MODE_CTR)
+		aesCheckDevice = ocl_AES_ctr_selfcheck(eks.rounds);
+#endif
+	aes_print_selfcheck(stdout);
+	if (benchSweepEnabled())
+	{
+		aes_sweep(hostName, &eks);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+	if (aesBatchMsgs > 0)
+	{
+		aes_batch(hostName, &eks);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+	if (benchServeEnabled())
+	{
+		aes_serve(hostName, &eks);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+
+	benchTraceBegin("read input.txt");
 	i_file = fopen("input.txt", "r");
 	fseek(i_file, 0, SEEK_END);
 	size_t filelen = ftell(i_file);
@@ -408,26 +1801,39 @@ int main()
 	else
 		plainText[filelen] = '\0';
 	fclose(i_file);
+	benchTraceEnd();
 
 	memset(cpuCipherText, 0, filelen);
 	memset(gpuCipherText, 0, filelen);
 
-	for (int i=0; i<60; i++)
-		eks.rd_key[i] = roundKey[i];
-	eks.rounds = 14;
-
-	ocl_AES_cbc_encryption(plainText, gpuCipherText, filelen, &eks);
+#ifndef CPU_ONLY
+	oclBuffer(plainText, &eks, filelen);
+	aes_tune(filelen, &eks);
+#endif
 
-	start_measure_time(CPU);
-	cpu_AES_cbc_encryption(plainText, cpuCipherText, filelen, &eks);
-	stop_measure_time(CPU);
+	aes_run(plainText, gpuCipherText, cpuCipherText, filelen, &eks);
+	aes_scaling_job scalingJob = {plainText, cpuCipherText, filelen, &eks};
+	benchScalingRun(aes_scaling_call, &scalingJob);
+#ifndef CPU_ONLY
+	if (oclHostMemMode() != OCL_MEM_COPY)
+	{
+		oclReadHostBuffer(&clRuntime, clCipherTextBuff, gpuCipherText, filelen);
+		oclTimeCopyPath(&clRuntime, filelen, filelen, WRDEV_COPY, RDDEV_COPY);
+	}
+	// before the key batch takes over the buffers
+	int verified = (memcmp(cpuCipherText, gpuCipherText, aes_text_len(filelen)) == 0);
+#endif
+	benchSummary(timeRes);
+	if (aesNumKeys > 0)
+		aes_key_batch(plainText, gpuCipherText, cpuCipherText, filelen);
 	/*-------------------------print result-----------------------*/
 	fio = fopen("log.txt", "a+");
 	fseek (fio, 0, SEEK_END);
 	int appendPos = ftell(fio);
 
-	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ];
-	float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV];
+	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ] + timeRes[PIPELINE] + timeRes[COOP];
+	float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+	double total_GPU_fair_J = benchPhaseJoules(GPU_SEQ) + benchPhaseJoules(KERNEL_EXEC) + benchPhaseJoules(WRDEV) + benchPhaseJoules(RDDEV) + benchPhaseJoules(PIPELINE) + benchPhaseJoules(COOP);
 
 //	struct tm *local;
 //	time_t t;
@@ -437,8 +1843,31 @@ int main()
 	fprintf(fio, "****************************************************\n");
 //	fprintf(fio, "Created on: %s", asctime(local));
 	fprintf(fio, "Host name: %s \n", hostName);
-	fprintf(fio, "Description: %s \n\n", description);
-	fprintf(fio, "Input size: %iMB \n\n", (unsigned int)filelen / (MB));
+	fprintf(fio, "Description: %s \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n", clRuntime.deviceName, clRuntime.platformName);
+	oclPrintCacheStats(fio);
+	oclPrintHostMemReport(fio, &clRuntime, WRDEV, RDDEV, WRDEV_COPY, RDDEV_COPY);
+	oclPrintPipelineReport(fio, &clPipeline, PIPELINE);
+	oclPrintCoopReport(fio, &clCoop, COOP, "bytes");
+	oclPrintTuneReport(fio, aes_tune_name(), &aesLaunch);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n");
+#endif
+	fprintf(fio, "\n");
+	fprintf(fio, "Input size: %iMB \n", (unsigned int)filelen / (MB));
+	fprintf(fio, "CPU threads: %i \n", benchCpuThreads());
+	if (aesEngine == AES_ENGINE_AESNI)
+		fprintf(fio, "CPU engine: AES-NI, %i blocks in flight \n", AESNI_LANES);
+	else if (aesEngine == AES_ENGINE_BITSLICED)
+		fprintf(fio, "CPU engine: bitsliced (%s), %i blocks per step \n", aesbsName(), aesbsBlocks());
+	else
+		fprintf(fio, "CPU engine: T-table \n");
+#ifndef CPU_ONLY
+	fprintf(fio, "Kernel: %s \n", aesKernelNames[aesKernel][aesMode]);
+#endif
+	aes_print_selfcheck(fio);
+	fprintf(fio, "\n");
 	/*for (unsigned int i=0; i<filelen; i++)
 		if (cpuCipherText[i] != gpuCipherText[i])
 		{
@@ -446,7 +1875,8 @@ int main()
 			return(-1);
 		}*/
 	fprintf(fio, "\n===========Performance Measurements=================\n");
-	fprintf(fio, "Execution times: \n"
+#ifndef CPU_ONLY
+	fprintf(fio, "Execution times (median of %i iterations): \n"
 			   "	PLATFORM = \t%10.2f msecs \n"
 			   "	DEVICE = \t%10.2f msecs \n"
 			   "	CONTEXT = \t%10.2f msecs \n"
@@ -458,6 +1888,7 @@ int main()
 			   "	KERNEL_EXEC = \t%10.2f msecs \n"
 			   "	RDDEV = \t%10.2f msecs \n\n"
 			   "    GPU_SEQ = \t%10.2f msec \n\n",
+			   benchIterations(),
 			   timeRes[PLATFORM],
 			   timeRes[DEVICE],
 			   timeRes[CONTEXT],
@@ -475,13 +1906,72 @@ int main()
 			"CPU time: \t\t%10.2f msecs \n\n",
 			total_GPU_time, total_GPU_fair_time, timeRes[CPU]);
 	fprintf(fio, "Speed UP: \t\t%10.2f \n\n", float(timeRes[CPU])/float(total_GPU_fair_time));
+	aes_print_throughput(fio, filelen, timeRes[KERNEL_EXEC], total_GPU_fair_time, timeRes[CPU]);
+	// per 16-byte block: 32 bytes in and out; per round 24 shifts and masks for the table indices and 16 xors,
+	// the last round masks 16 more (the tables and round keys sit in local and constant memory); CTR adds
+	// about 16 for the counter block and the xor with the plaintext. The bitsliced round is about 370 64-bit
+	// operations for 4 blocks (the S-box circuit 128, ShiftRows 160, MixColumns 70 and the round key), and the
+	// transposition in and out about 100 per block.
+	double aesOps = (aesKernel == AES_KERNEL_BITSLICED) ? 92.0 * eks.rounds + 100.0 : 40.0 * eks.rounds + 20.0;
+	ocl_kernel_cost aesCost = {aesKernelNames[aesKernel][aesMode], (double)((filelen + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE), 2.0 * AES_BLOCK_SIZE,
+							   aesOps + (aesMode == AES_MODE_CTR ? 16.0 : 0.0), OCL_ROOF_INT, timeRes[KERNEL_EXEC]};
+	oclPrintRooflineReport(fio, &aesCost, 1);
+#else
+	fprintf(fio, "CPU time (median of %i iterations): \t%10.2f msecs \n\n", benchIterations(), timeRes[CPU]);
+	aes_print_throughput(fio, filelen, 0.0f, 0.0f, timeRes[CPU]);
+#endif
+	aes_print_key_batch(fio);
+	benchPrintEnergySummary(fio, total_GPU_fair_J, total_GPU_fair_time, benchPhaseJoules(CPU), timeRes[CPU], filelen, "byte");
+	benchPrintScalingReport(fio, filelen, "MB/s", 1.0 / (1024.0 * 1024.0), total_GPU_fair_time);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+
+	bench_result res;
+	char workGroup[16];
+#ifndef CPU_ONLY
+	sprintf(workGroup, "%lu", (unsigned long)aesLaunch.local[0]);
+#else
+	sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+#endif
+	resultsInit(&res, "aes");
+	res.description = description;
+#ifndef CPU_ONLY
+	res.device = clRuntime.deviceName;
+	res.platform = clRuntime.platformName;
+	res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+	res.driver = clRuntime.driverVersion;
+#else
+	resultsSetHostDevice(&res);
+#endif
+	res.variant = aes_variant();
+	res.problemSize = filelen;
+	res.problemUnit = "bytes";
+	res.workGroup = workGroup;
+	res.cpuMs = timeRes[CPU];
+	res.cpuThroughput = filelen / (1024.0 * 1024.0) / (timeRes[CPU] * 1.0e-3);
+	res.throughputUnit = "MB/s";
+#ifndef CPU_ONLY
+	res.gpuMs = total_GPU_fair_time;
+	res.gpuThroughput = filelen / (1024.0 * 1024.0) / (total_GPU_fair_time * 1.0e-3);
+	res.speedup = timeRes[CPU] / total_GPU_fair_time;
+	// and the keyed schedules and text when the key batch ran
+	res.verified = verified && aesBatch.schedulesMatch != 0 && aesBatch.textMatch != 0;
+#endif
+	res.gpuJ = total_GPU_fair_J;
+	res.cpuJ = benchPhaseJoules(CPU);
+	res.energyOps = filelen;
+	res.energyOp = "byte";
+	resultsWrite(&res);
 
 	fseek(fio, appendPos, SEEK_SET);
 	while(fgets(buff,sizeof buff,fio))
 			printf("%s", buff);
 	fclose(fio);
 
+#ifndef CPU_ONLY
+	oclReleaseBuffers();
 	oclClean();
+#endif
 	free(plainText);
 	free(cpuCipherText);
 	free(gpuCipherText);
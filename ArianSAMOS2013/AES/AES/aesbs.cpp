@@ -0,0 +1,529 @@
+/*
+ * aesbs.cpp
+ *
+ *  Bitsliced, constant-time AES engine of the AES benchmark's CPU path, see aesbs.h.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "aesbs.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+ #define BS_INLINE	inline __attribute__((always_inline))
+ #if defined(__x86_64__) || defined(__i386__)
+  #define AESBS_AVX2
+  typedef uint64_t bs_avx2 __attribute__((vector_size(32)));
+ #endif
+ #if defined(__ARM_NEON) || defined(__aarch64__)
+  #define AESBS_NEON
+  typedef uint64_t bs_neon __attribute__((vector_size(16)));
+ #endif
+#else
+ #define BS_INLINE	__forceinline
+#endif
+
+#define BS_PORTABLE		0
+#define BS_NEON			1
+#define BS_AVX2			2
+
+static int variant = -1;
+
+static int bs_variant()
+{
+	if (variant < 0)
+	{
+		int v = BS_PORTABLE;
+#ifdef AESBS_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			v = BS_AVX2;
+#endif
+#ifdef AESBS_NEON
+		v = BS_NEON;
+#endif
+		variant = v;
+	}
+	return variant;
+}
+
+int aesbsBlocks()
+{
+	static const int blocks[] = {4, 8, 16};
+	return blocks[bs_variant()];
+}
+
+const char *aesbsName()
+{
+	static const char *names[] = {"64-bit", "NEON", "AVX2"};
+	return names[bs_variant()];
+}
+
+/*
+ * Moves bit b of every byte into word b (and back, the transform is its own inverse):
+ * q[0..3] and q[4..7] hold the interleaved halves of four blocks.
+ */
+static void bs_ortho(uint64_t *q)
+{
+#define SWAPN(cl, ch, s, x, y)	do { \
+		uint64_t a = (x), b = (y); \
+		(x) = (a & (uint64_t)(cl)) | ((b & (uint64_t)(cl)) << (s)); \
+		(y) = ((a & (uint64_t)(ch)) >> (s)) | (b & (uint64_t)(ch)); \
+	} while (0)
+#define SWAP2(x, y)		SWAPN(0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y)
+#define SWAP4(x, y)		SWAPN(0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y)
+#define SWAP8(x, y)		SWAPN(0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y)
+
+	SWAP2(q[0], q[1]);
+	SWAP2(q[2], q[3]);
+	SWAP2(q[4], q[5]);
+	SWAP2(q[6], q[7]);
+
+	SWAP4(q[0], q[2]);
+	SWAP4(q[1], q[3]);
+	SWAP4(q[4], q[6]);
+	SWAP4(q[5], q[7]);
+
+	SWAP8(q[0], q[4]);
+	SWAP8(q[1], q[5]);
+	SWAP8(q[2], q[6]);
+	SWAP8(q[3], q[7]);
+
+#undef SWAP8
+#undef SWAP4
+#undef SWAP2
+#undef SWAPN
+}
+
+/* The four little-endian words of a block into the even and odd bytes of two words */
+static void bs_interleave_in(uint64_t *q0, uint64_t *q1, const uint32_t *w)
+{
+	uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+
+	x0 |= (x0 << 16);
+	x1 |= (x1 << 16);
+	x2 |= (x2 << 16);
+	x3 |= (x3 << 16);
+	x0 &= 0x0000FFFF0000FFFFULL;
+	x1 &= 0x0000FFFF0000FFFFULL;
+	x2 &= 0x0000FFFF0000FFFFULL;
+	x3 &= 0x0000FFFF0000FFFFULL;
+	x0 |= (x0 << 8);
+	x1 |= (x1 << 8);
+	x2 |= (x2 << 8);
+	x3 |= (x3 << 8);
+	x0 &= 0x00FF00FF00FF00FFULL;
+	x1 &= 0x00FF00FF00FF00FFULL;
+	x2 &= 0x00FF00FF00FF00FFULL;
+	x3 &= 0x00FF00FF00FF00FFULL;
+	*q0 = x0 | (x2 << 8);
+	*q1 = x1 | (x3 << 8);
+}
+
+static void bs_interleave_out(uint32_t *w, uint64_t q0, uint64_t q1)
+{
+	uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL;
+	uint64_t x1 = q1 & 0x00FF00FF00FF00FFULL;
+	uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+	uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+
+	x0 |= (x0 >> 8);
+	x1 |= (x1 >> 8);
+	x2 |= (x2 >> 8);
+	x3 |= (x3 >> 8);
+	x0 &= 0x0000FFFF0000FFFFULL;
+	x1 &= 0x0000FFFF0000FFFFULL;
+	x2 &= 0x0000FFFF0000FFFFULL;
+	x3 &= 0x0000FFFF0000FFFFULL;
+	w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16);
+	w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+	w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16);
+	w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+void aesbsExpandKey(const int *rdKey, int rounds, unsigned long long *skey)
+{
+	for (int r=0; r<=rounds; r++)
+	{
+		uint64_t q[8];
+		uint32_t w[4];
+
+		// the same round key in all four block positions
+		memcpy(w, rdKey + 4 * r, sizeof(w));
+		for (int i=0; i<4; i++)
+			bs_interleave_in(&q[i], &q[i + 4], w);
+		bs_ortho(q);
+		for (int b=0; b<8; b++)
+			skey[8 * r + b] = q[b];
+	}
+}
+
+/* SubBytes on all 16 bytes of every block, the circuit of Boyar and Peralta */
+template <class W>
+static BS_INLINE void bs_sbox(W *q)
+{
+	W x0, x1, x2, x3, x4, x5, x6, x7;
+	W y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	W y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	W y20, y21;
+	W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	W z10, z11, z12, z13, z14, z15, z16, z17;
+	W t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	W t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	W t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	W t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	W t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	W t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	W t60, t61, t62, t63, t64, t65, t66, t67;
+	W s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	// top linear transformation
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	// non-linear section
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	// bottom linear transformation
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+template <class W>
+static BS_INLINE void bs_shift_rows(W *q)
+{
+	for (int i=0; i<8; i++)
+	{
+		W x = q[i];
+		q[i] = (x & (uint64_t)0x000000000000FFFFULL)
+			 | ((x & (uint64_t)0x00000000FFF00000ULL) >> 4)
+			 | ((x & (uint64_t)0x00000000000F0000ULL) << 12)
+			 | ((x & (uint64_t)0x0000FF0000000000ULL) >> 8)
+			 | ((x & (uint64_t)0x000000FF00000000ULL) << 8)
+			 | ((x & (uint64_t)0xF000000000000000ULL) >> 12)
+			 | ((x & (uint64_t)0x0FFF000000000000ULL) << 4);
+	}
+}
+
+template <class W>
+static BS_INLINE void bs_mix_columns(W *q)
+{
+	W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+	W r0 = (q0 >> 16) | (q0 << 48);
+	W r1 = (q1 >> 16) | (q1 << 48);
+	W r2 = (q2 >> 16) | (q2 << 48);
+	W r3 = (q3 >> 16) | (q3 << 48);
+	W r4 = (q4 >> 16) | (q4 << 48);
+	W r5 = (q5 >> 16) | (q5 << 48);
+	W r6 = (q6 >> 16) | (q6 << 48);
+	W r7 = (q7 >> 16) | (q7 << 48);
+	W t;
+
+#define ROTR32(x)	(t = (x), (t << 32) | (t >> 32))
+	q[0] = q7 ^ r7 ^ r0 ^ ROTR32(q0 ^ r0);
+	q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ ROTR32(q1 ^ r1);
+	q[2] = q1 ^ r1 ^ r2 ^ ROTR32(q2 ^ r2);
+	q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ ROTR32(q3 ^ r3);
+	q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ ROTR32(q4 ^ r4);
+	q[5] = q4 ^ r4 ^ r5 ^ ROTR32(q5 ^ r5);
+	q[6] = q5 ^ r5 ^ r6 ^ ROTR32(q6 ^ r6);
+	q[7] = q6 ^ r6 ^ r7 ^ ROTR32(q7 ^ r7);
+#undef ROTR32
+}
+
+template <class W>
+static BS_INLINE void bs_add_round_key(W *q, const W *sk)
+{
+	for (int i=0; i<8; i++)
+		q[i] ^= sk[i];
+}
+
+template <class W>
+static BS_INLINE void bs_encrypt(W *q, const W *sk, int rounds)
+{
+	bs_add_round_key(q, sk);
+	for (int r=1; r<rounds; r++)
+	{
+		bs_sbox(q);
+		bs_shift_rows(q);
+		bs_mix_columns(q);
+		bs_add_round_key(q, sk + 8 * r);
+	}
+	bs_sbox(q);
+	bs_shift_rows(q);
+	bs_add_round_key(q, sk + 8 * rounds);
+}
+
+/* The round keys in every lane of W */
+template <class W>
+static BS_INLINE void bs_load_keys(W *sk, const int *rdKey, int rounds)
+{
+	unsigned long long skey[8 * 15];
+	uint64_t lanes[sizeof(W) / 8];
+
+	aesbsExpandKey(rdKey, rounds, skey);
+	for (int i=0; i<8*(rounds+1); i++)
+	{
+		for (size_t j=0; j<sizeof(W)/8; j++)
+			lanes[j] = skey[i];
+		memcpy(&sk[i], lanes, sizeof(W));
+	}
+}
+
+/* Encrypts the 4 * (sizeof(W) / 8) blocks of in into out, which may be the same; lane j holds blocks 4j..4j+3 */
+template <class W>
+static BS_INLINE void bs_blocks(const unsigned char *in, unsigned char *out, const W *sk, int rounds)
+{
+	const int lanes = sizeof(W) / 8;
+	uint64_t qs[8 * lanes];
+	uint64_t t[8];
+	uint32_t w[16];
+	W q[8];
+
+	for (int g=0; g<lanes; g++)
+	{
+		memcpy(w, in + 64 * g, sizeof(w));
+		for (int i=0; i<4; i++)
+			bs_interleave_in(&t[i], &t[i + 4], w + 4 * i);
+		bs_ortho(t);
+		for (int b=0; b<8; b++)
+			qs[b * lanes + g] = t[b];
+	}
+	memcpy(q, qs, sizeof(q));
+	bs_encrypt(q, sk, rounds);
+	memcpy(qs, q, sizeof(q));
+	for (int g=0; g<lanes; g++)
+	{
+		for (int b=0; b<8; b++)
+			t[b] = qs[b * lanes + g];
+		bs_ortho(t);
+		for (int i=0; i<4; i++)
+			bs_interleave_out(w + 4 * i, t[i], t[i + 4]);
+		memcpy(out + 64 * g, w, sizeof(w));
+	}
+}
+
+template <class W>
+static BS_INLINE void bs_ecb(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds)
+{
+	const size_t step = 4 * sizeof(W) / 8;
+	unsigned char last[16 * AESBS_MAX_BLOCKS];
+	W sk[8 * 15];
+	size_t i = 0;
+
+	bs_load_keys(sk, rdKey, rounds);
+	for (; i + step <= blocks; i += step)
+		bs_blocks(in + 16 * i, out + 16 * i, sk, rounds);
+	if (i < blocks)
+	{
+		memset(last, 0, sizeof(last));
+		memcpy(last, in + 16 * i, 16 * (blocks - i));
+		bs_blocks(last, last, sk, rounds);
+		memcpy(out + 16 * i, last, 16 * (blocks - i));
+	}
+}
+
+template <class W>
+static BS_INLINE void bs_ctr(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+							 unsigned long long ctrHi, unsigned long long ctrLo)
+{
+	const size_t step = 4 * sizeof(W) / 8;
+	unsigned char key[16 * AESBS_MAX_BLOCKS];
+	W sk[8 * 15];
+
+	bs_load_keys(sk, rdKey, rounds);
+	for (size_t i=0; 16 * i < len; i += step)
+	{
+		// the counter blocks in big-endian order
+		for (size_t j=0; j<step; j++)
+		{
+			unsigned long long lo = ctrLo + i + j;
+			unsigned long long hi = ctrHi + (lo < ctrLo);
+			for (int b=0; b<8; b++)
+			{
+				key[16 * j + b] = (unsigned char)(hi >> (56 - 8 * b));
+				key[16 * j + 8 + b] = (unsigned char)(lo >> (56 - 8 * b));
+			}
+		}
+		bs_blocks(key, key, sk, rounds);
+		size_t n = (len - 16 * i < 16 * step) ? len - 16 * i : 16 * step;
+		for (size_t b=0; b<n; b++)
+			out[16 * i + b] = in[16 * i + b] ^ key[b];
+	}
+}
+
+#ifdef AESBS_AVX2
+__attribute__((target("avx2"))) static void ecb_avx2(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds)
+{
+	bs_ecb<bs_avx2>(in, out, blocks, rdKey, rounds);
+}
+
+__attribute__((target("avx2"))) static void ctr_avx2(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+													 unsigned long long ctrHi, unsigned long long ctrLo)
+{
+	bs_ctr<bs_avx2>(in, out, len, rdKey, rounds, ctrHi, ctrLo);
+}
+#endif
+
+void aesbsEncryptECB(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds)
+{
+#ifdef AESBS_AVX2
+	if (bs_variant() == BS_AVX2)
+	{
+		ecb_avx2(in, out, blocks, rdKey, rounds);
+		return;
+	}
+#endif
+#ifdef AESBS_NEON
+	bs_ecb<bs_neon>(in, out, blocks, rdKey, rounds);
+#else
+	bs_ecb<uint64_t>(in, out, blocks, rdKey, rounds);
+#endif
+}
+
+void aesbsEncryptCTR(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+					 unsigned long long ctrHi, unsigned long long ctrLo)
+{
+#ifdef AESBS_AVX2
+	if (bs_variant() == BS_AVX2)
+	{
+		ctr_avx2(in, out, len, rdKey, rounds, ctrHi, ctrLo);
+		return;
+	}
+#endif
+#ifdef AESBS_NEON
+	bs_ctr<bs_neon>(in, out, len, rdKey, rounds, ctrHi, ctrLo);
+#else
+	bs_ctr<uint64_t>(in, out, len, rdKey, rounds, ctrHi, ctrLo);
+#endif
+}
@@ -0,0 +1,53 @@
+/*
+ * aesbs.h
+ *
+ *  Bitsliced, constant-time AES engine of the AES benchmark's CPU path.
+ *
+ *  The T-table rounds index AESEncryptTable with key-dependent bytes, so
+ *  their timing depends on what the cache holds, and without AES
+ *  instructions they are the only fast path there is. The bitsliced form
+ *  keeps bit b of every byte of four blocks in one 64-bit word q[b] and
+ *  computes SubBytes as a 113-gate Boolean circuit (Boyar-Peralta),
+ *  ShiftRows as masks and shifts and MixColumns as rotations, so nothing
+ *  depends on the data but the values. The layout is the one of BearSSL's
+ *  aes_ct64.
+ *
+ *  The same code runs on a vector of 64-bit words with four blocks per
+ *  lane: 16 blocks per step in the AVX2 registers of x86 cores that have
+ *  them (checked at run time), 8 blocks in the NEON registers of ARM
+ *  cores, and 4 blocks in a plain 64-bit word elsewhere and with
+ *  compilers without vector extensions.
+ *
+ *  The round keys are the rd_key words of aes_key (data.h); the functions
+ *  bring them into the bitsliced form themselves. aesbsExpandKey gives
+ *  that form to the AES_*_bs kernels of kernel.cl, which run the 64-bit
+ *  code with four blocks per work-item.
+ */
+
+#ifndef AESBS_H_
+#define AESBS_H_
+
+#include <stddef.h>
+
+#define AESBS_MAX_BLOCKS	16		/* blocks per step of the widest variant */
+
+/* Blocks per step of the variant this CPU runs: 16 (AVX2), 8 (NEON) or 4 */
+int aesbsBlocks();
+/* Name of that variant */
+const char *aesbsName();
+
+/* The bitsliced round keys, 8 words per round, (rounds + 1) * 8 words */
+void aesbsExpandKey(const int *rdKey, int rounds, unsigned long long *skey);
+
+/* Encrypts blocks 16-byte blocks one by one (ECB) */
+void aesbsEncryptECB(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds);
+
+/*
+ * CTR mode over len bytes: block i is xored with the encryption of the
+ * 128-bit big-endian counter block (ctrHi, ctrLo) + i, a last partial
+ * block with the start of it.
+ */
+void aesbsEncryptCTR(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+					 unsigned long long ctrHi, unsigned long long ctrLo);
+
+#endif /* AESBS_H_ */
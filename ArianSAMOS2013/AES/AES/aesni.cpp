@@ -0,0 +1,168 @@
+/*
+ * aesni.cpp
+ *
+ *  AES-NI engine of the AES benchmark's CPU path, see aesni.h.
+ */
+
+#include "aesni.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+ #define AESNI_X86
+ #include <wmmintrin.h>
+ #include <emmintrin.h>
+ #include <tmmintrin.h>
+ #ifdef _MSC_VER
+  #include <intrin.h>
+  #define AESNI_TARGET
+ #else
+  #include <cpuid.h>
+  #define AESNI_TARGET	__attribute__((target("sse2,ssse3,aes")))
+ #endif
+#endif
+
+#ifdef AESNI_X86
+
+int aesniAvailable()
+{
+	unsigned int a = 0, b = 0, c = 0, d = 0;
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 1);
+	c = (unsigned int)r[2];
+	d = (unsigned int)r[3];
+#else
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+#endif
+	// CPUID.1: ECX bit 25 AES and bit 9 SSSE3, EDX bit 26 SSE2
+	return ((c >> 25) & 1) && ((c >> 9) & 1) && ((d >> 26) & 1);
+}
+
+static inline unsigned long long bswap64(unsigned long long x)
+{
+#ifdef _MSC_VER
+	return _byteswap_uint64(x);
+#else
+	return __builtin_bswap64(x);
+#endif
+}
+
+AESNI_TARGET static inline void load_keys(__m128i *k, const int *rdKey, int rounds)
+{
+	for (int r=0; r<=rounds; r++)
+		k[r] = _mm_loadu_si128((const __m128i *)rdKey + r);
+}
+
+AESNI_TARGET static inline __m128i encrypt_block(__m128i b, const __m128i *k, int rounds)
+{
+	b = _mm_xor_si128(b, k[0]);
+	for (int r=1; r<rounds; r++)
+		b = _mm_aesenc_si128(b, k[r]);
+	return _mm_aesenclast_si128(b, k[rounds]);
+}
+
+// the rounds of AESNI_LANES blocks, interleaved so the aesenc of one block hides the latency of the others
+AESNI_TARGET static inline void encrypt_lanes(__m128i *b, const __m128i *k, int rounds)
+{
+	for (int l=0; l<AESNI_LANES; l++)
+		b[l] = _mm_xor_si128(b[l], k[0]);
+	for (int r=1; r<rounds; r++)
+		for (int l=0; l<AESNI_LANES; l++)
+			b[l] = _mm_aesenc_si128(b[l], k[r]);
+	for (int l=0; l<AESNI_LANES; l++)
+		b[l] = _mm_aesenclast_si128(b[l], k[rounds]);
+}
+
+// the counter block (hi, lo) + n, the bytes in big-endian order
+AESNI_TARGET static inline __m128i counter_block(unsigned long long hi, unsigned long long lo, unsigned long long n)
+{
+	unsigned long long l = lo + n;
+	hi += (l < n);
+	return _mm_set_epi64x((long long)bswap64(l), (long long)bswap64(hi));
+}
+
+AESNI_TARGET void aesniEncryptECB(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds)
+{
+	__m128i k[15];
+	__m128i b[AESNI_LANES];
+	size_t i = 0;
+
+	load_keys(k, rdKey, rounds);
+	for (; i + AESNI_LANES <= blocks; i += AESNI_LANES)
+	{
+		for (int l=0; l<AESNI_LANES; l++)
+			b[l] = _mm_loadu_si128((const __m128i *)in + i + l);
+		encrypt_lanes(b, k, rounds);
+		for (int l=0; l<AESNI_LANES; l++)
+			_mm_storeu_si128((__m128i *)out + i + l, b[l]);
+	}
+	for (; i < blocks; i++)
+		_mm_storeu_si128((__m128i *)out + i, encrypt_block(_mm_loadu_si128((const __m128i *)in + i), k, rounds));
+}
+
+AESNI_TARGET void aesniEncryptCTR(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+								  unsigned long long ctrHi, unsigned long long ctrLo)
+{
+	__m128i k[15];
+	__m128i b[AESNI_LANES];
+	size_t blocks = len / 16;
+	size_t i = 0;
+
+	load_keys(k, rdKey, rounds);
+	if (ctrLo + blocks >= ctrLo)
+	{
+		// no carry into the upper half: the counter is added as a little-endian (lo, hi) pair and byte-reversed
+		const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		const __m128i one = _mm_set_epi64x(0, 1);
+		__m128i ctr = _mm_set_epi64x((long long)ctrHi, (long long)ctrLo);
+		for (; i + AESNI_LANES <= blocks; i += AESNI_LANES)
+		{
+			for (int l=0; l<AESNI_LANES; l++)
+			{
+				b[l] = _mm_shuffle_epi8(ctr, reverse);
+				ctr = _mm_add_epi64(ctr, one);
+			}
+			encrypt_lanes(b, k, rounds);
+			for (int l=0; l<AESNI_LANES; l++)
+				_mm_storeu_si128((__m128i *)out + i + l, _mm_xor_si128(b[l], _mm_loadu_si128((const __m128i *)in + i + l)));
+		}
+	}
+	for (; i + AESNI_LANES <= blocks; i += AESNI_LANES)
+	{
+		for (int l=0; l<AESNI_LANES; l++)
+			b[l] = counter_block(ctrHi, ctrLo, i + l);
+		encrypt_lanes(b, k, rounds);
+		for (int l=0; l<AESNI_LANES; l++)
+			_mm_storeu_si128((__m128i *)out + i + l, _mm_xor_si128(b[l], _mm_loadu_si128((const __m128i *)in + i + l)));
+	}
+	for (; i < blocks; i++)
+	{
+		__m128i key = encrypt_block(counter_block(ctrHi, ctrLo, i), k, rounds);
+		_mm_storeu_si128((__m128i *)out + i, _mm_xor_si128(key, _mm_loadu_si128((const __m128i *)in + i)));
+	}
+	if (len % 16 != 0)
+	{
+		unsigned char key[16];
+		_mm_storeu_si128((__m128i *)key, encrypt_block(counter_block(ctrHi, ctrLo, blocks), k, rounds));
+		for (size_t j = blocks * 16; j < len; j++)
+			out[j] = in[j] ^ key[j - blocks * 16];
+	}
+}
+
+#else /* AESNI_X86 */
+
+int aesniAvailable()
+{
+	return 0;
+}
+
+void aesniEncryptECB(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds)
+{
+}
+
+void aesniEncryptCTR(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+					 unsigned long long ctrHi, unsigned long long ctrLo)
+{
+}
+
+#endif /* AESNI_X86 */
@@ -0,0 +1,42 @@
+/*
+ * aesni.h
+ *
+ *  AES-NI engine of the AES benchmark's CPU path.
+ *
+ *  The T-table path in aes.cpp encrypts one block per loop iteration with
+ *  sixteen table lookups per round. On x86 cores with the AES instructions
+ *  one aesenc does a whole round, but its latency is several cycles while
+ *  a new one can issue every cycle, so a single block leaves the unit
+ *  mostly idle. These functions keep AESNI_LANES independent blocks in
+ *  flight, every round is issued for all of them before the next, and
+ *  encrypt the remainder one block at a time.
+ *
+ *  The round keys are the rd_key words of aes_key (data.h), whose bytes
+ *  are the key schedule in FIPS-197 order, so they load straight into the
+ *  registers. aesniAvailable checks CPUID at run time; the functions are
+ *  compiled for AES-NI through a target attribute, so the file needs no
+ *  -maes, and they are empty off x86, where aesniAvailable returns 0.
+ */
+
+#ifndef AESNI_H_
+#define AESNI_H_
+
+#include <stddef.h>
+
+#define AESNI_LANES		8		/* blocks in flight */
+
+/* 1 when the CPU has the AES instructions */
+int aesniAvailable();
+
+/* Encrypts blocks 16-byte blocks one by one (ECB) */
+void aesniEncryptECB(const unsigned char *in, unsigned char *out, size_t blocks, const int *rdKey, int rounds);
+
+/*
+ * CTR mode over len bytes: block i is xored with the encryption of the
+ * 128-bit big-endian counter block (ctrHi, ctrLo) + i, a last partial
+ * block with the start of it.
+ */
+void aesniEncryptCTR(const unsigned char *in, unsigned char *out, size_t len, const int *rdKey, int rounds,
+					 unsigned long long ctrHi, unsigned long long ctrLo);
+
+#endif /* AESNI_H_ */
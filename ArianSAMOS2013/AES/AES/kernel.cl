@@ -266,6 +266,13 @@ __constant uint Te3[256] = {
 	0x7bcbb0b0U, 0xa8fc5454U, 0x6dd6bbbbU, 0x2c3a1616U, 
 };
 
+/* -D AES_ROUNDS=<n> (oclBuildVariant) turns the round count into a constant, else the rounds argument is used */
+#ifdef AES_ROUNDS
+ #define ROUNDS		AES_ROUNDS
+#else
+ #define ROUNDS		rounds
+#endif
+
 __kernel void AES_encryption(__global uint4 *plainText, __global uint4 *cipherText, __constant uint4 *rKeys, uint rounds) 
 {
 	uint gid = get_global_id(0);
@@ -273,7 +280,7 @@ __kernel void AES_encryption(__global uint4 *plainText, __global uint4 *cipherTe
 
 	s = plainText[gid] ^ rKeys[0];
 
-    uint r = rounds >> 1;
+    uint r = ROUNDS >> 1;
 	uint4 offset0, offset1, offset2, offset3;
     for (;;) {		
 		offset0 = s & 0xff;
@@ -316,28 +323,175 @@ __kernel void AES_encryption(__global uint4 *plainText, __global uint4 *cipherTe
 	cipherText[gid] = s;
 }
 
+// the Te tables in local memory, copied by the whole work-group; every work-item copies its own part,
+// strided so any work-group size fills the 256 entries
+void AES_load_tables(__local uint *Te_Local0, __local uint *Te_Local1, __local uint *Te_Local2, __local uint *Te_Local3)
+{
+	for (uint i = get_local_id(0); i < 256; i += get_local_size(0))
+	{
+		Te_Local0[i] = Te0[i];
+		Te_Local1[i] = Te1[i];
+		Te_Local2[i] = Te2[i];
+		Te_Local3[i] = Te3[i];
+	}
+	
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// encrypts the block s with the local Te tables
+uint4 AES_rounds_local(uint4 s, __constant uint4 *rKeys, uint rounds,
+					   __local uint *Te_Local0, __local uint *Te_Local1, __local uint *Te_Local2, __local uint *Te_Local3)
+{
+	uint4 t;
+	
+	s = s ^ rKeys[0];
+	
+    uint r = ROUNDS >> 1;
+	uint4 offset0, offset1, offset2, offset3;
+    for (;;) {		
+		offset0 = s & 0xff;
+		offset1 = (s.yzwx >> 8) & 0xff;
+		offset2 = (s.zwxy >> 16) & 0xff;
+		offset3 = (s.wxyz >> 24);
+		t = (uint4)(Te_Local0[offset0.x], Te_Local0[offset0.y], Te_Local0[offset0.z], Te_Local0[offset0.w]) ^
+			(uint4)(Te_Local1[offset1.x], Te_Local1[offset1.y], Te_Local1[offset1.z], Te_Local1[offset1.w]) ^
+			(uint4)(Te_Local2[offset2.x], Te_Local2[offset2.y], Te_Local2[offset2.z], Te_Local2[offset2.w]) ^
+			(uint4)(Te_Local3[offset3.x], Te_Local3[offset3.y], Te_Local3[offset3.z], Te_Local3[offset3.w]) ^
+			rKeys[1];
+		
+        rKeys += 2;
+        if (--r == 0) {
+            break;
+        }
+		
+		offset0 = t & 0xff;
+		offset1 = (t.yzwx >> 8) & 0xff;
+		offset2 = (t.zwxy >> 16) & 0xff;
+		offset3 = (t.wxyz >> 24);
+		s = (uint4)(Te_Local0[offset0.x], Te_Local0[offset0.y], Te_Local0[offset0.z], Te_Local0[offset0.w]) ^
+			(uint4)(Te_Local1[offset1.x], Te_Local1[offset1.y], Te_Local1[offset1.z], Te_Local1[offset1.w]) ^
+			(uint4)(Te_Local2[offset2.x], Te_Local2[offset2.y], Te_Local2[offset2.z], Te_Local2[offset2.w]) ^
+			(uint4)(Te_Local3[offset3.x], Te_Local3[offset3.y], Te_Local3[offset3.z], Te_Local3[offset3.w]) ^
+			rKeys[0];
+    }
+	
+	offset0 = (t.zwxy >> 16) & 0xff;
+	offset1 = (t.wxyz >> 24);
+	offset2 = t & 0xff;
+	offset3 = (t.yzwx >> 8) & 0xff;
+	
+	return ((uint4)(Te_Local2[offset2.x], Te_Local2[offset2.y], Te_Local2[offset2.z], Te_Local2[offset2.w]) & 0x000000ff) ^
+		   ((uint4)(Te_Local3[offset3.x], Te_Local3[offset3.y], Te_Local3[offset3.z], Te_Local3[offset3.w]) & 0x0000ff00) ^
+		   ((uint4)(Te_Local0[offset0.x], Te_Local0[offset0.y], Te_Local0[offset0.z], Te_Local0[offset0.w]) & 0x00ff0000) ^
+		   ((uint4)(Te_Local1[offset1.x], Te_Local1[offset1.y], Te_Local1[offset1.z], Te_Local1[offset1.w]) & 0xff000000) ^
+		   rKeys[0];
+}
+
 __kernel void AES_encrypt_local(__global uint4 *plainText, __global uint4 *cipherText, __constant uint4 *rKeys, uint rounds)
 {
 	uint global_id = get_global_id(0);
-	uint local_id = get_local_id(0);
-	uint4 s, t;
 	
 	__local uint Te_Local0[256];
 	__local uint Te_Local1[256];
 	__local uint Te_Local2[256];
 	__local uint Te_Local3[256];
 	
-	// everyone copy his own part
-	Te_Local0[local_id] = Te0[local_id];
-	Te_Local1[local_id] = Te1[local_id];
-	Te_Local2[local_id] = Te2[local_id];
-	Te_Local3[local_id] = Te3[local_id];
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
 	
-	barrier(CLK_LOCAL_MEM_FENCE);
+	cipherText[global_id] = AES_rounds_local(plainText[global_id], rKeys, rounds, Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+}
+
+// the first n bytes of the block in xored with the key stream k into out, for a last block of n < 16 bytes
+void AES_xor_tail(__global const uint4 *in, __global uint4 *out, uint4 k, uint n)
+{
+	uint key[4] = {k.x, k.y, k.z, k.w};
+	__global const uchar *src = (__global const uchar *)in;
+	__global uchar *dst = (__global uchar *)out;
+	
+	for (uint b = 0; b < n; b++)
+		dst[b] = src[b] ^ ((uchar *)key)[b];
+}
+
+/*
+ * CTR mode (NIST SP 800-38A): block i is xored with the encryption of the counter block ctr + i.
+ * ctr is the initial counter block as four big-endian words, ctr.x the most significant, and the
+ * 128-bit sum is formed per work-item, so no block depends on another. The linear id covers the
+ * 2D launch of the VIVANTE build and the global offset of the pipelined chunks. The launch is padded
+ * to whole work-groups and the text is len bytes, so work-items past it only help load the tables
+ * and a last partial block is written byte by byte.
+ */
+__kernel void AES_ctr_local(__global uint4 *plainText, __global uint4 *cipherText, __constant uint4 *rKeys, uint rounds, uint4 ctr, uint len)
+{
+	ulong block = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	
+	__local uint Te_Local0[256];
+	__local uint Te_Local1[256];
+	__local uint Te_Local2[256];
+	__local uint Te_Local3[256];
 	
-	s = plainText[global_id] ^ rKeys[0];
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (16 * block >= len)
+		return;
 	
-    uint r = rounds >> 1;
+	ulong lo = upsample(ctr.z, ctr.w) + block;
+	ulong hi = upsample(ctr.x, ctr.y) + (lo < block);
+	uint4 c = (uint4)((uint)(hi >> 32), (uint)hi, (uint)(lo >> 32), (uint)lo);
+	// the round code reads the block bytes as little-endian words
+	c = (rotate(c, (uint4)8) & 0x00ff00ff) | (rotate(c, (uint4)24) & 0xff00ff00);
+	
+	uint4 k = AES_rounds_local(c, rKeys, rounds, Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (len - 16 * block >= 16)
+		cipherText[block] = plainText[block] ^ k;
+	else
+		AES_xor_tail(plainText + block, cipherText + block, k, (uint)(len - 16 * block));
+}
+
+/*
+ * Many keys in one launch: AES_expand_keys computes the schedules of numKeys keys of nk 32-bit words, one
+ * work-item per key, and the keyed kernels encrypt block i with schedule keyIndex[i]. Every schedule takes
+ * AES_KEY_WORDS words, the size of AES-256, and all keys of a launch have the same length.
+ */
+#define AES_KEY_WORDS	60
+
+// S[x] is the low byte of Te2[x], which is how the last round above reads it
+#define AES_SBOX(x)		(Te2[(x)] & 0xff)
+
+__kernel void AES_expand_keys(__global const uint *keys, __global uint *rdKeys, uint nk, uint numKeys)
+{
+	uint k = get_global_id(0);
+	uint w[AES_KEY_WORDS];
+	uint rcon = 1;
+	
+	if (k >= numKeys)
+		return;
+	for (uint i = 0; i < nk; i++)
+		w[i] = keys[nk * k + i];
+	for (uint i = nk; i < 4 * (nk + 7); i++)
+	{
+		uint t = w[i - 1];
+		// the first key byte is the low byte of a word, so RotWord is a rotation to the right
+		if (i % nk == 0)
+		{
+			t = (AES_SBOX((t >> 8) & 0xff) | (AES_SBOX((t >> 16) & 0xff) << 8) | (AES_SBOX(t >> 24) << 16) | (AES_SBOX(t & 0xff) << 24)) ^ rcon;
+			rcon = (rcon << 1) ^ ((rcon >> 7) * 0x11b);
+		}
+		else if (nk > 6 && i % nk == 4)
+			t = AES_SBOX(t & 0xff) | (AES_SBOX((t >> 8) & 0xff) << 8) | (AES_SBOX((t >> 16) & 0xff) << 16) | (AES_SBOX(t >> 24) << 24);
+		w[i] = w[i - nk] ^ t;
+	}
+	for (uint i = 0; i < 4 * (nk + 7); i++)
+		rdKeys[AES_KEY_WORDS * k + i] = w[i];
+}
+
+// AES_rounds_local with the round keys in global memory, where the schedules of a batch do not fit constant memory
+uint4 AES_rounds_global(uint4 s, __global const uint4 *rKeys, uint rounds,
+						__local uint *Te_Local0, __local uint *Te_Local1, __local uint *Te_Local2, __local uint *Te_Local3)
+{
+	uint4 t;
+	
+	s = s ^ rKeys[0];
+	
+    uint r = ROUNDS >> 1;
 	uint4 offset0, offset1, offset2, offset3;
     for (;;) {		
 		offset0 = s & 0xff;
@@ -371,11 +525,422 @@ __kernel void AES_encrypt_local(__global uint4 *plainText, __global uint4 *ciphe
 	offset2 = t & 0xff;
 	offset3 = (t.yzwx >> 8) & 0xff;
 	
-	s = ((uint4)(Te_Local2[offset2.x], Te_Local2[offset2.y], Te_Local2[offset2.z], Te_Local2[offset2.w]) & 0x000000ff) ^
-		((uint4)(Te_Local3[offset3.x], Te_Local3[offset3.y], Te_Local3[offset3.z], Te_Local3[offset3.w]) & 0x0000ff00) ^
-		((uint4)(Te_Local0[offset0.x], Te_Local0[offset0.y], Te_Local0[offset0.z], Te_Local0[offset0.w]) & 0x00ff0000) ^
-		((uint4)(Te_Local1[offset1.x], Te_Local1[offset1.y], Te_Local1[offset1.z], Te_Local1[offset1.w]) & 0xff000000) ^
-		rKeys[0];
+	return ((uint4)(Te_Local2[offset2.x], Te_Local2[offset2.y], Te_Local2[offset2.z], Te_Local2[offset2.w]) & 0x000000ff) ^
+		   ((uint4)(Te_Local3[offset3.x], Te_Local3[offset3.y], Te_Local3[offset3.z], Te_Local3[offset3.w]) & 0x0000ff00) ^
+		   ((uint4)(Te_Local0[offset0.x], Te_Local0[offset0.y], Te_Local0[offset0.z], Te_Local0[offset0.w]) & 0x00ff0000) ^
+		   ((uint4)(Te_Local1[offset1.x], Te_Local1[offset1.y], Te_Local1[offset1.z], Te_Local1[offset1.w]) & 0xff000000) ^
+		   rKeys[0];
+}
+
+// AES_encrypt_local with the key of every block picked by keyIndex; the text is len bytes and a last partial
+// block is left alone like on the CPU
+__kernel void AES_encrypt_keyed(__global uint4 *plainText, __global uint4 *cipherText, __global const uint4 *rKeys, uint rounds,
+								__global const uint *keyIndex, uint len)
+{
+	ulong block = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	
+	__local uint Te_Local0[256];
+	__local uint Te_Local1[256];
+	__local uint Te_Local2[256];
+	__local uint Te_Local3[256];
 	
-	cipherText[global_id] = s;
-}
\ No newline at end of file
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (block >= len / 16)
+		return;
+	
+	cipherText[block] = AES_rounds_global(plainText[block], rKeys + AES_KEY_WORDS / 4 * keyIndex[block], rounds,
+										  Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+}
+
+// AES_ctr_local with the key of every block picked by keyIndex; the counter block still is ctr + block
+__kernel void AES_ctr_keyed(__global uint4 *plainText, __global uint4 *cipherText, __global const uint4 *rKeys, uint rounds, uint4 ctr,
+							__global const uint *keyIndex, uint len)
+{
+	ulong block = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	
+	__local uint Te_Local0[256];
+	__local uint Te_Local1[256];
+	__local uint Te_Local2[256];
+	__local uint Te_Local3[256];
+	
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (16 * block >= len)
+		return;
+	
+	ulong lo = upsample(ctr.z, ctr.w) + block;
+	ulong hi = upsample(ctr.x, ctr.y) + (lo < block);
+	uint4 c = (uint4)((uint)(hi >> 32), (uint)hi, (uint)(lo >> 32), (uint)lo);
+	c = (rotate(c, (uint4)8) & 0x00ff00ff) | (rotate(c, (uint4)24) & 0xff00ff00);
+	
+	uint4 k = AES_rounds_global(c, rKeys + AES_KEY_WORDS / 4 * keyIndex[block], rounds, Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (len - 16 * block >= 16)
+		cipherText[block] = plainText[block] ^ k;
+	else
+		AES_xor_tail(plainText + block, cipherText + block, k, (uint)(len - 16 * block));
+}
+
+/*
+ * Batches of messages (--batch): msgs describes numMsgs messages packed into in and out, each at an offset that
+ * is a multiple of 16, with its own length, key and initial counter block, and counts its first block over
+ * the whole batch. One work-item encrypts one block of any message, so a batch of packets of any sizes is one
+ * launch of numBlocks work-items; the message of a block is found by a binary search on firstBlock.
+ */
+typedef struct
+{
+	uint	offset;
+	uint	length;
+	uint	key;
+	uint	firstBlock;
+	uint4	iv;			// four big-endian words like ctr of AES_ctr_local
+} aes_msg;
+
+uint AES_batch_message(__global const aes_msg *msgs, uint numMsgs, uint block)
+{
+	uint lo = 0, hi = numMsgs - 1;
+	
+	// the last message that starts at or before the block
+	while (lo < hi)
+	{
+		uint mid = (lo + hi + 1) >> 1;
+		if (msgs[mid].firstBlock <= block)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+// ECB, the lengths are whole blocks and the iv is not used
+__kernel void AES_encrypt_batch(__global const uint4 *in, __global uint4 *out, __global const uint4 *rKeys, uint rounds,
+								__global const aes_msg *msgs, uint numMsgs, uint numBlocks)
+{
+	uint block = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	
+	__local uint Te_Local0[256];
+	__local uint Te_Local1[256];
+	__local uint Te_Local2[256];
+	__local uint Te_Local3[256];
+	
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (block >= numBlocks)
+		return;
+	
+	aes_msg m = msgs[AES_batch_message(msgs, numMsgs, block)];
+	uint i = m.offset / 16 + block - m.firstBlock;
+	out[i] = AES_rounds_global(in[i], rKeys + AES_KEY_WORDS / 4 * m.key, rounds, Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+}
+
+// CTR, block j of a message is xored with the encryption of iv + j; the last block of a message may be partial
+__kernel void AES_ctr_batch(__global const uint4 *in, __global uint4 *out, __global const uint4 *rKeys, uint rounds,
+							__global const aes_msg *msgs, uint numMsgs, uint numBlocks)
+{
+	uint block = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	
+	__local uint Te_Local0[256];
+	__local uint Te_Local1[256];
+	__local uint Te_Local2[256];
+	__local uint Te_Local3[256];
+	
+	AES_load_tables(Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	if (block >= numBlocks)
+		return;
+	
+	aes_msg m = msgs[AES_batch_message(msgs, numMsgs, block)];
+	uint j = block - m.firstBlock;
+	uint i = m.offset / 16 + j;
+	ulong lo = upsample(m.iv.z, m.iv.w) + j;
+	ulong hi = upsample(m.iv.x, m.iv.y) + (lo < j);
+	uint4 c = (uint4)((uint)(hi >> 32), (uint)hi, (uint)(lo >> 32), (uint)lo);
+	c = (rotate(c, (uint4)8) & 0x00ff00ff) | (rotate(c, (uint4)24) & 0xff00ff00);
+	uint4 k = AES_rounds_global(c, rKeys + AES_KEY_WORDS / 4 * m.key, rounds, Te_Local0, Te_Local1, Te_Local2, Te_Local3);
+	
+	if (m.length - 16 * j >= 16)
+		out[i] = in[i] ^ k;
+	else
+	{
+		// only the bytes of the message, the rest of the block may belong to nobody
+		uint key[4] = {k.x, k.y, k.z, k.w};
+		__global const uchar *src = (__global const uchar *)(in + i);
+		__global uchar *dst = (__global uchar *)(out + i);
+		for (uint b = 0; b < m.length - 16 * j; b++)
+			dst[b] = src[b] ^ ((uchar *)key)[b];
+	}
+}
+
+/*
+ * Bitsliced kernels (aesbs.h): no table lookups, so no timing that depends on the data. Every work-item
+ * encrypts 4 consecutive blocks with bit b of all their bytes in one ulong q[b]; SubBytes is a Boolean
+ * circuit, ShiftRows masks and shifts, MixColumns rotations. sk holds the round keys in that form,
+ * 8 ulongs per round (aesbsExpandKey), and the text is len bytes: ECB leaves a last partial block alone
+ * like the CPU path, CTR xors it byte by byte.
+ */
+
+#define AES_BS_SWAP(cl, ch, n, x, y)	{ ulong a = (x), b = (y); \
+										  (x) = (a & (cl)) | ((b & (cl)) << (n)); \
+										  (y) = ((a & (ch)) >> (n)) | (b & (ch)); }
+
+// moves bit b of every byte into word b and back
+void AES_bs_ortho(ulong *q)
+{
+	for (int i = 0; i < 8; i += 2)
+		AES_BS_SWAP(0x5555555555555555UL, 0xAAAAAAAAAAAAAAAAUL, 1, q[i], q[i + 1]);
+	for (int i = 0; i < 8; i += 4)
+	{
+		AES_BS_SWAP(0x3333333333333333UL, 0xCCCCCCCCCCCCCCCCUL, 2, q[i], q[i + 2]);
+		AES_BS_SWAP(0x3333333333333333UL, 0xCCCCCCCCCCCCCCCCUL, 2, q[i + 1], q[i + 3]);
+	}
+	for (int i = 0; i < 4; i++)
+		AES_BS_SWAP(0x0F0F0F0F0F0F0F0FUL, 0xF0F0F0F0F0F0F0F0UL, 4, q[i], q[i + 4]);
+}
+
+// the four little-endian words of a block into the even and odd bytes of two words
+void AES_bs_interleave_in(ulong *q0, ulong *q1, uint4 w)
+{
+	ulong4 x = convert_ulong4(w);
+	
+	x |= x << 16;
+	x &= 0x0000FFFF0000FFFFUL;
+	x |= x << 8;
+	x &= 0x00FF00FF00FF00FFUL;
+	*q0 = x.x | (x.z << 8);
+	*q1 = x.y | (x.w << 8);
+}
+
+uint4 AES_bs_interleave_out(ulong q0, ulong q1)
+{
+	ulong4 x = (ulong4)(q0, q1, q0 >> 8, q1 >> 8) & 0x00FF00FF00FF00FFUL;
+	
+	x |= x >> 8;
+	x &= 0x0000FFFF0000FFFFUL;
+	return convert_uint4(x) | convert_uint4(x >> 16);
+}
+
+// SubBytes on all 16 bytes of the 4 blocks, the circuit of Boyar and Peralta
+void AES_bs_sbox(ulong *q)
+{
+	ulong x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+	ulong y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+	ulong z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+	ulong t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	ulong t20, t21, t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	ulong t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	ulong t60, t61, t62, t63, t64, t65, t66, t67;
+	
+	// top linear transformation
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+	
+	// non-linear section
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+	
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+	
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+	
+	// bottom linear transformation
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	q[7] = t59 ^ t63;
+	q[1] = t56 ^ ~t62;
+	q[0] = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	q[4] = t53 ^ t66;
+	q[3] = t51 ^ t66;
+	q[2] = t47 ^ t65;
+	q[6] = t64 ^ ~q[4];
+	q[5] = t55 ^ ~t67;
+}
+
+void AES_bs_shift_rows(ulong *q)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		ulong x = q[i];
+		q[i] = (x & 0x000000000000FFFFUL)
+			 | ((x & 0x00000000FFF00000UL) >> 4)
+			 | ((x & 0x00000000000F0000UL) << 12)
+			 | ((x & 0x0000FF0000000000UL) >> 8)
+			 | ((x & 0x000000FF00000000UL) << 8)
+			 | ((x & 0xF000000000000000UL) >> 12)
+			 | ((x & 0x0FFF000000000000UL) << 4);
+	}
+}
+
+void AES_bs_mix_columns(ulong *q)
+{
+	ulong p[8], r[8], s[8];
+	
+	// r is every word rotated by one column, s the rotation by two of the sum
+	for (int i = 0; i < 8; i++)
+	{
+		p[i] = q[i];
+		r[i] = rotate(p[i], (ulong)48);
+		s[i] = rotate(p[i] ^ r[i], (ulong)32);
+	}
+	q[0] = p[7] ^ r[7] ^ r[0] ^ s[0];
+	q[1] = p[0] ^ r[0] ^ p[7] ^ r[7] ^ r[1] ^ s[1];
+	q[2] = p[1] ^ r[1] ^ r[2] ^ s[2];
+	q[3] = p[2] ^ r[2] ^ p[7] ^ r[7] ^ r[3] ^ s[3];
+	q[4] = p[3] ^ r[3] ^ p[7] ^ r[7] ^ r[4] ^ s[4];
+	q[5] = p[4] ^ r[4] ^ r[5] ^ s[5];
+	q[6] = p[5] ^ r[5] ^ r[6] ^ s[6];
+	q[7] = p[6] ^ r[6] ^ r[7] ^ s[7];
+}
+
+// the rounds on the 4 bitsliced blocks; the round keys are added as they are, they sit in every block position
+void AES_bs_rounds(ulong *q, __constant ulong *sk, uint rounds)
+{
+	for (int i = 0; i < 8; i++)
+		q[i] ^= sk[i];
+	for (uint r = 1; r < ROUNDS; r++)
+	{
+		AES_bs_sbox(q);
+		AES_bs_shift_rows(q);
+		AES_bs_mix_columns(q);
+		for (int i = 0; i < 8; i++)
+			q[i] ^= sk[8 * r + i];
+	}
+	AES_bs_sbox(q);
+	AES_bs_shift_rows(q);
+	for (int i = 0; i < 8; i++)
+		q[i] ^= sk[8 * ROUNDS + i];
+}
+
+__kernel void AES_encrypt_bs(__global uint4 *plainText, __global uint4 *cipherText, __constant ulong *sk, uint rounds, uint len)
+{
+	ulong first = (get_global_id(1) * get_global_size(0) + get_global_id(0)) * 4;
+	ulong numBlocks = len / 16;
+	ulong q[8];
+	
+	for (int i = 0; i < 4; i++)
+		AES_bs_interleave_in(&q[i], &q[i + 4], (first + i < numBlocks) ? plainText[first + i] : (uint4)0);
+	AES_bs_ortho(q);
+	AES_bs_rounds(q, sk, rounds);
+	AES_bs_ortho(q);
+	for (int i = 0; i < 4; i++)
+		if (first + i < numBlocks)
+			cipherText[first + i] = AES_bs_interleave_out(q[i], q[i + 4]);
+}
+
+// CTR mode like AES_ctr_local, the 4 counter blocks of the work-item go through the circuit together
+__kernel void AES_ctr_bs(__global uint4 *plainText, __global uint4 *cipherText, __constant ulong *sk, uint rounds, uint4 ctr, uint len)
+{
+	ulong first = (get_global_id(1) * get_global_size(0) + get_global_id(0)) * 4;
+	ulong q[8];
+	
+	for (int i = 0; i < 4; i++)
+	{
+		ulong lo = upsample(ctr.z, ctr.w) + first + i;
+		ulong hi = upsample(ctr.x, ctr.y) + (lo < first + i);
+		uint4 c = (uint4)((uint)(hi >> 32), (uint)hi, (uint)(lo >> 32), (uint)lo);
+		c = (rotate(c, (uint4)8) & 0x00ff00ff) | (rotate(c, (uint4)24) & 0xff00ff00);
+		AES_bs_interleave_in(&q[i], &q[i + 4], c);
+	}
+	AES_bs_ortho(q);
+	AES_bs_rounds(q, sk, rounds);
+	AES_bs_ortho(q);
+	for (int i = 0; i < 4; i++)
+		if (16 * (first + i) + 16 <= len)
+			cipherText[first + i] = plainText[first + i] ^ AES_bs_interleave_out(q[i], q[i + 4]);
+		else if (16 * (first + i) < len)
+			AES_xor_tail(plainText + first + i, cipherText + first + i, AES_bs_interleave_out(q[i], q[i + 4]), (uint)(len - 16 * (first + i)));
+}
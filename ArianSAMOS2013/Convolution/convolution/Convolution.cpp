@@ -13,12 +13,40 @@
  * Bug reports and fixes are truly welcome at unmesh.bordoloi@liu.se but has no guarantee of a reply :D
  */
 #include <stdio.h>
-#include <CL/cl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
-#include <omp.h>
+#ifndef CPU_ONLY
+ #include <CL/cl.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
 #include "bmp.h"
+#ifndef CPU_ONLY
+ #include "oclRuntime.h"
+ #include "oclProgramCache.h"
+ #include "oclHostMem.h"
+ #include "oclMemPool.h"
+ #include "oclPipeline.h"
+ #include "oclCoop.h"
+ #include "oclTune.h"
+ #include "oclRoofline.h"
+ #include "oclTrace.h"
+ #include "oclHandles.h"
+ #ifdef SAMOS_EMBED_KERNELS
+  #include "samosKernels.h"
+ #endif
+#endif
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchSweep.h"
+#include "benchServe.h"
+#include "benchArena.h"
+#include "benchScaling.h"
 
 // Include sys/time.h in Linux environments
 // #include <sys/time.h>
@@ -34,8 +62,7 @@
  #include <sys/time.h> // linux machines
 #endif
 
-// #define FERMI
-#define NUM_CORES		1
+// The platform and device are picked at run time, see ../../common/oclRuntime.h
 
 #define PLATFORM		0
 #define DEVICE			1
@@ -48,35 +75,40 @@
 #define WRDEV			8
 #define RDDEV			9
 #define CPU				10
+#define WRDEV_COPY		11		// copy path reference for --mem-mode alloc/use
+#define RDDEV_COPY		12
+#define PIPELINE		13		// WRDEV + KERNEL_EXEC + RDDEV overlapped, with --pipeline
+#define COOP			14		// one image shared by the device and the CPU, with --coop
+#define NUM_PHASES		15
+
+const char *phaseNames[NUM_PHASES] = {"PLATFORM", "DEVICE", "CONTEXT", "CMDQ", "PGM", "KERNEL",
+									  "KERNEL_EXEC", "BUFF", "WRDEV", "RDDEV", "CPU",
+									  "WRDEV_COPY", "RDDEV_COPY", "PIPELINE", "COOP"};
 
 #define BW				8
 #define BH				8
 
 #define WARP_SIZE		16
 
-cl_program 			clProgram;
+#ifndef CPU_ONLY
+ocl_handle<cl_program>	clProgram;
 cl_device_id 		clDeviceId;
 cl_context 			clContext;
-cl_mem 				clSrcImage;
-cl_mem 				clDstImage;
-cl_mem				clDstBuff;
-cl_mem				clFilterBuff;
-cl_mem				clTmpBuff;
-cl_sampler			clSampler;
-cl_kernel 			clKernel;
+ocl_handle<cl_mem>	clSrcImage;
+ocl_handle<cl_mem>	clDstImage;
+ocl_buffer<int>		clFilterBuff;
+ocl_handle<cl_sampler>	clSampler;
+ocl_handle<cl_kernel>	clKernel;
 cl_command_queue 	clCommandQueue;
 cl_int 				clErr;
-cl_event 			clEvent;
-#ifdef FERMI
-cl_platform_id 		clPlatformId[3];
-#else
-cl_platform_id		clPlatformId;
+ocl_runtime			clRuntime;
+ocl_pipeline		clPipeline;
+ocl_coop			clCoop;
+ocl_launch			convLaunch = {{BW, BH}, 0, 0.0, OCL_TUNE_DEFAULT};
 #endif
 
-FILE *fp;
 FILE *fio;
 char buff[256];
-char *kernelSrc;
 char description[256] = "Convolution, using image";
 int width;
 int height;
@@ -101,122 +133,73 @@ size_t origin[3] = {0, 0, 0};
 size_t region[3];
 int lineSize;
 
-struct timeval start[15];
-struct timeval stop[15];
-float timeRes[15] = {0};
+float timeRes[BENCH_MAX_PHASES] = {0};
 
 void start_measure_time(int seg)
 {
-    gettimeofday(&start[seg], NULL);
+	benchStart(seg);
 }
 
 void stop_measure_time(int seg)
 {
-    gettimeofday(&stop[seg], NULL);
-    timeRes[seg] = 1000 * ((float)(float)(stop[seg].tv_sec  - start[seg].tv_sec) + 1.0e-6 * (stop[seg].tv_usec - start[seg].tv_usec));
+	benchStop(seg);
 }
 
+#ifndef CPU_ONLY
 void oclInit()
 {
+	char options[OCL_OPTIONS_LEN] = "";
+
 	/*-----------------------get platform---------------------------*/
 	start_measure_time(PLATFORM);
-	#ifdef FERMI
-		if (clGetPlatformIDs(3, (cl_platform_id *)&clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId[1], CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#else
-		if (clGetPlatformIDs(1, &clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId, CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#endif
+	if (oclGetPlatforms(&clRuntime) == 0)
+		exit(1);
 	stop_measure_time(PLATFORM);
 
 	/*-----------------------get device-----------------------------*/
 	start_measure_time(DEVICE);
-	#ifdef FERMI
-		if (clGetDeviceIDs(clPlatformId[1], CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#else
-		if (clGetDeviceIDs(clPlatformId, CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#endif
-		else
-		{
-			clGetDeviceInfo(clDeviceId, CL_DEVICE_NAME, 200, buff, NULL);
-			printf("Device name: %s \n", buff);
-		}
+	if (oclSelectDevice(&clRuntime) != 0)
+		exit(1);
+	clDeviceId = clRuntime.device;
 	stop_measure_time(DEVICE);
 
 	/*-----------------------create context-------------------------*/
 	start_measure_time(CONTEXT);
-	clContext = clCreateContext(0, 1, (cl_device_id *) &clDeviceId, NULL, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating context!, clErr=%i \n", clErr);
-	else
-		printf("Context created! \n");
+	oclCreateContext(&clRuntime);
+	clContext = clRuntime.context;
 	stop_measure_time(CONTEXT);
 
 	/*---------------------create command queue---------------------*/
 	start_measure_time(CMDQ);
-	clCommandQueue = clCreateCommandQueue(clContext, clDeviceId, CL_QUEUE_PROFILING_ENABLE, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating command queue!, clErr=%i \n", clErr);
-	else
-		printf("Command queue created! \n");
+	oclCreateQueue(&clRuntime, CL_QUEUE_PROFILING_ENABLE);
+	clCommandQueue = clRuntime.queue;
+	if (oclPipelineCreate(&clRuntime, &clPipeline) != 0)
+		exit(1);
 	stop_measure_time(CMDQ);
 
 	/*------------------create and build program--------------------*/
+#ifdef SAMOS_EMBED_KERNELS
+	oclEmbedKernelSources(samosKernelSources);
+#endif
+	// a constant filter width lets the compiler unroll the filter loops
+	if (oclSpecializeEnabled())
+		oclDefine(options, "FILTER_WIDTH", filterWidth);
 	start_measure_time(PGM);
-	int filelen;
-	int readlen;
-
-	fp = fopen("kernel.cl", "r");
-	// getting size of the file
-	fseek(fp, 0, SEEK_END);  //set position indicator to the end of file
-	filelen = ftell(fp);	//return the current value of position indicator
-	rewind(fp);	//set position indicator to the beginning
-
-	kernelSrc = (char*) malloc(sizeof(char) * (filelen + 1));
-	readlen = fread(kernelSrc, 1, filelen, fp);
-	if (readlen < filelen)
-		kernelSrc[readlen] = '\0';
-	else
-		kernelSrc[filelen] = '\0';
-
-	clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program!, clErr=%i \n", clErr);
-	else
-		printf("Program created! \n");
-
-	clErr = clBuildProgram(clProgram, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 1!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program built! \n");
+	clProgram.reset(oclBuildVariant(&clRuntime, "kernel.cl", options));
+	if (clProgram == NULL)
+		exit(1);
 	stop_measure_time(PGM);
 
 	/*-----------------------create kernel------------------------*/
 	start_measure_time(KERNEL);
-	clKernel = clCreateKernel(clProgram, "convolution", &clErr);
+	clKernel.reset(clCreateKernel(clProgram, "convolution", &clErr));
 	if (clErr != CL_SUCCESS)
 			printf("Error in creating kernel!, clErr=%i \n", clErr);
 	else printf("Kernel created! \n");
-	fclose(fp);
-	free(kernelSrc);
 	stop_measure_time(KERNEL);
+
+	oclCoopInit(&clCoop);
+	oclRooflineMeasure(&clRuntime);
 }
 
 void oclBuffer()
@@ -227,39 +210,49 @@ void oclBuffer()
 	format.image_channel_order = CL_RGBA;
 	format.image_channel_data_type = CL_UNSIGNED_INT8;
 
-	clSrcImage = clCreateImage2D(clContext, 0, &format, width, height, 0, NULL, &clErr);
-	clDstImage = clCreateImage2D(clContext, 0, &format, width, height, 0, NULL, &clErr);
-	clFilterBuff = clCreateBuffer(clContext, 0, sizeof(int) * filterWidth * filterWidth, NULL, &clErr);
-	clSampler = clCreateSampler(clContext, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, NULL);
+	// with --mem-mode alloc/use the source pixels are placed in host-visible memory here, once
+	clSrcImage.reset(oclPoolImage2D(&clRuntime, 0, &format, width, height, 4, srcImg, &clErr));
+	clDstImage.reset(oclPoolImage2D(&clRuntime, 0, &format, width, height, 4, NULL, &clErr));
+	clFilterBuff.reset(oclPoolDeviceBuffer(&clRuntime, 0, sizeof(int) * filterWidth * filterWidth, &clErr), filterWidth * filterWidth);
+	clSampler.reset(clCreateSampler(clContext, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, NULL));
 	stop_measure_time(BUFF);
 
-	/*-----------------------write into device--------------------*/
-	start_measure_time(WRDEV);
 	region[0] = width;
 	region[1] = height;
 	region[2] = 1;
+}
 
-	clErr = clEnqueueWriteImage(clCommandQueue, clSrcImage, CL_TRUE, origin, region, 0, 0, srcImg, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing image!, clErr=%i \n", clErr);
-	clEnqueueWriteBuffer(clCommandQueue, clFilterBuff, CL_TRUE, 0, sizeof(int) * filterWidth * filterWidth, filter, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing buffer!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+void oclWrite()
+{
+	/*-----------------------write into device--------------------*/
+	start_measure_time(WRDEV);
+	ocl_future image;
+	if (oclHostMemMode() == OCL_MEM_COPY)
+		image = oclWriteImageAsync(clCommandQueue, clSrcImage, origin, region, srcImg, ocl_after(), "WRDEV image");
+	else
+		oclHandOverImage2D(&clRuntime, clSrcImage, CL_MAP_WRITE, width, height);
+	ocl_future filt = oclWriteAsync(clCommandQueue, clFilterBuff, filter, clFilterBuff.size(), ocl_after(), "WRDEV filter");
+	image.wait();
+	filt.wait();
 	stop_measure_time(WRDEV);
 }
 
+void oclReleaseBuffers()
+{
+	clSrcImage.reset();
+	clDstImage.reset();
+	clFilterBuff.reset();
+	clSampler.reset();
+}
+
 void oclClean()
 {
-	clReleaseContext(clContext);
-	clReleaseCommandQueue(clCommandQueue);
-	clReleaseProgram(clProgram);
-	clReleaseMemObject(clSrcImage);
-	clReleaseMemObject(clDstImage);
-	clReleaseSampler(clSampler);
-	clReleaseKernel(clKernel);
-	clReleaseMemObject(clDstBuff);
+	clKernel.reset();
+	clProgram.reset();
+	oclPipelineRelease(&clPipeline);
+	oclRelease(&clRuntime);
 }
+#endif /* CPU_ONLY */
 
 int round_up(int value, int multiple)
 {
@@ -383,17 +376,88 @@ char * make_image(pixel *p, int numofPixels)
 	return imageBytes;
 }
 
-int main(void)
+#ifndef CPU_ONLY
+static cl_int conv_tune_launch(void *user, cl_command_queue q, const ocl_launch *l, cl_event *ev)
 {
-	char hostName[50];
-	gethostname(hostName, 50);
+	size_t clGlobalSize[2] = {(size_t)width, (size_t)height};
+	return clEnqueueNDRangeKernel(q, clKernel, 2, NULL, clGlobalSize, l->local, 0, NULL, ev);
+}
 
-	srcImg = read_bmp("disney.bmp", &bmp, &dib, &palette);
-	width = round_up(dib.width, BW);
-	height = round_up(dib.height, BH);
+// Picks the work-group shape, see ../../common/oclTune.h. The kernel does not check its bounds, so the
+// candidates are the shapes that divide the padded image.
+void conv_tune()
+{
+	ocl_launch cand[OCL_TUNE_MAX_CAND];
+	int numCand = 0;
 
-	oclInit();
-	oclBuffer();
+	for (size_t bh = 1; bh <= 32; bh *= 2)
+		for (size_t bw = 4; bw <= 64; bw *= 2)
+			if ((size_t)width % bw == 0 && (size_t)height % bh == 0)
+			{
+				ocl_launch c = {{bw, bh}, 0, 0.0, OCL_TUNE_DEFAULT};
+				cand[numCand++] = c;
+			}
+	// the timing does not depend on the pixels, only the filter is uploaded ahead of the first WRDEV
+	oclWriteAsync(clCommandQueue, clFilterBuff, filter, clFilterBuff.size(), ocl_after(), "tuning filter").wait();
+	oclSetArgs(clKernel, clSrcImage, clDstImage, clFilterBuff, clSampler, width, height, filterWidth);
+	oclTuneLaunch(&clRuntime, clKernel, "convolution.convolution", cand, numCand, conv_tune_launch, NULL, &convLaunch);
+}
+
+// one chunk of the pipelined path is a band of bandRows image rows
+int bandRows;
+
+static size_t band_rows(int chunk)
+{
+	int y0 = chunk * bandRows;
+	return (y0 + bandRows > height) ? height - y0 : bandRows;
+}
+
+static cl_int conv_upload(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	size_t bandOrigin[3] = {0, (size_t)chunk * bandRows, 0};
+	size_t bandRegion[3] = {(size_t)width, band_rows(chunk), 1};
+	return clEnqueueWriteImage(q, clSrcImage, CL_FALSE, bandOrigin, bandRegion, 0, 0,
+							   srcImg + (size_t)chunk * bandRows * width * 4, numWait, wait, done);
+}
+
+static cl_int conv_execute(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	size_t clGlobalOffset[2] = {0, (size_t)chunk * bandRows};
+	size_t clGlobalSize[2] = {(size_t)width, band_rows(chunk)};
+	return clEnqueueNDRangeKernel(q, clKernel, 2, clGlobalOffset, clGlobalSize, convLaunch.local, numWait, wait, done);
+}
+
+static cl_int conv_readback(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	size_t bandOrigin[3] = {0, (size_t)chunk * bandRows, 0};
+	size_t bandRegion[3] = {(size_t)width, band_rows(chunk), 1};
+	return clEnqueueReadImage(q, clDstImage, CL_FALSE, bandOrigin, bandRegion, 0, 0,
+							  gpuDstImg + (size_t)chunk * bandRows * width * 4, numWait, wait, done);
+}
+
+// --pipeline: band i+1 is written while band i is filtered and band i-1 read back
+void ocl_convolution_pipelined()
+{
+	// the filter reads one row above and below its band, so every band also waits for its neighbours' upload
+	ocl_pipe_stages stages = {conv_upload, conv_execute, conv_readback, 1, NULL};
+
+	bandRows = (int)oclPipelineChunkSize(height, convLaunch.local[1]);
+	int numChunks = (height + bandRows - 1) / bandRows;
+
+	start_measure_time(PIPELINE);
+	oclWriteAsync(clCommandQueue, clFilterBuff, filter, clFilterBuff.size(), ocl_after(), "WRDEV filter").wait();
+	oclSetArgs(clKernel, clSrcImage, clDstImage, clFilterBuff, clSampler, width, height, filterWidth);
+	oclPipelineRun(&clPipeline, numChunks, &stages);
+	stop_measure_time(PIPELINE);
+}
+
+void ocl_convolution()
+{
+	if (clPipeline.numQueues > 0)
+	{
+		ocl_convolution_pipelined();
+		return;
+	}
 
 //	size_t ws, ls;
 //	clGetKernelWorkGroupInfo(clKernel, clDeviceId, CL_KERNEL_WORK_GROUP_SIZE, sizeof(ws), (void *) &ws, NULL);
@@ -401,26 +465,17 @@ int main(void)
 //	clGetKernelWorkGroupInfo(clKernel, clDeviceId, CL_KERNEL_LOCAL_MEM_SIZE , sizeof(ls), (void *) &ls, NULL);
 //	printf("CL_KERNEL_LOCAL_MEM_SIZE is: %i \n", ls);
 
+	oclWrite();
+
 	/*-----------------------dispatch kernel----------------------*/
 	start_measure_time(KERNEL_EXEC);
 	size_t clGlobalSize[2] = {width, height};
-	size_t clLocalSize[2] = {BW, BH};
+	size_t *clLocalSize = convLaunch.local;
 
-	clSetKernelArg(clKernel, 0, sizeof(cl_mem), &clSrcImage);
-	clSetKernelArg(clKernel, 1, sizeof(cl_mem), &clDstImage);
-	clSetKernelArg(clKernel, 2, sizeof(cl_mem), &clFilterBuff);
-	clSetKernelArg(clKernel, 3, sizeof(cl_sampler), &clSampler);
-	clSetKernelArg(clKernel, 4, sizeof(int), &width);
-	clSetKernelArg(clKernel, 5, sizeof(int), &height);
-	clSetKernelArg(clKernel, 6, sizeof(int), &filterWidth);
+	oclSetArgs(clKernel, clSrcImage, clDstImage, clFilterBuff, clSampler, width, height, filterWidth);
 
-//	while(1)
-//	{
-	clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel, 2, 0, clGlobalSize, clLocalSize, 0, NULL, &clEvent);
-	if (clErr != CL_SUCCESS)
-		printf("Error in executing kernel!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
-//	}
+	ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel, 2, clGlobalSize, clLocalSize, ocl_after(), "convolution");
+	exec.wait();
 	stop_measure_time(KERNEL_EXEC);
 
 	cl_ulong queued_time = (cl_ulong)0;
@@ -429,10 +484,10 @@ int main(void)
 	cl_ulong end_time   = (cl_ulong)0;
 	size_t return_bytes;
 
-	clErr = clGetEventProfilingInfo(clEvent, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(clEvent, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(clEvent, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(clEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, &return_bytes);
+	clErr = clGetEventProfilingInfo(exec.get(), CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued_time, &return_bytes);
+	clErr = clGetEventProfilingInfo(exec.get(), CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, &return_bytes);
+	clErr = clGetEventProfilingInfo(exec.get(), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, &return_bytes);
+	clErr = clGetEventProfilingInfo(exec.get(), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, &return_bytes);
 
 	printf("Time from queue to submit : %10.3f msecs \n", ((double)(submitted_time-queued_time) * 1.0e-6));
 	printf("Time from submit to start : %10.3f msecs \n", ((double)(start_time-submitted_time) * 1.0e-6));
@@ -441,47 +496,31 @@ int main(void)
 
 	/*-----------------------read from device---------------------*/
 	start_measure_time(RDDEV);
-	gpuDstImg = (char *)malloc(sizeof(char *) * dib.height * dib.width * 4);
-	clErr = clEnqueueReadImage(clCommandQueue, clDstImage, CL_TRUE, origin, region, 0, 0, gpuDstImg, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in reading image!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+	if (oclHostMemMode() == OCL_MEM_COPY)
+		oclReadImageAsync(clCommandQueue, clDstImage, origin, region, gpuDstImg, ocl_after(exec), "RDDEV image").wait();
+	else
+		oclHandOverImage2D(&clRuntime, clDstImage, CL_MAP_READ, width, height);
 	stop_measure_time(RDDEV);
+}
+#endif /* CPU_ONLY */
 
-	/*-----------------------create final image-------------------*/
-	write_bmp("gpuResult.bmp", &bmp, &dib, palette, gpuDstImg);
-	free(gpuDstImg);
-
-	/*---------------------convolution on cpu---------------------*/
-	pixel * pixels = (pixel *)malloc(sizeof(pixel)*dib.height*dib.width);
+// Filters rows firstRow .. lastRow-1 of the image into dstPixels
+void cpu_convolution_rows(pixel *pixels, pixel *dstPixels, int firstRow, int lastRow, int numThreads)
+{
 	int idx = 0;
 	int weight = 0;
 	pixel currPix;
 	int filterIdx = 0;
 	int filterRadious = filterWidth >> 1;
 
-	for (int i=0; i<dib.height*dib.width; i++)
-	{
-		pixels[i].R = srcImg[idx];
-		pixels[i].G = srcImg[idx+1];
-		pixels[i].B = srcImg[idx+2];
-		pixels[i].A = srcImg[idx+3];
-		idx += 4;
-	}
-	pixel * dstPixels = (pixel *)malloc(sizeof(pixel)*dib.width*dib.height);
-
-	start_measure_time(CPU);
 	pixel sum;
-	idx = 0;
 	int R; int G; int B; int A;
 
-//	while(1)
-	{
-	omp_set_num_threads(NUM_CORES);
-	#pragma omp parallel default(none) shared(filter, pixels, dib, dstPixels) private(idx, sum, currPix, filterIdx, R, G, B, A, weight, filterRadious)
+	benchSetThreads(numThreads);
+	#pragma omp parallel default(none) shared(filter, pixels, dib, dstPixels, firstRow, lastRow) private(idx, sum, currPix, filterIdx, R, G, B, A, weight, filterRadious)
 	{
 		#pragma omp for
-			for (int i=0; i<dib.height; i++)		//for border accesses
+			for (int i=firstRow; i<lastRow; i++)		//for border accesses
 			{
 				filterRadious = 1;
 				for (int j=0; j<dib.width; j++)
@@ -526,24 +565,402 @@ int main(void)
 				}
 			}
 	}
-	}
-	char * cpuDstImg = (char *)malloc(sizeof(char *) * dib.height * dib.width * 4);
+}
+
+void cpu_convolution(pixel *pixels, pixel *dstPixels)
+{
+	free(cpuDstImg);
+	start_measure_time(CPU);
+//	while(1)
+	cpu_convolution_rows(pixels, dstPixels, 0, dib.height, benchCpuThreads());
 	cpuDstImg = make_image(dstPixels, dib.height*dib.width);
 	stop_measure_time(CPU);
+}
+
+#ifndef CPU_ONLY
+// --coop: the device filters the top rows of the image while the CPU threads filter the rest
+void coop_convolution(pixel *pixels, pixel *dstPixels)
+{
+	ocl_future first, last;
+	int filterRadius = filterWidth >> 1;
+	int gpuRows = (int)oclCoopSplit(&clCoop, height, convLaunch.local[1]);
+	int cpuRows = (gpuRows < dib.height) ? dib.height - gpuRows : 0;
+
+	start_measure_time(COOP);
+	if (gpuRows > 0)
+	{
+		// the device share also needs the rows its filter reads below the last one
+		size_t srcRegion[3] = {(size_t)width, (size_t)((gpuRows + filterRadius < height) ? gpuRows + filterRadius : height), 1};
+		size_t dstRegion[3] = {(size_t)width, (size_t)gpuRows, 1};
+		size_t clGlobalSize[2] = {(size_t)width, (size_t)gpuRows};
+		size_t *clLocalSize = convLaunch.local;
+
+		first = oclWriteImageAsync(clCommandQueue, clSrcImage, origin, srcRegion, srcImg, ocl_after(), "coop write image");
+		ocl_future filt = oclWriteAsync(clCommandQueue, clFilterBuff, filter, clFilterBuff.size(), ocl_after(), "coop write filter");
+		oclSetArgs(clKernel, clSrcImage, clDstImage, clFilterBuff, clSampler, width, height, filterWidth);
+		ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel, 2, clGlobalSize, clLocalSize, ocl_after(first, filt), "coop convolution");
+		last = oclReadImageAsync(clCommandQueue, clDstImage, origin, dstRegion, gpuDstImg, ocl_after(exec), "coop read image");
+		clFlush(clCommandQueue);
+	}
+
+	unsigned long long cpuStart = benchNowNs();
+	if (cpuRows > 0)
+	{
+		cpu_convolution_rows(pixels, dstPixels, gpuRows, dib.height, oclCoopThreads());
+		for (int i=gpuRows; i<dib.height; i++)
+			memcpy(gpuDstImg + (size_t)i * width * 4, dstPixels + (size_t)i * dib.width, sizeof(pixel) * dib.width);
+	}
+	double cpuMs = (benchNowNs() - cpuStart) * 1.0e-6;
+
+	last.wait();
+	stop_measure_time(COOP);
+
+	oclCoopUpdate(&clCoop, gpuRows, oclCoopEventMs(first.get(), last.get()), cpuRows, cpuMs);
+}
+#endif /* CPU_ONLY */
+
+// the measured loop, the same for disney.bmp and every sweep size
+void conv_run(pixel *pixels, pixel *dstPixels)
+{
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		benchBeginIteration(it);
+#ifndef CPU_ONLY
+		if (oclCoopEnabled())
+			coop_convolution(pixels, dstPixels);
+		else
+			ocl_convolution();
+#endif
+		cpu_convolution(pixels, dstPixels);
+		benchEndIteration();
+	}
+}
+
+// --scaling: the CPU path of the measured loop on every thread count, see ../../common/benchScaling.h
+struct conv_scaling_job
+{
+	pixel	*pixels;
+	pixel	*dstPixels;
+};
+
+static void conv_scaling_call(void *user, int numThreads)
+{
+	conv_scaling_job *job = (conv_scaling_job *)user;
+	cpu_convolution_rows(job->pixels, job->dstPixels, 0, dib.height, numThreads);
+}
+
+// --sweep: random square images of about every size instead of disney.bmp, see ../../common/benchSweep.h
+void conv_sweep(const char *hostName)
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ, PGM, KERNEL};
+	long long sizes[BENCH_SWEEP_MAX];
+	int numSizes = benchSweepSizes(sizes, 64 * 64, 4096 * 4096, 1);
+	int lastSide = 0;
+
+	for (int s=0; s<numSizes; s++)
+	{
+		// a side that is a multiple of the work-group, so the image needs no padding
+		int side = round_up((int)sqrt((double)sizes[s]), BW > BH ? BW : BH);
+		if (side == lastSide)
+			continue;
+		lastSide = side;
+		dib.width = dib.height = width = height = side;
+		long long numofPixels = (long long)side * side;
+
+		srcImg = (char *)malloc(sizeof(pixel) * numofPixels);
+		gpuDstImg = (char *)malloc(sizeof(pixel) * numofPixels);
+		pixel *pixels = (pixel *)malloc(sizeof(pixel) * numofPixels);
+		pixel *dstPixels = (pixel *)malloc(sizeof(pixel) * numofPixels);
+		if (srcImg == NULL || gpuDstImg == NULL || pixels == NULL || dstPixels == NULL)
+		{
+			printf("Out of memory at a sweep size of %lli pixels \n", numofPixels);
+			free(srcImg);
+			free(gpuDstImg);
+			free(pixels);
+			free(dstPixels);
+			break;
+		}
+		for (long long i=0; i<numofPixels * 4; i++)
+			srcImg[i] = (char)rand();
+		memcpy(pixels, srcImg, sizeof(pixel) * numofPixels);
+
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+#ifndef CPU_ONLY
+		oclBuffer();
+		conv_tune();
+#endif
+		conv_run(pixels, dstPixels);
+		benchSummary(timeRes);
+
+		float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+		float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + total_GPU_fair_time;
+#ifdef CPU_ONLY
+		total_GPU_fair_time = total_GPU_time = 0.0f;
+#endif
+		benchSweepAdd(numofPixels, timeRes[CPU], total_GPU_fair_time, total_GPU_time);
+
+		bench_result res;
+		char workGroup[16];
+#ifndef CPU_ONLY
+		sprintf(workGroup, "%lux%lu", (unsigned long)convLaunch.local[0], (unsigned long)convLaunch.local[1]);
+#else
+		sprintf(workGroup, "%ix%i", BW, BH);
+#endif
+		resultsInit(&res, "convolution");
+		res.description = description;
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.variant = oclCoopName() ? oclCoopName() : oclPipelineName() ? oclPipelineName() : oclHostMemModeName(oclHostMemMode());
+		res.gpuMs = total_GPU_fair_time;
+		res.gpuTotalMs = total_GPU_time;
+		res.gpuThroughput = numofPixels * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+		res.speedup = timeRes[CPU] / total_GPU_fair_time;
+#else
+		resultsSetHostDevice(&res);
+#endif
+		res.problemSize = numofPixels;
+		res.problemUnit = "pixels";
+		res.workGroup = workGroup;
+		res.cpuMs = timeRes[CPU];
+		res.cpuThroughput = numofPixels * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+		res.throughputUnit = "Mpixels/s";
+		resultsWrite(&res);
+
+#ifndef CPU_ONLY
+		oclReleaseBuffers();
+#endif
+		free(srcImg);
+		free(gpuDstImg);
+		free(cpuDstImg);
+		free(pixels);
+		free(dstPixels);
+		srcImg = gpuDstImg = cpuDstImg = NULL;
+	}
+
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, size sweep on random square images \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintSweepReport(fio, "pixels", "Mpixels/s", 1.0e-6);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+// --serve: every request is an RGBA8 image of param[0] x param[1] pixels, see ../../common/benchServe.h
+#ifndef CPU_ONLY
+static int		serveWidth = 0, serveHeight = 0;	// size of the device images, recreated when a request differs
+static size_t	serveCap = 0;						// pixels srcImg and gpuDstImg hold, they only grow
+#endif
+
+static int conv_serve_request(const bench_serve_request *req, const void *payload)
+{
+	int w = (int)req->param[0], h = (int)req->param[1];
+
+	if (w <= 0 || h <= 0 || w > 65536 || h > 65536 || req->length != (uint64_t)w * h * sizeof(pixel))
+		return BENCH_SERVE_BAD_REQUEST;
+	pixel *dstPixels = (pixel *)benchServeReply(req->length);
+	if (dstPixels == NULL)
+		return BENCH_SERVE_NO_MEMORY;
+	dib.width = w;
+	dib.height = h;
+#ifndef CPU_ONLY
+	width = round_up(w, BW);
+	height = round_up(h, BH);
+	if ((size_t)width * height > serveCap)
+	{
+		char *src = (char *)realloc(srcImg, sizeof(pixel) * width * height);
+		if (src != NULL)
+			srcImg = src;
+		char *dst = (char *)realloc(gpuDstImg, sizeof(pixel) * width * height);
+		if (dst != NULL)
+			gpuDstImg = dst;
+		if (src == NULL || dst == NULL)
+			return BENCH_SERVE_NO_MEMORY;
+		serveCap = (size_t)width * height;
+	}
+	// the padding to whole work-groups repeats the last column and row, the edge the CPU path clamps to
+	const pixel *in = (const pixel *)payload;
+	pixel *padded = (pixel *)srcImg;
+	for (int i=0; i<height; i++)
+	{
+		const pixel *row = in + (size_t)((i < h) ? i : h - 1) * w;
+		memcpy(padded + (size_t)i * width, row, sizeof(pixel) * w);
+		for (int j=w; j<width; j++)
+			padded[(size_t)i * width + j] = row[w - 1];
+	}
+	if (width != serveWidth || height != serveHeight)
+	{
+		if (serveWidth > 0)
+			oclReleaseBuffers();
+		oclBuffer();
+		if (clErr != CL_SUCCESS)
+		{
+			oclReleaseBuffers();
+			serveWidth = serveHeight = 0;
+			return BENCH_SERVE_NO_MEMORY;
+		}
+		serveWidth = width;
+		serveHeight = height;
+	}
+	clErr = CL_SUCCESS;
+	if (oclCoopEnabled())
+		coop_convolution((pixel *)payload, dstPixels);
+	else
+		ocl_convolution();
+	const pixel *out = (const pixel *)gpuDstImg;
+	for (int i=0; i<h; i++)
+		memcpy(dstPixels + (size_t)i * w, out + (size_t)i * width, sizeof(pixel) * w);
+	return (clErr == CL_SUCCESS) ? BENCH_SERVE_OK : BENCH_SERVE_FAILED;
+#else
+	start_measure_time(CPU);
+	cpu_convolution_rows((pixel *)payload, dstPixels, 0, h, benchCpuThreads());
+	stop_measure_time(CPU);
+	return BENCH_SERVE_OK;
+#endif
+}
+
+void conv_serve(const char *hostName)
+{
+	if (benchServe(BENCH_OP_CONV, conv_serve_request) < 0)
+		return;
+	benchSummary(timeRes);
+#ifndef CPU_ONLY
+	if (serveWidth > 0)
+		oclReleaseBuffers();
+	serveWidth = serveHeight = 0;
+	serveCap = 0;
+#endif
+	free(srcImg);
+	free(gpuDstImg);
+	srcImg = gpuDstImg = NULL;
+
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, service of filter requests \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintServeReport(fio);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+int main(int argc, char **argv)
+{
+	char hostName[50];
+#ifndef CPU_ONLY
+	oclParseArgs(&argc, argv);
+#endif
+	benchParseArgs(&argc, argv);
+	resultsParseArgs(&argc, argv);
+	benchInit(phaseNames, NUM_PHASES);
+	gethostname(hostName, 50);
+
+	if (benchSweepEnabled())
+	{
+#ifndef CPU_ONLY
+		oclInit();
+#endif
+		conv_sweep(hostName);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+	if (benchServeEnabled())
+	{
+#ifndef CPU_ONLY
+		oclInit();
+#endif
+		conv_serve(hostName);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+
+	benchTraceBegin("BMP decode");
+	srcImg = read_bmp("disney.bmp", &bmp, &dib, &palette);
+	benchTraceEnd();
+	width = round_up(dib.width, BW);
+	height = round_up(dib.height, BH);
+
+#ifndef CPU_ONLY
+	oclInit();
+	oclBuffer();
+	conv_tune();
+#endif
+	gpuDstImg = (char *)malloc(sizeof(char *) * dib.height * dib.width * 4);
 
+	/*---------------------convolution on cpu---------------------*/
+	benchTraceBegin("unpack pixels");
+	pixel * pixels = (pixel *)malloc(sizeof(pixel)*dib.height*dib.width);
+	int idx = 0;
+	for (int i=0; i<dib.height*dib.width; i++)
+	{
+		pixels[i].R = srcImg[idx];
+		pixels[i].G = srcImg[idx+1];
+		pixels[i].B = srcImg[idx+2];
+		pixels[i].A = srcImg[idx+3];
+		idx += 4;
+	}
+	benchTraceEnd();
+	pixel * dstPixels = (pixel *)malloc(sizeof(pixel)*dib.width*dib.height);
+
+	conv_run(pixels, dstPixels);
+	conv_scaling_job scalingJob = {pixels, dstPixels};
+	benchScalingRun(conv_scaling_call, &scalingJob);
+#ifndef CPU_ONLY
+	if (oclHostMemMode() != OCL_MEM_COPY)
+	{
+		oclReadHostImage2D(&clRuntime, clDstImage, gpuDstImg, width, height, 4);
+		oclTimeCopyPath(&clRuntime, (size_t)width * height * 4, (size_t)width * height * 4, WRDEV_COPY, RDDEV_COPY);
+	}
+#endif
+	benchSummary(timeRes);
+
+	/*-----------------------create final image-------------------*/
+	benchTraceBegin("BMP encode");
+#ifndef CPU_ONLY
+	write_bmp("gpuResult.bmp", &bmp, &dib, palette, gpuDstImg);
+#endif
 	write_bmp("cpuResult.bmp", &bmp, &dib, palette, cpuDstImg);
+	benchTraceEnd();
 
+	free(gpuDstImg);
+	free(pixels);
 	free(dstPixels);
 	free(cpuDstImg);
-//	}
 	free(srcImg);
 	/*-------------------------print result-----------------------*/
 	fio = fopen("log.txt", "a+");
 	fseek (fio, 0, SEEK_END);
 	int appendPos = ftell(fio);
 
-	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV];
-	float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV];
+	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+	float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+	double total_GPU_fair_J = benchPhaseJoules(KERNEL_EXEC) + benchPhaseJoules(WRDEV) + benchPhaseJoules(RDDEV) + benchPhaseJoules(PIPELINE) + benchPhaseJoules(COOP);
 
 	struct tm *local;
 	time_t t;
@@ -553,7 +970,18 @@ int main(void)
 	fprintf(fio, "****************************************************\n");
 	fprintf(fio, "Created on: %s", asctime(local));
 	fprintf(fio, "Host name: %s \n", hostName);
-	fprintf(fio, "Description: %s \n\n", description);
+	fprintf(fio, "Description: %s \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n", clRuntime.deviceName, clRuntime.platformName);
+	oclPrintCacheStats(fio);
+	oclPrintHostMemReport(fio, &clRuntime, WRDEV, RDDEV, WRDEV_COPY, RDDEV_COPY);
+	oclPrintPipelineReport(fio, &clPipeline, PIPELINE);
+	oclPrintCoopReport(fio, &clCoop, COOP, "rows");
+	oclPrintTuneReport(fio, "convolution.convolution", &convLaunch);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n");
+#endif
+	fprintf(fio, "\n");
 	fprintf(fio, "Result GPU is: %i \n", gpuResult);
 	fprintf(fio, "Result CPU is: %i \n", cpuResult);
 	if (cpuResult != gpuResult)
@@ -565,8 +993,12 @@ int main(void)
 
 	fprintf(fio, "\n===========Performance Measurements=================\n");
 	fprintf(fio, "Global size: %i * %i \n", width, height);
-	fprintf(fio, "Local size: %i * %i \n", BW, BH);
-	fprintf(fio, "Execution times: \n"
+#ifndef CPU_ONLY
+	fprintf(fio, "Local size: %lu * %lu \n", (unsigned long)convLaunch.local[0], (unsigned long)convLaunch.local[1]);
+#endif
+	fprintf(fio, "CPU threads: %i \n", benchCpuThreads());
+#ifndef CPU_ONLY
+	fprintf(fio, "Execution times (median of %i iterations): \n"
 			   "	PLATFORM = \t%10.2f msecs \n"
 			   "	DEVICE = \t%10.2f msecs \n"
 			   "	CONTEXT = \t%10.2f msecs \n"
@@ -577,6 +1009,7 @@ int main(void)
 			   "	WRDEV = \t%10.2f msecs \n"
 			   "	KERNEL_EXEC = \t%10.2f msecs \n"
 			   "	RDDEV = \t%10.2f msecs \n\n",
+			   benchIterations(),
 			   timeRes[PLATFORM],
 			   timeRes[DEVICE],
 			   timeRes[CONTEXT],
@@ -593,12 +1026,62 @@ int main(void)
 			"CPU time: \t\t%10.2f msecs \n\n",
 			total_GPU_time, total_GPU_fair_time, timeRes[CPU]);
 	fprintf(fio, "Speed UP: \t\t%10.2f \n\n", float(timeRes[CPU])/float(total_GPU_fair_time));
+	// per pixel: one RGBA8 texel in and one out, the neighbours come from the image cache; per tap a uint4
+	// multiply-add and the weight sum, then the uint4 division
+	ocl_kernel_cost convCost = {"convolution", (double)width * height, 8.0, 9.0 * filterWidth * filterWidth + 4.0, OCL_ROOF_INT,
+								timeRes[KERNEL_EXEC]};
+	oclPrintRooflineReport(fio, &convCost, 1);
+#else
+	fprintf(fio, "CPU time (median of %i iterations): \t%10.2f msecs \n\n", benchIterations(), timeRes[CPU]);
+#endif
+	benchPrintEnergySummary(fio, total_GPU_fair_J, total_GPU_fair_time, benchPhaseJoules(CPU), timeRes[CPU], (double)dib.width * dib.height, "pixel");
+	benchPrintScalingReport(fio, (double)dib.width * dib.height, "Mpixels/s", 1.0e-6, total_GPU_fair_time);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+
+	bench_result res;
+	char workGroup[16];
+#ifndef CPU_ONLY
+	sprintf(workGroup, "%lux%lu", (unsigned long)convLaunch.local[0], (unsigned long)convLaunch.local[1]);
+#else
+	sprintf(workGroup, "%ix%i", BW, BH);
+#endif
+	resultsInit(&res, "convolution");
+	res.description = description;
+#ifndef CPU_ONLY
+	res.device = clRuntime.deviceName;
+	res.platform = clRuntime.platformName;
+	res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+	res.driver = clRuntime.driverVersion;
+	res.variant = oclCoopName() ? oclCoopName() : oclPipelineName() ? oclPipelineName() : oclHostMemModeName(oclHostMemMode());
+#else
+	resultsSetHostDevice(&res);
+#endif
+	res.problemSize = (long long)dib.width * dib.height;
+	res.problemUnit = "pixels";
+	res.workGroup = workGroup;
+	res.cpuMs = timeRes[CPU];
+	res.cpuThroughput = res.problemSize * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+	res.throughputUnit = "Mpixels/s";
+#ifndef CPU_ONLY
+	res.gpuMs = total_GPU_fair_time;
+	res.gpuThroughput = res.problemSize * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+	res.speedup = timeRes[CPU] / total_GPU_fair_time;
+#endif
+	res.gpuJ = total_GPU_fair_J;
+	res.cpuJ = benchPhaseJoules(CPU);
+	res.energyOps = (double)dib.width * dib.height;
+	res.energyOp = "pixel";
+	resultsWrite(&res);
 
 	fseek(fio, appendPos, SEEK_SET);
 	while(fgets(buff,sizeof buff,fio))
 			printf("%s", buff);
 	fclose(fio);
+#ifndef CPU_ONLY
+	oclReleaseBuffers();
 	oclClean();
+#endif
 }
 
 
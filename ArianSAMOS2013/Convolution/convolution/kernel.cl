@@ -1,3 +1,10 @@
+/* -D FILTER_WIDTH=<n> (oclBuildVariant) turns the filter width into a constant, else the filterWidth argument is used */
+#ifdef FILTER_WIDTH
+ #define FILTER_W	FILTER_WIDTH
+#else
+ #define FILTER_W	filterWidth
+#endif
+
 //__kernel void convolution(__read_only image2d_t clSrcImage, __global char * clDstBuff, __constant int * filter, sampler_t sampler, int cols, int rows, int filterWidth)
 __kernel void convolution(__read_only image2d_t clSrcImage, __write_only image2d_t clDstImage, __constant int * filter, sampler_t sampler, int cols, int rows, int filterWidth)
 {
@@ -6,7 +13,7 @@ __kernel void convolution(__read_only image2d_t clSrcImage, __write_only image2d
 	
 	uint4 pix;
 	uint4 sum = {0, 0, 0, 0};
-	int filterRadius = filterWidth >> 1;
+	int filterRadius = FILTER_W >> 1;
 	int2 coord;
 	int filterIdx = 0;
 	int weight = 0;
@@ -16,10 +16,34 @@
 #include <math.h>
 #include <string.h>
 #include <time.h>
-#include <CL/cl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <omp.h>
+#ifndef CPU_ONLY
+ #include <CL/cl.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
+
+#ifndef CPU_ONLY
+ #include "oclRuntime.h"
+ #include "oclProgramCache.h"
+ #include "oclMemPool.h"
+ #include "oclCoop.h"
+ #include "oclRoofline.h"
+ #include "oclTrace.h"
+ #include "oclHandles.h"
+ #ifdef SAMOS_EMBED_KERNELS
+  #include "samosKernels.h"
+ #endif
+#endif
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchSweep.h"
+#include "benchArena.h"
+#include "benchScaling.h"
 
 // Include sys/time.h in Linux environments
 // #include <sys/time.h>
@@ -35,10 +59,9 @@
  #include <sys/time.h> // linux machines
 #endif
 
-#define NUM_CORES		1
 /***************** OpenCL Definitions ******************/
 // OpenCL Definitions
-// #define FERMI
+// The platform and device are picked at run time, see ../../common/oclRuntime.h
 #define VIVANTE
 
 #define PLATFORM		0
@@ -53,6 +76,11 @@
 #define RDDEV			9
 #define CPU				10
 #define GPU_SEQ			11
+#define COOP			12		// one generation shared by the device and the CPU, with --coop
+#define NUM_PHASES		13
+
+const char *phaseNames[NUM_PHASES] = {"PLATFORM", "DEVICE", "CONTEXT", "CMDQ", "PGM", "KERNEL",
+									  "KERNEL_EXEC", "BUFF", "WRDEV", "RDDEV", "CPU", "GPU_SEQ", "COOP"};
 
 #ifdef VIVANTE
 #define CL_GLOBAL_SIZE_0		(32*1024)
@@ -64,33 +92,28 @@
 	#define WORK_GROUP_SIZE	32
 #endif
 
-cl_program 			clProgram;
+#ifndef CPU_ONLY
+ocl_handle<cl_program>	clProgram;
 cl_device_id 		clDeviceId;
 cl_context 			clContext;
-cl_kernel 			clKernel1;
+ocl_handle<cl_kernel>	clKernel1;
 cl_command_queue 	clCommandQueue;
 cl_int 				clErr = 0;
-cl_mem				clPopulationBuff, cllastofIndBuff, clTrainInBuff, clConstantBuff, clTrainOutBuff, clFitnessBuff, clDebugBuff;
-cl_mem				clLengthBuff, clEvaluateBuff;
-//cl_event			prof_event;
+ocl_buffer<char>	clPopulationBuff;
+ocl_buffer<int>		clLengthBuff;
+ocl_buffer<float>	clTrainInBuff, clConstantBuff, clEvaluateBuff;
+ocl_runtime			clRuntime;
+ocl_coop			clCoop;
+double				roofNodes = 0.0, roofFuncNodes = 0.0, roofIndividuals = 0.0;	// individuals the kernel evaluated, for --roofline
+#endif
 
-struct timeval 		start[15];
-struct timeval 		stop[15];
 float 				timeRes[15] = {0};
-FILE 				*fp;
 FILE 				*fio;
 char 				buff[256];
-char 				*kernelSrc;
 char 				description[256] = "Genetic Programming: Classification Problem";
 size_t 				clLocalSize;
 size_t 				clGlobalSize;
 
-#ifdef FERMI
-cl_platform_id 		clPlatformId[3];
-#else
-cl_platform_id		clPlatformId;
-#endif
-
 /***************** Application Definitions ******************/
 #define IS_VAR(n)		(n == X || n == Y)
 #define IS_CONST(n)		(n >= CONST_START && n <= CONST_END)
@@ -102,6 +125,7 @@ cl_platform_id		clPlatformId;
 #define MIN_RND			-1
 #define MAX_RND			1
 #define POP_SIZE		500
+#define MAX_POP_SIZE	8192		// bound of the arrays, --sweep varies popSize up to it
 #define MAX_DEPTH		10
 #define MAX_IND_LEN 	200
 #define GENERATION		20
@@ -145,16 +169,17 @@ cl_platform_id		clPlatformId;
 #define INT		0
 #define FLOAT	1
 
-char pop[POP_SIZE][MAX_IND_LEN];
+int popSize = POP_SIZE;
+char pop[MAX_POP_SIZE][MAX_IND_LEN];
 float values[NUM_VAR + NUM_CONST];
-unsigned char fitness_cpu[POP_SIZE] = {0};
-unsigned char fitness_gpu[POP_SIZE] = {0};
-int inds_len[POP_SIZE];
+unsigned char fitness_cpu[MAX_POP_SIZE] = {0};
+unsigned char fitness_gpu[MAX_POP_SIZE] = {0};
+int inds_len[MAX_POP_SIZE];
 float train_set_in[TRAIN_SIZE * 2];
 char train_set_out[TRAIN_SIZE];
 float test_set_in[TEST_SIZE * 2];
 char test_set_out[TEST_SIZE];
-int best_inds[POP_SIZE];
+int best_inds[MAX_POP_SIZE];
 int best_ind = -1;
 int test_best_fit = 0;
 unsigned int gen_best_fit = 0;
@@ -162,112 +187,66 @@ int test_best_len = MAX_IND_LEN;
 int gen_best_len = MAX_IND_LEN;
 char ch;
 
+// Phases stopped several times in one iteration (once per generation) are summed by the harness
 void start_measure_time(int seg)
 {
-    gettimeofday(&start[seg], NULL);
+	benchStart(seg);
 }
 
 void stop_measure_time(int seg)
 {
-    gettimeofday(&stop[seg], NULL);
-    timeRes[seg] += 1000 * ((float)(float)(stop[seg].tv_sec  - start[seg].tv_sec) + 1.0e-6 * (stop[seg].tv_usec - start[seg].tv_usec));
+	benchStop(seg);
 }
 
+#ifndef CPU_ONLY
 void oclInit()
 {
+	char options[OCL_OPTIONS_LEN] = "";
+
 	/*-----------------------get platform---------------------------*/
 	start_measure_time(PLATFORM);
-	#ifdef FERMI
-		if (clGetPlatformIDs(3, (cl_platform_id *)&clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId[1], CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#else
-		if (clGetPlatformIDs(1, &clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId, CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#endif
+	if (oclGetPlatforms(&clRuntime) == 0)
+		exit(1);
 	stop_measure_time(PLATFORM);
 
 	/*-----------------------get device-----------------------------*/
 	start_measure_time(DEVICE);
-	#ifdef FERMI
-		if (clGetDeviceIDs(clPlatformId[1], CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#else
-		if (clGetDeviceIDs(clPlatformId, CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#endif
-		else
-		{
-			clGetDeviceInfo(clDeviceId, CL_DEVICE_NAME, 200, buff, NULL);
-			printf("Device name: %s \n", buff);
-		}
+	if (oclSelectDevice(&clRuntime) != 0)
+		exit(1);
+	clDeviceId = clRuntime.device;
 	stop_measure_time(DEVICE);
 
 	/*-----------------------create context-------------------------*/
 	start_measure_time(CONTEXT);
-	clContext = clCreateContext(0, 1, (cl_device_id *) &clDeviceId, NULL, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating context!, clErr=%i \n", clErr);
-	else
-		printf("Context created! \n");
+	oclCreateContext(&clRuntime);
+	clContext = clRuntime.context;
 	stop_measure_time(CONTEXT);
 
 	/*---------------------create command queue---------------------*/
 	start_measure_time(CMDQ);
-	clCommandQueue = clCreateCommandQueue(clContext, clDeviceId, CL_QUEUE_PROFILING_ENABLE, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating command queue!, clErr=%i \n", clErr);
-	else
-		printf("Command queue created! \n");
+	oclCreateQueue(&clRuntime, CL_QUEUE_PROFILING_ENABLE);
+	clCommandQueue = clRuntime.queue;
 	stop_measure_time(CMDQ);
 
 	/*------------------create and build program--------------------*/
+#ifdef SAMOS_EMBED_KERNELS
+	oclEmbedKernelSources(samosKernelSources);
+#endif
+	// the kernel takes its sizes from here rather than keeping its own copies
+	oclDefine(options, "MAX_IND_LEN", MAX_IND_LEN);
+	oclDefine(options, "WORK_GROUP_SIZE", WORK_GROUP_SIZE);
+	oclDefine(options, "TRAIN_SIZE", TRAIN_SIZE);
+	oclDefine(options, "NUM_CONST", NUM_CONST);
+	oclDefine(options, "MAX_DEPTH", MAX_DEPTH);
 	start_measure_time(PGM);
-	int filelen;
-	int readlen;
-
-	fp = fopen("kernel.cl", "r");
-	// getting size of the file
-	fseek(fp, 0, SEEK_END);  //set position indicator to the end of file
-	filelen = ftell(fp);	//return the current value of position indicator
-	rewind(fp);	//set position indicator to the beginning
-
-	kernelSrc = (char*) malloc(sizeof(char) * (filelen + 1));
-	readlen = fread(kernelSrc, 1, filelen, fp);
-	if (readlen < filelen)
-		kernelSrc[readlen] = '\0';
-	else
-		kernelSrc[filelen] = '\0';
-
-	clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program!, clErr=%i \n", clErr);
-	else
-		printf("Program created! \n");
-
-	clErr = clBuildProgram(clProgram, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 1!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program built! \n");
+	clProgram.reset(oclBuildVariant(&clRuntime, "kernel.cl", options));
+	if (clProgram == NULL)
+		exit(1);
 	stop_measure_time(PGM);
 
 	/*-----------------------create kernel------------------------*/
 	start_measure_time(KERNEL);
-	clKernel1 = clCreateKernel(clProgram, "fitness", &clErr);
+	clKernel1.reset(clCreateKernel(clProgram, "fitness", &clErr));
 	if (clErr != CL_SUCCESS)
 	{
 			printf("Error in creating kernel!, clErr=%i \n", clErr);
@@ -275,73 +254,76 @@ void oclInit()
 	}
 	else
 		printf("Kernel created! \n");
-	fclose(fp);
-	free(kernelSrc);
 	stop_measure_time(KERNEL);
+
+	oclCoopInit(&clCoop);
+	oclRooflineMeasure(&clRuntime);
 }
 
 void oclBuffer()
 {
 	/*-----------------------create buffer------------------------*/
 	start_measure_time(BUFF);
-	clPopulationBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(char) * MAX_IND_LEN * POP_SIZE, NULL, &clErr);
+	clPopulationBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(char) * MAX_IND_LEN * popSize, &clErr), MAX_IND_LEN * popSize);
 	if (clErr != CL_SUCCESS)
 	{
 		printf("Error in creating Pop buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clLengthBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(int) * POP_SIZE, NULL, &clErr);
+	clLengthBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(int) * popSize, &clErr), popSize);
 	if (clErr != CL_SUCCESS)
 	{
 		printf("Error in creating Length buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clEvaluateBuff = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(float) * POP_SIZE * TRAIN_SIZE, NULL, &clErr);
+	clEvaluateBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_WRITE_ONLY, sizeof(float) * popSize * TRAIN_SIZE, &clErr), popSize * TRAIN_SIZE);
 	if (clErr != CL_SUCCESS)
 	{
 		printf("Error in creating TrainIn buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clTrainInBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * TRAIN_SIZE * 2, NULL, &clErr);
+	clTrainInBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(float) * TRAIN_SIZE * 2, &clErr), TRAIN_SIZE * 2);
 	if (clErr != CL_SUCCESS)
 	{
 		printf("Error in creating TrainIn buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clConstantBuff = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * NUM_CONST, NULL, &clErr);
+	clConstantBuff.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(float) * NUM_CONST, &clErr), NUM_CONST);
 	if (clErr != CL_SUCCESS)
 	{
 		printf("Error in creating Constant buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
 	stop_measure_time(BUFF);
+}
 
+void oclWrite()
+{
 	/*-----------------------write into device--------------------*/
 	start_measure_time(WRDEV);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, clTrainInBuff, CL_TRUE, 0, sizeof(float) * TRAIN_SIZE * 2, train_set_in, 0, NULL, NULL);
-	clErr |= clEnqueueWriteBuffer(clCommandQueue, clConstantBuff, CL_TRUE, 0, sizeof(float) * NUM_CONST, (float *)values + NUM_VAR, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing buffer!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+	ocl_future train = oclWriteAsync(clCommandQueue, clTrainInBuff, train_set_in, clTrainInBuff.size(), ocl_after(), "WRDEV training set");
+	ocl_future consts = oclWriteAsync(clCommandQueue, clConstantBuff, values + NUM_VAR, clConstantBuff.size(), ocl_after(), "WRDEV constants");
+	train.wait();
+	consts.wait();
 	stop_measure_time(WRDEV);
 }
 
+void oclReleaseBuffers()
+{
+	clPopulationBuff.reset();
+	clLengthBuff.reset();
+	clEvaluateBuff.reset();
+	clTrainInBuff.reset();
+	clConstantBuff.reset();
+}
+
 void oclClean()
 {
-	clReleaseContext(clContext);
-	clReleaseCommandQueue(clCommandQueue);
-	clReleaseProgram(clProgram);
-	clReleaseMemObject(clPopulationBuff);
-//	clReleaseMemObject(cllastofIndBuff);
-	clReleaseMemObject(clLengthBuff);
-//	clReleaseMemObject(clFitnessBuff);
-	clReleaseMemObject(clEvaluateBuff);
-	clReleaseMemObject(clTrainInBuff);
-//	clReleaseMemObject(clTrainOutBuff);
-	clReleaseMemObject(clConstantBuff);
-//	clReleaseMemObject(clDebugBuff);
-	clReleaseKernel(clKernel1);
+	clKernel1.reset();
+	clProgram.reset();
+	oclRelease(&clRuntime);
 }
+#endif /* CPU_ONLY */
 
 union fint
 {
@@ -431,34 +413,45 @@ char evaluate(char *ind, float *vals, int i)
 		return 0;
 }
 
-void fitness_func()
+// Evaluates individuals [first, last) on numThreads OpenMP threads, each with its own copy of the values
+void cpu_fitness(unsigned char *fitness, int first, int last, int numThreads)
 {
-	start_measure_time(CPU);
 	float vals[NUM_VAR + NUM_CONST];
-//	omp_set_num_threads(1);
-//	while(1)
-//	{
-//	#pragma omp parallel private(vals)
+	benchSetThreads(numThreads);
+	#pragma omp parallel private(vals)
 	{
 		for (int i=0; i<NUM_VAR + NUM_CONST; i++)
 			vals[i] = values[i];
-//		#pragma omp for
-			for (int i=0; i<POP_SIZE; i++)
+		#pragma omp for
+			for (int i=first; i<last; i++)
 			{
-				fitness_cpu[i] = 0;
+				fitness[i] = 0;
 				for (int j=0; j<TRAIN_SIZE; j++)
 				{
 					vals[X] = train_set_in[j];
 					vals[Y] = train_set_in[j + TRAIN_SIZE];
 					if (evaluate(pop[i], vals, i) == train_set_out[j])
-						fitness_cpu[i]++;
+						fitness[i]++;
 				}
 			}
-//	}
 	}
+}
+
+void fitness_func()
+{
+	start_measure_time(CPU);
+	cpu_fitness(fitness_cpu, 0, popSize, benchCpuThreads());
 	stop_measure_time(CPU);
 }
 
+// --scaling: the fitness evaluations of one iteration (GENERATION of them) on the last population, see ../../common/benchScaling.h
+static void gp_scaling_call(void *user, int numThreads)
+{
+	(void)user;
+	for (int g=0; g<GENERATION; g++)
+		cpu_fitness(fitness_cpu, 0, popSize, numThreads);
+}
+
 void gen_ind(char *ind, int max_dep, int max_len)
 {
 	char stack[MAX_IND_LEN*10];
@@ -538,7 +531,7 @@ void gen_ind(char *ind, int max_dep, int max_len)
 
 void init_pop()
 {
-	for (int i=0; i<POP_SIZE; i++)
+	for (int i=0; i<popSize; i++)
 		gen_ind(pop[i], MAX_DEPTH, MAX_IND_LEN);
 }
 
@@ -578,7 +571,7 @@ int tournament(int t_size)
 	int best_fitness = 0;
 	for (int i=0; i<t_size; i++)
 	{
-		int next_ind = gen_rnd(INT, 0, POP_SIZE-1).i;
+		int next_ind = gen_rnd(INT, 0, popSize-1).i;
 		if (fitness_gpu[next_ind] > best_fitness)
 		{
 			best = next_ind;
@@ -721,116 +714,165 @@ void reproduct(char *ind, char *offspring)
 void next_gen()
 {
 	char *parent1, *parent2;
-	char new_gen[POP_SIZE][MAX_IND_LEN];
+	static char new_gen[MAX_POP_SIZE][MAX_IND_LEN];
 	int cntr = 0;
 
-	for(int j=0; j<POP_SIZE; j++)
+	for(int j=0; j<popSize; j++)
 		for(int k=0; k<MAX_IND_LEN; k++)
 			new_gen[j][k] = '*';
 
-	for(int i=0; i<(int)POP_SIZE * CROSSOVER_RATE; i++)
+	for(int i=0; i<(int)popSize * CROSSOVER_RATE; i++)
 	{
 		parent1 = pop[tournament(2)];
 		parent2 = pop[tournament(2)];
 		cross_over(parent1, parent2, new_gen[cntr++]);
 	}
-	for(int i=0; i<(int)POP_SIZE * MUTATION_RATE; i++)
+	for(int i=0; i<(int)popSize * MUTATION_RATE; i++)
 	{
 		parent1 = pop[tournament(2)];
 		mutate(parent1, new_gen[cntr++]);
 	}
-	for(int i=0; i<(int)POP_SIZE * REPRODUCT_RATE; i++)
+	for(int i=0; i<(int)popSize * REPRODUCT_RATE; i++)
 	{
 		parent1 = pop[tournament(2)];
 		reproduct(parent1, new_gen[cntr++]);
 	}
-	for (int i=0; i<POP_SIZE; i++)
+	for (int i=0; i<popSize; i++)
 		for (int j=0; j<MAX_IND_LEN; j++)
 			pop[i][j] = new_gen[i][j];
 }
 
+#ifndef CPU_ONLY
+// Scores individuals [first, last) from the kernel's evaluations of the training set
+void score_eval_results(const float *eval_results, int first, int last)
+{
+	#pragma omp parallel
+		#pragma omp for
+			for (int i=first; i<last; i++)
+			{
+				fitness_gpu[i] = 0;
+				for (int j=0; j<TRAIN_SIZE; j++)
+				{
+					if (eval_results[i * TRAIN_SIZE + j] > 0 && train_set_out[j] == 1)
+						fitness_gpu[i]++;
+					else if (eval_results[i * TRAIN_SIZE + j] <= 0 && train_set_out[j] == 0)
+						fitness_gpu[i]++;
+				}
+			}
+}
+
+// --coop: the device evaluates the first individuals while the CPU threads evaluate the rest
+void coop_fitness_func()
+{
+	size_t mark = benchArenaMark();
+	float *eval_results = (float *)benchArenaAlloc(sizeof(float) * popSize * TRAIN_SIZE);
+	char *popflat = (char *)benchArenaAlloc(MAX_IND_LEN * popSize);
+	ocl_future first, last;
+	int gpuInds = (int)oclCoopSplit(&clCoop, popSize, 1);
+
+	for (int i=0; i<gpuInds; i++)
+	{
+		int ind_len = length(pop[i]);
+		memcpy(popflat + i*MAX_IND_LEN, pop[i], MAX_IND_LEN);
+		for (int j=0; j<3; j++) 	// just to be sure we are safe
+			popflat[i*MAX_IND_LEN + ind_len + j] = '*';
+		inds_len[i] = ceil((float)ind_len / 4);
+	}
+
+	start_measure_time(COOP);
+	if (gpuInds > 0)
+	{
+		size_t clLocalSize = WORK_GROUP_SIZE;
+		size_t clGlobalSize = gpuInds * WORK_GROUP_SIZE;
+
+		first = oclWriteAsync(clCommandQueue, clPopulationBuff, popflat, MAX_IND_LEN * gpuInds, ocl_after(), "coop write population");
+		ocl_future lengths = oclWriteAsync(clCommandQueue, clLengthBuff, inds_len, gpuInds, ocl_after(), "coop write lengths");
+		oclSetArgs(clKernel1, clPopulationBuff, clLengthBuff, clEvaluateBuff, clTrainInBuff, clConstantBuff);
+		ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel1, 1, &clGlobalSize, &clLocalSize, ocl_after(first, lengths), "coop fitness");
+		last = oclReadAsync(clCommandQueue, clEvaluateBuff, eval_results, gpuInds * TRAIN_SIZE, ocl_after(exec), "coop read eval results");
+		clFlush(clCommandQueue);
+	}
+
+	unsigned long long cpuStart = benchNowNs();
+	cpu_fitness(fitness_gpu, gpuInds, popSize, oclCoopThreads());
+	double cpuMs = (benchNowNs() - cpuStart) * 1.0e-6;
+
+	last.wait();
+	benchSetThreads(1);
+	score_eval_results(eval_results, 0, gpuInds);
+	stop_measure_time(COOP);
+
+	oclCoopUpdate(&clCoop, gpuInds, oclCoopEventMs(first.get(), last.get()), popSize - gpuInds, cpuMs);
+	benchArenaRelease(mark);
+}
+
 void ocl_fitness_func()
 {
-	float *eval_results = (float *)malloc(sizeof(float) * POP_SIZE * TRAIN_SIZE);
-	char *popflat = (char *)malloc(MAX_IND_LEN * POP_SIZE);
+	if (oclCoopEnabled())
+	{
+		coop_fitness_func();
+		return;
+	}
+
+	// scratch of this generation, from the host arena so the generations after the first do not allocate
+	size_t mark = benchArenaMark();
+	float *eval_results = (float *)benchArenaAlloc(sizeof(float) * popSize * TRAIN_SIZE);
+	char *popflat = (char *)benchArenaAlloc(MAX_IND_LEN * popSize);
 	int ind_len;
 
-	for (int i=0; i<POP_SIZE; i++)
+	for (int i=0; i<popSize; i++)
 	{
 		ind_len = length(pop[i]);
 		memcpy(popflat + i*MAX_IND_LEN, pop[i], MAX_IND_LEN);
 		for (int j=0; j<3; j++) 	// just to be sure we are safe
 			popflat[i*MAX_IND_LEN + ind_len + j] = '*';
 		inds_len[i] = ceil((float)ind_len / 4);
+		for (int j=0; j<ind_len; j++)
+			roofFuncNodes += IS_FUNC(pop[i][j]);
+		roofNodes += ind_len;
 	}
+	roofIndividuals += popSize;
 
 	// write and transfer new population into the GPU's memory
 	start_measure_time(WRDEV);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, clPopulationBuff, CL_TRUE, 0, sizeof(char) * MAX_IND_LEN * POP_SIZE, popflat, 0, NULL, NULL);
-	clErr |= clEnqueueWriteBuffer(clCommandQueue, clLengthBuff, CL_TRUE, 0, sizeof(int) * POP_SIZE, inds_len, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing buffer!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+	ocl_future population = oclWriteAsync(clCommandQueue, clPopulationBuff, popflat, MAX_IND_LEN * popSize, ocl_after(), "WRDEV population");
+	ocl_future lengths = oclWriteAsync(clCommandQueue, clLengthBuff, inds_len, popSize, ocl_after(), "WRDEV lengths");
+	population.wait();
+	lengths.wait();
 	stop_measure_time(WRDEV);
 
-	clErr = clSetKernelArg(clKernel1, 0, sizeof(cl_mem), &clPopulationBuff);
-	clErr |= clSetKernelArg(clKernel1, 1, sizeof(cl_mem), &clLengthBuff);
-	clErr |= clSetKernelArg(clKernel1, 2, sizeof(cl_mem), &clEvaluateBuff);
-	clErr |= clSetKernelArg(clKernel1, 3, sizeof(cl_mem), &clTrainInBuff);
-	clErr |= clSetKernelArg(clKernel1, 4, sizeof(cl_mem), &clConstantBuff);
-	if (clErr != CL_SUCCESS)
-	{
-		printf("Error in clSetKernelArg!, clErr=%i \n", clErr);
+	if (oclSetArgs(clKernel1, clPopulationBuff, clLengthBuff, clEvaluateBuff, clTrainInBuff, clConstantBuff) != CL_SUCCESS)
 		exit(1);
-	}
 
 	size_t clLocalSize = WORK_GROUP_SIZE;
-	size_t clGlobalSize = POP_SIZE * WORK_GROUP_SIZE;
+	size_t clGlobalSize = popSize * WORK_GROUP_SIZE;
 
 	start_measure_time(KERNEL_EXEC);
-//	while(1)
-//	{
-	clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel1, 1, NULL, &clGlobalSize, &clLocalSize, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		printf("Error in launching kernel!, clErr=%i \n", clErr);
+	ocl_future exec = oclLaunchAsync(clCommandQueue, clKernel1, 1, &clGlobalSize, &clLocalSize, ocl_after(population, lengths), "fitness");
+	if (exec.wait() != CL_SUCCESS)
 		exit(1);
-	}
-//	}
-	clFinish(clCommandQueue);
 	stop_measure_time(KERNEL_EXEC);
 
 	start_measure_time(RDDEV);
-	clErr = clEnqueueReadBuffer(clCommandQueue, clEvaluateBuff, CL_TRUE, 0, sizeof(float) * POP_SIZE * TRAIN_SIZE, eval_results, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		printf("Error in reading buffer!, clErr=%i \n", clErr);
+	if (oclReadAsync(clCommandQueue, clEvaluateBuff, eval_results, popSize * TRAIN_SIZE, ocl_after(exec), "RDDEV eval results").wait() != CL_SUCCESS)
 		exit(1);
-	}
-	clFinish(clCommandQueue);
 	stop_measure_time(RDDEV);
 
 	start_measure_time(GPU_SEQ);
 
-	omp_set_num_threads(1);
-	#pragma omp parallel
-		#pragma omp for
-			for (int i=0; i<POP_SIZE; i++)
-			{
-				fitness_gpu[i] = 0;
-				for (int j=0; j<TRAIN_SIZE; j++)
-				{
-					if (eval_results[i * TRAIN_SIZE + j] > 0 && train_set_out[j] == 1)
-						fitness_gpu[i]++;
-					else if (eval_results[i * TRAIN_SIZE + j] <= 0 && train_set_out[j] == 0)
-						fitness_gpu[i]++;
-				}
-			}
+	benchSetThreads(1);
+	score_eval_results(eval_results, 0, popSize);
 	stop_measure_time(GPU_SEQ);
 
-	free(eval_results);
-	free(popflat);
+	benchArenaRelease(mark);
+}
+#else
+void ocl_fitness_func()
+{
+	// selection and gen_per() read fitness_gpu, so the CPU-only build feeds it from the CPU path
+	memcpy(fitness_gpu, fitness_cpu, sizeof(fitness_gpu));
 }
+#endif /* CPU_ONLY */
 
 void printResult()
 {
@@ -838,8 +880,9 @@ void printResult()
 	fseek (fio, 0, SEEK_END);
 	int appendPos = ftell(fio);
 
-	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ];
-	float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[GPU_SEQ];
+	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV] + timeRes[KERNEL_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ] + timeRes[COOP];
+	float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[GPU_SEQ] + timeRes[COOP];
+	double total_GPU_fair_J = benchPhaseJoules(KERNEL_EXEC) + benchPhaseJoules(WRDEV) + benchPhaseJoules(RDDEV) + benchPhaseJoules(GPU_SEQ) + benchPhaseJoules(COOP);
 
 	struct tm *local;
 	time_t t;
@@ -853,6 +896,13 @@ void printResult()
 	fprintf(fio, "Created on: %s", asctime(local));
 	fprintf(fio, "Host name: %s \n", hostName);
 	fprintf(fio, "Description: %s \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n", clRuntime.deviceName, clRuntime.platformName);
+	oclPrintCacheStats(fio);
+	oclPrintCoopReport(fio, &clCoop, COOP, "individuals");
+#else
+	fprintf(fio, "Device: none, CPU-only build \n");
+#endif
 	fprintf(fio, "\n==============GP Parameters=====================\n");
 	fprintf(fio,
 				"GENERATION = %i, POP_SIZE = %i \n"
@@ -862,10 +912,11 @@ void printResult()
 				"CROSSOVER_RATE = %.2f, MUTATION_RATE = %.2f, REPRODUCT_RATE = %.2f \n"
 				"VAR_PROB = %.2f, CONST_PROB = %.2f, FUNC_PROB = %.2f \n"
 				"SEL_FUNC = %.2f, SEL_TERM = %.2f \n",
-				GENERATION, POP_SIZE, MAX_IND_LEN, MAX_DEPTH, NUM_CONST, MIN_RND, MAX_RND,
+				GENERATION, popSize, MAX_IND_LEN, MAX_DEPTH, NUM_CONST, MIN_RND, MAX_RND,
 				TRAIN_SIZE, CROSSOVER_RATE, MUTATION_RATE, REPRODUCT_RATE, VAR_PROB,
 				CONST_PROB, FUNC_PROB, SEL_FUNC, SEL_TERM
 			);
+	fprintf(fio, "CPU threads = %i \n", benchCpuThreads());
 
 	fprintf(fio, "\n===========Performance Measurements=================\n");
 	fprintf(fio, "GP Performance: \n"
@@ -879,7 +930,8 @@ void printResult()
 				(int)test_best_fit, test_best_len, ((int)test_best_fit * 100)/TEST_SIZE
 			);
 
-	fprintf(fio, "\nExecution times: \n"
+#ifndef CPU_ONLY
+	fprintf(fio, "\nExecution times (median over %i iterations of %i generations): \n"
 				"	PLATFORM = \t%10.2f msecs \n"
 				"	DEVICE = \t%10.2f msecs \n"
 				"	CONTEXT = \t%10.2f msecs \n"
@@ -891,6 +943,7 @@ void printResult()
 				"	KERNEL_EXEC = \t%10.2f msecs \n"
 				"	RDDEV = \t%10.2f msecs \n"
 				"	GPU_SEQ = \t%10.2f msecs \n",
+			   benchIterations(), GENERATION,
 			   timeRes[PLATFORM],
 			   timeRes[DEVICE],
 			   timeRes[CONTEXT],
@@ -908,6 +961,52 @@ void printResult()
 			"CPU time: \t\t%10.2f msecs \n\n",
 			total_GPU_time, total_GPU_fair_time, timeRes[CPU]);
 	fprintf(fio, "Speed UP: \t\t%10.2f \n\n", float(timeRes[CPU])/float(total_GPU_fair_time));
+	// a work-item runs one individual on 4 training points: one float4 operation per function node and a float4
+	// result out; the work-group shares the individual's nodes and length, the training set is read by all
+	double avgNodes = (roofIndividuals > 0.0) ? roofNodes / roofIndividuals : 0.0;
+	double avgFuncNodes = (roofIndividuals > 0.0) ? roofFuncNodes / roofIndividuals : 0.0;
+	ocl_kernel_cost gpCost = {"fitness", (double)popSize * WORK_GROUP_SIZE * GENERATION, 16.0 + (avgNodes + 4.0) / WORK_GROUP_SIZE,
+							  4.0 * avgFuncNodes, OCL_ROOF_FLOAT, timeRes[KERNEL_EXEC]};
+	oclPrintRooflineReport(fio, &gpCost, 1);
+#else
+	fprintf(fio, "\nCPU time (median over %i iterations of %i generations): \t%10.2f msecs \n\n",
+			benchIterations(), GENERATION, timeRes[CPU]);
+#endif
+	benchPrintEnergySummary(fio, total_GPU_fair_J, total_GPU_fair_time, benchPhaseJoules(CPU), timeRes[CPU], (double)popSize * GENERATION, "fitness evaluation");
+	benchPrintScalingReport(fio, (double)popSize * TRAIN_SIZE * GENERATION, "Mevals/s", 1.0e-6, total_GPU_fair_time);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+
+	bench_result res;
+	char workGroup[16];
+	sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+	resultsInit(&res, "gp");
+	res.description = description;
+#ifndef CPU_ONLY
+	res.device = clRuntime.deviceName;
+	res.platform = clRuntime.platformName;
+	res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+	res.driver = clRuntime.driverVersion;
+#else
+	resultsSetHostDevice(&res);
+#endif
+	res.problemSize = (long long)popSize * TRAIN_SIZE * GENERATION;
+	res.problemUnit = "evaluations";
+	res.workGroup = workGroup;
+	res.cpuMs = timeRes[CPU];
+	res.cpuThroughput = res.problemSize * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+	res.throughputUnit = "Mevals/s";
+#ifndef CPU_ONLY
+	res.variant = oclCoopName();
+	res.gpuMs = total_GPU_fair_time;
+	res.gpuThroughput = res.problemSize * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+	res.speedup = timeRes[CPU] / total_GPU_fair_time;
+#endif
+	res.gpuJ = total_GPU_fair_J;
+	res.cpuJ = benchPhaseJoules(CPU);
+	res.energyOps = (double)popSize * GENERATION;
+	res.energyOp = "fitness evaluation";
+	resultsWrite(&res);
 
 	fseek(fio, appendPos, SEEK_SET);
 	while(fgets(buff,sizeof buff,fio))
@@ -949,7 +1048,7 @@ void gen_per(int num)
 {
 	int idx = 0;
 	gen_best_fit = 0;
-	for (int i=0; i<POP_SIZE; i++)
+	for (int i=0; i<popSize; i++)
 		if (fitness_gpu[i] > gen_best_fit)
 		{
 			idx = 0;
@@ -970,15 +1069,163 @@ void gen_per(int num)
 	printf("Shortest length = %i \n", gen_best_len);
 }
 
-int main()
+// the measured loop: every iteration evolves GENERATION generations of popSize individuals
+void gp_run()
 {
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		benchBeginIteration(it);
+		// every iteration evolves the same initial population
+		if (it > 0)
+		{
+			benchTraceBegin("init population");
+			srand(0);
+			init_GP();
+			init_pop();
+			benchTraceEnd();
+		}
+#ifndef CPU_ONLY
+		oclWrite();
+#endif
+
+		fitness_func();
+		ocl_fitness_func();
+
+		if (it == 0)
+			for (int i=0; i<popSize; i++)
+			{
+				if (fitness_cpu[i] != fitness_gpu[i])
+					printf("mismatch at i = %i \n", i);
+				printf("fitness_gpu[%i] = %i, fitness_cpu[%i] = %i \n", i, fitness_gpu[i], i, fitness_cpu[i]);
+			}
+		for (int i=1; i<GENERATION; i++)
+		{
+			//printf("hello \n");
+			benchTraceBegin("next generation");
+			next_gen();
+			benchTraceEnd();
+			fitness_func();
+			ocl_fitness_func();
+			gen_per(i);
+		}
+		benchEndIteration();
+	}
+}
+
+// --sweep: random populations of every size instead of POP_SIZE individuals, see ../../common/benchSweep.h
+void gp_sweep()
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ, PGM, KERNEL};
+	long long sizes[BENCH_SWEEP_MAX];
+	int numSizes = benchSweepSizes(sizes, 32, MAX_POP_SIZE, 1);
+
+	for (int s=0; s<numSizes; s++)
+	{
+		if (sizes[s] > MAX_POP_SIZE)
+		{
+			printf("Sweep stopped at MAX_POP_SIZE = %i individuals \n", MAX_POP_SIZE);
+			break;
+		}
+		popSize = (int)sizes[s];
+		benchTraceBegin("init population");
+		srand(0);
+		init_GP();
+		init_pop();
+		benchTraceEnd();
+
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+#ifndef CPU_ONLY
+		oclBuffer();
+#endif
+		gp_run();
+		benchSummary(timeRes);
+
+		float total_GPU_fair_time = timeRes[KERNEL_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[GPU_SEQ] + timeRes[COOP];
+		float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + total_GPU_fair_time;
+#ifdef CPU_ONLY
+		total_GPU_fair_time = total_GPU_time = 0.0f;
+#endif
+		benchSweepAdd(popSize, timeRes[CPU], total_GPU_fair_time, total_GPU_time);
+
+		bench_result res;
+		char workGroup[16];
+		sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+		resultsInit(&res, "gp");
+		res.description = description;
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.variant = oclCoopName();
+#else
+		resultsSetHostDevice(&res);
+#endif
+		res.problemSize = (long long)popSize * TRAIN_SIZE * GENERATION;
+		res.problemUnit = "evaluations";
+		res.workGroup = workGroup;
+		res.cpuMs = timeRes[CPU];
+		res.cpuThroughput = res.problemSize * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+		res.throughputUnit = "Mevals/s";
+#ifndef CPU_ONLY
+		res.gpuMs = total_GPU_fair_time;
+		res.gpuTotalMs = total_GPU_time;
+		res.gpuThroughput = res.problemSize * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+		res.speedup = timeRes[CPU] / total_GPU_fair_time;
+		oclReleaseBuffers();
+#endif
+		resultsWrite(&res);
+	}
+
+	char hostName[50];
+	gethostname(hostName, 50);
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, size sweep on random populations, %i generations of %i training points \n", description, GENERATION, TRAIN_SIZE);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintSweepReport(fio, "individuals", "Mevals/s", (double)TRAIN_SIZE * GENERATION * 1.0e-6);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+int main(int argc, char **argv)
+{
+#ifndef CPU_ONLY
+	oclParseArgs(&argc, argv);
+#endif
+	benchParseArgs(&argc, argv);
+	resultsParseArgs(&argc, argv);
+	benchInit(phaseNames, NUM_PHASES);
 	srand(0);
 
+	benchTraceBegin("init population");
 	init_GP();
 	init_pop();
+	benchTraceEnd();
 
+#ifndef CPU_ONLY
 	oclInit();
+#endif
+	if (benchSweepEnabled())
+	{
+		gp_sweep();
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+#ifndef CPU_ONLY
 	oclBuffer();
+#endif
 
 //	size_t ws, ls;
 //	clGetKernelWorkGroupInfo(clKernel1, clDeviceId, CL_KERNEL_WORK_GROUP_SIZE, sizeof(ws), (void *) &ws, NULL);
@@ -986,24 +1233,13 @@ int main()
 //	clGetKernelWorkGroupInfo(clKernel1, clDeviceId, CL_KERNEL_LOCAL_MEM_SIZE , sizeof(ls), (void *) &ls, NULL);
 //	printf("CL_KERNEL_LOCAL_MEM_SIZE is: %i \n", ls);
 
-	fitness_func();
-	ocl_fitness_func();
-
-	for (int i=0; i<POP_SIZE; i++)
-	{
-		if (fitness_cpu[i] != fitness_gpu[i])
-			printf("mismatch at i = %i \n", i);
-		printf("fitness_gpu[%i] = %i, fitness_cpu[%i] = %i \n", i, fitness_gpu[i], i, fitness_cpu[i]);
-	}
-	for (int i=1; i<GENERATION; i++)
-	{
-		//printf("hello \n");
-		next_gen();
-		fitness_func();
-		ocl_fitness_func();
-		gen_per(i);
-	}
+	gp_run();
+	benchScalingRun(gp_scaling_call, NULL);
+	benchSummary(timeRes);
+#ifndef CPU_ONLY
+	oclReleaseBuffers();
 	oclClean();
+#endif
 	test_gp();
 	printResult();
 
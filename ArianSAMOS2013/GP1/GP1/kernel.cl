@@ -1,8 +1,19 @@
-#define MAX_IND_LEN  	200
-#define WORK_GROUP_SIZE	32
-#define TRAIN_SIZE		128
-#define NUM_CONST		20
-#define MAX_DEPTH		10
+/* The host passes these with -D (oclBuildVariant), the values here are only defaults */
+#ifndef MAX_IND_LEN
+ #define MAX_IND_LEN  	200
+#endif
+#ifndef WORK_GROUP_SIZE
+ #define WORK_GROUP_SIZE	32
+#endif
+#ifndef TRAIN_SIZE
+ #define TRAIN_SIZE		128
+#endif
+#ifndef NUM_CONST
+ #define NUM_CONST		20
+#endif
+#ifndef MAX_DEPTH
+ #define MAX_DEPTH		10
+#endif
 
 #define X			0
 #define Y			1
@@ -1,7 +1,16 @@
-#define SHIFT_SIZE		21
-#define GLOBAL_SIZE_0	(32*1024)
-#define PROFILE_SIZE	64
-#define TEMPLATE_SIZE	72
+/* The host passes these with -D (oclBuildVariant), the values here are only defaults */
+#ifndef SHIFT_SIZE
+ #define SHIFT_SIZE		21
+#endif
+#ifndef GLOBAL_SIZE_0
+ #define GLOBAL_SIZE_0	(32*1024)
+#endif
+#ifndef PROFILE_SIZE
+ #define PROFILE_SIZE	64
+#endif
+#ifndef TEMPLATE_SIZE
+ #define TEMPLATE_SIZE	72
+#endif
 
 __kernel void pm_part1(__global float *tmp_pf_db, __global float *inm_tmp_pf_db, __global char *tmp_exc , __global float *tmp_exc_mean,
 					 __global float *noise_shift, float test_noise, float test_noise_db)
@@ -11,8 +11,8 @@
  *  For debugging, you may also put a break point to see the statements printed on the screen
  *
  *  IMPORTANT NOTE: This code is not stable. 2 parts of the compute intensive part have been
- *  implemented but one part has not been implemented yet. See below for hints. #pragma omp 
- *  has been commented but should be enabled for openmp.
+ *  implemented but one part has not been implemented yet. See below for hints. The template
+ *  loop of pmCPU runs on --threads OpenMP threads.
  *
  *  Bug reports and fixes are truly welcome at unmesh.bordoloi@liu.se but has no guarantee of a reply :D
  */ 
@@ -49,11 +49,35 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
-#include <CL/cl.h>
-#include <omp.h>
+#ifndef CPU_ONLY
+ #include <CL/cl.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
 
 #include "PcaCArray.h"
 #include "PcaCTimer.h"
+#ifndef CPU_ONLY
+ #include "oclRuntime.h"
+ #include "oclProgramCache.h"
+ #include "oclMemPool.h"
+ #include "oclCoop.h"
+ #include "oclRoofline.h"
+ #include "oclTrace.h"
+ #include "oclHandles.h"
+ #ifdef SAMOS_EMBED_KERNELS
+  #include "samosKernels.h"
+ #endif
+#endif
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchSweep.h"
+#include "benchServe.h"
+#include "benchArena.h"
+#include "benchScaling.h"
 
 
 // Include sys/time.h in Linux environments
@@ -70,15 +94,9 @@
  #include <sys/time.h> // linux machines
 #endif
 
-#define NUM_CORES		1
 /*-------------------OpenCL Definitions-----------------------*/
-#define FERMI
+// The platform and device are picked at run time, see ../../common/oclRuntime.h
 
-#ifdef FERMI
-cl_platform_id 		clPlatformId[3];
-#else
-cl_platform_id		clPlatformId;
-#endif
 #define PLATFORM		0
 #define DEVICE			1
 #define CONTEXT			2
@@ -92,41 +110,45 @@ cl_platform_id		clPlatformId;
 #define RDDEV			10
 #define CPU				11
 #define GPU_SEQ			12
+#define COOP			13		// the templates shared by the device and the CPU, with --coop
+#define NUM_PHASES		14
+
+const char *phaseNames[NUM_PHASES] = {"PLATFORM", "DEVICE", "CONTEXT", "CMDQ", "PGM", "KERNEL", "KERNEL1_EXEC",
+									  "KERNEL2_EXEC", "BUFF", "WRDEV", "RDDEV", "CPU", "GPU_SEQ", "COOP"};
 
 #define GLOBAL_SIZE_0		(32*1024)
 #define WORK_GROUP_SIZE		PROFILE_SIZE
 
-cl_program 			clProgram;
+#ifndef CPU_ONLY
+ocl_runtime			clRuntime;
+
+ocl_handle<cl_program>	clProgram;
 cl_device_id 		clDeviceId;
 cl_context 			clContext;
-cl_kernel 			clKernel1;
-cl_kernel 			clKernel2;
+ocl_handle<cl_kernel>	clKernel1;
+ocl_handle<cl_kernel>	clKernel2;
 cl_command_queue 	clCommandQueue;
 cl_int 				clErr;
 
-cl_mem				cl_tmp_pf_db;
-cl_mem				cl_inm_tmp_pf_db;
-cl_mem				cl_tmp_exc;
-cl_mem				cl_tmp_exc_mean;
-cl_mem 				cl_noise_shift;
-cl_mem				cl_test;
-
-cl_mem				cl_weighted_MSEs;
-//cl_mem 				cl_num_tmp_exc;
-cl_mem 				cl_test_pf_db;
-cl_mem 				cl_test_exc_means;
-//cl_mem 				cl_pwr_ratio;
+ocl_buffer<float>	cl_tmp_pf_db;
+ocl_buffer<float>	cl_inm_tmp_pf_db;
+ocl_buffer<char>	cl_tmp_exc;
+ocl_buffer<float>	cl_tmp_exc_mean;
+ocl_buffer<float>	cl_noise_shift;
+ocl_buffer<float>	cl_test;
+
+ocl_buffer<float>	cl_weighted_MSEs;
+ocl_buffer<float>	cl_test_pf_db;
+ocl_buffer<float>	cl_test_exc_means;
 size_t 				clGlobalSize[2];
 size_t 				clLocalSize[2];
+ocl_coop			clCoop;
+#endif
 
-struct timeval 		start[15];
-struct timeval 		stop[15];
 float 				timeRes[15] = {0};
 
-FILE 				*fp;
 FILE 				*fio;
 char 				buff[256];
-char 				*kernelSrc;
 char 				description[256] = "Pattern Matching from HPEC, data set 1";
 
 /*-------------------Application Definitions-----------------------*/
@@ -177,193 +199,174 @@ PcaCArrayInt   	patnum;
 
 float *test1;
 float test2[72];
-float *GPU_weighted_MSEs = (float *)malloc(sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE);
-float *CPU_weighted_MSEs = (float *)malloc(sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE);
-float *test = (float *)malloc(sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE);
+int numTemplates = TEMPLATE_SIZE;		// the library size, --sweep varies it
+float *GPU_weighted_MSEs = NULL;
+float *CPU_weighted_MSEs = NULL;
+float *test = NULL;
+float *template_noise_shift = NULL;
+
+/* (Re)allocates the per-template outputs for numTemplates templates */
+void pm_alloc()
+{
+	free(GPU_weighted_MSEs);
+	free(CPU_weighted_MSEs);
+	free(test);
+	free(template_noise_shift);
+	GPU_weighted_MSEs = (float *)malloc(sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE);
+	CPU_weighted_MSEs = (float *)malloc(sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE);
+	test = (float *)malloc(sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE);
+	template_noise_shift = (float *)malloc(sizeof(float) * numTemplates);
+}
 
 void start_measure_time(int seg)
 {
-    gettimeofday(&start[seg], NULL);
+	benchStart(seg);
 }
 
 void stop_measure_time(int seg)
 {
-    gettimeofday(&stop[seg], NULL);
-    timeRes[seg] += 1000 * ((float)(float)(stop[seg].tv_sec  - start[seg].tv_sec) + 1.0e-6 * (stop[seg].tv_usec - start[seg].tv_usec));
+	benchStop(seg);
 }
 
+#ifndef CPU_ONLY
 void oclInit()
 {
 	/*-----------------------get platform---------------------------*/
 	start_measure_time(PLATFORM);
-	#ifdef FERMI
-		if (clGetPlatformIDs(3, (cl_platform_id *)&clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId[1], CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#else
-		if (clGetPlatformIDs(1, &clPlatformId, NULL) != CL_SUCCESS)
-			printf("Error in clGetPlatformID! \n");
-		else
-		{
-			clGetPlatformInfo(clPlatformId, CL_PLATFORM_NAME, 200, buff, NULL);
-			printf("Platform ID: %s \n", buff);
-		}
-	#endif
+	if (oclGetPlatforms(&clRuntime) == 0)
+		exit(1);
 	stop_measure_time(PLATFORM);
 
 	/*-----------------------get device-----------------------------*/
 	start_measure_time(DEVICE);
-	#ifdef FERMI
-		if (clGetDeviceIDs(clPlatformId[1], CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#else
-		if (clGetDeviceIDs(clPlatformId, CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL) != CL_SUCCESS)
-			printf("Error in clGetDeviceIDs! \n");
-	#endif
-		else
-		{
-			clGetDeviceInfo(clDeviceId, CL_DEVICE_NAME, 200, buff, NULL);
-			printf("Device name: %s \n", buff);
-		}
+	if (oclSelectDevice(&clRuntime) != 0)
+		exit(1);
+	clDeviceId = clRuntime.device;
 	stop_measure_time(DEVICE);
 
 	/*-----------------------create context-------------------------*/
 	start_measure_time(CONTEXT);
-	clContext = clCreateContext(0, 1, (cl_device_id *) &clDeviceId, NULL, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating context!, clErr=%i \n", clErr);
-	else
-		printf("Context created! \n");
+	oclCreateContext(&clRuntime);
+	clContext = clRuntime.context;
 	stop_measure_time(CONTEXT);
 
 	/*---------------------create command queue---------------------*/
 	start_measure_time(CMDQ);
-	clCommandQueue = clCreateCommandQueue(clContext, clDeviceId, CL_QUEUE_PROFILING_ENABLE, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating command queue!, clErr=%i \n", clErr);
-	else
-		printf("Command queue created! \n");
+	oclCreateQueue(&clRuntime, CL_QUEUE_PROFILING_ENABLE);
+	clCommandQueue = clRuntime.queue;
 	stop_measure_time(CMDQ);
+	oclCoopInit(&clCoop);
+	oclRooflineMeasure(&clRuntime);
+    printf("OpenCL init was successful\n");
+}
+
+/* Builds the program for numTemplates templates, again for every size of a sweep */
+void oclProgram()
+{
+	char options[OCL_OPTIONS_LEN] = "";
 
 	/*------------------create and build program--------------------*/
+#ifdef SAMOS_EMBED_KERNELS
+	oclEmbedKernelSources(samosKernelSources);
+#endif
+	// the kernel takes its sizes from here rather than keeping its own copies
+	oclDefine(options, "SHIFT_SIZE", SHIFT_SIZE);
+	oclDefine(options, "GLOBAL_SIZE_0", GLOBAL_SIZE_0);
+	oclDefine(options, "PROFILE_SIZE", PROFILE_SIZE);
+	oclDefine(options, "TEMPLATE_SIZE", numTemplates);
 	start_measure_time(PGM);
-	int filelen;
-	int readlen;
-
-	fp = fopen("kernel.cl", "r");
-	// getting size of the file
-	fseek(fp, 0, SEEK_END);  //set position indicator to the end of file
-	filelen = ftell(fp);	//return the current value of position indicator
-	rewind(fp);	//set position indicator to the beginning
-
-	kernelSrc = (char*) malloc(sizeof(char) * (filelen + 1));
-	readlen = fread(kernelSrc, 1, filelen, fp);
-	if (readlen < filelen)
-		kernelSrc[readlen] = '\0';
-	else
-		kernelSrc[filelen] = '\0';
-
-	clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program!, clErr=%i \n", clErr);
-	else
-		printf("Program created! \n");
-
-	clErr = clBuildProgram(clProgram, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 1!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program built! \n");
+	clProgram.reset(oclBuildVariant(&clRuntime, "kernel.cl", options));
+	if (clProgram == NULL)
+		exit(1);
 	stop_measure_time(PGM);
 
 	/*-----------------------create kernel------------------------*/
 	start_measure_time(KERNEL);
-	clKernel1 = clCreateKernel(clProgram, "pm_part1", &clErr);
-	clKernel2 = clCreateKernel(clProgram, "pm_part2", &clErr);
+	clKernel1.reset(clCreateKernel(clProgram, "pm_part1", &clErr));
+	clKernel2.reset(clCreateKernel(clProgram, "pm_part2", &clErr));
 	if (clErr != CL_SUCCESS)
 			printf("Error in creating kernel!, clErr=%i \n", clErr);
 	else printf("Kernel created! \n");
-	fclose(fp);
-	free(kernelSrc);
 	stop_measure_time(KERNEL);
-    printf("OpenCL init was successful\n");
 }
 
-void oclBuffer(float *template_profiles_db, float *noise_shift, float *test_exc_means, float *test_pf_db)
+void oclBuffer()
 {
 	/*-----------------------create buffer------------------------*/
-	printf("OpenCL buffer creation and writing begins now ");
+	printf("OpenCL buffer creation begins now ");
 	start_measure_time(BUFF);
-	cl_tmp_pf_db = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(cl_float) * TEMPLATE_SIZE * PROFILE_SIZE, NULL, &clErr);
+	cl_tmp_pf_db.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_WRITE, sizeof(cl_float) * numTemplates * PROFILE_SIZE, &clErr), numTemplates * PROFILE_SIZE);
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating buffer cl_tmp_pf_db!, clErr=%i \n", clErr);
-	cl_inm_tmp_pf_db = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(cl_float) * TEMPLATE_SIZE * PROFILE_SIZE, NULL, &clErr);
+	cl_inm_tmp_pf_db.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_WRITE, sizeof(cl_float) * numTemplates * PROFILE_SIZE, &clErr), numTemplates * PROFILE_SIZE);
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_inm_tmp_pf_db!, clErr=%i \n", clErr);
-	cl_tmp_exc = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(char) * TEMPLATE_SIZE * PROFILE_SIZE, NULL, &clErr);
+	cl_tmp_exc.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_WRITE, sizeof(char) * numTemplates * PROFILE_SIZE, &clErr), numTemplates * PROFILE_SIZE);
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_tmp_exc!, clErr=%i \n", clErr);
-	cl_tmp_exc_mean = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(cl_float) * TEMPLATE_SIZE, NULL, &clErr);
+	cl_tmp_exc_mean.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_WRITE, sizeof(cl_float) * numTemplates, &clErr), numTemplates);
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_tmp_exc_mean!, clErr=%i \n", clErr);
-	cl_noise_shift = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * TEMPLATE_SIZE, NULL, &clErr);
+	cl_noise_shift.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(float) * numTemplates, &clErr), numTemplates);
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_noise_shift!, clErr=%i \n", clErr);
 
-	cl_test = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE, NULL, &clErr);
+	cl_test.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_WRITE_ONLY, sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE, &clErr), numTemplates * SHIFT_SIZE * PROFILE_SIZE);
     if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_test!, clErr=%i \n", clErr);
-	cl_weighted_MSEs = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE, NULL, &clErr);
+	cl_weighted_MSEs.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_WRITE_ONLY, sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE, &clErr), numTemplates * SHIFT_SIZE * PROFILE_SIZE);
     if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_weighted_MSEs!, clErr=%i \n", clErr);
-//	cl_num_tmp_exc = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(char) * TEMPLATE_SIZE, NULL, &clErr);
-	cl_test_pf_db = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * PROFILE_SIZE, NULL, &clErr);
+	cl_test_pf_db.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(float) * PROFILE_SIZE, &clErr), PROFILE_SIZE);
     if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_test_pf_db!, clErr=%i \n", clErr);
-	cl_test_exc_means = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * SHIFT_SIZE, NULL, &clErr);
+	cl_test_exc_means.reset(oclPoolDeviceBuffer(&clRuntime, CL_MEM_READ_ONLY, sizeof(float) * SHIFT_SIZE, &clErr), SHIFT_SIZE);
     if (clErr != CL_SUCCESS)
 		printf("Error in creating image cl_test_exc_means!, clErr=%i \n", clErr);
-//	cl_pwr_ratio = clCreateBuffer(clContext, CL_MEM_READ_ONLY, sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE, NULL, &clErr);
 	stop_measure_time(BUFF);
+	printf("OpenCL buffer creation was successful");
+}
 
+void oclWrite(float *template_profiles_db, float *noise_shift, float *test_exc_means, float *test_pf_db)
+{
 	/*-----------------------write into device--------------------*/
 	start_measure_time(WRDEV);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, cl_tmp_pf_db, true, 0, sizeof(cl_float) * TEMPLATE_SIZE * PROFILE_SIZE, template_profiles_db, 0, NULL, NULL);
-    if (clErr != CL_SUCCESS)
-		printf("Error in writing image cl_tmp_pf_db!, clErr=%i \n", clErr);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, cl_noise_shift, true, 0, sizeof(cl_float) * TEMPLATE_SIZE, noise_shift, 0, NULL, NULL);
-    if (clErr != CL_SUCCESS)
-		printf("Error in writing image cl_noise_shift!, clErr=%i \n", clErr);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, cl_test_exc_means, true, 0, sizeof(cl_float) * SHIFT_SIZE, test_exc_means, 0, NULL, NULL);
-    if (clErr != CL_SUCCESS)
-		printf("Error in writing image cl_test_exc_means!, clErr=%i \n", clErr);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, cl_test_pf_db, true, 0, sizeof(cl_float) * PROFILE_SIZE, test_pf_db, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in writing image cl_test_pf_db!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
+	ocl_future templates = oclWriteAsync(clCommandQueue, cl_tmp_pf_db, template_profiles_db, cl_tmp_pf_db.size(), ocl_after(), "WRDEV template profiles");
+	ocl_future noise = oclWriteAsync(clCommandQueue, cl_noise_shift, noise_shift, cl_noise_shift.size(), ocl_after(), "WRDEV noise shift");
+	ocl_future means = oclWriteAsync(clCommandQueue, cl_test_exc_means, test_exc_means, cl_test_exc_means.size(), ocl_after(), "WRDEV test exceed means");
+	ocl_future test = oclWriteAsync(clCommandQueue, cl_test_pf_db, test_pf_db, cl_test_pf_db.size(), ocl_after(), "WRDEV test profile");
+	templates.wait();
+	noise.wait();
+	means.wait();
+	test.wait();
 	stop_measure_time(WRDEV);
-	printf("OpenCL buffer creation and writing was successful");
+}
+
+void oclReleaseBuffers()
+{
+	cl_inm_tmp_pf_db.reset();
+	cl_tmp_pf_db.reset();
+	cl_tmp_exc.reset();
+	cl_tmp_exc_mean.reset();
+	cl_noise_shift.reset();
+	cl_test.reset();
+	cl_weighted_MSEs.reset();
+	cl_test_pf_db.reset();
+	cl_test_exc_means.reset();
+}
+
+void oclReleaseProgram()
+{
+	clKernel1.reset();
+	clKernel2.reset();
+	clProgram.reset();
 }
 
 void oclClean()
 {
-	clReleaseContext(clContext);
-	clReleaseCommandQueue(clCommandQueue);
-	clReleaseProgram(clProgram);
-	clReleaseMemObject(cl_inm_tmp_pf_db);
-	clReleaseMemObject(cl_tmp_pf_db);
-	clReleaseMemObject(cl_tmp_exc);
-	clReleaseMemObject(cl_tmp_exc_mean);
-	clReleaseKernel(clKernel1);
+	oclRelease(&clRuntime);
 }
+#endif /* CPU_ONLY */
 /***********************************************************************/
 /* We found out the bottle neck of this kernel was in the pow and log
  * functions. Therefore, we have implemented our own log and pow, instead
@@ -548,38 +551,30 @@ void clean(PmData *pmdata)
 }
 
 /***********************************************************************/
-int pmGPU(PmData *pmdata)
+#ifndef CPU_ONLY
+/* Host part of the device path: clips the test profile and computes the test exceed means and
+ * the noise shift of every template */
+void pm_gpu_prepare(PmData *pmdata, float *noise_shift, float *test_noise_out, float *test_noise_db_out)
 {
-	start_measure_time(GPU_SEQ);
-	int    elsize               		= pmdata->elsize;
 	float *test_profile_db     		 	= pmdata->test_profile_db;
 	float *template_profiles_db		 	= pmdata->template_profiles_db;
 	float *test_exceed_means 			= pmdata->test_exceed_means;
 
-	float sumWeights_inv = 1.0f / PROFILE_SIZE;
 	float test_noise = ( pow10fpm(test_profile_db[0]*0.1f) +              /* noise level of the test pattern */
 			       pow10fpm(test_profile_db[PROFILE_SIZE-1]*0.1f) ) * 0.5f;
 
 	float test_peak;
 	float template_peak;
-	float noise_shift[TEMPLATE_SIZE];
 
-	float power_shift, ave_power_ratio;
-	float power_ratio;
-	int patsize = PROFILE_SIZE*elsize;
 	int half_shift_size = (int)ceil((float)(SHIFT_SIZE) / 2.0f);
 	float test_noise_db        = (test_noise == 0.0f) ? -100.0f : 10.0f * log10fpm(fabs(test_noise)); /* test noise in dB */
 	float test_noise_db_plus_3 = test_noise_db + 3.0f;
-	float *cur_tp, *fptr, *fptr2, *fptr3, *endptr;
+	float *cur_tp, *fptr, *fptr2, *endptr;
 
 	float sum_exceed = 0.0f;
 	int num_test_exceed;
-	int num_template_exceed[TEMPLATE_SIZE] = {0};
 
 	int i;
-	uchar *bptr;
-	uchar *template_exceed   = (uchar *)malloc(sizeof(uchar) * PROFILE_SIZE * TEMPLATE_SIZE);
-	float *template_exceed_mean = (float *)malloc(sizeof(float) * TEMPLATE_SIZE);
 
 	fptr = test_profile_db;
 	test_peak = *fptr++;
@@ -617,7 +612,7 @@ int pmGPU(PmData *pmdata)
 		*fptr2++ = num_test_exceed ? sum_exceed / (float)(num_test_exceed) : 0.0f;
 	} /* for (current_shift=0; current_shift<shift_size; current_shift++) */
 
-	for (int template_index=0; template_index<TEMPLATE_SIZE; template_index++)
+	for (int template_index=0; template_index<numTemplates; template_index++)
 	{
 		cur_tp = template_profiles_db+(template_index*PROFILE_SIZE);
 		fptr = cur_tp;
@@ -628,50 +623,54 @@ int pmGPU(PmData *pmdata)
 
 		noise_shift[template_index] = test_peak - template_peak;
 	}
+	*test_noise_out = test_noise;
+	*test_noise_db_out = test_noise_db;
+}
+
+/* Sets the launch size of kernel2 for numofWorkItems items, PROFILE_SIZE per work-group */
+void pm_kernel2_size(int numofWorkItems)
+{
+	clLocalSize[0] = PROFILE_SIZE;
+	clLocalSize[1] = 1;
+
+	if (numofWorkItems >= GLOBAL_SIZE_0)
+	{
+		clGlobalSize[0] = GLOBAL_SIZE_0;
+		clGlobalSize[1] = (numofWorkItems % GLOBAL_SIZE_0 == 0) ? numofWorkItems/GLOBAL_SIZE_0 : numofWorkItems/GLOBAL_SIZE_0 + 1;
+	}
+	else
+	{
+		clGlobalSize[0] = (numofWorkItems % WORK_GROUP_SIZE == 0) ? numofWorkItems : numofWorkItems + WORK_GROUP_SIZE - (numofWorkItems % WORK_GROUP_SIZE);
+		clGlobalSize[1] = 1;
+	}
+}
+
+int pmGPU(PmData *pmdata)
+{
+	start_measure_time(GPU_SEQ);
+	float *test_profile_db     		 	= pmdata->test_profile_db;
+	float *template_profiles_db		 	= pmdata->template_profiles_db;
+	float *test_exceed_means 			= pmdata->test_exceed_means;
+
+	float test_noise, test_noise_db;
+	float *noise_shift = template_noise_shift;
+
+	pm_gpu_prepare(pmdata, noise_shift, &test_noise, &test_noise_db);
 	stop_measure_time(GPU_SEQ);
 
 	/*--------------------------------OpenCL---------------------------------*/
-	oclInit();
-	printf("Between OpenCL Init and Buffer creation");
-	oclBuffer(template_profiles_db, noise_shift, test_exceed_means, test_profile_db);
+	oclWrite(template_profiles_db, noise_shift, test_exceed_means, test_profile_db);
 
  	/*-------------------------launch kernel1--------------------------------*/
- 	clSetKernelArg(clKernel1, 0, sizeof(cl_mem), &cl_tmp_pf_db);
- 	clSetKernelArg(clKernel1, 1, sizeof(cl_mem), &cl_inm_tmp_pf_db);
- 	clSetKernelArg(clKernel1, 2, sizeof(cl_mem), &cl_tmp_exc);
- 	clSetKernelArg(clKernel1, 3, sizeof(cl_mem), &cl_tmp_exc_mean);
- 	clSetKernelArg(clKernel1, 4, sizeof(cl_mem), &cl_noise_shift);
- 	clSetKernelArg(clKernel1, 5, sizeof(float), &test_noise);
- 	clSetKernelArg(clKernel1, 6, sizeof(float), &test_noise_db);
-
- 	clGlobalSize[0] = TEMPLATE_SIZE * PROFILE_SIZE;
+	oclSetArgs(clKernel1, cl_tmp_pf_db, cl_inm_tmp_pf_db, cl_tmp_exc, cl_tmp_exc_mean, cl_noise_shift, test_noise, test_noise_db);
+
+ 	clGlobalSize[0] = numTemplates * PROFILE_SIZE;
  	clGlobalSize[1] = 1;
  	clLocalSize[0] = WORK_GROUP_SIZE;
  	clLocalSize[1] = 1;
 
- 	cl_event prof_event;
-
- 	clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel1, 2, 0, clGlobalSize, clLocalSize, 0, NULL, &prof_event);
- 	if (clErr != CL_SUCCESS)
-		printf("Error in executing kernel1!, clErr=%i \n", clErr);
-	clFinish(clCommandQueue);
-
-	cl_ulong queued_time = (cl_ulong)0;
-	cl_ulong submitted_time = (cl_ulong)0;
-	cl_ulong start_time = (cl_ulong)0;
-	cl_ulong end_time   = (cl_ulong)0;
-	size_t return_bytes;
-
-	clErr = clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, &return_bytes);
-	clErr = clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, &return_bytes);
-	if (clErr != CL_SUCCESS)
-	{
-		printf("Error in clGetEvent!, clErr=%i \n", clErr);
-		exit(1);
-	}
-	timeRes[KERNEL1_EXEC] = (end_time-submitted_time) * 1.0e-6;
+ 	// both kernels are timed from their events, so kernel2 is queued behind kernel1 without waiting in between
+ 	ocl_future exec1 = oclLaunchAsync(clCommandQueue, clKernel1, 2, clGlobalSize, clLocalSize, ocl_after(), "pm_part1");
 
 /*-----------------------read from device---------------------*/
 /*
@@ -705,43 +704,29 @@ int pmGPU(PmData *pmdata)
 //	stop_measure_time(GPU_SEQ);
 
 	/*-------------------------launch kernel2--------------------------------*/
-	cl_tmp_pf_db = cl_inm_tmp_pf_db;
-	clSetKernelArg(clKernel2, 0, sizeof(cl_mem), &cl_tmp_pf_db);
-	clSetKernelArg(clKernel2, 1, sizeof(cl_mem), &cl_weighted_MSEs);
-	clSetKernelArg(clKernel2, 2, sizeof(cl_mem), &cl_tmp_exc);
-	clSetKernelArg(clKernel2, 3, sizeof(cl_mem), &cl_tmp_exc_mean);
-	clSetKernelArg(clKernel2, 4, sizeof(cl_mem), &cl_test_pf_db);
-	clSetKernelArg(clKernel2, 5, sizeof(cl_mem), &cl_test_exc_means);
-	clSetKernelArg(clKernel2, 6, sizeof(float), &test_noise_db);
-	clSetKernelArg(clKernel2, 7, sizeof(cl_mem), &cl_test);
-
-	int numofWorkItems = TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE;
-	clLocalSize[0] = PROFILE_SIZE;
-	clLocalSize[1] = 1;
+	// kernel2 reads the templates kernel1 wrote, cl_tmp_pf_db itself stays the input of the next iteration
+	oclSetArgs(clKernel2, cl_inm_tmp_pf_db, cl_weighted_MSEs, cl_tmp_exc, cl_tmp_exc_mean, cl_test_pf_db, cl_test_exc_means,
+			   test_noise_db, cl_test);
 
-	if (numofWorkItems >= GLOBAL_SIZE_0)
-	{
-		clGlobalSize[0] = GLOBAL_SIZE_0;
-		clGlobalSize[1] = (numofWorkItems % GLOBAL_SIZE_0 == 0) ? numofWorkItems/GLOBAL_SIZE_0 : numofWorkItems/GLOBAL_SIZE_0 + 1;
-	}
-	else
-	{
-		clGlobalSize[0] = (numofWorkItems % WORK_GROUP_SIZE == 0) ? numofWorkItems : numofWorkItems + WORK_GROUP_SIZE - (numofWorkItems % WORK_GROUP_SIZE);
-		clGlobalSize[1] = 1;
-	}
+	pm_kernel2_size(numTemplates * SHIFT_SIZE * PROFILE_SIZE);
+
+	ocl_future exec2 = oclLaunchAsync(clCommandQueue, clKernel2, 2, clGlobalSize, clLocalSize, ocl_after(exec1), "pm_part2");
+	if (exec2.wait() != CL_SUCCESS)
+		exit(1);
+
+	cl_ulong submitted_time = (cl_ulong)0;
+	cl_ulong end_time   = (cl_ulong)0;
 
-	clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel2, 2, 0, clGlobalSize, clLocalSize, 0, NULL, &prof_event);
+	clErr = clGetEventProfilingInfo(exec1.get(), CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, NULL);
+	clErr |= clGetEventProfilingInfo(exec1.get(), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
 	if (clErr != CL_SUCCESS)
 	{
-		printf("Error in executing kernel2!, clErr=%i \n", clErr);
+		printf("Error in clGetEvent!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clFinish(clCommandQueue);
-
-	clErr |= clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued_time, &return_bytes);
-	clErr |= clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, &return_bytes);
-	clErr |= clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, &return_bytes);
-	clErr |= clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, &return_bytes);
+	benchAddNs(KERNEL1_EXEC, end_time-submitted_time);
+	clErr = clGetEventProfilingInfo(exec2.get(), CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted_time, NULL);
+	clErr |= clGetEventProfilingInfo(exec2.get(), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
 
 	start_measure_time(RDDEV);
    
@@ -749,7 +734,7 @@ int pmGPU(PmData *pmdata)
 *	The following lines may be commented for the purposes of performance measurement.
 *    They have the intermediate results from the second kernel in the GPU 
 */
-	clErr = clEnqueueReadBuffer(clCommandQueue, cl_weighted_MSEs, CL_TRUE, 0, sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE, GPU_weighted_MSEs, 0, NULL, NULL);
+	clErr = oclReadAsync(clCommandQueue, cl_weighted_MSEs, GPU_weighted_MSEs, cl_weighted_MSEs.size(), ocl_after(exec2), "RDDEV weighted MSEs").wait();
 //	clErr = clEnqueueReadBuffer(clCommandQueue, cl_test, CL_TRUE, 0, sizeof(float) * TEMPLATE_SIZE * SHIFT_SIZE * PROFILE_SIZE, test, 0, NULL, NULL);
 //	clErr = clEnqueueReadBuffer(clCommandQueue, cl_tmp_exc, CL_TRUE, 0, sizeof(char) * PROFILE_SIZE * TEMPLATE_SIZE, template_exceed, 0, NULL, NULL);
 //	clErr = clEnqueueReadBuffer(clCommandQueue, cl_tmp_exc_mean, CL_TRUE, 0, sizeof(float) * TEMPLATE_SIZE, template_exceed_mean, 0, NULL, NULL);
@@ -758,19 +743,67 @@ int pmGPU(PmData *pmdata)
 		printf("Error in reading buffer!, clErr=%i \n", clErr);
 		exit(1);
 	}
-	clFinish(clCommandQueue);
 	stop_measure_time(RDDEV);
 
-	timeRes[KERNEL2_EXEC] = (end_time-submitted_time) * 1.0e-6;
+	benchAddNs(KERNEL2_EXEC, end_time-submitted_time);
+	return 0;
+}
+
+int pmCPU(PmData *pmdata, int firstTemplate, int lastTemplate, float *weighted_MSEs, int numThreads);
+
+/* --coop: the device matches the first templates while the CPU threads match the rest on cpuData, whose
+ * library they scale in place. */
+int pmCoop(PmData *gpuData, PmData *cpuData)
+{
+	float test_noise, test_noise_db;
+	float *noise_shift = template_noise_shift;
+	ocl_future first, last;
+	int gpuTemplates = (int)oclCoopSplit(&clCoop, numTemplates, 1);
+
+	start_measure_time(COOP);
+	pm_gpu_prepare(gpuData, noise_shift, &test_noise, &test_noise_db);
+	if (gpuTemplates > 0)
+	{
+		first = oclWriteAsync(clCommandQueue, cl_tmp_pf_db, gpuData->template_profiles_db, gpuTemplates * PROFILE_SIZE, ocl_after(), "coop write template profiles");
+		ocl_future noise = oclWriteAsync(clCommandQueue, cl_noise_shift, noise_shift, gpuTemplates, ocl_after(), "coop write noise shift");
+		ocl_future means = oclWriteAsync(clCommandQueue, cl_test_exc_means, gpuData->test_exceed_means, SHIFT_SIZE, ocl_after(), "coop write test exceed means");
+		ocl_future test = oclWriteAsync(clCommandQueue, cl_test_pf_db, gpuData->test_profile_db, PROFILE_SIZE, ocl_after(), "coop write test profile");
+
+		oclSetArgs(clKernel1, cl_tmp_pf_db, cl_inm_tmp_pf_db, cl_tmp_exc, cl_tmp_exc_mean, cl_noise_shift, test_noise, test_noise_db);
+		clGlobalSize[0] = gpuTemplates * PROFILE_SIZE;
+		clGlobalSize[1] = 1;
+		clLocalSize[0] = WORK_GROUP_SIZE;
+		clLocalSize[1] = 1;
+		ocl_future exec1 = oclLaunchAsync(clCommandQueue, clKernel1, 2, clGlobalSize, clLocalSize, ocl_after(first, noise), "coop pm_part1");
+
+		oclSetArgs(clKernel2, cl_inm_tmp_pf_db, cl_weighted_MSEs, cl_tmp_exc, cl_tmp_exc_mean, cl_test_pf_db, cl_test_exc_means,
+				   test_noise_db, cl_test);
+		pm_kernel2_size(gpuTemplates * SHIFT_SIZE * PROFILE_SIZE);
+		ocl_future exec2 = oclLaunchAsync(clCommandQueue, clKernel2, 2, clGlobalSize, clLocalSize, ocl_after(exec1, means, test), "coop pm_part2");
+
+		last = oclReadAsync(clCommandQueue, cl_weighted_MSEs, GPU_weighted_MSEs, gpuTemplates * SHIFT_SIZE * PROFILE_SIZE, ocl_after(exec2), "coop read weighted MSEs");
+		clFlush(clCommandQueue);
+	}
+
+	unsigned long long cpuStart = benchNowNs();
+	pmCPU(cpuData, gpuTemplates, numTemplates, GPU_weighted_MSEs, oclCoopThreads());
+	double cpuMs = (benchNowNs() - cpuStart) * 1.0e-6;
+
+	last.wait();
+	stop_measure_time(COOP);
+
+	oclCoopUpdate(&clCoop, gpuTemplates, oclCoopEventMs(first.get(), last.get()), numTemplates - gpuTemplates, cpuMs);
+	return 0;
 }
+#endif /* CPU_ONLY */
 /***********************************************************************/
 /* The pattern match kernel overlays two patterns to compute the likelihood
  * that the two vectors match. This process is performed on a library of
- * patterns. */
+ * patterns. Templates [firstTemplate, lastTemplate) are matched on numThreads
+ * OpenMP threads, their squared errors go to weighted_MSEs. */
 /***********************************************************************/
-int pmCPU(PmData *pmdata)
+int pmCPU(PmData *pmdata, int firstTemplate, int lastTemplate, float *weighted_MSEs, int numThreads)
 {
-	start_measure_time(CPU);
 	int    elsize               = pmdata->elsize;               /* size of a single fp number    */
 	int    shift_size           = pmdata->shift_size;           /* number of shifting to the left and right of the test profile */
 	int    profile_size         = pmdata->profile_size;         /* number of pixels in a pattern */
@@ -808,14 +841,11 @@ int pmCPU(PmData *pmdata)
 	int patsize = profile_size*elsize; /* number of bytes of a pattern */
 
 	float *minimum_MSE_score = pmdata->minimum_MSE_score;
-	float *MSE_scores        = pmdata->MSE_scores;
 	float *mag_shift_scores  = pmdata->mag_shift_scores;
 
 	float test_noise_db        = (test_noise == 0.0f) ? -100.0f : 10.0f * log10fpm(fabs(test_noise)); /* test noise in dB */
 	float test_noise_db_plus_3 = test_noise_db + 3.0f; /* twice test noise in the power domain, approximately +3dB */
 
-	float *template_copy     = pmdata->template_copy;
-	uchar *template_exceed   = pmdata->template_exceed;
 	float *test_exceed_means = pmdata->test_exceed_means;
 
 	int i, j; /* indices */
@@ -906,14 +936,19 @@ int pmCPU(PmData *pmdata)
 	/* Loop over all the templates. Determine the best shift distance, then
 	* the best gain adjustment. */
 
-//	#pragma omp parallel default(none) \
-	private(template_index, cur_tp, fptr, template_peak, i, noise_shift, sum_exceed, num_template_exceed, template_noise, template_exceed_mean,\
-			noise_shift2, tmp1, template_exceed, current_shift, template_copy, bptr, power_ratio, weighted_MSE, MSE_scores, fptr2, fptr3) \
-	shared(template_profiles_db, profile_size, test_peak, test_noise, test_noise_db, CPU_weighted_MSEs, num_templates,\
-			test_noise_db_plus_3, test_exceed_means, shift_size, patsize, all_shifted_test_db, sumWeights_inv)
+	if (lastTemplate > num_templates)
+		lastTemplate = num_templates;
+	benchSetThreads(numThreads);
+	#pragma omp parallel private(template_index, cur_tp, fptr, fptr2, fptr3, bptr, template_peak, i, noise_shift, noise_shift2, sum_exceed,\
+			num_template_exceed, template_noise, template_exceed_mean, tmp1, current_shift, power_ratio, weighted_MSE)
 	{
-//		#pragma omp for
-			for (template_index=0; template_index<num_templates; template_index++)
+		/* The templates are independent, but every thread needs its own scratch arrays */
+		uchar template_exceed[PROFILE_SIZE];
+		float template_copy[PROFILE_SIZE];
+		float MSE_scores[SHIFT_SIZE];
+
+		#pragma omp for
+			for (template_index=firstTemplate; template_index<lastTemplate; template_index++)
 			{
 				cur_tp = template_profiles_db+(template_index*profile_size);
 
@@ -1060,7 +1095,7 @@ int pmCPU(PmData *pmdata)
 						{
 							tmp1 = *fptr++ - *fptr2++;
 							weighted_MSE += tmp1 * tmp1;
-							CPU_weighted_MSEs[template_index * SHIFT_SIZE * PROFILE_SIZE + current_shift * PROFILE_SIZE + i] = tmp1 * tmp1;
+							weighted_MSEs[template_index * SHIFT_SIZE * PROFILE_SIZE + current_shift * PROFILE_SIZE + i] = tmp1 * tmp1;
 						}
 
 						/* ----------------------------------------------------------------
@@ -1101,14 +1136,13 @@ int pmCPU(PmData *pmdata)
 						{
 							tmp1 = *fptr++ - *fptr2++;
 							weighted_MSE += tmp1 * tmp1;
-							CPU_weighted_MSEs[template_index * SHIFT_SIZE * PROFILE_SIZE + current_shift * PROFILE_SIZE + i] = tmp1 * tmp1;
+							weighted_MSEs[template_index * SHIFT_SIZE * PROFILE_SIZE + current_shift * PROFILE_SIZE + i] = tmp1 * tmp1;
 						}
 						MSE_scores[current_shift] = weighted_MSE * sumWeights_inv;
 					} /* for current_shift */
 				} /* else .. if (num_template_exceed) */
 			}
 	}
-	stop_measure_time(CPU);
 /*  
 *	The following belongs to the original pm code from HPEC but we have left it commented because we did not implement 
 *		the corresponding kernel. If you are the one to write it, please send us an email :D
@@ -1237,8 +1271,9 @@ void print_result()
 	gethostname(hostName, 50);
 
 	float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + timeRes[WRDEV]
-						   + timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ];
-	float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV];
+						   + timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[RDDEV] + timeRes[GPU_SEQ] + timeRes[COOP];
+	float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[COOP];
+	double total_GPU_fair_J = benchPhaseJoules(GPU_SEQ) + benchPhaseJoules(KERNEL1_EXEC) + benchPhaseJoules(KERNEL2_EXEC) + benchPhaseJoules(WRDEV) + benchPhaseJoules(RDDEV) + benchPhaseJoules(COOP);
 
 	struct tm *local;
 	time_t t;
@@ -1248,9 +1283,19 @@ void print_result()
 	fprintf(fio, "****************************************************\n");
 	fprintf(fio, "Created on: %s", asctime(local));
 	fprintf(fio, "Host name: %s \n", hostName);
-	fprintf(fio, "Description: %s \n\n", description);
+	fprintf(fio, "Description: %s \n", description);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n", clRuntime.deviceName, clRuntime.platformName);
+	oclPrintCacheStats(fio);
+	oclPrintCoopReport(fio, &clCoop, COOP, "templates");
+#else
+	fprintf(fio, "Device: none, CPU-only build \n");
+#endif
+	fprintf(fio, "\n");
+	fprintf(fio, "CPU threads: %i \n", benchCpuThreads());
 	fprintf(fio, "\n===========Performance Measurements=================\n");
-	fprintf(fio, "Execution times: \n"
+#ifndef CPU_ONLY
+	fprintf(fio, "Execution times (median of %i iterations): \n"
 			"	PLATFORM = \t%10.2f msecs \n"
 			"	DEVICE = \t%10.2f msecs \n"
 			"	CONTEXT = \t%10.2f msecs \n"
@@ -1263,6 +1308,7 @@ void print_result()
 			"	KERNEL2_EXEC = \t%10.2f msecs \n"
 			"	RDDEV = \t%10.2f msecs \n\n"
 			"   GPU_SEQ = \t%10.2f msec \n\n",
+			   benchIterations(),
 			   timeRes[PLATFORM],
 			   timeRes[DEVICE],
 			   timeRes[CONTEXT],
@@ -1281,6 +1327,53 @@ void print_result()
 			"CPU time: \t\t%10.2f msecs \n\n",
 			total_GPU_time, total_GPU_fair_time, timeRes[CPU]);
 	fprintf(fio, "Speed UP: \t\t%10.2f \n\n", float(timeRes[CPU])/float(total_GPU_fair_time));
+	// pm_part1, one work-item per template point: a float in, the rescaled float and the exceed flag out, and a share
+	// of the template's noise shift and exceed mean; the 20- and 17-term series take 3 flops a term, about 10 more
+	// around them and 2 adds in the reductions. pm_part2, one per template point and shift: the squared error and
+	// the debug copy out, the template point and flag shared by the shifts, 5 flops.
+	ocl_kernel_cost pmCost[2] = {
+		{"pm_part1", (double)numTemplates * PROFILE_SIZE, 9.0 + 8.0 / PROFILE_SIZE, 3.0 * (20 + 17) + 10.0 + 2.0, OCL_ROOF_FLOAT,
+		 timeRes[KERNEL1_EXEC]},
+		{"pm_part2", (double)numTemplates * SHIFT_SIZE * PROFILE_SIZE, 8.0 + 5.0 / SHIFT_SIZE, 5.0, OCL_ROOF_FLOAT, timeRes[KERNEL2_EXEC]}};
+	oclPrintRooflineReport(fio, pmCost, 2);
+#else
+	fprintf(fio, "CPU time (median of %i iterations): \t%10.2f msecs \n\n", benchIterations(), timeRes[CPU]);
+#endif
+	benchPrintEnergySummary(fio, total_GPU_fair_J, total_GPU_fair_time, benchPhaseJoules(CPU), timeRes[CPU], numTemplates, "template match");
+	benchPrintScalingReport(fio, (double)numTemplates * SHIFT_SIZE * PROFILE_SIZE, "Mpoints/s", 1.0e-6, total_GPU_fair_time);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+
+	bench_result res;
+	char workGroup[16];
+	sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+	resultsInit(&res, "pm");
+	res.description = description;
+#ifndef CPU_ONLY
+	res.device = clRuntime.deviceName;
+	res.platform = clRuntime.platformName;
+	res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+	res.driver = clRuntime.driverVersion;
+#else
+	resultsSetHostDevice(&res);
+#endif
+	res.problemSize = (long long)numTemplates * SHIFT_SIZE * PROFILE_SIZE;
+	res.problemUnit = "points";
+	res.workGroup = workGroup;
+	res.cpuMs = timeRes[CPU];
+	res.cpuThroughput = res.problemSize * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+	res.throughputUnit = "Mpoints/s";
+#ifndef CPU_ONLY
+	res.variant = oclCoopName();
+	res.gpuMs = total_GPU_fair_time;
+	res.gpuThroughput = res.problemSize * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+	res.speedup = timeRes[CPU] / total_GPU_fair_time;
+#endif
+	res.gpuJ = total_GPU_fair_J;
+	res.cpuJ = benchPhaseJoules(CPU);
+	res.energyOps = numTemplates;
+	res.energyOp = "template match";
+	resultsWrite(&res);
 
 	fseek(fio, appendPos, SEEK_SET);
 	while(fgets(buff,sizeof buff,fio))
@@ -1298,19 +1391,248 @@ void clean()
 	clean_mem(float, pattern2);
 	clean_mem(int,   patnum);
 	clean_mem(float, rtime);
+#ifndef CPU_ONLY
+	oclReleaseBuffers();
+	oclReleaseProgram();
 	oclClean();
+#endif
+}
+
+/* The measured loop; lib is the library both paths start from, pmCPU scales cpuLib in place, so it is
+ * copied back from lib every iteration */
+void pm_run(const float *lib, float *cpuLib, int *cpuResult, int *gpuResult)
+{
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		benchBeginIteration(it);
+		memcpy(cpuLib, lib, sizeof(float) * numTemplates * PROFILE_SIZE);
+#ifndef CPU_ONLY
+		if (oclCoopEnabled())
+		{
+			*gpuResult = pmCoop(&gpuPmdata, &cpuPmdata);
+			memcpy(cpuLib, lib, sizeof(float) * numTemplates * PROFILE_SIZE);
+		}
+		else
+			*gpuResult = pmGPU(&gpuPmdata);
+#endif
+		start_measure_time(CPU);
+		*cpuResult = pmCPU(&cpuPmdata, 0, numTemplates, CPU_weighted_MSEs, benchCpuThreads());
+		stop_measure_time(CPU);
+		benchEndIteration();
+	}
+}
+
+/* --scaling: the CPU path of the measured loop on every thread count, with the copy of the library it
+ * scales, see ../../common/benchScaling.h */
+struct pm_scaling_job
+{
+	const float	*lib;
+	float		*cpuLib;
+};
+
+static void pm_scaling_call(void *user, int numThreads)
+{
+	const pm_scaling_job *job = (const pm_scaling_job *)user;
+	memcpy(job->cpuLib, job->lib, sizeof(float) * numTemplates * PROFILE_SIZE);
+	pmCPU(&cpuPmdata, 0, numTemplates, CPU_weighted_MSEs, numThreads);
+}
+
+/* --sweep: libraries of every size instead of the data set's, see ../../common/benchSweep.h. A library
+ * repeats the data set's templates, every further copy shifted by a random gain of up to +-1 dB. */
+void pm_sweep()
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ};
+	long long sizes[BENCH_SWEEP_MAX];
+	int numSizes = benchSweepSizes(sizes, 8, 64 * 1024, 1);
+	int libTemplates = lib1.size[0];
+	int cpuResult, gpuResult;
+
+	for (int s=0; s<numSizes; s++)
+	{
+		numTemplates = (int)sizes[s];
+		float *lib = (float *)malloc(sizeof(float) * numTemplates * PROFILE_SIZE);
+		float *gpuLib = (float *)malloc(sizeof(float) * numTemplates * PROFILE_SIZE);
+		float *cpuLib = (float *)malloc(sizeof(float) * numTemplates * PROFILE_SIZE);
+		if (lib == NULL || gpuLib == NULL || cpuLib == NULL)
+		{
+			printf("Out of memory at a sweep size of %i templates \n", numTemplates);
+			free(lib);
+			free(gpuLib);
+			free(cpuLib);
+			break;
+		}
+		for (int t=0; t<numTemplates; t++)
+		{
+			float gain = (t < libTemplates) ? 0.0f : 2.0f * rand() / RAND_MAX - 1.0f;
+			for (int i=0; i<PROFILE_SIZE; i++)
+				lib[t * PROFILE_SIZE + i] = lib1.data[(t % libTemplates) * PROFILE_SIZE + i] + gain;
+		}
+		memcpy(gpuLib, lib, sizeof(float) * numTemplates * PROFILE_SIZE);
+		pm_alloc();
+		gpuPmdata.template_profiles_db = gpuLib;
+		cpuPmdata.template_profiles_db = cpuLib;
+		gpuPmdata.num_templates = cpuPmdata.num_templates = numTemplates;
+		free(gpuPmdata.minimum_MSE_score);
+		free(cpuPmdata.minimum_MSE_score);
+		gpuPmdata.minimum_MSE_score = (float *)malloc(sizeof(float) * numTemplates);
+		cpuPmdata.minimum_MSE_score = (float *)malloc(sizeof(float) * numTemplates);
+
+		// the kernel is specialised on the library size, so PGM and KERNEL are part of every size
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+#ifndef CPU_ONLY
+		oclProgram();
+		oclBuffer();
+#endif
+		pm_run(lib, cpuLib, &cpuResult, &gpuResult);
+		benchSummary(timeRes);
+
+		float total_GPU_fair_time = timeRes[GPU_SEQ] + timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[COOP];
+		float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM] + timeRes[KERNEL] + timeRes[BUFF] + total_GPU_fair_time;
+#ifdef CPU_ONLY
+		total_GPU_fair_time = total_GPU_time = 0.0f;
+#endif
+		benchSweepAdd(numTemplates, timeRes[CPU], total_GPU_fair_time, total_GPU_time);
+
+		bench_result res;
+		char workGroup[16];
+		sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+		resultsInit(&res, "pm");
+		res.description = description;
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.variant = oclCoopName();
+#else
+		resultsSetHostDevice(&res);
+#endif
+		res.problemSize = (long long)numTemplates * SHIFT_SIZE * PROFILE_SIZE;
+		res.problemUnit = "points";
+		res.workGroup = workGroup;
+		res.cpuMs = timeRes[CPU];
+		res.cpuThroughput = res.problemSize * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+		res.throughputUnit = "Mpoints/s";
+#ifndef CPU_ONLY
+		res.gpuMs = total_GPU_fair_time;
+		res.gpuTotalMs = total_GPU_time;
+		res.gpuThroughput = res.problemSize * 1.0e-6 / (total_GPU_fair_time * 1.0e-3);
+		res.speedup = timeRes[CPU] / total_GPU_fair_time;
+		oclReleaseBuffers();
+		oclReleaseProgram();
+#endif
+		resultsWrite(&res);
+
+		free(lib);
+		free(gpuLib);
+		free(cpuLib);
+	}
+	// clean() frees the data set's libraries, not these
+	gpuPmdata.template_profiles_db = lib1.data;
+	cpuPmdata.template_profiles_db = lib2.data;
+
+	char hostName[50];
+	gethostname(hostName, 50);
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, size sweep on copies of its %i templates \n", description, libTemplates);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintSweepReport(fio, "templates", "Mpoints/s", SHIFT_SIZE * PROFILE_SIZE * 1.0e-6);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
+}
+
+/* --serve: every request is a test profile of PROFILE_SIZE floats matched against the data set's library,
+ * the reply the squared errors both paths compute, see ../../common/benchServe.h. Both paths clip the test
+ * profile in place and pmCPU scales its library, so each gets fresh copies per request. */
+static float serveProfile[2][PROFILE_SIZE];
+
+static int pm_serve_request(const bench_serve_request *req, const void *payload)
+{
+	size_t outLen = sizeof(float) * numTemplates * SHIFT_SIZE * PROFILE_SIZE;
+
+	if (req->length != sizeof(float) * PROFILE_SIZE)
+		return BENCH_SERVE_BAD_REQUEST;
+	float *weighted_MSEs = (float *)benchServeReply(outLen);
+	if (weighted_MSEs == NULL)
+		return BENCH_SERVE_NO_MEMORY;
+	memcpy(serveProfile[0], payload, sizeof(float) * PROFILE_SIZE);
+	memcpy(serveProfile[1], payload, sizeof(float) * PROFILE_SIZE);
+	gpuPmdata.test_profile_db = serveProfile[0];
+	cpuPmdata.test_profile_db = serveProfile[1];
+	memcpy(cpuPmdata.template_profiles_db, gpuPmdata.template_profiles_db, sizeof(float) * numTemplates * PROFILE_SIZE);
+#ifndef CPU_ONLY
+	clErr = CL_SUCCESS;
+	if (oclCoopEnabled())
+		pmCoop(&gpuPmdata, &cpuPmdata);
+	else
+		pmGPU(&gpuPmdata);
+	memcpy(weighted_MSEs, GPU_weighted_MSEs, outLen);
+	return (clErr == CL_SUCCESS) ? BENCH_SERVE_OK : BENCH_SERVE_FAILED;
+#else
+	start_measure_time(CPU);
+	pmCPU(&cpuPmdata, 0, numTemplates, weighted_MSEs, benchCpuThreads());
+	stop_measure_time(CPU);
+	return BENCH_SERVE_OK;
+#endif
+}
+
+void pm_serve()
+{
+	long served = benchServe(BENCH_OP_PM, pm_serve_request);
+
+	gpuPmdata.test_profile_db = pattern1.data;
+	cpuPmdata.test_profile_db = pattern2.data;
+	if (served < 0)
+		return;
+	benchSummary(timeRes);
+
+	char hostName[50];
+	gethostname(hostName, 50);
+	fio = fopen("log.txt", "a+");
+	fseek (fio, 0, SEEK_END);
+	int appendPos = ftell(fio);
+	fprintf(fio, "****************************************************\n");
+	fprintf(fio, "Host name: %s \n", hostName);
+	fprintf(fio, "Description: %s, service of match requests against its %i templates \n", description, numTemplates);
+#ifndef CPU_ONLY
+	fprintf(fio, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fio, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintServeReport(fio);
+	benchPrintAllocReport(fio);
+	benchPrintStats(fio);
+	fseek(fio, appendPos, SEEK_SET);
+	while(fgets(buff,sizeof buff,fio))
+			printf("%s", buff);
+	fclose(fio);
 }
 
 int main(int argc, char **argv)
 {
 	pca_timer_t    	timer;
 	char           	libfile[100], patfile[100], timefile[100], patnumfile[100], buff[256];
-	int 			cpuResult, gpuResult;
+	int 			cpuResult, gpuResult = 0;
 	FILE*			fio;
 
-
+#ifndef CPU_ONLY
+	oclParseArgs(&argc, argv);
+#endif
+	benchParseArgs(&argc, argv);
+	resultsParseArgs(&argc, argv);
+	benchInit(phaseNames, NUM_PHASES);
  	if (argc != 2) {
- 		printf("Usage: %s <data set num>\n", argv[0]);
+ 		printf("Usage: %s [--device <spec>] [--warmup <n>] [--iterations <n>] [--serve <socket>] <data set num>\n", argv[0]);
  	return -1;
  	}
 
@@ -1321,22 +1643,58 @@ int main(int argc, char **argv)
  	sprintf(timefile,   "./data/%s-pm-timing.dat",  argv[1]);
 
  	/* Read the template library and the test pattern from files */
+	benchTraceBegin("read data set");
     readFromFile(float, libfile, lib1);
     readFromFile(float, patfile, pattern1);
 
     readFromFile(float, libfile, lib2);
     readFromFile(float, patfile, pattern2);
+	benchTraceEnd();
 
 	/* Allocate memory for internal arrays and output */
 	pca_create_carray_1d(int,  patnum, 1, PCA_REAL);
 	pca_create_carray_1d(float, rtime, 1, PCA_REAL);
 
+	benchTraceBegin("init");
 	init(&gpuPmdata, &lib1, &pattern1);
 	init(&cpuPmdata, &lib2, &pattern2);
+	benchTraceEnd();
+
+#ifndef CPU_ONLY
+	oclInit();
+#endif
+	if (benchSweepEnabled())
+	{
+		pm_sweep();
+		clean(&cpuPmdata);
+		clean(&gpuPmdata);
+#ifndef CPU_ONLY
+		oclClean();
+#endif
+		return 0;
+	}
+	if (benchServeEnabled())
+	{
+		pm_alloc();
+#ifndef CPU_ONLY
+		oclProgram();
+		oclBuffer();
+#endif
+		pm_serve();
+		clean();
+		return 0;
+	}
+	pm_alloc();
+#ifndef CPU_ONLY
+	oclProgram();
+	oclBuffer();
+#endif
 
 	/* Run and time the pattern match kernel */
-	gpuResult = pmGPU(&gpuPmdata);
-	cpuResult = pmCPU(&cpuPmdata);
+	pm_run(lib1.data, lib2.data, &cpuResult, &gpuResult);
+	pm_scaling_job scalingJob = {lib1.data, lib2.data};
+	benchScalingRun(pm_scaling_call, &scalingJob);
+	benchSummary(timeRes);
 
 //	for (int i=0; i<TEMPLATE_SIZE; i++){
 //		printf("test2[%i]=%.6f, test[%i]=%.6f \n", i, test2[i], i, test[i]);
@@ -1348,7 +1706,7 @@ int main(int argc, char **argv)
 	for (int i=0; i<200; i++)
 	{
 		printf("CPUweighted[%i]=%.6f, GPUweighted[%i]=%.6f \n", i, CPU_weighted_MSEs[i], i, GPU_weighted_MSEs[i]);
-		int fromend = TEMPLATE_SIZE * PROFILE_SIZE * SHIFT_SIZE - i;
+		int fromend = numTemplates * PROFILE_SIZE * SHIFT_SIZE - i;
 		printf("CPUweighted[%i]=%.6f, GPUweighted[%i]=%.6f \n", fromend, CPU_weighted_MSEs[fromend],
 				fromend, GPU_weighted_MSEs[fromend]);
 	}
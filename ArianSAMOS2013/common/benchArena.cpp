@@ -0,0 +1,217 @@
+/*
+ * benchArena.cpp
+ *
+ *  Host arena and allocation accounting for the SAMOS 2013 benchmarks, see benchArena.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+ #include <malloc.h>
+#endif
+
+#include "benchArena.h"
+#include "benchHarness.h"
+
+#define ARENA_ALIGN			64			/* a cache line, enough for any vector load of the callers */
+#define ARENA_MIN_BLOCK		(64 * 1024)
+#define ARENA_MAX_BLOCKS	32
+
+struct arena_block
+{
+	char	*base;
+	size_t	size;
+	size_t	start;			/* offset of the block in the arena, marks are offsets */
+};
+
+static int					requested = -1;
+
+static arena_block			blocks[ARENA_MAX_BLOCKS];
+static int					numBlocks = 0;
+static int					curBlock = 0;
+static size_t				used = 0;		/* offset of the next free byte */
+static size_t				held = 0;		/* bytes of all blocks */
+
+static bench_alloc_stats	allocStats;
+
+int benchArenaParseArg(int argc, char **argv, int *i)
+{
+	(void)argc;
+	if (strcmp(argv[*i], "--no-pool") == 0)
+	{
+		requested = 0;
+		return 1;
+	}
+	return 0;
+}
+
+int benchPoolEnabled()
+{
+	if (requested < 0)
+		requested = (getenv("SAMOS_NO_POOL") && atoi(getenv("SAMOS_NO_POOL")) > 0) ? 0 : 1;
+	return requested;
+}
+
+static char *block_alloc(size_t size)
+{
+	void *p = NULL;
+#ifdef _WIN32
+	p = _aligned_malloc(size, ARENA_ALIGN);
+#else
+	if (posix_memalign(&p, ARENA_ALIGN, size) != 0)
+		p = NULL;
+#endif
+	if (p == NULL)
+	{
+		printf("Error: %lu bytes of host memory could not be allocated! \n", (unsigned long)size);
+		exit(1);
+	}
+	return (char *)p;
+}
+
+static void block_free(char *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/* Appends a block of at least size bytes; with pooling it at least doubles the arena */
+static void add_block(size_t size)
+{
+	if (numBlocks == ARENA_MAX_BLOCKS)
+	{
+		printf("Error: the host arena ran out of blocks! \n");
+		exit(1);
+	}
+	if (benchPoolEnabled())
+	{
+		if (size < held)
+			size = held;
+		if (size < ARENA_MIN_BLOCK)
+			size = ARENA_MIN_BLOCK;
+	}
+	arena_block *b = &blocks[numBlocks];
+	b->base = block_alloc(size);
+	b->size = size;
+	b->start = numBlocks ? blocks[numBlocks - 1].start + blocks[numBlocks - 1].size : 0;
+	held += size;
+	benchAllocNote(BENCH_ALLOC_HOST, 1, size, held);
+	curBlock = numBlocks++;
+	used = b->start;
+}
+
+size_t benchArenaMark()
+{
+	return used;
+}
+
+void *benchArenaAlloc(size_t size)
+{
+	int fresh = 0;
+
+	size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	if (size == 0)
+		size = ARENA_ALIGN;
+	while (curBlock < numBlocks && used + size > blocks[curBlock].start + blocks[curBlock].size)
+	{
+		// the tail of the block stays unused until the next release below it
+		if (++curBlock < numBlocks)
+			used = blocks[curBlock].start;
+	}
+	if (curBlock >= numBlocks)
+	{
+		add_block(size);
+		fresh = 1;
+	}
+
+	arena_block *b = &blocks[curBlock];
+	char *p = b->base + (used - b->start);
+	used += size;
+	if (!fresh)
+		benchAllocNote(BENCH_ALLOC_HOST, 0, size, held);
+	return p;
+}
+
+void benchArenaRelease(size_t mark)
+{
+	if (mark > used)
+		return;
+	used = mark;
+
+	if (!benchPoolEnabled())
+	{
+		// --no-pool: give back every block above the mark, so the next call allocates again
+		while (numBlocks > 0 && blocks[numBlocks - 1].start >= mark)
+		{
+			numBlocks--;
+			held -= blocks[numBlocks].size;
+			block_free(blocks[numBlocks].base);
+		}
+	}
+	else if (mark == 0 && numBlocks > 1)
+	{
+		// merge the blocks, the next round of the same requests then fits into one
+		size_t total = held;
+		benchArenaFree();
+		add_block(total);
+	}
+
+	curBlock = 0;
+	while (curBlock + 1 < numBlocks && blocks[curBlock + 1].start <= mark)
+		curBlock++;
+}
+
+void benchArenaFree()
+{
+	for (int b=0; b<numBlocks; b++)
+		block_free(blocks[b].base);
+	numBlocks = 0;
+	curBlock = 0;
+	used = 0;
+	held = 0;
+}
+
+void benchAllocNote(int kind, int fresh, size_t bytes, size_t heldNow)
+{
+	if (kind < 0 || kind >= BENCH_ALLOC_KINDS)
+		return;
+	if (fresh)
+	{
+		allocStats.allocs[kind]++;
+		allocStats.bytes[kind] += bytes;
+		if (benchIsMeasuring())
+		{
+			allocStats.measuredAllocs++;
+			allocStats.measuredBytes += bytes;
+		}
+	}
+	else
+		allocStats.reuses[kind]++;
+	if ((long long)heldNow > allocStats.peakBytes[kind])
+		allocStats.peakBytes[kind] = heldNow;
+}
+
+const bench_alloc_stats *benchAllocStats()
+{
+	return &allocStats;
+}
+
+void benchPrintAllocReport(FILE *fout)
+{
+	static const char *kindNames[BENCH_ALLOC_KINDS] = {"host arena", "device pool"};
+	const bench_alloc_stats *s = &allocStats;
+
+	if (s->allocs[BENCH_ALLOC_HOST] + s->reuses[BENCH_ALLOC_HOST] + s->allocs[BENCH_ALLOC_DEVICE] + s->reuses[BENCH_ALLOC_DEVICE] == 0)
+		return;
+	fprintf(fout, "Allocations%s: \n", benchPoolEnabled() ? "" : " (--no-pool, no reuse)");
+	for (int k=0; k<BENCH_ALLOC_KINDS; k++)
+		fprintf(fout, "	%-12s %8lld allocation(s) %10.2f MB, %8lld reuse(s), peak %.2f MB held \n", kindNames[k],
+				s->allocs[k], s->bytes[k] / (1024.0 * 1024.0), s->reuses[k], s->peakBytes[k] / (1024.0 * 1024.0));
+	fprintf(fout, "	%lld allocation(s) of %.2f MB in the measured iterations%s \n\n", s->measuredAllocs,
+			s->measuredBytes / (1024.0 * 1024.0), (s->measuredAllocs == 0) ? ", the hot loop is allocation-free" : "");
+}
@@ -0,0 +1,73 @@
+/*
+ * benchArena.h
+ *
+ *  Host arena and allocation accounting for the SAMOS 2013 benchmarks.
+ *
+ *  Some paths allocate their scratch arrays on every call, e.g. the
+ *  evaluation results and the flattened population of every GP generation
+ *  or the template exceed arrays of every PM match. The arena hands out
+ *  that memory from a few large blocks instead:
+ *
+ *    size_t mark = benchArenaMark();
+ *    float *r = (float *)benchArenaAlloc(n * sizeof(float));
+ *    ...
+ *    benchArenaRelease(mark);
+ *
+ *  Allocations are 64-byte aligned and live until the release of a mark
+ *  taken before them. When a call does not fit, a new block is added; once
+ *  the arena is released completely the blocks are merged into one, so
+ *  from the second call on the same sizes are served without malloc. The
+ *  arena is not thread-safe, the callers use it from the host thread only.
+ *
+ *  The device side is oclMemPool.h, which reports into the same counters.
+ *  log.txt and the JSON results get the number of real allocations and
+ *  their bytes, the number of requests served from memory already held,
+ *  and how many allocations fell into the measured iterations of the
+ *  harness, which is 0 when the hot loop is allocation-free. With
+ *
+ *    --no-pool        or SAMOS_NO_POOL=1
+ *
+ *  both allocate and free on every request, to compare against.
+ */
+
+#ifndef BENCH_ARENA_H_
+#define BENCH_ARENA_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define BENCH_ALLOC_HOST		0
+#define BENCH_ALLOC_DEVICE		1
+#define BENCH_ALLOC_KINDS		2
+
+struct bench_alloc_stats
+{
+	long long	allocs[BENCH_ALLOC_KINDS];		/* malloc / clCreate* calls */
+	long long	bytes[BENCH_ALLOC_KINDS];		/* bytes of those calls */
+	long long	reuses[BENCH_ALLOC_KINDS];		/* requests served from memory already held */
+	long long	measuredAllocs;					/* allocations inside measured harness iterations */
+	long long	measuredBytes;
+	long long	peakBytes[BENCH_ALLOC_KINDS];	/* most memory held at once */
+};
+
+/* Consumes --no-pool, called from benchParseArgs */
+int benchArenaParseArg(int argc, char **argv, int *i);
+
+/* 0 with --no-pool */
+int benchPoolEnabled();
+
+size_t benchArenaMark();
+/* Never returns NULL, exits when the memory cannot be allocated */
+void *benchArenaAlloc(size_t size);
+/* Frees everything allocated after mark was taken */
+void benchArenaRelease(size_t mark);
+/* Returns the blocks to the system, e.g. at the end of a run */
+void benchArenaFree();
+
+/* Counts one request of kind; fresh when it needed a real allocation of bytes, held is the memory kind holds now */
+void benchAllocNote(int kind, int fresh, size_t bytes, size_t held);
+const bench_alloc_stats *benchAllocStats();
+
+void benchPrintAllocReport(FILE *fout);
+
+#endif /* BENCH_ARENA_H_ */
@@ -0,0 +1,296 @@
+/*
+ * benchEnergy.cpp
+ *
+ *  Energy sensors for the SAMOS 2013 benchmarks, see benchEnergy.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+ #include <dirent.h>
+#endif
+
+#include "benchEnergy.h"
+#include "benchHarness.h"
+
+#define SENSOR_ENERGY		0		/* cumulative microjoules */
+#define SENSOR_POWER		1		/* microwatts */
+
+struct energy_domain
+{
+	char				name[64];
+	char				path[512];
+	int					type;
+	unsigned long long	maxRaw;			/* wrap-around of an energy counter, 0 if unknown */
+	unsigned long long	lastRaw;
+	double				lastW;
+	unsigned long long	lastNs;
+	double				joules;			/* since the first reading */
+};
+
+static int				requested = -1;
+static const char		*sensorSpec = NULL;
+static int				state = -1;		/* -1 not opened yet, 0 off, 1 on */
+static energy_domain	domains[BENCH_ENERGY_MAX_DOMAINS];
+static int				numDomains = 0;
+static char				sensorNames[BENCH_ENERGY_MAX_DOMAINS * 64];
+
+int benchEnergyParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--energy") == 0)
+	{
+		requested = 1;
+		return 1;
+	}
+	if (strcmp(argv[*i], "--energy-sensor") == 0 && *i + 1 < argc)
+	{
+		sensorSpec = argv[++(*i)];
+		requested = 1;
+		return 1;
+	}
+	return 0;
+}
+
+static int read_raw(const char *path, double *value)
+{
+	FILE *fp = fopen(path, "r");
+	int ok;
+
+	if (fp == NULL)
+		return 0;
+	ok = (fscanf(fp, "%lf", value) == 1);
+	fclose(fp);
+	return ok;
+}
+
+static int read_text(const char *path, char *text, int len)
+{
+	FILE *fp = fopen(path, "r");
+
+	text[0] = '\0';
+	if (fp == NULL)
+		return 0;
+	if (fgets(text, len, fp) != NULL)
+		text[strcspn(text, "\r\n")] = '\0';
+	fclose(fp);
+	return text[0] != '\0';
+}
+
+/* Adds the sensor if it can be read now; the first reading is the baseline */
+static int add_domain(const char *name, const char *path, int type, unsigned long long maxRaw)
+{
+	energy_domain *d = &domains[numDomains];
+	double raw;
+
+	if (numDomains == BENCH_ENERGY_MAX_DOMAINS || !read_raw(path, &raw))
+		return 0;
+	memset(d, 0, sizeof(*d));
+	snprintf(d->name, sizeof(d->name), "%s", name);
+	snprintf(d->path, sizeof(d->path), "%s", path);
+	d->type = type;
+	d->maxRaw = maxRaw;
+	d->lastRaw = (unsigned long long)raw;
+	d->lastW = raw * 1.0e-6;
+	d->lastNs = benchNowNs();
+	numDomains++;
+	return 1;
+}
+
+#ifndef _WIN32
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp((const char *)a, (const char *)b);
+}
+
+/* The entries of dir whose name starts with prefix, sorted, at most 63 characters each (the %.63s of the paths below) */
+static int list_dir(const char *dir, const char *prefix, char (*entries)[64], int max)
+{
+	DIR *dp = opendir(dir);
+	struct dirent *de;
+	int n = 0;
+
+	if (dp == NULL)
+		return 0;
+	while ((de = readdir(dp)) != NULL && n < max)
+		if (strncmp(de->d_name, prefix, strlen(prefix)) == 0)
+			snprintf(entries[n++], 64, "%.63s", de->d_name);
+	closedir(dp);
+	qsort(entries, n, 64, cmp_name);
+	return n;
+}
+
+static int open_rapl()
+{
+	char zones[BENCH_ENERGY_MAX_DOMAINS][64];
+	char path[512], name[64];
+	double maxRaw;
+	int found = 0;
+	int n = list_dir("/sys/class/powercap", "intel-rapl:", zones, BENCH_ENERGY_MAX_DOMAINS);
+
+	for (int z=0; z<n; z++)
+	{
+		// sub-zones (intel-rapl:0:0, core/uncore/dram) are part of their package
+		if (strchr(zones[z] + strlen("intel-rapl:"), ':') != NULL)
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/powercap/%.63s/name", zones[z]);
+		if (!read_text(path, name, sizeof(name)))
+			snprintf(name, sizeof(name), "%.63s", zones[z]);
+		if (strcmp(name, "psys") == 0)
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/powercap/%.63s/max_energy_range_uj", zones[z]);
+		if (!read_raw(path, &maxRaw))
+			maxRaw = 0.0;
+		snprintf(path, sizeof(path), "/sys/class/powercap/%.63s/energy_uj", zones[z]);
+		if (add_domain(name, path, SENSOR_ENERGY, (unsigned long long)maxRaw))
+			found++;
+		else
+			printf("RAPL zone %s (%s) is not readable, skipped \n", zones[z], name);
+	}
+	return found;
+}
+
+static int open_hwmon(int haveRapl)
+{
+	static const char *inputs[3] = {"energy1_input", "power1_average", "power1_input"};
+	char chips[64][64];
+	char path[512], name[64];
+	int found = 0;
+	int n = list_dir("/sys/class/hwmon", "hwmon", chips, 64);
+
+	for (int c=0; c<n; c++)
+	{
+		snprintf(path, sizeof(path), "/sys/class/hwmon/%.63s/name", chips[c]);
+		if (!read_text(path, name, sizeof(name)))
+			snprintf(name, sizeof(name), "%.63s", chips[c]);
+		// these mirror the RAPL counters
+		if (haveRapl && (strcmp(name, "amd_energy") == 0 || strcmp(name, "zenpower") == 0))
+			continue;
+		for (int k=0; k<3; k++)
+		{
+			snprintf(path, sizeof(path), "/sys/class/hwmon/%.63s/%s", chips[c], inputs[k]);
+			if (add_domain(name, path, (k == 0) ? SENSOR_ENERGY : SENSOR_POWER, 0))
+			{
+				found++;
+				break;
+			}
+		}
+	}
+	return found;
+}
+#endif
+
+static void open_sensors()
+{
+	char spec[1024];
+	int haveRapl = 0;
+
+	if (requested < 0)
+		requested = (getenv("SAMOS_ENERGY") && atoi(getenv("SAMOS_ENERGY")) > 0) ? 1 : 0;
+	if (sensorSpec == NULL && getenv("SAMOS_ENERGY_SENSOR") != NULL && *getenv("SAMOS_ENERGY_SENSOR") != '\0')
+	{
+		sensorSpec = getenv("SAMOS_ENERGY_SENSOR");
+		requested = 1;
+	}
+	state = 0;
+	if (!requested)
+		return;
+
+	snprintf(spec, sizeof(spec), "%s", sensorSpec ? sensorSpec : "rapl,hwmon");
+	for (char *tok = strtok(spec, ","); tok != NULL; tok = strtok(NULL, ","))
+	{
+		if (strncmp(tok, "energy:", 7) == 0 || strncmp(tok, "power:", 6) == 0)
+		{
+			int power = (tok[0] == 'p');
+			const char *path = tok + (power ? 6 : 7);
+			if (!add_domain(path, path, power ? SENSOR_POWER : SENSOR_ENERGY, 0))
+				printf("Energy sensor %s is not readable, skipped \n", path);
+		}
+#ifndef _WIN32
+		else if (strcmp(tok, "rapl") == 0)
+			haveRapl = open_rapl();
+		else if (strcmp(tok, "hwmon") == 0)
+			open_hwmon(haveRapl);
+#endif
+		else
+			printf("Unknown energy sensor %s, skipped \n", tok);
+	}
+
+	if (numDomains == 0)
+	{
+		printf("No energy sensor could be read, energy is not reported \n");
+		return;
+	}
+	sensorNames[0] = '\0';
+	for (int d=0; d<numDomains; d++)
+	{
+		if (d > 0)
+			strcat(sensorNames, "+");
+		strcat(sensorNames, domains[d].name);
+	}
+	printf("Energy sensors: %s \n", sensorNames);
+	state = 1;
+}
+
+int benchEnergyEnabled()
+{
+	if (state < 0)
+		open_sensors();
+	return state;
+}
+
+double benchEnergyReadJ()
+{
+	double total = 0.0;
+	double raw;
+
+	if (!benchEnergyEnabled())
+		return 0.0;
+	for (int i=0; i<numDomains; i++)
+	{
+		energy_domain *d = &domains[i];
+		if (read_raw(d->path, &raw))
+		{
+			if (d->type == SENSOR_ENERGY)
+			{
+				unsigned long long now = (unsigned long long)raw;
+				if (now >= d->lastRaw)
+					d->joules += (now - d->lastRaw) * 1.0e-6;
+				else if (d->maxRaw > d->lastRaw)
+					d->joules += (d->maxRaw - d->lastRaw + now) * 1.0e-6;
+				d->lastRaw = now;
+			}
+			else
+			{
+				unsigned long long ns = benchNowNs();
+				double w = raw * 1.0e-6;
+				d->joules += 0.5 * (d->lastW + w) * (ns - d->lastNs) * 1.0e-9;
+				d->lastW = w;
+				d->lastNs = ns;
+			}
+		}
+		total += d->joules;
+	}
+	return total;
+}
+
+const char *benchEnergySensorNames()
+{
+	return benchEnergyEnabled() ? sensorNames : NULL;
+}
+
+void benchPrintEnergySummary(FILE *fout, double gpuJ, double gpuMs, double cpuJ, double cpuMs,
+							 double ops, const char *opName)
+{
+	if (!benchEnergyEnabled())
+		return;
+	fprintf(fout, "Energy (%s): ", sensorNames);
+	if (gpuMs > 0.0)
+		fprintf(fout, "GPU %.4f J, %.2f W, %.4g J/%s; ", gpuJ, gpuJ / (gpuMs * 1.0e-3), (ops > 0.0) ? gpuJ / ops : 0.0, opName);
+	fprintf(fout, "CPU %.4f J, %.2f W, %.4g J/%s", cpuJ, (cpuMs > 0.0) ? cpuJ / (cpuMs * 1.0e-3) : 0.0,
+			(ops > 0.0) ? cpuJ / ops : 0.0, opName);
+	if (gpuMs > 0.0 && cpuJ > 0.0)
+		fprintf(fout, "; the GPU path takes %.2fx the CPU energy", gpuJ / cpuJ);
+	fprintf(fout, " \n");
+}
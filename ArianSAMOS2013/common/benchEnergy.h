@@ -0,0 +1,63 @@
+/*
+ * benchEnergy.h
+ *
+ *  Energy sensors for the SAMOS 2013 benchmarks.
+ *
+ *  The question of the paper is whether the low-power GPUs pay off, which
+ *  the phase times alone do not answer. With
+ *
+ *    --energy                 sample the energy sensors around every phase
+ *    --energy-sensor <spec>   use these sensors instead of the ones found
+ *
+ *  or SAMOS_ENERGY=1 / SAMOS_ENERGY_SENSOR in the environment, benchStart
+ *  and benchStop (benchHarness.h) read the sensors as well, so every phase
+ *  also gets its energy per iteration; log.txt adds joules and average
+ *  watts per phase and the benchmarks report joules per byte, pixel,
+ *  fitness evaluation or template match.
+ *
+ *  By default every top-level /sys/class/powercap RAPL zone except psys
+ *  (which contains the package) is used, plus the first power sensor of
+ *  every /sys/class/hwmon device that has one, e.g. amdgpu. <spec> is a
+ *  comma-separated list of
+ *
+ *    rapl           the RAPL zones
+ *    hwmon          the hwmon sensors
+ *    energy:<path>  a file holding a cumulative energy in microjoules
+ *    power:<path>   a file holding the current power in microwatts
+ *
+ *  The last two work with any file, so a test can fake a sensor by
+ *  writing numbers into it. Power sensors are integrated between two
+ *  readings (trapezoid rule), which is only accurate for phases long
+ *  against the sensor's update interval; RAPL counters update about every
+ *  millisecond. The sensors measure the whole package or board, idle power
+ *  and other processes included. Unreadable sensors (recent kernels make
+ *  energy_uj root-only) are skipped, and without any sensor the energy
+ *  reports are left out.
+ */
+
+#ifndef BENCH_ENERGY_H_
+#define BENCH_ENERGY_H_
+
+#include <stdio.h>
+
+#define BENCH_ENERGY_MAX_DOMAINS	16
+
+/* Consumes --energy and --energy-sensor <spec>, called from benchParseArgs */
+int benchEnergyParseArg(int argc, char **argv, int *i);
+
+/* 1 when energy was requested and at least one sensor could be read; the first call opens the sensors */
+int benchEnergyEnabled();
+/* Energy since the first reading summed over all sensors, in joules */
+double benchEnergyReadJ();
+
+/* e.g. "package-0+amdgpu", NULL when disabled */
+const char *benchEnergySensorNames();
+
+/*
+ * One line for the report: gpuJ / cpuJ are the energies of the phases that
+ * make up the GPU and CPU times (msecs), ops the operations they processed.
+ */
+void benchPrintEnergySummary(FILE *fout, double gpuJ, double gpuMs, double cpuJ, double cpuMs,
+							 double ops, const char *opName);
+
+#endif /* BENCH_ENERGY_H_ */
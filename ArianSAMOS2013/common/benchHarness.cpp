@@ -0,0 +1,465 @@
+/*
+ * benchHarness.cpp
+ *
+ *  Shared timing harness for the SAMOS 2013 benchmarks, see benchHarness.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+ #include <windows.h>
+#else
+ #include <time.h>
+#endif
+
+#include "benchHarness.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchPerf.h"
+#include "benchSweep.h"
+#include "benchServe.h"
+#include "benchArena.h"
+#include "benchScaling.h"
+
+static int					warmup = 1;
+static int					iterations = 10;
+static int					argsGiven = 0;
+
+static const char * const	*names = NULL;
+static int					numPhases = 0;
+
+static int					inIteration = 0;
+static int					curIteration = -1;
+static unsigned long long	iterationNs;
+static unsigned long long	startNs[BENCH_MAX_PHASES];
+static unsigned long long	accNs[BENCH_MAX_PHASES];
+static int					touched[BENCH_MAX_PHASES];
+static double				startJ[BENCH_MAX_PHASES];
+static double				accJ[BENCH_MAX_PHASES];
+static int					touchedJ[BENCH_MAX_PHASES];
+static unsigned long long	startPerf[BENCH_MAX_PHASES][BENCH_PERF_EVENTS];
+static unsigned long long	accPerf[BENCH_MAX_PHASES][BENCH_PERF_EVENTS];
+static double				totalPerf[BENCH_MAX_PHASES][BENCH_PERF_EVENTS];
+static int					numPerf[BENCH_MAX_PHASES];
+
+static double				*samples[BENCH_MAX_PHASES];
+static int					numSamples[BENCH_MAX_PHASES];
+static int					capSamples[BENCH_MAX_PHASES];
+static double				*samplesJ[BENCH_MAX_PHASES];		/* joules, negative without a reading */
+static bench_stats			stats[BENCH_MAX_PHASES];
+static int					statsValid = 0;
+
+void benchParseArgs(int *argc, char **argv)
+{
+	int out = 1;
+	for (int i=1; i<*argc; i++)
+	{
+		if (strcmp(argv[i], "--warmup") == 0 && i + 1 < *argc)
+		{
+			warmup = atoi(argv[++i]);
+			argsGiven |= 1;
+		}
+		else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < *argc)
+		{
+			iterations = atoi(argv[++i]);
+			argsGiven |= 2;
+		}
+		else if (!benchEnergyParseArg(*argc, argv, &i) && !benchTraceParseArg(*argc, argv, &i)
+				 && !benchPerfParseArg(*argc, argv, &i) && !benchSweepParseArg(*argc, argv, &i)
+				 && !benchServeParseArg(*argc, argv, &i) && !benchArenaParseArg(*argc, argv, &i)
+				 && !benchScalingParseArg(*argc, argv, &i))
+			argv[out++] = argv[i];
+	}
+	argv[out] = NULL;
+	*argc = out;
+
+	if (!(argsGiven & 1) && getenv("SAMOS_WARMUP") != NULL)
+		warmup = atoi(getenv("SAMOS_WARMUP"));
+	if (!(argsGiven & 2) && getenv("SAMOS_ITERATIONS") != NULL)
+		iterations = atoi(getenv("SAMOS_ITERATIONS"));
+	if (warmup < 0)
+		warmup = 0;
+	if (iterations < 1)
+		iterations = 1;
+}
+
+void benchInit(const char * const *phaseNames, int n)
+{
+	names = phaseNames;
+	numPhases = (n > BENCH_MAX_PHASES) ? BENCH_MAX_PHASES : n;
+	for (int p=0; p<BENCH_MAX_PHASES; p++)
+	{
+		free(samples[p]);
+		free(samplesJ[p]);
+		samples[p] = samplesJ[p] = NULL;
+		numSamples[p] = capSamples[p] = 0;
+		accNs[p] = 0;
+		touched[p] = 0;
+		accJ[p] = 0.0;
+		touchedJ[p] = 0;
+		memset(accPerf[p], 0, sizeof(accPerf[p]));
+		memset(totalPerf[p], 0, sizeof(totalPerf[p]));
+		numPerf[p] = 0;
+	}
+	inIteration = 0;
+	curIteration = -1;
+	statsValid = 0;
+	// before any OpenMP team exists, so the counters inherit into its threads
+	benchPerfEnabled();
+}
+
+void benchResetPhases(const int *keep, int numKeep)
+{
+	for (int p=0; p<numPhases; p++)
+	{
+		int kept = 0;
+		for (int k=0; k<numKeep; k++)
+			kept |= (keep[k] == p);
+		if (kept)
+			continue;
+		numSamples[p] = 0;
+		memset(totalPerf[p], 0, sizeof(totalPerf[p]));
+		numPerf[p] = 0;
+	}
+	statsValid = 0;
+}
+
+int benchWarmup()
+{
+	return warmup;
+}
+
+int benchIterations()
+{
+	return iterations;
+}
+
+int benchTotalIterations()
+{
+	return warmup + iterations;
+}
+
+int benchIsWarmup()
+{
+	return inIteration && curIteration < warmup;
+}
+
+int benchIsMeasuring()
+{
+	return inIteration && curIteration >= warmup;
+}
+
+unsigned long long benchNowNs()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long)((double)now.QuadPart * 1.0e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void add_counts(int phase, const unsigned long long *counts)
+{
+	for (int e=0; e<BENCH_PERF_EVENTS; e++)
+		totalPerf[phase][e] += (double)counts[e];
+	numPerf[phase]++;
+	statsValid = 0;
+}
+
+static void add_sample(int phase, unsigned long long ns, double joules)
+{
+	if (numSamples[phase] == capSamples[phase])
+	{
+		capSamples[phase] = capSamples[phase] ? 2 * capSamples[phase] : 16;
+		samples[phase] = (double *)realloc(samples[phase], sizeof(double) * capSamples[phase]);
+		samplesJ[phase] = (double *)realloc(samplesJ[phase], sizeof(double) * capSamples[phase]);
+	}
+	samplesJ[phase][numSamples[phase]] = joules;
+	samples[phase][numSamples[phase]++] = ns * 1.0e-6;
+	statsValid = 0;
+}
+
+void benchBeginIteration(int iter)
+{
+	inIteration = 1;
+	curIteration = iter;
+	for (int p=0; p<numPhases; p++)
+	{
+		accNs[p] = 0;
+		touched[p] = 0;
+		accJ[p] = 0.0;
+		touchedJ[p] = 0;
+		memset(accPerf[p], 0, sizeof(accPerf[p]));
+	}
+	if (iter == warmup && benchServeEnabled())
+		printf("Warm-up done (%i request(s)), measuring every further request \n", warmup);
+	else if (iter == warmup)
+		printf("Warm-up done (%i iteration(s)), measuring %i iteration(s) \n", warmup, iterations);
+	iterationNs = benchNowNs();
+}
+
+void benchEndIteration()
+{
+	if (benchTraceEnabled())
+	{
+		char name[BENCH_TRACE_NAME_LEN];
+		sprintf(name, "%s %i", benchIsWarmup() ? "warm-up" : "iteration", benchIsWarmup() ? curIteration : curIteration - warmup);
+		benchTraceSpan(BENCH_TRACE_HOST, 0, name, "iteration", iterationNs, benchNowNs(), NULL);
+	}
+	if (!benchIsWarmup())
+		for (int p=0; p<numPhases; p++)
+			if (touched[p])
+			{
+				add_sample(p, accNs[p], touchedJ[p] ? accJ[p] : -1.0);
+				if (benchPerfEnabled())
+					add_counts(p, accPerf[p]);
+			}
+	inIteration = 0;
+}
+
+/* joules is negative for durations without an energy reading, counts NULL without counter readings */
+static void add_duration(int phase, unsigned long long ns, double joules, const unsigned long long *counts)
+{
+	if (phase < 0 || phase >= numPhases)
+		return;
+	if (inIteration)
+	{
+		accNs[phase] += ns;
+		touched[phase] = 1;
+		if (joules >= 0.0)
+		{
+			accJ[phase] += joules;
+			touchedJ[phase] = 1;
+		}
+		if (counts != NULL)
+			for (int e=0; e<BENCH_PERF_EVENTS; e++)
+				accPerf[phase][e] += counts[e];
+	}
+	else
+	{
+		add_sample(phase, ns, joules);
+		if (counts != NULL)
+			add_counts(phase, counts);
+	}
+}
+
+void benchAddNs(int phase, unsigned long long ns)
+{
+	add_duration(phase, ns, -1.0, NULL);
+}
+
+// the sensors are read outside the timed interval of the phase itself
+void benchStart(int phase)
+{
+	if (phase >= 0 && phase < numPhases)
+	{
+		if (benchEnergyEnabled())
+			startJ[phase] = benchEnergyReadJ();
+		if (benchPerfEnabled())
+			benchPerfRead(startPerf[phase]);
+		startNs[phase] = benchNowNs();
+	}
+}
+
+void benchStop(int phase)
+{
+	unsigned long long now = benchNowNs();
+	if (phase >= 0 && phase < numPhases)
+	{
+		unsigned long long counts[BENCH_PERF_EVENTS];
+		if (benchPerfEnabled())
+		{
+			benchPerfRead(counts);
+			for (int e=0; e<BENCH_PERF_EVENTS; e++)
+				counts[e] -= startPerf[phase][e];
+		}
+		add_duration(phase, now - startNs[phase], benchEnergyEnabled() ? benchEnergyReadJ() - startJ[phase] : -1.0,
+					 benchPerfEnabled() ? counts : NULL);
+		if (names != NULL && names[phase] != NULL)
+			benchTraceSpan(BENCH_TRACE_HOST, 0, names[phase], "phase", startNs[phase], now, NULL);
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Linear interpolation between the closest ranks */
+static double percentile(const double *sorted, int n, double q)
+{
+	double pos = q * (n - 1);
+	int lo = (int)pos;
+	if (lo >= n - 1)
+		return sorted[n - 1];
+	return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+static void compute_stats()
+{
+	if (statsValid)
+		return;
+	for (int p=0; p<numPhases; p++)
+	{
+		bench_stats *s = &stats[p];
+		int n = numSamples[p];
+
+		memset(s, 0, sizeof(*s));
+		s->n = n;
+		if (n == 0)
+			continue;
+
+		double *sorted = (double *)malloc(sizeof(double) * n);
+		memcpy(sorted, samples[p], sizeof(double) * n);
+		qsort(sorted, n, sizeof(double), cmp_double);
+
+		double sum = 0.0, sq = 0.0;
+		for (int i=0; i<n; i++)
+			sum += sorted[i];
+		s->mean = sum / n;
+		for (int i=0; i<n; i++)
+			sq += (sorted[i] - s->mean) * (sorted[i] - s->mean);
+		s->stddev = (n > 1) ? sqrt(sq / (n - 1)) : 0.0;
+		s->min = sorted[0];
+		s->median = percentile(sorted, n, 0.50);
+		s->p95 = percentile(sorted, n, 0.95);
+		s->p99 = percentile(sorted, n, 0.99);
+
+		double totalJ = 0.0, totalMs = 0.0;
+		for (int i=0; i<n; i++)
+			if (samplesJ[p][i] >= 0.0)
+			{
+				sorted[s->nJ++] = samplesJ[p][i];
+				totalJ += samplesJ[p][i];
+				totalMs += samples[p][i];
+			}
+		if (s->nJ > 0)
+		{
+			qsort(sorted, s->nJ, sizeof(double), cmp_double);
+			s->joules = percentile(sorted, s->nJ, 0.50);
+			s->watts = (totalMs > 0.0) ? totalJ / (totalMs * 1.0e-3) : 0.0;
+		}
+		free(sorted);
+
+		s->nPerf = numPerf[p];
+		for (int e=0; e<BENCH_PERF_EVENTS; e++)
+			s->counts[e] = (numPerf[p] > 0) ? totalPerf[p][e] / numPerf[p] : 0.0;
+	}
+	statsValid = 1;
+}
+
+int benchNumPhases()
+{
+	return numPhases;
+}
+
+const char *benchPhaseName(int phase)
+{
+	if (names == NULL || phase < 0 || phase >= numPhases)
+		return NULL;
+	return names[phase];
+}
+
+const bench_stats *benchPhaseStats(int phase)
+{
+	if (phase < 0 || phase >= numPhases)
+		return NULL;
+	compute_stats();
+	return &stats[phase];
+}
+
+double benchPhaseJoules(int phase)
+{
+	const bench_stats *s = benchPhaseStats(phase);
+	return (s != NULL && s->nJ > 0) ? s->joules : 0.0;
+}
+
+void benchSummary(float *timeRes)
+{
+	compute_stats();
+	for (int p=0; p<numPhases; p++)
+		timeRes[p] = (float)stats[p].median;
+}
+
+static void print_energy(FILE *fout)
+{
+	if (!benchEnergyEnabled())
+		return;
+	fprintf(fout, "Phase energy (%s): \n", benchEnergySensorNames());
+	fprintf(fout, "	%-14s %4s %12s %10s \n", "phase", "n", "median J", "mean W");
+	for (int p=0; p<numPhases; p++)
+	{
+		const bench_stats *s = &stats[p];
+		if (names[p] == NULL || s->nJ == 0)
+			continue;
+		fprintf(fout, "	%-14s %4i %12.6f %10.2f \n", names[p], s->nJ, s->joules, s->watts);
+	}
+	fprintf(fout, "\n");
+}
+
+/* Misses per thousand instructions, or "-" when either counter is missing */
+static void print_mpki(FILE *fout, const bench_stats *s, int e)
+{
+	if (benchPerfCounting(e) && benchPerfCounting(BENCH_PERF_INSTRUCTIONS) && s->counts[BENCH_PERF_INSTRUCTIONS] > 0.0)
+		fprintf(fout, " %10.3f", 1000.0 * s->counts[e] / s->counts[BENCH_PERF_INSTRUCTIONS]);
+	else
+		fprintf(fout, " %10s", "-");
+}
+
+static void print_counters(FILE *fout)
+{
+	if (!benchPerfEnabled())
+		return;
+	fprintf(fout, "Phase counters (mean per sample; MPKI = misses per 1000 instructions): \n");
+	fprintf(fout, "	%-14s %4s %12s %12s %6s %10s %10s %10s \n",
+			"phase", "n", "Mcycles", "Minstr", "IPC", "L1D MPKI", "LLC MPKI", "br MPKI");
+	for (int p=0; p<numPhases; p++)
+	{
+		const bench_stats *s = &stats[p];
+		if (names[p] == NULL || s->nPerf == 0)
+			continue;
+		fprintf(fout, "	%-14s %4i %12.3f %12.3f", names[p], s->nPerf,
+				s->counts[BENCH_PERF_CYCLES] * 1.0e-6, s->counts[BENCH_PERF_INSTRUCTIONS] * 1.0e-6);
+		if (s->counts[BENCH_PERF_CYCLES] > 0.0)
+			fprintf(fout, " %6.2f", s->counts[BENCH_PERF_INSTRUCTIONS] / s->counts[BENCH_PERF_CYCLES]);
+		else
+			fprintf(fout, " %6s", "-");
+		print_mpki(fout, s, BENCH_PERF_L1D_MISSES);
+		print_mpki(fout, s, BENCH_PERF_LLC_MISSES);
+		print_mpki(fout, s, BENCH_PERF_BRANCH_MISSES);
+		fprintf(fout, " \n");
+	}
+	fprintf(fout, "\n");
+}
+
+void benchPrintStats(FILE *fout)
+{
+	compute_stats();
+	if (benchServeEnabled())
+		fprintf(fout, "Phase statistics (%i warm-up, one iteration per request), msecs: \n", warmup);
+	else
+		fprintf(fout, "Phase statistics (%i warm-up, %i measured iteration(s)), msecs: \n", warmup, iterations);
+	fprintf(fout, "	%-14s %4s %10s %10s %10s %10s %10s %10s \n",
+			"phase", "n", "min", "median", "mean", "p95", "p99", "stddev");
+	for (int p=0; p<numPhases; p++)
+	{
+		const bench_stats *s = &stats[p];
+		if (names[p] == NULL || s->n == 0)
+			continue;
+		fprintf(fout, "	%-14s %4i %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f \n",
+				names[p], s->n, s->min, s->median, s->mean, s->p95, s->p99, s->stddev);
+	}
+	fprintf(fout, "\n");
+
+	print_energy(fout);
+	print_counters(fout);
+}
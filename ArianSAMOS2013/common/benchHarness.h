@@ -0,0 +1,104 @@
+/*
+ * benchHarness.h
+ *
+ *  Shared timing harness for the SAMOS 2013 benchmarks.
+ *
+ *  The original start_measure_time/stop_measure_time pairs timed a single
+ *  cold run with gettimeofday, so log.txt changed a lot from one run to the
+ *  next. The benchmarks now run the measured part (WRDEV, KERNEL_EXEC, RDDEV,
+ *  CPU, ...) in a loop:
+ *
+ *    --warmup N       iterations run first and thrown away (default 1)
+ *    --iterations N   iterations that are recorded (default 10)
+ *
+ *  or SAMOS_WARMUP / SAMOS_ITERATIONS in the environment. Time is taken from
+ *  a monotonic nanosecond clock. Every phase keeps one sample per iteration
+ *  (a phase stopped several times in one iteration is summed, as GP and PM
+ *  do per generation) and gets min/median/mean/p95/p99/stddev at the end.
+ *  Phases timed outside the loop, i.e. the one-time set-up, keep one sample
+ *  per start/stop pair. With --energy (benchEnergy.h) benchStart/benchStop
+ *  also read the energy sensors, and every phase gets its energy as well.
+ *  With --trace (benchTrace.h) every start/stop pair and every iteration
+ *  is also written as a span to a trace file, and with --perf (benchPerf.h)
+ *  the CPU performance counters are read around every phase. --sweep
+ *  (benchSweep.h) runs the loop once per problem size, with
+ *  benchResetPhases in between, and --serve (benchServe.h) runs one
+ *  iteration per request of a service. --threads, --affinity and --scaling
+ *  (benchScaling.h) set the threads of the CPU paths.
+ *
+ *  Typical use:
+ *
+ *    benchInit(phaseNames, NUM_PHASES);
+ *    ... set-up, timed with benchStart/benchStop ...
+ *    for (int it=0; it<benchTotalIterations(); it++)
+ *    {
+ *        benchBeginIteration(it);
+ *        ... measured work ...
+ *        benchEndIteration();
+ *    }
+ *    benchSummary(timeRes);       // medians in msecs, for the existing report
+ *    benchPrintStats(fio);
+ */
+
+#ifndef BENCH_HARNESS_H_
+#define BENCH_HARNESS_H_
+
+#include <stdio.h>
+
+#include "benchPerf.h"
+
+#define BENCH_MAX_PHASES	32
+
+struct bench_stats
+{
+	int		n;
+	double	min;			/* all in msecs */
+	double	median;
+	double	mean;
+	double	p95;
+	double	p99;
+	double	stddev;
+
+	int		nJ;				/* samples with an energy reading, 0 without --energy */
+	double	joules;			/* median energy per sample */
+	double	watts;			/* total energy / total time of those samples */
+
+	int		nPerf;			/* samples with counter readings, 0 without --perf */
+	double	counts[BENCH_PERF_EVENTS];	/* mean count per sample, indexed by BENCH_PERF_* */
+};
+
+/* Consumes --warmup, --iterations, the --energy options, --trace, --perf, --sweep, --serve, --no-pool, --threads, --affinity and --scaling from argv, like oclParseArgs */
+void benchParseArgs(int *argc, char **argv);
+
+/* phaseNames[i] names the phase with index i, NULL entries are not reported; opens the --perf counters */
+void benchInit(const char * const *phaseNames, int numPhases);
+
+int benchWarmup();
+int benchIterations();
+int benchTotalIterations();
+
+/* Drops the samples of every phase except the numKeep phases in keep[], e.g. the set-up between two sweep sizes */
+void benchResetPhases(const int *keep, int numKeep);
+
+void benchBeginIteration(int iter);
+void benchEndIteration();
+int benchIsWarmup();
+/* Inside an iteration after the warm-ups */
+int benchIsMeasuring();
+
+unsigned long long benchNowNs();
+void benchStart(int phase);
+void benchStop(int phase);
+/* For durations measured elsewhere, e.g. from CL_PROFILING_COMMAND_* */
+void benchAddNs(int phase, unsigned long long ns);
+
+int benchNumPhases();
+const char *benchPhaseName(int phase);
+const bench_stats *benchPhaseStats(int phase);
+/* Median energy of phase in joules, 0 without an energy reading */
+double benchPhaseJoules(int phase);
+/* Writes the median of every phase into timeRes[] (msecs); phases without samples are set to 0 */
+void benchSummary(float *timeRes);
+void benchPrintStats(FILE *fout);
+
+#endif /* BENCH_HARNESS_H_ */
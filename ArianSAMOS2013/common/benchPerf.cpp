@@ -0,0 +1,127 @@
+/*
+ * benchPerf.cpp
+ *
+ *  CPU performance counters for the SAMOS 2013 benchmarks, see benchPerf.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+ #include <errno.h>
+ #include <unistd.h>
+ #include <sys/syscall.h>
+ #include <linux/perf_event.h>
+#endif
+
+#include "benchPerf.h"
+
+static const char	*eventNames[BENCH_PERF_EVENTS] = {
+	"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+static int			requested = -1;
+static int			state = -1;		/* -1 not opened yet, 0 off, 1 on */
+static int			fds[BENCH_PERF_EVENTS] = {-1, -1, -1, -1, -1};
+
+int benchPerfParseArg(int argc, char **argv, int *i)
+{
+	(void)argc;
+	if (strcmp(argv[*i], "--perf") == 0)
+	{
+		requested = 1;
+		return 1;
+	}
+	return 0;
+}
+
+const char *benchPerfEventName(int e)
+{
+	return (e >= 0 && e < BENCH_PERF_EVENTS) ? eventNames[e] : NULL;
+}
+
+#ifdef __linux__
+static void event_attr(int e, struct perf_event_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = PERF_TYPE_HARDWARE;
+	switch (e)
+	{
+	case BENCH_PERF_CYCLES:			attr->config = PERF_COUNT_HW_CPU_CYCLES; break;
+	case BENCH_PERF_INSTRUCTIONS:	attr->config = PERF_COUNT_HW_INSTRUCTIONS; break;
+	case BENCH_PERF_LLC_MISSES:		attr->config = PERF_COUNT_HW_CACHE_MISSES; break;
+	case BENCH_PERF_BRANCH_MISSES:	attr->config = PERF_COUNT_HW_BRANCH_MISSES; break;
+	case BENCH_PERF_L1D_MISSES:
+		attr->type = PERF_TYPE_HW_CACHE;
+		attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	}
+	attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr->inherit = 1;			/* threads started later, i.e. the OpenMP team */
+	attr->exclude_kernel = 1;	/* allowed with perf_event_paranoid 2 */
+	attr->exclude_hv = 1;
+}
+#endif
+
+static void open_counters()
+{
+	if (requested < 0)
+		requested = (getenv("SAMOS_PERF") && atoi(getenv("SAMOS_PERF")) > 0) ? 1 : 0;
+	state = 0;
+	if (!requested)
+		return;
+
+#ifdef __linux__
+	struct perf_event_attr attr;
+	int numOpen = 0;
+
+	for (int e=0; e<BENCH_PERF_EVENTS; e++)
+	{
+		event_attr(e, &attr);
+		fds[e] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fds[e] < 0)
+			printf("Performance counter %s could not be opened (%s), skipped \n", eventNames[e], strerror(errno));
+		else
+			numOpen++;
+	}
+	if (numOpen == 0)
+	{
+		printf("No performance counter could be opened, counters are not reported \n");
+		return;
+	}
+	state = 1;
+#else
+	printf("Performance counters need Linux perf_event_open, counters are not reported \n");
+#endif
+}
+
+int benchPerfEnabled()
+{
+	if (state < 0)
+		open_counters();
+	return state;
+}
+
+int benchPerfCounting(int e)
+{
+	return benchPerfEnabled() && e >= 0 && e < BENCH_PERF_EVENTS && fds[e] >= 0;
+}
+
+void benchPerfRead(unsigned long long *counts)
+{
+	for (int e=0; e<BENCH_PERF_EVENTS; e++)
+	{
+		counts[e] = 0;
+#ifdef __linux__
+		unsigned long long value[3];		/* count, time enabled, time running */
+		if (fds[e] < 0 || read(fds[e], value, sizeof(value)) != (ssize_t)sizeof(value))
+			continue;
+		if (value[2] > 0 && value[2] < value[1])
+			counts[e] = (unsigned long long)((double)value[0] * value[1] / value[2]);
+		else
+			counts[e] = value[0];
+#endif
+	}
+}
@@ -0,0 +1,52 @@
+/*
+ * benchPerf.h
+ *
+ *  CPU performance counters for the SAMOS 2013 benchmarks.
+ *
+ *  The CPU reference paths are what every speed-up is measured against,
+ *  and their time alone does not say whether they wait for memory or for
+ *  the ALUs. With
+ *
+ *    --perf           count hardware events around every phase
+ *
+ *  or SAMOS_PERF=1 in the environment, benchStart and benchStop
+ *  (benchHarness.h) also read a set of perf_event_open counters: cycles,
+ *  instructions, L1 data cache read misses, last-level cache misses and
+ *  branch misses. log.txt adds a table with the mean counts per sample of
+ *  every phase, the IPC and the misses per thousand instructions (MPKI);
+ *  the JSON results carry the same per phase. A low IPC with a high LLC
+ *  MPKI points at a memory-bound loop, a high IPC at a compute-bound one.
+ *
+ *  The counters follow this process and, as they are opened in benchInit
+ *  with inherit set, the threads it starts afterwards (the OpenMP team);
+ *  kernel time and the OpenCL driver's own threads started earlier are not
+ *  counted. When the PMU has fewer counters than events the kernel
+ *  multiplexes them and the counts are scaled by the time each one ran.
+ *  Linux only; counters the kernel refuses (no PMU in a VM, or
+ *  /proc/sys/kernel/perf_event_paranoid above 2) are left out.
+ */
+
+#ifndef BENCH_PERF_H_
+#define BENCH_PERF_H_
+
+#define BENCH_PERF_CYCLES			0
+#define BENCH_PERF_INSTRUCTIONS		1
+#define BENCH_PERF_L1D_MISSES		2
+#define BENCH_PERF_LLC_MISSES		3
+#define BENCH_PERF_BRANCH_MISSES	4
+#define BENCH_PERF_EVENTS			5
+
+/* Consumes --perf, called from benchParseArgs */
+int benchPerfParseArg(int argc, char **argv, int *i);
+
+/* 1 when counters were requested and at least one could be opened; the first call opens them */
+int benchPerfEnabled();
+/* 1 when counter e is open */
+int benchPerfCounting(int e);
+/* Counts since the counters were opened, scaled for multiplexing; 0 for counters that are not open */
+void benchPerfRead(unsigned long long *counts);
+
+/* e.g. "cycles", "llc_misses"; also the JSON keys */
+const char *benchPerfEventName(int e);
+
+#endif /* BENCH_PERF_H_ */
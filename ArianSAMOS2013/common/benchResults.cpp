@@ -0,0 +1,285 @@
+/*
+ * benchResults.cpp
+ *
+ *  Machine-readable results for the SAMOS 2013 benchmarks, see benchResults.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+ #include <Winsock2.h>
+ #pragma comment(lib, "Ws2_32.lib")
+#else
+ #include <unistd.h>
+#endif
+
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchPerf.h"
+#include "benchArena.h"
+#include "benchScaling.h"
+
+#define FORMAT_AUTO		0
+#define FORMAT_JSON		1
+#define FORMAT_CSV		2
+
+static const char	*resultsFile = NULL;
+static int			resultsFormat = FORMAT_AUTO;
+static int			resultsDisabled = 0;
+
+void resultsParseArgs(int *argc, char **argv)
+{
+	int out = 1;
+	for (int i=1; i<*argc; i++)
+	{
+		if (strcmp(argv[i], "--results") == 0 && i + 1 < *argc)
+			resultsFile = argv[++i];
+		else if (strcmp(argv[i], "--results-format") == 0 && i + 1 < *argc)
+		{
+			i++;
+			if (strcmp(argv[i], "csv") == 0)
+				resultsFormat = FORMAT_CSV;
+			else if (strcmp(argv[i], "json") == 0 || strcmp(argv[i], "jsonl") == 0)
+				resultsFormat = FORMAT_JSON;
+			else
+				printf("Unknown results format %s, using the file extension \n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--no-results") == 0)
+			resultsDisabled = 1;
+		else
+			argv[out++] = argv[i];
+	}
+	argv[out] = NULL;
+	*argc = out;
+
+	if (resultsFile == NULL)
+		resultsFile = getenv("SAMOS_RESULTS");
+	if (resultsFile == NULL || *resultsFile == '\0')
+		resultsFile = "results.jsonl";
+}
+
+void resultsInit(bench_result *r, const char *benchmark)
+{
+	memset(r, 0, sizeof(*r));
+	r->benchmark = benchmark;
+	r->verified = -1;
+}
+
+void resultsSetHostDevice(bench_result *r)
+{
+	static char cpuName[256] = "";
+
+	if (cpuName[0] == '\0')
+	{
+		strcpy(cpuName, "unknown CPU");
+#ifndef _WIN32
+		char line[512];
+		FILE *fp = fopen("/proc/cpuinfo", "r");
+		while (fp != NULL && fgets(line, sizeof(line), fp))
+		{
+			/* "model name" on x86, "Hardware" or "Processor" on most ARM kernels */
+			char *colon = strchr(line, ':');
+			if (colon == NULL || (strncmp(line, "model name", 10) != 0 && strncmp(line, "Hardware", 8) != 0
+								  && strncmp(line, "Processor", 9) != 0))
+				continue;
+			colon++;
+			while (*colon == ' ' || *colon == '\t')
+				colon++;
+			colon[strcspn(colon, "\r\n")] = '\0';
+			if (*colon == '\0')
+				continue;
+			strncpy(cpuName, colon, sizeof(cpuName) - 1);
+			break;
+		}
+		if (fp != NULL)
+			fclose(fp);
+#endif
+	}
+	r->device = cpuName;
+	r->platform = "host";
+	r->deviceType = "CPU_ONLY";
+	r->driver = "";
+}
+
+static const char *str(const char *s)
+{
+	return s ? s : "";
+}
+
+static void json_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (s = str(s); *s; s++)
+	{
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c == '\n')
+			fputs("\\n", fp);
+		else if (c == '\t')
+			fputs("\\t", fp);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void csv_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (s = str(s); *s; s++)
+	{
+		if (*s == '"')
+			fputc('"', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+static void write_json(FILE *fp, const bench_result *r, const char *timestamp, const char *host)
+{
+	fprintf(fp, "{\"timestamp\":\"%s\",\"benchmark\":", timestamp);
+	json_string(fp, r->benchmark);
+	fprintf(fp, ",\"description\":");
+	json_string(fp, r->description);
+	fprintf(fp, ",\"host\":");
+	json_string(fp, host);
+	fprintf(fp, ",\"device\":");
+	json_string(fp, r->device);
+	fprintf(fp, ",\"platform\":");
+	json_string(fp, r->platform);
+	fprintf(fp, ",\"device_type\":");
+	json_string(fp, r->deviceType);
+	fprintf(fp, ",\"driver\":");
+	json_string(fp, r->driver);
+	fprintf(fp, ",\"problem_size\":%lld,\"problem_unit\":", r->problemSize);
+	json_string(fp, r->problemUnit);
+	fprintf(fp, ",\"work_group\":");
+	json_string(fp, r->workGroup);
+	fprintf(fp, ",\"variant\":");
+	json_string(fp, r->variant);
+	fprintf(fp, ",\"warmup\":%i,\"iterations\":%i", benchWarmup(), benchIterations());
+	fprintf(fp, ",\"gpu_ms\":%.6f,\"cpu_ms\":%.6f,\"gpu_throughput\":%.6f,\"cpu_throughput\":%.6f,\"throughput_unit\":",
+			r->gpuMs, r->cpuMs, r->gpuThroughput, r->cpuThroughput);
+	json_string(fp, r->throughputUnit);
+	if (r->gpuTotalMs > 0.0)
+		fprintf(fp, ",\"gpu_total_ms\":%.6f", r->gpuTotalMs);
+	fprintf(fp, ",\"speedup\":%.6f,\"verified\":%i,\"cpu_threads\":%i", r->speedup, r->verified, benchCpuThreads());
+	if (benchEnergySensorNames() != NULL)
+	{
+		fprintf(fp, ",\"energy\":{\"sensors\":");
+		json_string(fp, benchEnergySensorNames());
+		fprintf(fp, ",\"gpu_j\":%.6f,\"cpu_j\":%.6f,\"op\":", r->gpuJ, r->cpuJ);
+		json_string(fp, r->energyOp);
+		fprintf(fp, ",\"gpu_j_per_op\":%.6g,\"cpu_j_per_op\":%.6g}", (r->energyOps > 0.0) ? r->gpuJ / r->energyOps : 0.0,
+				(r->energyOps > 0.0) ? r->cpuJ / r->energyOps : 0.0);
+	}
+	const bench_alloc_stats *a = benchAllocStats();
+	if (a->allocs[BENCH_ALLOC_HOST] + a->reuses[BENCH_ALLOC_HOST] + a->allocs[BENCH_ALLOC_DEVICE] + a->reuses[BENCH_ALLOC_DEVICE] > 0)
+		fprintf(fp, ",\"alloc\":{\"pool\":%i,\"host_allocs\":%lld,\"host_bytes\":%lld,\"host_reuses\":%lld,"
+				"\"device_allocs\":%lld,\"device_bytes\":%lld,\"device_reuses\":%lld,\"measured_allocs\":%lld,\"measured_bytes\":%lld}",
+				benchPoolEnabled(), a->allocs[BENCH_ALLOC_HOST], a->bytes[BENCH_ALLOC_HOST], a->reuses[BENCH_ALLOC_HOST],
+				a->allocs[BENCH_ALLOC_DEVICE], a->bytes[BENCH_ALLOC_DEVICE], a->reuses[BENCH_ALLOC_DEVICE],
+				a->measuredAllocs, a->measuredBytes);
+	fprintf(fp, ",\"phases\":{");
+
+	int first = 1;
+	for (int p=0; p<benchNumPhases(); p++)
+	{
+		const bench_stats *s = benchPhaseStats(p);
+		if (benchPhaseName(p) == NULL || s->n == 0)
+			continue;
+		if (!first)
+			fputc(',', fp);
+		first = 0;
+		json_string(fp, benchPhaseName(p));
+		fprintf(fp, ":{\"n\":%i,\"min\":%.6f,\"median\":%.6f,\"mean\":%.6f,\"p95\":%.6f,\"p99\":%.6f,\"stddev\":%.6f",
+				s->n, s->min, s->median, s->mean, s->p95, s->p99, s->stddev);
+		if (s->nJ > 0)
+			fprintf(fp, ",\"joules\":%.6f,\"watts\":%.3f", s->joules, s->watts);
+		if (s->nPerf > 0)
+		{
+			fprintf(fp, ",\"counters\":{\"n\":%i", s->nPerf);
+			for (int e=0; e<BENCH_PERF_EVENTS; e++)
+				if (benchPerfCounting(e))
+					fprintf(fp, ",\"%s\":%.0f", benchPerfEventName(e), s->counts[e]);
+			if (benchPerfCounting(BENCH_PERF_CYCLES) && s->counts[BENCH_PERF_CYCLES] > 0.0)
+				fprintf(fp, ",\"ipc\":%.4f", s->counts[BENCH_PERF_INSTRUCTIONS] / s->counts[BENCH_PERF_CYCLES]);
+			fputc('}', fp);
+		}
+		fputc('}', fp);
+	}
+	fprintf(fp, "}}\n");
+}
+
+static void write_csv(FILE *fp, const bench_result *r, const char *timestamp, const char *host)
+{
+	fseek(fp, 0, SEEK_END);
+	if (ftell(fp) == 0)
+		fprintf(fp, "timestamp,benchmark,host,device,platform,device_type,driver,problem_size,problem_unit,work_group,variant,"
+				"warmup,iterations,gpu_ms,cpu_ms,gpu_throughput,cpu_throughput,throughput_unit,speedup,verified,"
+				"phase,n,min,median,mean,p95,p99,stddev\n");
+
+	for (int p=0; p<benchNumPhases(); p++)
+	{
+		const bench_stats *s = benchPhaseStats(p);
+		if (benchPhaseName(p) == NULL || s->n == 0)
+			continue;
+		fprintf(fp, "%s,", timestamp);
+		csv_string(fp, r->benchmark);		fputc(',', fp);
+		csv_string(fp, host);				fputc(',', fp);
+		csv_string(fp, r->device);			fputc(',', fp);
+		csv_string(fp, r->platform);		fputc(',', fp);
+		csv_string(fp, r->deviceType);		fputc(',', fp);
+		csv_string(fp, r->driver);			fputc(',', fp);
+		fprintf(fp, "%lld,", r->problemSize);
+		csv_string(fp, r->problemUnit);		fputc(',', fp);
+		csv_string(fp, r->workGroup);		fputc(',', fp);
+		csv_string(fp, r->variant);			fputc(',', fp);
+		fprintf(fp, "%i,%i,%.6f,%.6f,%.6f,%.6f,", benchWarmup(), benchIterations(),
+				r->gpuMs, r->cpuMs, r->gpuThroughput, r->cpuThroughput);
+		csv_string(fp, r->throughputUnit);	fputc(',', fp);
+		fprintf(fp, "%.6f,%i,", r->speedup, r->verified);
+		csv_string(fp, benchPhaseName(p));
+		fprintf(fp, ",%i,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", s->n, s->min, s->median, s->mean, s->p95, s->p99, s->stddev);
+	}
+}
+
+void resultsWrite(const bench_result *r)
+{
+	char host[256] = "";
+	char timestamp[32];
+	time_t t = time(NULL);
+	int format = resultsFormat;
+
+	if (resultsDisabled)
+		return;
+
+	gethostname(host, sizeof(host) - 1);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+	if (format == FORMAT_AUTO)
+	{
+		size_t len = strlen(resultsFile);
+		format = (len > 4 && strcmp(resultsFile + len - 4, ".csv") == 0) ? FORMAT_CSV : FORMAT_JSON;
+	}
+
+	FILE *fp = fopen(resultsFile, "a");
+	if (fp == NULL)
+	{
+		printf("Error: results file %s could not be opened! \n", resultsFile);
+		return;
+	}
+	if (format == FORMAT_CSV)
+		write_csv(fp, r, timestamp, host);
+	else
+		write_json(fp, r, timestamp, host);
+	fclose(fp);
+	printf("Results appended to %s \n", resultsFile);
+}
@@ -0,0 +1,68 @@
+/*
+ * benchResults.h
+ *
+ *  Machine-readable results for the SAMOS 2013 benchmarks.
+ *
+ *  log.txt stays the human-readable report. Next to it every run appends one
+ *  structured record to a results file:
+ *
+ *    --results <file>         default results.jsonl, or SAMOS_RESULTS
+ *    --results-format <fmt>   json (one object per line) or csv; by default
+ *                             taken from the file extension
+ *    --no-results             do not write a record
+ *
+ *  A JSON record holds the host, device, benchmark, problem size, work-group
+ *  size, variant, GPU/CPU time, throughput, speed-up, the threads of the CPU
+ *  path (benchScaling.h) and the full statistics of every
+ *  phase from benchHarness.h; with --energy (benchEnergy.h) also the joules
+ *  of the GPU and CPU paths and of every phase, and with --perf (benchPerf.h)
+ *  the mean counter values of every phase. The allocation counts of the
+ *  host arena and the buffer pool (benchArena.h) are added when anything
+ *  went through them. The CSV file has one row per phase with the
+ *  run-level fields repeated, so it loads straight into a spreadsheet; it
+ *  carries the times only. tools/compareResults reads both
+ *  formats.
+ */
+
+#ifndef BENCH_RESULTS_H_
+#define BENCH_RESULTS_H_
+
+struct bench_result
+{
+	const char	*benchmark;			/* short name, e.g. "aes" */
+	const char	*description;
+	const char	*device;
+	const char	*platform;
+	const char	*deviceType;
+	const char	*driver;
+	long long	problemSize;
+	const char	*problemUnit;		/* "bytes", "pixels", ... */
+	const char	*workGroup;			/* e.g. "256" or "8x8" */
+	const char	*variant;			/* how the GPU path ran, e.g. the memory mode; part of the comparison key */
+	double		gpuMs;				/* the "GPU exec time" of log.txt */
+	double		gpuTotalMs;			/* the "GPU total time" with the set-up, written when > 0 */
+	double		cpuMs;
+	double		gpuThroughput;		/* problemSize per second scaled to throughputUnit */
+	double		cpuThroughput;
+	const char	*throughputUnit;	/* e.g. "MB/s" */
+	double		speedup;
+	int			verified;			/* 1 results match, 0 mismatch, -1 not checked */
+	double		gpuJ;				/* energy of the phases summed in gpuMs / cpuMs, with --energy */
+	double		cpuJ;
+	double		energyOps;			/* operations the energy is divided by, e.g. bytes */
+	const char	*energyOp;			/* "byte", "pixel", ... */
+};
+
+/* Consumes --results, --results-format and --no-results from argv */
+void resultsParseArgs(int *argc, char **argv);
+
+/* Zeroes *r and sets verified to -1 */
+void resultsInit(bench_result *r, const char *benchmark);
+
+/* Fills device/platform/deviceType for builds without OpenCL (CPU_ONLY) from the host CPU */
+void resultsSetHostDevice(bench_result *r);
+
+/* Appends one record, phase statistics are taken from the harness */
+void resultsWrite(const bench_result *r);
+
+#endif /* BENCH_RESULTS_H_ */
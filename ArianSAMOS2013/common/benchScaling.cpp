@@ -0,0 +1,324 @@
+/*
+ * benchScaling.cpp
+ *
+ *  CPU thread count, affinity and strong scaling for the SAMOS 2013 benchmarks, see benchScaling.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+ #include <windows.h>
+#else
+ #include <unistd.h>
+#endif
+#ifdef __linux__
+ #include <sched.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
+
+#include "benchHarness.h"
+#include "benchScaling.h"
+
+#define MAX_CPUS	1024
+
+struct scaling_point
+{
+	int		threads;
+	double	medianMs;
+	double	minMs;
+};
+
+static const char		*threadsSpec = NULL;
+static const char		*affinitySpec = NULL;
+static const char		*scalingSpec = NULL;
+static int				cpuThreads = -1;
+
+static int				numCores = -1;
+static int				allowed[MAX_CPUS];		/* CPUs of the process before any pinning */
+static int				pinOrder[MAX_CPUS];		/* thread t runs on pinOrder[t % numPin] */
+static int				numPin = -1;			/* 0 when not pinning */
+static int				pinnedThreads = 0;		/* team size the threads were pinned for */
+
+static scaling_point	points[BENCH_SCALING_MAX];
+static int				numPoints = 0;
+
+int benchScalingParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--threads") == 0 && *i + 1 < argc)
+		threadsSpec = argv[++(*i)];
+	else if (strcmp(argv[*i], "--affinity") == 0 && *i + 1 < argc)
+		affinitySpec = argv[++(*i)];
+	else if (strcmp(argv[*i], "--scaling") == 0 && *i + 1 < argc)
+		scalingSpec = argv[++(*i)];
+	else
+		return 0;
+	return 1;
+}
+
+int benchNumCores()
+{
+	if (numCores > 0)
+		return numCores;
+	numCores = 0;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		for (int c=0; c<CPU_SETSIZE && numCores<MAX_CPUS; c++)
+			if (CPU_ISSET(c, &set))
+				allowed[numCores++] = c;
+#endif
+	if (numCores == 0)
+	{
+#ifdef _WIN32
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		numCores = (int)si.dwNumberOfProcessors;
+#else
+		numCores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (numCores < 1)
+			numCores = 1;
+		if (numCores > MAX_CPUS)
+			numCores = MAX_CPUS;
+		for (int c=0; c<numCores; c++)
+			allowed[c] = c;
+	}
+	return numCores;
+}
+
+/* A thread count, "all" for every core; -1 on a bad number */
+static int parse_threads(const char *s, const char **end)
+{
+	char *e;
+	long v;
+
+	if (strncmp(s, "all", 3) == 0)
+	{
+		*end = s + 3;
+		return benchNumCores();
+	}
+	v = strtol(s, &e, 10);
+	if (e == s || v < 1 || v > 4096)
+		return -1;
+	*end = e;
+	return (int)v;
+}
+
+int benchCpuThreads()
+{
+	const char *end;
+
+	if (cpuThreads > 0)
+		return cpuThreads;
+	if (threadsSpec == NULL)
+		threadsSpec = getenv("SAMOS_THREADS");
+	cpuThreads = 1;
+	if (threadsSpec != NULL && threadsSpec[0] != '\0')
+	{
+		int n = parse_threads(threadsSpec, &end);
+		if (n < 0 || *end != '\0')
+			printf("Bad --threads \"%s\", running the CPU paths on 1 thread \n", threadsSpec);
+		else
+			cpuThreads = n;
+	}
+	return cpuThreads;
+}
+
+/* Fills pinOrder from the --affinity spec once; 0 when the threads are not pinned */
+static int pin_setup()
+{
+	const char *spec = affinitySpec ? affinitySpec : getenv("SAMOS_AFFINITY");
+
+	if (numPin >= 0)
+		return numPin;
+	numPin = 0;
+	benchNumCores();
+	if (spec == NULL || spec[0] == '\0' || strcmp(spec, "off") == 0)
+		return 0;
+#ifndef __linux__
+	printf("--affinity is not supported on this system, the threads are not pinned \n");
+	return 0;
+#else
+	if (getenv("OMP_PROC_BIND") || getenv("OMP_PLACES"))
+	{
+		printf("OMP_PROC_BIND/OMP_PLACES are set, leaving the thread placement to the OpenMP runtime \n");
+		return 0;
+	}
+	if (strcmp(spec, "compact") == 0)
+	{
+		memcpy(pinOrder, allowed, numCores * sizeof(int));
+		numPin = numCores;
+		return numPin;
+	}
+	for (const char *p = spec; *p; )
+	{
+		char *e;
+		long lo = strtol(p, &e, 10), hi = lo;
+		if (e != p && *e == '-')
+			hi = strtol(e + 1, &e, 10);
+		if (e == p || lo < 0 || hi < lo || hi >= MAX_CPUS || (*e != ',' && *e != '\0'))
+		{
+			printf("Bad --affinity \"%s\", expected compact or a CPU list like 4-7,0-3 \n", spec);
+			numPin = 0;
+			return 0;
+		}
+		for (long c = lo; c <= hi && numPin < MAX_CPUS; c++)
+			pinOrder[numPin++] = (int)c;
+		p = (*e == ',') ? e + 1 : e;
+	}
+	return numPin;
+#endif
+}
+
+#ifdef __linux__
+static void pin_self(int t)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(pinOrder[t % numPin], &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		printf("Thread %i could not be pinned to CPU %i \n", t, pinOrder[t % numPin]);
+}
+#endif
+
+void benchSetThreads(int numThreads)
+{
+	if (numThreads < 1)
+		numThreads = 1;
+#ifdef _OPENMP
+	omp_set_num_threads(numThreads);
+#endif
+	if (pin_setup() == 0 || numThreads == pinnedThreads)
+		return;
+	// the OpenMP runtime keeps its threads from one region to the next of the same size,
+	// so every thread pins itself once per team size
+#ifdef __linux__
+ #ifdef _OPENMP
+	#pragma omp parallel num_threads(numThreads)
+	pin_self(omp_get_thread_num());
+ #else
+	pin_self(0);
+ #endif
+#endif
+	pinnedThreads = numThreads;
+}
+
+int benchScalingEnabled()
+{
+	if (scalingSpec == NULL)
+		scalingSpec = getenv("SAMOS_SCALING");
+	return scalingSpec != NULL && scalingSpec[0] != '\0' && strcmp(scalingSpec, "off") != 0;
+}
+
+/* The thread counts of the spec, 0 on a bad spec */
+static int scaling_counts(int *counts)
+{
+	int n = 0;
+
+	if (strcmp(scalingSpec, "default") == 0)
+	{
+		for (int t = 1; t < benchNumCores() && n < BENCH_SCALING_MAX - 1; t *= 2)
+			counts[n++] = t;
+		counts[n++] = benchNumCores();
+		return n;
+	}
+	for (const char *p = scalingSpec; *p; )
+	{
+		int t = parse_threads(p, &p);
+		if (t < 0 || (*p != ',' && *p != '\0'))
+		{
+			printf("Bad --scaling \"%s\", expected default or a list like 1,2,4,all \n", scalingSpec);
+			return 0;
+		}
+		if (n < BENCH_SCALING_MAX)
+			counts[n++] = t;
+		if (*p == ',')
+			p++;
+	}
+	return n;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+void benchScalingRun(bench_cpu_fn fn, void *user)
+{
+	int counts[BENCH_SCALING_MAX];
+	int numCounts;
+	double *ms;
+
+	if (!benchScalingEnabled() || (numCounts = scaling_counts(counts)) == 0)
+		return;
+	ms = (double *)malloc(benchIterations() * sizeof(double));
+	for (int c=0; c<numCounts && numPoints<BENCH_SCALING_MAX; c++)
+	{
+		printf("Scaling: %i thread(s) \n", counts[c]);
+		for (int it=0; it<benchTotalIterations(); it++)
+		{
+			unsigned long long start = benchNowNs();
+			fn(user, counts[c]);
+			if (it >= benchWarmup())
+				ms[it - benchWarmup()] = (benchNowNs() - start) * 1.0e-6;
+		}
+		qsort(ms, benchIterations(), sizeof(double), cmp_double);
+
+		scaling_point *pt = &points[numPoints++];
+		pt->threads = counts[c];
+		pt->minMs = ms[0];
+		pt->medianMs = (benchIterations() % 2) ? ms[benchIterations() / 2]
+											   : 0.5 * (ms[benchIterations() / 2 - 1] + ms[benchIterations() / 2]);
+	}
+	free(ms);
+	// the CPU paths go back to --threads
+	benchSetThreads(benchCpuThreads());
+}
+
+void benchPrintScalingReport(FILE *fout, double work, const char *throughputUnit, double scale, double gpuMs)
+{
+	const scaling_point *ref = NULL;
+	int from = -1;
+
+	if (numPoints == 0)
+		return;
+	// speed-up and efficiency are relative to the fewest threads, taken as linear up to them
+	for (int p=0; p<numPoints; p++)
+		if (ref == NULL || points[p].threads < ref->threads)
+			ref = &points[p];
+
+	fprintf(fout, "CPU strong scaling (%i core(s), affinity %s, median of %i call(s) each), throughput in %s: \n",
+			benchNumCores(), pin_setup() ? (affinitySpec ? affinitySpec : getenv("SAMOS_AFFINITY")) : "none",
+			benchIterations(), throughputUnit);
+	fprintf(fout, "	%8s %12s %12s %12s %10s %10s", "threads", "median ms", "min ms", "throughput", "speed-up", "efficiency");
+	if (gpuMs > 0.0)
+		fprintf(fout, " %10s", "CPU/GPU");
+	fprintf(fout, " \n");
+	for (int p=0; p<numPoints; p++)
+	{
+		const scaling_point *pt = &points[p];
+		double speedup = (pt->medianMs > 0.0) ? ref->medianMs * ref->threads / pt->medianMs : 0.0;
+		double tput = (pt->medianMs > 0.0) ? work * scale / (pt->medianMs * 1.0e-3) : 0.0;
+
+		fprintf(fout, "	%8i %12.3f %12.3f %12.3f %10.2f %9.1f%%", pt->threads, pt->medianMs, pt->minMs, tput,
+				speedup, 100.0 * speedup / pt->threads);
+		if (gpuMs > 0.0)
+			fprintf(fout, " %10.2f", pt->medianMs / gpuMs);
+		fprintf(fout, " \n");
+		if (gpuMs > 0.0 && pt->medianMs <= gpuMs && (from < 0 || pt->threads < points[from].threads))
+			from = p;
+	}
+	if (ref->threads > 1)
+		fprintf(fout, "	(speed-up counted from %i thread(s), taken as scaling linearly up to there) \n", ref->threads);
+	if (gpuMs > 0.0 && from >= 0)
+		fprintf(fout, "	the CPU first matches the GPU exec time (%.3f msecs) with %i thread(s) \n", gpuMs, points[from].threads);
+	else if (gpuMs > 0.0)
+		fprintf(fout, "	the GPU exec time (%.3f msecs) beats every thread count \n", gpuMs);
+	fprintf(fout, "\n");
+}
@@ -0,0 +1,60 @@
+/*
+ * benchScaling.h
+ *
+ *  CPU thread count, affinity and strong scaling for the SAMOS 2013 benchmarks.
+ *
+ *  The OpenMP CPU paths used to run on NUM_CORES threads, a #define of 1,
+ *  so the speed-up in log.txt always compared the device against one core.
+ *  With
+ *
+ *    --threads <n|all>    or SAMOS_THREADS       threads of the CPU paths (default 1)
+ *    --affinity <spec>    or SAMOS_AFFINITY      pin thread t to one CPU
+ *    --scaling <spec>     or SAMOS_SCALING       strong-scaling sweep
+ *
+ *  the CPU reference path of every iteration runs on n threads. The
+ *  affinity spec is "compact", thread t on the t-th CPU the process may run
+ *  on, or a list of CPUs in the order they are handed out, e.g. 4-7,0-3 to
+ *  fill the big cluster of a big.LITTLE part first. Pinning is done with
+ *  sched_setaffinity from inside an OpenMP region, so it is left alone when
+ *  OMP_PROC_BIND or OMP_PLACES is set, and is not available off Linux.
+ *
+ *  The scaling spec is "default", 1, 2, 4, ... threads and all cores, or a
+ *  list like 1,2,3,4,all. After the measured loop the benchmark's CPU path
+ *  is run warm-up + iterations times at every thread count, on the same
+ *  input and outside the phase statistics, and log.txt gets the median
+ *  time, the speed-up over one thread, the parallel efficiency (speed-up /
+ *  threads) and how each count compares with the GPU exec time.
+ */
+
+#ifndef BENCH_SCALING_H_
+#define BENCH_SCALING_H_
+
+#include <stdio.h>
+
+#define BENCH_SCALING_MAX	64
+
+/* One call of a CPU path on numThreads threads */
+typedef void (*bench_cpu_fn)(void *user, int numThreads);
+
+/* Consumes --threads, --affinity and --scaling, called from benchParseArgs */
+int benchScalingParseArg(int argc, char **argv, int *i);
+
+/* CPUs the process may run on */
+int benchNumCores();
+/* Threads of the CPU paths, --threads */
+int benchCpuThreads();
+/* Sets the OpenMP thread count of the next parallel region and pins the threads with --affinity */
+void benchSetThreads(int numThreads);
+
+int benchScalingEnabled();
+/* Times fn at every thread count of the spec */
+void benchScalingRun(bench_cpu_fn fn, void *user);
+
+/*
+ * The scaling table; every call does work units of work, the throughput is
+ * work * scale per second in throughputUnit. gpuMs is the GPU exec time to
+ * compare against, 0 in CPU-only builds.
+ */
+void benchPrintScalingReport(FILE *fout, double work, const char *throughputUnit, double scale, double gpuMs);
+
+#endif /* BENCH_SCALING_H_ */
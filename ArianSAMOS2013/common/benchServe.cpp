@@ -0,0 +1,374 @@
+/*
+ * benchServe.cpp
+ *
+ *  Service mode for the SAMOS 2013 benchmarks, see benchServe.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "benchHarness.h"
+#include "benchServe.h"
+
+static const char			*servePath = NULL;
+static int					pathChecked = 0;
+
+static unsigned char		*requestBuf = NULL;		/* grow-only, reused by every request */
+static size_t				requestCap = 0;
+static unsigned char		*replyBuf = NULL;
+static size_t				replyCap = 0;
+static size_t				replyLen = 0;
+
+/* Statistics of the last benchServe */
+static long					numRequests = 0;		/* requests of the benchmark's op, warm-ups included */
+static long					numOther = 0;			/* pings, shutdowns and refused requests */
+static long					numErrors = 0;
+static long					numClients = 0;
+static unsigned long long	bytesIn = 0, bytesOut = 0;
+static unsigned long long	servedNs = 0;			/* wall time of the service loop */
+static double				*serviceMs = NULL;		/* per recorded request */
+static long					numServiceMs = 0, capServiceMs = 0;
+
+int benchServeParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--serve") == 0 && *i + 1 < argc)
+	{
+		servePath = argv[++(*i)];
+		pathChecked = 1;
+		return 1;
+	}
+	return 0;
+}
+
+const char *benchServePath()
+{
+	if (!pathChecked)
+	{
+		servePath = getenv("SAMOS_SERVE");
+		pathChecked = 1;
+	}
+	if (servePath != NULL && (servePath[0] == '\0' || strcmp(servePath, "off") == 0))
+		servePath = NULL;
+	return servePath;
+}
+
+int benchServeEnabled()
+{
+	return benchServePath() != NULL;
+}
+
+void *benchServeReply(size_t len)
+{
+	if (len > replyCap)
+	{
+		unsigned char *p = (unsigned char *)realloc(replyBuf, len);
+		if (p == NULL)
+			return NULL;
+		replyBuf = p;
+		replyCap = len;
+	}
+	replyLen = len;
+	// a zero-length reply still needs a valid pointer
+	return replyBuf ? (void *)replyBuf : (void *)&replyCap;
+}
+
+static void add_service_ms(double ms)
+{
+	if (numServiceMs == capServiceMs)
+	{
+		long cap = capServiceMs ? 2 * capServiceMs : 1024;
+		double *p = (double *)realloc(serviceMs, sizeof(double) * cap);
+		if (p == NULL)
+			return;
+		serviceMs = p;
+		capServiceMs = cap;
+	}
+	serviceMs[numServiceMs++] = ms;
+}
+
+#ifndef _WIN32
+static volatile sig_atomic_t stopRequested = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopRequested = 1;
+}
+
+/* 0 on success, -1 on an error or when the peer closed the connection before len bytes */
+static int read_full(int fd, void *buf, size_t len)
+{
+	unsigned char *p = (unsigned char *)buf;
+	while (len > 0)
+	{
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	while (len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int send_reply(int fd, int status, const void *payload, uint64_t len, uint64_t ns)
+{
+	bench_serve_reply rep;
+	rep.magic = BENCH_SERVE_MAGIC;
+	rep.status = status;
+	rep.length = (status == BENCH_SERVE_OK) ? len : 0;
+	rep.serviceNs = ns;
+	if (write_full(fd, &rep, sizeof(rep)) != 0)
+		return -1;
+	if (rep.length > 0 && write_full(fd, payload, rep.length) != 0)
+		return -1;
+	bytesOut += rep.length;
+	return 0;
+}
+
+/*
+ * Reads and answers one request of client fd. Returns 0 to keep the
+ * connection, -1 to close it, 1 after a shutdown request.
+ */
+static int serve_one(int fd, int op, bench_serve_handler handler)
+{
+	bench_serve_request req;
+
+	if (read_full(fd, &req, sizeof(req)) != 0)
+		return -1;
+	if (req.magic != BENCH_SERVE_MAGIC || req.length > BENCH_SERVE_MAX_PAYLOAD)
+	{
+		printf("Refused a malformed request (magic 0x%08x, %llu bytes), connection closed \n", req.magic, (unsigned long long)req.length);
+		numOther++;
+		numErrors++;
+		send_reply(fd, BENCH_SERVE_BAD_REQUEST, NULL, 0, 0);
+		return -1;
+	}
+	if (req.length > requestCap)
+	{
+		unsigned char *p = (unsigned char *)realloc(requestBuf, req.length);
+		if (p == NULL)
+		{
+			printf("Out of memory for a request of %llu bytes, connection closed \n", (unsigned long long)req.length);
+			numOther++;
+			numErrors++;
+			send_reply(fd, BENCH_SERVE_NO_MEMORY, NULL, 0, 0);
+			return -1;
+		}
+		requestBuf = p;
+		requestCap = req.length;
+	}
+	if (req.length > 0 && read_full(fd, requestBuf, req.length) != 0)
+		return -1;
+	bytesIn += req.length;
+
+	unsigned long long start = benchNowNs();
+	if (req.op == BENCH_OP_PING || req.op == BENCH_OP_SHUTDOWN)
+	{
+		numOther++;
+		if (send_reply(fd, BENCH_SERVE_OK, NULL, 0, benchNowNs() - start) != 0)
+			return -1;
+		return (req.op == BENCH_OP_SHUTDOWN) ? 1 : 0;
+	}
+	if (req.op != (uint32_t)op)
+	{
+		numOther++;
+		numErrors++;
+		return (send_reply(fd, BENCH_SERVE_BAD_OP, NULL, 0, benchNowNs() - start) != 0) ? -1 : 0;
+	}
+
+	// every request is one iteration of the harness, the first benchWarmup() are warm-ups
+	replyLen = 0;
+	benchBeginIteration((int)numRequests);
+	int status = handler(&req, requestBuf);
+	benchEndIteration();
+	unsigned long long ns = benchNowNs() - start;
+
+	if (numRequests >= benchWarmup())
+		add_service_ms(ns * 1.0e-6);
+	numRequests++;
+	if (status != BENCH_SERVE_OK)
+		numErrors++;
+	return (send_reply(fd, status, replyBuf, replyLen, ns) != 0) ? -1 : 0;
+}
+
+long benchServe(int op, bench_serve_handler handler)
+{
+	const char *path = benchServePath();
+	struct sockaddr_un addr;
+	struct pollfd fds[BENCH_SERVE_MAX_CLIENTS + 1];
+	int numFds = 1, stop = 0;
+
+	numRequests = numOther = numErrors = numClients = 0;
+	bytesIn = bytesOut = 0;
+	numServiceMs = 0;
+
+	if (path == NULL)
+		return -1;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		printf("Socket path %s is too long for a Unix-domain socket \n", path);
+		return -1;
+	}
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0)
+	{
+		printf("Error in creating the service socket: %s \n", strerror(errno));
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	// a socket file left behind by an earlier service would make bind fail
+	unlink(path);
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, BENCH_SERVE_MAX_CLIENTS) != 0)
+	{
+		printf("Error in binding the service socket %s: %s \n", path, strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+	// no SA_RESTART, so a signal wakes poll up; a client that goes away must not kill the service
+	struct sigaction sa, oldInt, oldTerm, oldPipe;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	stopRequested = 0;
+	sigaction(SIGINT, &sa, &oldInt);
+	sigaction(SIGTERM, &sa, &oldTerm);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, &oldPipe);
+
+	printf("Serving on %s, stop with a shutdown request or Ctrl-C \n", path);
+	fflush(stdout);
+	unsigned long long loopStart = benchNowNs();
+	fds[0].fd = listenFd;
+	fds[0].events = POLLIN;
+	while (!stop && !stopRequested)
+	{
+		if (poll(fds, numFds, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			printf("Error in polling the service socket: %s \n", strerror(errno));
+			break;
+		}
+		for (int c=numFds-1; c>=1 && !stop; c--)
+		{
+			if (fds[c].revents == 0)
+				continue;
+			int r = (fds[c].revents & POLLIN) ? serve_one(fds[c].fd, op, handler) : -1;
+			if (r == 1)
+				stop = 1;
+			if (r != 0)
+			{
+				close(fds[c].fd);
+				fds[c] = fds[--numFds];
+			}
+		}
+		if (!stop && (fds[0].revents & POLLIN))
+		{
+			int fd = accept(listenFd, NULL, NULL);
+			if (fd >= 0 && numFds == BENCH_SERVE_MAX_CLIENTS + 1)
+			{
+				printf("More than %i clients, connection refused \n", BENCH_SERVE_MAX_CLIENTS);
+				close(fd);
+			}
+			else if (fd >= 0)
+			{
+				fds[numFds].fd = fd;
+				fds[numFds].events = POLLIN;
+				fds[numFds].revents = 0;
+				numFds++;
+				numClients++;
+			}
+		}
+	}
+	servedNs = benchNowNs() - loopStart;
+	if (stopRequested)
+		printf("Service stopped by a signal \n");
+
+	for (int c=1; c<numFds; c++)
+		close(fds[c].fd);
+	close(listenFd);
+	unlink(path);
+	sigaction(SIGINT, &oldInt, NULL);
+	sigaction(SIGTERM, &oldTerm, NULL);
+	sigaction(SIGPIPE, &oldPipe, NULL);
+
+	free(requestBuf);
+	requestBuf = NULL;
+	requestCap = 0;
+	return numRequests;
+}
+#else
+long benchServe(int op, bench_serve_handler handler)
+{
+	printf("Service mode needs Unix-domain sockets, --serve is not supported on this platform \n");
+	return -1;
+}
+#endif /* _WIN32 */
+
+static int cmp_ms(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, long n, double q)
+{
+	double pos = q * (n - 1);
+	long lo = (long)pos;
+	if (lo >= n - 1)
+		return sorted[n - 1];
+	return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+void benchPrintServeReport(FILE *fout)
+{
+	double secs = servedNs * 1.0e-9;
+
+	fprintf(fout, "Service on %s: %li request(s) from %li connection(s), %li warm-up, %li other (ping, shutdown, refused), %li error(s) \n",
+			benchServePath() ? benchServePath() : "-", numRequests, numClients,
+			(numRequests < benchWarmup()) ? numRequests : (long)benchWarmup(), numOther, numErrors);
+	fprintf(fout, "	%.2f MB in, %.2f MB out in %.2f s of service (%.1f requests/s, idle time included) \n",
+			bytesIn / (1024.0 * 1024.0), bytesOut / (1024.0 * 1024.0), secs, (secs > 0.0) ? numRequests / secs : 0.0);
+	if (numServiceMs > 0)
+	{
+		qsort(serviceMs, numServiceMs, sizeof(double), cmp_ms);
+		double sum = 0.0;
+		for (long i=0; i<numServiceMs; i++)
+			sum += serviceMs[i];
+		fprintf(fout, "	service time per request: min %.3f, median %.3f, mean %.3f, p95 %.3f, p99 %.3f msecs \n",
+				serviceMs[0], percentile(serviceMs, numServiceMs, 0.50), sum / numServiceMs,
+				percentile(serviceMs, numServiceMs, 0.95), percentile(serviceMs, numServiceMs, 0.99));
+	}
+	fprintf(fout, "\n");
+}
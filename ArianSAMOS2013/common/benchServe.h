@@ -0,0 +1,108 @@
+/*
+ * benchServe.h
+ *
+ *  Service mode for the SAMOS 2013 benchmarks.
+ *
+ *  A normal run pays for the platform, context, queue, program build and
+ *  buffers and tears them down again in oclClean(). With
+ *
+ *    --serve <path>     or SAMOS_SERVE=<path>
+ *
+ *  a benchmark does its set-up once and then serves jobs on a Unix-domain
+ *  socket at <path> until a BENCH_OP_SHUTDOWN request, SIGINT or SIGTERM:
+ *  AES encrypts, Convolution filters, BitCounter counts and PM matches
+ *  test profiles against its library, each with the context, the built
+ *  kernels and its buffers kept warm. Buffers grow when a request does not
+ *  fit and are otherwise reused. Several clients may stay connected; their
+ *  requests are served one at a time in the order they arrive.
+ *
+ *  Every request is one iteration of the harness, so the first --warmup
+ *  requests are not recorded and the phases (WRDEV, KERNEL_EXEC, RDDEV or
+ *  CPU in CPU-only builds) get their statistics over the requests. On
+ *  shutdown log.txt gets the request count, the bytes moved and the
+ *  service time percentiles, followed by the usual phase table.
+ *
+ *  The protocol is binary in host byte order, the socket never leaves the
+ *  machine. A request is a bench_serve_request header followed by length
+ *  bytes of payload, the reply a bench_serve_reply followed by length
+ *  bytes. The payloads are
+ *
+ *    BENCH_OP_AES        plaintext, a multiple of 16 bytes -> ciphertext
+ *    BENCH_OP_CONV       param[0] x param[1] RGBA8 pixels -> filtered pixels
+ *    BENCH_OP_BITCOUNT   int32 elements -> uint32 number of 1 bits
+ *    BENCH_OP_PM         one test profile of 64 floats -> the weighted
+ *                        squared error of every library template, range
+ *                        shift and point (templates * 21 * 64 floats)
+ *    BENCH_OP_PING       nothing -> nothing
+ *    BENCH_OP_SHUTDOWN   nothing -> nothing, then the service stops
+ *
+ *  tools/serveClient.cpp measures the latency and throughput of a service.
+ *  This header only needs the C library, so the client includes it as well.
+ */
+
+#ifndef BENCH_SERVE_H_
+#define BENCH_SERVE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_SERVE_MAGIC		0x534d4f53u			/* "SMOS" */
+#define BENCH_SERVE_MAX_PAYLOAD	(1ULL << 30)		/* larger requests are refused and the connection closed */
+#define BENCH_SERVE_MAX_CLIENTS	64
+
+#define BENCH_OP_PING			0
+#define BENCH_OP_SHUTDOWN		1
+#define BENCH_OP_AES			2
+#define BENCH_OP_CONV			3
+#define BENCH_OP_BITCOUNT		4
+#define BENCH_OP_PM				5
+
+#define BENCH_SERVE_OK			0
+#define BENCH_SERVE_BAD_OP		-1		/* not an op this benchmark serves */
+#define BENCH_SERVE_BAD_REQUEST	-2		/* payload or parameters do not fit the op */
+#define BENCH_SERVE_NO_MEMORY	-3
+#define BENCH_SERVE_FAILED		-4		/* the device reported an error */
+
+struct bench_serve_request
+{
+	uint32_t	magic;
+	uint32_t	op;
+	uint32_t	param[4];		/* per op, e.g. the image size of BENCH_OP_CONV */
+	uint64_t	length;			/* payload bytes */
+};
+
+struct bench_serve_reply
+{
+	uint32_t	magic;
+	int32_t		status;			/* BENCH_SERVE_* */
+	uint64_t	length;			/* payload bytes, 0 unless status is BENCH_SERVE_OK */
+	uint64_t	serviceNs;		/* from the complete request to the reply, on the server */
+};
+
+/*
+ * Serves one request of the benchmark's op; payload holds req->length bytes.
+ * The reply goes into benchServeReply(). Returns a BENCH_SERVE_* status.
+ */
+typedef int (*bench_serve_handler)(const bench_serve_request *req, const void *payload);
+
+/* Consumes --serve <path>, called from benchParseArgs */
+int benchServeParseArg(int argc, char **argv, int *i);
+
+int benchServeEnabled();
+const char *benchServePath();
+
+/* The reply payload of the current request, len bytes; NULL when it cannot be allocated */
+void *benchServeReply(size_t len);
+
+/*
+ * Listens on benchServePath() and hands every request of op to handler
+ * until shutdown. Returns the number of requests served, -1 when the
+ * socket could not be set up.
+ */
+long benchServe(int op, bench_serve_handler handler);
+
+/* Requests, bytes and service times of the last benchServe */
+void benchPrintServeReport(FILE *fout);
+
+#endif /* BENCH_SERVE_H_ */
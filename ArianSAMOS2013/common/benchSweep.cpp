@@ -0,0 +1,255 @@
+/*
+ * benchSweep.cpp
+ *
+ *  Problem-size sweeps for the SAMOS 2013 benchmarks, see benchSweep.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "benchHarness.h"
+#include "benchSweep.h"
+
+#define SERIES_GPU		0		/* GPU exec time */
+#define SERIES_TOTAL	1		/* GPU time with the set-up */
+
+struct sweep_point
+{
+	long long	size;
+	double		cpuMs;
+	double		gpuMs;
+	double		gpuTotalMs;
+};
+
+static const char	*sweepSpec = NULL;
+static sweep_point	points[BENCH_SWEEP_MAX];
+static int			numPoints = 0;
+
+int benchSweepParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--sweep") == 0 && *i + 1 < argc)
+	{
+		sweepSpec = argv[++(*i)];
+		return 1;
+	}
+	return 0;
+}
+
+static const char *sweep_spec()
+{
+	if (sweepSpec == NULL)
+		sweepSpec = getenv("SAMOS_SWEEP");
+	if (sweepSpec != NULL && (sweepSpec[0] == '\0' || strcmp(sweepSpec, "off") == 0))
+		sweepSpec = NULL;
+	return sweepSpec;
+}
+
+int benchSweepEnabled()
+{
+	return sweep_spec() != NULL;
+}
+
+/* A size with an optional K/M/G suffix; *end is set past it, -1 on a bad number */
+static long long parse_size(const char *s, const char **end)
+{
+	char *e;
+	long long v = strtoll(s, &e, 10);
+
+	if (e == s || v <= 0)
+		return -1;
+	if (*e == 'K' || *e == 'k')
+		v <<= 10, e++;
+	else if (*e == 'M' || *e == 'm')
+		v <<= 20, e++;
+	else if (*e == 'G' || *e == 'g')
+		v <<= 30, e++;
+	*end = e;
+	return v;
+}
+
+static int add_size(long long *sizes, int n, long long size, long long granule)
+{
+	if (granule > 1)
+		size = (size + granule - 1) / granule * granule;
+	// rounding can map neighbouring sizes onto the same one
+	if (n > 0 && sizes[n - 1] == size)
+		return n;
+	if (n == BENCH_SWEEP_MAX)
+	{
+		printf("Sweep truncated to %i sizes \n", BENCH_SWEEP_MAX);
+		return n;
+	}
+	sizes[n] = size;
+	return n + 1;
+}
+
+int benchSweepSizes(long long *sizes, long long lo, long long hi, long long granule)
+{
+	const char *spec = sweep_spec();
+	const char *p;
+	long long step = 2;
+	int multiply = 1;
+	int n = 0;
+
+	if (spec == NULL)
+		return 0;
+	if (strcmp(spec, "default") != 0)
+	{
+		if (strchr(spec, ',') != NULL || strchr(spec, ':') == NULL)
+		{
+			for (p = spec; *p; )
+			{
+				long long v = parse_size(p, &p);
+				if (v < 0 || (*p != ',' && *p != '\0'))
+				{
+					printf("Error: bad --sweep list \"%s\" \n", spec);
+					exit(1);
+				}
+				n = add_size(sizes, n, v, granule);
+				if (*p == ',')
+					p++;
+			}
+			return n;
+		}
+
+		lo = parse_size(spec, &p);
+		hi = (lo > 0 && *p == ':') ? parse_size(p + 1, &p) : -1;
+		if (hi > 0 && *p == ':')
+		{
+			multiply = (p[1] == 'x' || p[1] == '*');
+			step = (p[1] == 'x' || p[1] == '*' || p[1] == '+') ? parse_size(p + 2, &p) : -1;
+		}
+		if (lo < 0 || hi < lo || step < 0 || (multiply && step < 2) || *p != '\0')
+		{
+			printf("Error: bad --sweep range \"%s\", expected lo:hi[:xF|:+S] \n", spec);
+			exit(1);
+		}
+	}
+	for (long long v = lo; v <= hi; v = multiply ? v * step : v + step)
+		n = add_size(sizes, n, v, granule);
+	return n;
+}
+
+void benchSweepAdd(long long size, double cpuMs, double gpuMs, double gpuTotalMs)
+{
+	if (numPoints == BENCH_SWEEP_MAX)
+		return;
+	points[numPoints].size = size;
+	points[numPoints].cpuMs = cpuMs;
+	points[numPoints].gpuMs = gpuMs;
+	points[numPoints].gpuTotalMs = gpuTotalMs;
+	numPoints++;
+}
+
+static int cmp_point(const void *a, const void *b)
+{
+	long long x = ((const sweep_point *)a)->size, y = ((const sweep_point *)b)->size;
+	return (x > y) - (x < y);
+}
+
+static double series_ms(const sweep_point *pt, int series)
+{
+	return (series == SERIES_GPU) ? pt->gpuMs : pt->gpuTotalMs;
+}
+
+static void format_size(char *out, double size, const char *unit)
+{
+	if (strcmp(unit, "bytes") != 0)
+		sprintf(out, "%.0f", size);
+	else if (size >= 1024.0 * 1024.0 * 1024.0)
+		sprintf(out, "%.4gGB", size / (1024.0 * 1024.0 * 1024.0));
+	else if (size >= 1024.0 * 1024.0)
+		sprintf(out, "%.4gMB", size / (1024.0 * 1024.0));
+	else if (size >= 1024.0)
+		sprintf(out, "%.4gKB", size / 1024.0);
+	else
+		sprintf(out, "%.0fB", size);
+}
+
+static double throughput(long long size, double ms, double scale)
+{
+	return (ms > 0.0) ? size * scale / (ms * 1.0e-3) : 0.0;
+}
+
+/*
+ * Index of the smallest size from which the device is faster at every larger
+ * size, numPoints when it never gets there. *estimate gets the size where
+ * the speed-up crosses 1, interpolated on a log-log scale between the last
+ * losing and the first winning size.
+ */
+static int crossover(int series, double *estimate)
+{
+	int k = numPoints;
+
+	while (k > 0 && series_ms(&points[k - 1], series) > 0.0 && series_ms(&points[k - 1], series) < points[k - 1].cpuMs)
+		k--;
+	*estimate = 0.0;
+	if (k > 0 && k < numPoints && points[k - 1].cpuMs > 0.0 && series_ms(&points[k - 1], series) > 0.0)
+	{
+		double s0 = log(points[k - 1].cpuMs / series_ms(&points[k - 1], series));
+		double s1 = log(points[k].cpuMs / series_ms(&points[k], series));
+		double x0 = log((double)points[k - 1].size), x1 = log((double)points[k].size);
+		double t = (s1 > s0) ? -s0 / (s1 - s0) : 1.0;
+		*estimate = exp(x0 + t * (x1 - x0));
+	}
+	return k;
+}
+
+static void print_crossover(FILE *fout, int series, const char *unit, const char *what)
+{
+	char at[32], about[32];
+	double estimate;
+	int k = crossover(series, &estimate);
+
+	if (k == numPoints)
+		fprintf(fout, "	%s: the CPU is faster up to the largest size swept \n", what);
+	else if (k == 0)
+		fprintf(fout, "	%s: the device is faster at every size swept \n", what);
+	else
+	{
+		format_size(at, (double)points[k].size, unit);
+		format_size(about, estimate, unit);
+		if (strcmp(unit, "bytes") != 0)
+			sprintf(at + strlen(at), " %s", unit);
+		fprintf(fout, "	%s: offloading pays off from %s on (crossing at about %s) \n", what, at, about);
+	}
+}
+
+void benchPrintSweepReport(FILE *fout, const char *sizeUnit, const char *throughputUnit, double scale)
+{
+	int haveGpu = 0;
+
+	if (numPoints == 0)
+		return;
+	qsort(points, numPoints, sizeof(points[0]), cmp_point);
+	for (int i=0; i<numPoints; i++)
+		haveGpu |= (points[i].gpuMs > 0.0);
+
+	fprintf(fout, "Size sweep (%i sizes, median of %i iterations each), throughput in %s: \n", numPoints, benchIterations(), throughputUnit);
+	if (haveGpu)
+		fprintf(fout, "	%12s %12s %12s %12s %12s %12s %12s %8s \n", sizeUnit, "CPU ms", "GPU ms", "GPU+set-up", "CPU", "GPU", "GPU+set-up", "speed-up");
+	else
+		fprintf(fout, "	%12s %12s %12s \n", sizeUnit, "CPU ms", "CPU");
+	for (int i=0; i<numPoints; i++)
+	{
+		const sweep_point *pt = &points[i];
+		char size[32];
+
+		format_size(size, (double)pt->size, sizeUnit);
+		if (haveGpu)
+			fprintf(fout, "	%12s %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f %8.2f \n", size, pt->cpuMs, pt->gpuMs, pt->gpuTotalMs,
+					throughput(pt->size, pt->cpuMs, scale), throughput(pt->size, pt->gpuMs, scale),
+					throughput(pt->size, pt->gpuTotalMs, scale), (pt->gpuMs > 0.0) ? pt->cpuMs / pt->gpuMs : 0.0);
+		else
+			fprintf(fout, "	%12s %12.3f %12.3f \n", size, pt->cpuMs, throughput(pt->size, pt->cpuMs, scale));
+	}
+	if (haveGpu)
+	{
+		fprintf(fout, "Crossover: \n");
+		print_crossover(fout, SERIES_GPU, sizeUnit, "GPU exec time");
+		print_crossover(fout, SERIES_TOTAL, sizeUnit, "GPU time with set-up");
+	}
+	fprintf(fout, "\n");
+}
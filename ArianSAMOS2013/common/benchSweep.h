@@ -0,0 +1,60 @@
+/*
+ * benchSweep.h
+ *
+ *  Problem-size sweeps for the SAMOS 2013 benchmarks.
+ *
+ *  Every benchmark has one fixed input (input.txt, disney.bmp, 1M ints,
+ *  500 individuals, 72 templates), which cannot tell at which size the
+ *  device starts to pay off. With
+ *
+ *    --sweep <spec>     or SAMOS_SWEEP=<spec>
+ *
+ *  a benchmark runs its measured loop once per size on synthetic input of
+ *  that size and records, per size, the CPU time, the GPU exec time (the
+ *  "fair" time of log.txt) and the GPU time including the set-up, i.e. the
+ *  PLATFORM .. KERNEL phases plus the buffers of that size. <spec> is
+ *
+ *    lo:hi          powers of two from lo to hi, e.g. 4K:1G
+ *    lo:hi:xF       lo, lo*F, lo*F*F, ... up to hi
+ *    lo:hi:+S       lo, lo+S, lo+2S, ... up to hi
+ *    a,b,c          these sizes
+ *    default        the range the benchmark suggests
+ *
+ *  in the unit of the benchmark (AES bytes, Convolution pixels, BitCounter
+ *  elements, GP individuals, PM templates); K, M and G multiply by 1024,
+ *  1024^2 and 1024^3. Sizes are rounded up to what the benchmark can
+ *  launch. log.txt gets one table with the throughput curves and the
+ *  crossover sizes, the smallest size from which the device is faster at
+ *  every larger size, for the exec time and for the time with set-up, and
+ *  every size is also appended to the results file as its own record.
+ */
+
+#ifndef BENCH_SWEEP_H_
+#define BENCH_SWEEP_H_
+
+#include <stdio.h>
+
+#define BENCH_SWEEP_MAX		64
+
+/* Consumes --sweep <spec>, called from benchParseArgs */
+int benchSweepParseArg(int argc, char **argv, int *i);
+
+int benchSweepEnabled();
+/*
+ * Fills sizes[] (at most BENCH_SWEEP_MAX) from the spec, "default" runs the
+ * powers of two from lo to hi; every size is rounded up to a multiple of
+ * granule. Returns the number of sizes, exits on a bad spec.
+ */
+int benchSweepSizes(long long *sizes, long long lo, long long hi, long long granule);
+
+/* One point of the sweep, in msecs; gpuMs and gpuTotalMs are 0 in CPU-only builds */
+void benchSweepAdd(long long size, double cpuMs, double gpuMs, double gpuTotalMs);
+
+/*
+ * The table of all points and the crossover sizes. Throughputs are
+ * size * scale per second in throughputUnit, e.g. scale 1/1048576 for
+ * bytes in MB/s; sizes are printed with K/M/G when sizeUnit is "bytes".
+ */
+void benchPrintSweepReport(FILE *fout, const char *sizeUnit, const char *throughputUnit, double scale);
+
+#endif /* BENCH_SWEEP_H_ */
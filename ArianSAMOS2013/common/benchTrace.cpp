@@ -0,0 +1,196 @@
+/*
+ * benchTrace.cpp
+ *
+ *  Trace-event export for the SAMOS 2013 benchmarks, see benchTrace.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchTrace.h"
+#include "benchHarness.h"
+
+#define TRACE_MAX_DEPTH		32
+#define TRACE_MAX_TRACKS	32
+
+struct trace_span
+{
+	int					pid;
+	int					tid;
+	char				name[BENCH_TRACE_NAME_LEN];
+	const char			*cat;
+	unsigned long long	startNs;
+	unsigned long long	endNs;
+	char				args[BENCH_TRACE_ARGS_LEN];
+};
+
+struct trace_track
+{
+	int					pid;
+	int					tid;
+	char				name[BENCH_TRACE_NAME_LEN];
+};
+
+static const char			*traceFile = NULL;
+static int					state = -1;		/* -1 not decided yet, 0 off, 1 on */
+static trace_span			*spans = NULL;
+static int					numSpans = 0;
+static int					capSpans = 0;
+static trace_track			tracks[TRACE_MAX_TRACKS];
+static int					numTracks = 0;
+
+static char					openName[TRACE_MAX_DEPTH][BENCH_TRACE_NAME_LEN];
+static unsigned long long	openNs[TRACE_MAX_DEPTH];
+static int					depth = 0;
+
+int benchTraceParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--trace") == 0 && *i + 1 < argc)
+	{
+		traceFile = argv[++(*i)];
+		return 1;
+	}
+	return 0;
+}
+
+static void write_at_exit()
+{
+	benchTraceWrite();
+}
+
+int benchTraceEnabled()
+{
+	if (state < 0)
+	{
+		if (traceFile == NULL && getenv("SAMOS_TRACE") != NULL && *getenv("SAMOS_TRACE") != '\0')
+			traceFile = getenv("SAMOS_TRACE");
+		state = (traceFile != NULL);
+		if (state)
+		{
+			atexit(write_at_exit);
+			benchTraceTrackName(BENCH_TRACE_HOST, 0, "host");
+		}
+	}
+	return state;
+}
+
+void benchTraceSpan(int pid, int tid, const char *name, const char *cat,
+					unsigned long long startNs, unsigned long long endNs, const char *args)
+{
+	if (!benchTraceEnabled())
+		return;
+	if (numSpans == capSpans)
+	{
+		capSpans = capSpans ? 2 * capSpans : 1024;
+		spans = (trace_span *)realloc(spans, sizeof(trace_span) * capSpans);
+	}
+	trace_span *s = &spans[numSpans++];
+	s->pid = pid;
+	s->tid = tid;
+	snprintf(s->name, sizeof(s->name), "%s", name);
+	s->cat = cat;
+	s->startNs = startNs;
+	s->endNs = (endNs > startNs) ? endNs : startNs;
+	snprintf(s->args, sizeof(s->args), "%s", args ? args : "");
+}
+
+void benchTraceTrackName(int pid, int tid, const char *name)
+{
+	if (!benchTraceEnabled() || numTracks == TRACE_MAX_TRACKS)
+		return;
+	for (int t=0; t<numTracks; t++)
+		if (tracks[t].pid == pid && tracks[t].tid == tid)
+			return;
+	tracks[numTracks].pid = pid;
+	tracks[numTracks].tid = tid;
+	snprintf(tracks[numTracks].name, BENCH_TRACE_NAME_LEN, "%s", name);
+	numTracks++;
+}
+
+void benchTraceBegin(const char *name)
+{
+	if (!benchTraceEnabled())
+		return;
+	if (depth < TRACE_MAX_DEPTH)
+	{
+		snprintf(openName[depth], BENCH_TRACE_NAME_LEN, "%s", name);
+		openNs[depth] = benchNowNs();
+	}
+	depth++;
+}
+
+void benchTraceEnd()
+{
+	unsigned long long now = benchNowNs();
+
+	if (!benchTraceEnabled() || depth == 0)
+		return;
+	depth--;
+	if (depth < TRACE_MAX_DEPTH)
+		benchTraceSpan(BENCH_TRACE_HOST, 0, openName[depth], "host", openNs[depth], now, NULL);
+}
+
+static void json_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; s++)
+	{
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+void benchTraceWrite()
+{
+	static int written = 0;
+	unsigned long long base = ~0ULL;
+
+	if (written || !benchTraceEnabled())
+		return;
+	written = 1;
+
+	FILE *fp = fopen(traceFile, "w");
+	if (fp == NULL)
+	{
+		printf("Error: trace file %s could not be opened! \n", traceFile);
+		return;
+	}
+	for (int s=0; s<numSpans; s++)
+		if (spans[s].startNs < base)
+			base = spans[s].startNs;
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%i,\"tid\":0,\"args\":{\"name\":\"host\"}},\n", BENCH_TRACE_HOST);
+	fprintf(fp, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%i,\"tid\":0,\"args\":{\"name\":\"device\"}}", BENCH_TRACE_DEVICE);
+	for (int t=0; t<numTracks; t++)
+	{
+		fprintf(fp, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%i,\"tid\":%i,\"args\":{\"name\":", tracks[t].pid, tracks[t].tid);
+		json_string(fp, tracks[t].name);
+		fprintf(fp, "}}");
+	}
+	for (int s=0; s<numSpans; s++)
+	{
+		const trace_span *sp = &spans[s];
+		fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":%i,\"tid\":%i,\"name\":", sp->pid, sp->tid);
+		json_string(fp, sp->name);
+		fprintf(fp, ",\"cat\":");
+		json_string(fp, sp->cat);
+		fprintf(fp, ",\"ts\":%.3f,\"dur\":%.3f", (sp->startNs - base) * 1.0e-3, (sp->endNs - sp->startNs) * 1.0e-3);
+		if (sp->args[0] != '\0')
+			fprintf(fp, ",\"args\":{%s}", sp->args);
+		fputc('}', fp);
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	printf("Trace with %i spans written to %s \n", numSpans, traceFile);
+	free(spans);
+	spans = NULL;
+	numSpans = capSpans = 0;
+}
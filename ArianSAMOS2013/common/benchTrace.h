@@ -0,0 +1,50 @@
+/*
+ * benchTrace.h
+ *
+ *  Trace-event export for the SAMOS 2013 benchmarks.
+ *
+ *  The phase statistics say how long WRDEV or KERNEL_EXEC took, not where
+ *  the time between two commands went. With
+ *
+ *    --trace <file>   write a trace of the run to <file>
+ *
+ *  or SAMOS_TRACE=<file> in the environment, every benchStart/benchStop
+ *  pair (benchHarness.h), every iteration and the host steps marked with
+ *  benchTraceBegin/benchTraceEnd become spans on the host track, and the
+ *  OpenCL commands the benchmarks enqueue become spans on one track per
+ *  command queue (oclTrace.h). The file is in the Chrome trace-event JSON
+ *  format and opens in chrome://tracing or https://ui.perfetto.dev.
+ *
+ *  All timestamps are on the clock of benchNowNs, in microseconds from the
+ *  first span. The file is written when the program exits.
+ */
+
+#ifndef BENCH_TRACE_H_
+#define BENCH_TRACE_H_
+
+#define BENCH_TRACE_HOST		1		/* pid of the host spans */
+#define BENCH_TRACE_DEVICE		2		/* pid of the device spans, tid is the queue */
+#define BENCH_TRACE_NAME_LEN	64
+#define BENCH_TRACE_ARGS_LEN	160
+
+/* Consumes --trace <file>, called from benchParseArgs */
+int benchTraceParseArg(int argc, char **argv, int *i);
+int benchTraceEnabled();
+
+/* Nested host spans; name is copied */
+void benchTraceBegin(const char *name);
+void benchTraceEnd();
+
+/*
+ * One complete span from startNs to endNs (benchNowNs clock). args is
+ * either NULL or the members of a JSON object, e.g. "\"bytes\":1024".
+ */
+void benchTraceSpan(int pid, int tid, const char *name, const char *cat,
+					unsigned long long startNs, unsigned long long endNs, const char *args);
+/* Labels a track in the viewer */
+void benchTraceTrackName(int pid, int tid, const char *name);
+
+/* Writes the file now; also runs at exit */
+void benchTraceWrite();
+
+#endif /* BENCH_TRACE_H_ */
@@ -0,0 +1,163 @@
+/*
+ * oclCoop.cpp
+ *
+ *  Cooperative CPU + device execution, see oclCoop.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclCoop.h"
+#include "oclHostMem.h"
+#include "benchHarness.h"
+#include "benchScaling.h"
+
+#define COOP_START_SHARE	0.5			/* auto mode starts from an even split */
+#define COOP_SMOOTHING		0.5			/* weight of the newest job in the rates and the share */
+
+static const char	*coopSpec = NULL;
+static int			coopThreads = -1;
+
+int oclCoopParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--coop") == 0 && *i + 1 < argc)
+	{
+		coopSpec = argv[++(*i)];
+		return 1;
+	}
+	if (strcmp(argv[*i], "--coop-threads") == 0 && *i + 1 < argc)
+	{
+		coopThreads = atoi(argv[++(*i)]);
+		return 1;
+	}
+	return 0;
+}
+
+static const char *coop_spec()
+{
+	if (coopSpec == NULL)
+		coopSpec = getenv("SAMOS_COOP");
+	if (coopSpec != NULL && (coopSpec[0] == '\0' || strcmp(coopSpec, "off") == 0))
+		coopSpec = NULL;
+	return coopSpec;
+}
+
+int oclCoopEnabled()
+{
+	static int warned = 0;
+
+	if (coop_spec() == NULL)
+		return 0;
+	if (oclHostMemMode() != OCL_MEM_COPY)
+	{
+		if (!warned)
+			printf("Cooperative mode needs --mem-mode copy, running the %s path on the device only \n", oclHostMemModeName(oclHostMemMode()));
+		warned = 1;
+		return 0;
+	}
+	return 1;
+}
+
+int oclCoopThreads()
+{
+	if (coopThreads < 0 && getenv("SAMOS_COOP_THREADS"))
+		coopThreads = atoi(getenv("SAMOS_COOP_THREADS"));
+	if (coopThreads < 1)
+		coopThreads = benchNumCores();
+	return coopThreads;
+}
+
+const char *oclCoopName()
+{
+	static char name[32];
+	ocl_coop c;
+
+	if (!oclCoopEnabled())
+		return NULL;
+	oclCoopInit(&c);
+	if (c.adaptive)
+		sprintf(name, "coop-auto");
+	else
+		sprintf(name, "coop-%.2f", c.share);
+	return name;
+}
+
+void oclCoopInit(ocl_coop *c)
+{
+	memset(c, 0, sizeof(*c));
+	c->adaptive = 1;
+	c->share = COOP_START_SHARE;
+	if (coop_spec() == NULL || strcmp(coop_spec(), "auto") == 0)
+		return;
+
+	c->adaptive = 0;
+	c->share = atof(coop_spec());
+	if (c->share < 0.0)
+		c->share = 0.0;
+	if (c->share > 1.0)
+		c->share = 1.0;
+}
+
+size_t oclCoopSplit(const ocl_coop *c, size_t total, size_t granule)
+{
+	size_t units = (size_t)(c->share * total + 0.5 * granule) / granule * granule;
+
+	// in auto mode both sides keep at least one granule, otherwise the idle one is never measured again
+	if (c->adaptive && total >= 2 * granule)
+	{
+		if (units < granule)
+			units = granule;
+		if (units > total - granule)
+			units = (total - granule) / granule * granule;
+	}
+	return (units > total) ? total : units;
+}
+
+double oclCoopEventMs(cl_event first, cl_event last)
+{
+	cl_ulong queued = 0, end = 0;
+
+	if (first == NULL)
+		return 0.0;
+	clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL);
+	clGetEventProfilingInfo(last ? last : first, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	return (end > queued) ? (end - queued) * 1.0e-6 : 0.0;
+}
+
+static double smooth(double old, double now)
+{
+	return (old > 0.0) ? (1.0 - COOP_SMOOTHING) * old + COOP_SMOOTHING * now : now;
+}
+
+void oclCoopUpdate(ocl_coop *c, size_t gpuUnits, double gpuMs, size_t cpuUnits, double cpuMs)
+{
+	c->jobs++;
+	c->gpuMs = gpuMs;
+	c->cpuMs = cpuMs;
+	if (gpuUnits > 0 && gpuMs > 0.0)
+		c->gpuRate = smooth(c->gpuRate, gpuUnits / gpuMs);
+	if (cpuUnits > 0 && cpuMs > 0.0)
+		c->cpuRate = smooth(c->cpuRate, cpuUnits / cpuMs);
+
+	if (!c->adaptive || c->gpuRate <= 0.0 || c->cpuRate <= 0.0)
+		return;
+	// both sides finish together when each gets work in proportion to its rate
+	c->share = smooth(c->share, c->gpuRate / (c->gpuRate + c->cpuRate));
+}
+
+void oclPrintCoopReport(FILE *fout, const ocl_coop *c, int coopPhase, const char *unit)
+{
+	if (!oclCoopEnabled())
+	{
+		fprintf(fout, "Cooperative CPU+device: off \n");
+		return;
+	}
+
+	const bench_stats *s = benchPhaseStats(coopPhase);
+	fprintf(fout, "Cooperative CPU+device: %s, device share %.3f after %i jobs, %i CPU threads \n",
+			c->adaptive ? "auto" : "fixed", c->share, c->jobs, oclCoopThreads());
+	fprintf(fout, "Cooperative rates: device %.3f %s/msec, CPU %.3f %s/msec, last job device %.3f msecs, CPU %.3f msecs, "
+			"%s %.3f msecs (median) \n", c->gpuRate, unit, c->cpuRate, unit, c->gpuMs, c->cpuMs,
+			benchPhaseName(coopPhase), (s && s->n > 0) ? s->median : 0.0);
+}
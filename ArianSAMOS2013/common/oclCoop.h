@@ -0,0 +1,68 @@
+/*
+ * oclCoop.h
+ *
+ *  Cooperative CPU + device execution for the SAMOS 2013 benchmarks.
+ *
+ *  Normally the device computes the whole problem and the CPU computes all
+ *  of it again, on --threads threads (benchScaling.h), only for the
+ *  speed-up figure. With
+ *
+ *    --coop auto        split every job between the device and the OpenMP
+ *                       CPU path and tune the split online
+ *    --coop <share>     fixed device share between 0 and 1, e.g. 0.7
+ *    --coop-threads N   CPU threads for the CPU share (default: all cores)
+ *
+ *  or SAMOS_COOP / SAMOS_COOP_THREADS in the environment, a benchmark
+ *  enqueues the device share of a job (AES blocks, image rows, BitCounter
+ *  elements, GP individuals, PM templates) without blocking, computes the
+ *  rest on the host in the meantime and then waits for the device. The job
+ *  is timed as the COOP phase; the CPU reference run is kept, so log.txt
+ *  still reports a speed-up.
+ *
+ *  The device time of a job runs from the queued time of its first command
+ *  to the end of its last one (event profiling), the CPU time is taken from
+ *  the host clock. In auto mode each side keeps at least one granule so both
+ *  rates stay measured, and after every job the share moves half-way
+ *  towards gpuRate / (gpuRate + cpuRate).
+ *
+ *  Cooperative mode only runs with --mem-mode copy and takes precedence
+ *  over --pipeline.
+ */
+
+#ifndef OCL_COOP_H_
+#define OCL_COOP_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+struct ocl_coop
+{
+	int		adaptive;
+	double	share;			/* fraction of the work units given to the device */
+	int		jobs;
+	double	gpuRate;		/* work units per msec, smoothed */
+	double	cpuRate;
+	double	gpuMs;			/* last job */
+	double	cpuMs;
+};
+
+/* Consumes --coop <auto|share> and --coop-threads <n>, called from oclParseArgs */
+int oclCoopParseArg(int argc, char **argv, int *i);
+
+int oclCoopEnabled();
+int oclCoopThreads();
+/* e.g. "coop-auto" or "coop-0.70" for the results records, NULL when off */
+const char *oclCoopName();
+
+void oclCoopInit(ocl_coop *c);
+/* Device part of total work units, a multiple of granule (or total itself); the CPU takes the rest */
+size_t oclCoopSplit(const ocl_coop *c, size_t total, size_t granule);
+/* Queued time of first to end time of last, in msecs; 0 when first is NULL */
+double oclCoopEventMs(cl_event first, cl_event last);
+/* Feeds back the measured job; moves the share in auto mode */
+void oclCoopUpdate(ocl_coop *c, size_t gpuUnits, double gpuMs, size_t cpuUnits, double cpuMs);
+
+/* coopPhase is the host time of the whole job, unit names the work units */
+void oclPrintCoopReport(FILE *fout, const ocl_coop *c, int coopPhase, const char *unit);
+
+#endif /* OCL_COOP_H_ */
@@ -0,0 +1,346 @@
+/*
+ * oclHandles.h
+ *
+ *  Owning handles and event futures for the SAMOS 2013 benchmarks.
+ *
+ *  The benchmarks kept their programs, kernels, samplers and buffers in
+ *  plain globals and released them by hand, so every path had to get the
+ *  order right and a missed release leaked. This header-only layer wraps
+ *  them instead:
+ *
+ *    ocl_handle<T>       move-only owner of a cl_kernel, cl_program,
+ *                        cl_sampler, cl_event, cl_mem, ... that releases it
+ *                        on reset() or destruction; it converts to T, so
+ *                        the clXxx calls take it as before
+ *    ocl_buffer<E>       a buffer of count elements of type E; cl_mem
+ *                        handles go back through oclPoolRelease (oclMemPool.h)
+ *    oclSetArgs(k, ...)  binds all arguments of a kernel in one call, a
+ *                        buffer or handle as its cl_mem, ocl_local(bytes)
+ *                        as local memory and anything else by value
+ *    ocl_future          the event and status of one enqueued command
+ *    ocl_after(f, ...)   the wait list of a command, from futures
+ *
+ *  oclWriteAsync, oclReadAsync, their image forms and oclLaunchAsync enqueue
+ *  without blocking and return a future, and a dependent command lists the
+ *  futures it needs:
+ *
+ *    ocl_future wr = oclWriteAsync(q, in, host, n);
+ *    ocl_future ex = oclLaunchAsync(q, k, 1, global, local, ocl_after(wr));
+ *    ocl_future rd = oclReadAsync(q, out, result, n, ocl_after(ex));
+ *    rd.wait();
+ *
+ *  so the host only waits where it needs a result, not after every step.
+ *  A trace name given to an enqueue hands its event to --trace (oclTrace.h).
+ *  Errors are printed and returned as cl_int like the rest of the code;
+ *  a failed enqueue gives a future without an event, and every later
+ *  future that waits on it carries the error on.
+ *
+ *  Globals holding handles are reset in the benchmarks' oclClean before
+ *  oclRelease releases the queue and the context, so nothing is left for
+ *  the static destructors.
+ */
+
+#ifndef OCL_HANDLES_H_
+#define OCL_HANDLES_H_
+
+#include <stdio.h>
+#include <utility>
+#include <CL/cl.h>
+
+#include "oclMemPool.h"
+#include "oclTrace.h"
+
+#define OCL_AFTER_MAX		8
+
+/* How a handle of T is released */
+template <class T> struct ocl_release_of;
+template <> struct ocl_release_of<cl_kernel>		{ static void release(cl_kernel k) { clReleaseKernel(k); } };
+template <> struct ocl_release_of<cl_program>		{ static void release(cl_program p) { clReleaseProgram(p); } };
+template <> struct ocl_release_of<cl_command_queue>	{ static void release(cl_command_queue q) { clReleaseCommandQueue(q); } };
+template <> struct ocl_release_of<cl_sampler>		{ static void release(cl_sampler s) { clReleaseSampler(s); } };
+template <> struct ocl_release_of<cl_event>			{ static void release(cl_event e) { clReleaseEvent(e); } };
+/* buffers and images of the pool stay in the pool, others are released */
+template <> struct ocl_release_of<cl_mem>			{ static void release(cl_mem m) { oclPoolRelease(m); } };
+
+template <class T>
+class ocl_handle
+{
+public:
+	ocl_handle() : obj(NULL) {}
+	explicit ocl_handle(T o) : obj(o) {}
+	ocl_handle(ocl_handle &&o) : obj(o.obj) { o.obj = NULL; }
+	~ocl_handle() { reset(); }
+
+	ocl_handle &operator=(ocl_handle &&o)
+	{
+		if (this != &o)
+		{
+			reset();
+			obj = o.obj;
+			o.obj = NULL;
+		}
+		return *this;
+	}
+	ocl_handle(const ocl_handle &) = delete;
+	ocl_handle &operator=(const ocl_handle &) = delete;
+
+	T get() const { return obj; }
+	operator T() const { return obj; }
+
+	/* Releases the object held and takes o */
+	void reset(T o = NULL)
+	{
+		if (obj != NULL)
+			ocl_release_of<T>::release(obj);
+		obj = o;
+	}
+	/* Gives the object up without releasing it */
+	T detach()
+	{
+		T o = obj;
+		obj = NULL;
+		return o;
+	}
+	/* For the out-parameters of the clXxx calls, e.g. the event of an enqueue */
+	T *out()
+	{
+		reset();
+		return &obj;
+	}
+
+private:
+	T	obj;
+};
+
+template <class E>
+class ocl_buffer
+{
+public:
+	ocl_buffer() : count(0) {}
+
+	/* Takes mem, which holds n elements */
+	void reset(cl_mem mem = NULL, size_t n = 0)
+	{
+		handle.reset(mem);
+		count = (mem != NULL) ? n : 0;
+	}
+
+	cl_mem get() const { return handle.get(); }
+	operator cl_mem() const { return handle.get(); }
+	size_t size() const { return count; }
+	size_t bytes() const { return count * sizeof(E); }
+
+private:
+	ocl_handle<cl_mem>	handle;
+	size_t				count;
+};
+
+/* Local memory of a kernel argument */
+struct ocl_local
+{
+	size_t	bytes;
+	explicit ocl_local(size_t b) : bytes(b) {}
+};
+
+inline cl_int ocl_set_arg(cl_kernel k, cl_uint i, const ocl_local &l)
+{
+	return clSetKernelArg(k, i, l.bytes, NULL);
+}
+
+inline cl_int ocl_set_arg(cl_kernel k, cl_uint i, const ocl_handle<cl_mem> &h)
+{
+	cl_mem m = h.get();
+	return clSetKernelArg(k, i, sizeof(cl_mem), &m);
+}
+
+inline cl_int ocl_set_arg(cl_kernel k, cl_uint i, const ocl_handle<cl_sampler> &h)
+{
+	cl_sampler s = h.get();
+	return clSetKernelArg(k, i, sizeof(cl_sampler), &s);
+}
+
+template <class E>
+inline cl_int ocl_set_arg(cl_kernel k, cl_uint i, const ocl_buffer<E> &b)
+{
+	cl_mem m = b.get();
+	return clSetKernelArg(k, i, sizeof(cl_mem), &m);
+}
+
+/* cl_mem, cl_sampler and the scalar and vector types by value */
+template <class T>
+inline cl_int ocl_set_arg(cl_kernel k, cl_uint i, const T &v)
+{
+	return clSetKernelArg(k, i, sizeof(T), &v);
+}
+
+inline cl_int oclSetArgsFrom(cl_kernel k, cl_uint first)
+{
+	(void)k;
+	(void)first;
+	return CL_SUCCESS;
+}
+
+/* Sets the arguments of k from index first on, e.g. the ones that change between launches; returns the first error */
+template <class A, class... R>
+inline cl_int oclSetArgsFrom(cl_kernel k, cl_uint first, const A &arg, const R &... rest)
+{
+	cl_int err = ocl_set_arg(k, first, arg);
+	if (err != CL_SUCCESS)
+	{
+		printf("Error in setting kernel argument %u!, clErr=%i \n", first, err);
+		return err;
+	}
+	return oclSetArgsFrom(k, first + 1, rest...);
+}
+
+template <class... A>
+inline cl_int oclSetArgs(cl_kernel k, const A &... args)
+{
+	return oclSetArgsFrom(k, 0, args...);
+}
+
+class ocl_future
+{
+public:
+	ocl_future() : err(CL_SUCCESS) {}
+	ocl_future(cl_int e, cl_event ev) : err(e), event(ev) {}
+	ocl_future(ocl_future &&o) = default;
+	ocl_future &operator=(ocl_future &&o) = default;
+
+	cl_int error() const { return err; }
+	bool ok() const { return err == CL_SUCCESS; }
+	/* NULL for a failed enqueue or a future that was never enqueued */
+	cl_event get() const { return event.get(); }
+
+	/* Blocks until the command has finished; returns its error or the one of the wait */
+	cl_int wait()
+	{
+		cl_event ev = event.get();
+		if (err == CL_SUCCESS && ev != NULL)
+		{
+			err = clWaitForEvents(1, &ev);
+			if (err != CL_SUCCESS)
+				printf("Error in waiting for a command!, clErr=%i \n", err);
+		}
+		return err;
+	}
+
+private:
+	cl_int					err;
+	ocl_handle<cl_event>	event;
+};
+
+/* The wait list of a command; the futures must live until it is enqueued */
+class ocl_after
+{
+public:
+	ocl_after() : num(0), err(CL_SUCCESS) {}
+	ocl_after(const ocl_future &a) : num(0), err(CL_SUCCESS) { add(a); }
+	ocl_after(const ocl_future &a, const ocl_future &b) : num(0), err(CL_SUCCESS) { add(a).add(b); }
+	ocl_after(const ocl_future &a, const ocl_future &b, const ocl_future &c) : num(0), err(CL_SUCCESS) { add(a).add(b).add(c); }
+
+	ocl_after &add(const ocl_future &f)
+	{
+		if (!f.ok())
+			err = f.error();
+		else if (f.get() != NULL && num == OCL_AFTER_MAX)
+		{
+			printf("Error: more than %i events to wait for! \n", OCL_AFTER_MAX);
+			err = CL_INVALID_EVENT_WAIT_LIST;
+		}
+		else if (f.get() != NULL)
+			list[num++] = f.get();
+		return *this;
+	}
+
+	cl_uint size() const { return num; }
+	const cl_event *events() const { return num ? list : NULL; }
+	/* The error of a future in the list; the command is then not enqueued */
+	cl_int error() const { return err; }
+
+private:
+	cl_uint		num;
+	cl_event	list[OCL_AFTER_MAX];
+	cl_int		err;
+};
+
+/*
+ * Turns the result of an enqueue into a future: prints what failed, or
+ * hands the event to the trace under name (NULL for none). Any clEnqueue*
+ * call can be wrapped like this:
+ *
+ *    cl_event ev = NULL;
+ *    cl_int err = clEnqueueFillBuffer(q, buf, &zero, sizeof(zero), 0, size, 0, NULL, &ev);
+ *    ocl_future fill = oclEnqueued(err, ev, "WRDEV zero", "filling buffer");
+ */
+inline ocl_future oclEnqueued(cl_int err, cl_event ev, const char *name, const char *what)
+{
+	if (err != CL_SUCCESS)
+	{
+		printf("Error in %s!, clErr=%i \n", what, err);
+		if (ev != NULL)
+			clReleaseEvent(ev);
+		return ocl_future(err, NULL);
+	}
+	if (name != NULL)
+		oclTraceKeep(name, ev);
+	return ocl_future(CL_SUCCESS, ev);
+}
+
+/* Writes n elements from src into buf, starting at element first */
+template <class E>
+inline ocl_future oclWriteAsync(cl_command_queue q, const ocl_buffer<E> &buf, const E *src, size_t n,
+								const ocl_after &after = ocl_after(), const char *name = NULL, size_t first = 0)
+{
+	cl_event ev = NULL;
+	if (after.error() != CL_SUCCESS)
+		return ocl_future(after.error(), NULL);
+	cl_int err = clEnqueueWriteBuffer(q, buf, CL_FALSE, first * sizeof(E), n * sizeof(E), src, after.size(), after.events(), &ev);
+	return oclEnqueued(err, ev, name, "writing buffer");
+}
+
+/* Reads n elements of buf, starting at element first, into dst */
+template <class E>
+inline ocl_future oclReadAsync(cl_command_queue q, const ocl_buffer<E> &buf, E *dst, size_t n,
+							   const ocl_after &after = ocl_after(), const char *name = NULL, size_t first = 0)
+{
+	cl_event ev = NULL;
+	if (after.error() != CL_SUCCESS)
+		return ocl_future(after.error(), NULL);
+	cl_int err = clEnqueueReadBuffer(q, buf, CL_FALSE, first * sizeof(E), n * sizeof(E), dst, after.size(), after.events(), &ev);
+	return oclEnqueued(err, ev, name, "reading buffer");
+}
+
+/* Writes the region at origin of a 2D image from tightly packed src */
+inline ocl_future oclWriteImageAsync(cl_command_queue q, cl_mem img, const size_t *origin, const size_t *region, const void *src,
+									 const ocl_after &after = ocl_after(), const char *name = NULL)
+{
+	cl_event ev = NULL;
+	if (after.error() != CL_SUCCESS)
+		return ocl_future(after.error(), NULL);
+	cl_int err = clEnqueueWriteImage(q, img, CL_FALSE, origin, region, 0, 0, src, after.size(), after.events(), &ev);
+	return oclEnqueued(err, ev, name, "writing image");
+}
+
+inline ocl_future oclReadImageAsync(cl_command_queue q, cl_mem img, const size_t *origin, const size_t *region, void *dst,
+									const ocl_after &after = ocl_after(), const char *name = NULL)
+{
+	cl_event ev = NULL;
+	if (after.error() != CL_SUCCESS)
+		return ocl_future(after.error(), NULL);
+	cl_int err = clEnqueueReadImage(q, img, CL_FALSE, origin, region, 0, 0, dst, after.size(), after.events(), &ev);
+	return oclEnqueued(err, ev, name, "reading image");
+}
+
+/* Launches k over global (dims entries), local may be NULL and offset is the global work offset */
+inline ocl_future oclLaunchAsync(cl_command_queue q, cl_kernel k, cl_uint dims, const size_t *global, const size_t *local,
+								 const ocl_after &after = ocl_after(), const char *name = NULL, const size_t *offset = NULL)
+{
+	cl_event ev = NULL;
+	if (after.error() != CL_SUCCESS)
+		return ocl_future(after.error(), NULL);
+	cl_int err = clEnqueueNDRangeKernel(q, k, dims, offset, global, local, after.size(), after.events(), &ev);
+	return oclEnqueued(err, ev, name, "launching kernel");
+}
+
+#endif /* OCL_HANDLES_H_ */
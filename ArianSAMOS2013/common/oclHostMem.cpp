@@ -0,0 +1,364 @@
+/*
+ * oclHostMem.cpp
+ *
+ *  Zero-copy host buffers for the SAMOS 2013 benchmarks, see oclHostMem.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclHostMem.h"
+#include "oclTrace.h"
+#include "benchHarness.h"
+#include "benchServe.h"
+
+#define HOST_MEM_ALIGN		4096		/* page alignment, what CL_MEM_USE_HOST_PTR needs to avoid a copy */
+#define HOST_MEM_SIZE_ALIGN	64			/* some drivers also want the size in whole cache lines */
+
+static int	memMode = -1;
+
+static int parse_mode(const char *s)
+{
+	if (strcmp(s, "copy") == 0)
+		return OCL_MEM_COPY;
+	if (strcmp(s, "alloc") == 0)
+		return OCL_MEM_ALLOC;
+	if (strcmp(s, "use") == 0)
+		return OCL_MEM_USE;
+	printf("Unknown memory mode %s, using copy \n", s);
+	return OCL_MEM_COPY;
+}
+
+int oclHostMemParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--mem-mode") == 0 && *i + 1 < argc)
+	{
+		memMode = parse_mode(argv[++(*i)]);
+		return 1;
+	}
+	return 0;
+}
+
+int oclHostMemMode()
+{
+	if (memMode < 0)
+		memMode = getenv("SAMOS_MEM_MODE") ? parse_mode(getenv("SAMOS_MEM_MODE")) : OCL_MEM_COPY;
+	// the zero-copy buffers hold one input placed there at creation, a service gets a new one per request
+	if (memMode != OCL_MEM_COPY && benchServeEnabled())
+	{
+		printf("Service mode needs --mem-mode copy, serving with copies \n");
+		memMode = OCL_MEM_COPY;
+	}
+	return memMode;
+}
+
+const char *oclHostMemModeName(int mode)
+{
+	switch (mode)
+	{
+		case OCL_MEM_ALLOC:	return "alloc";
+		case OCL_MEM_USE:	return "use";
+		default:			return "copy";
+	}
+}
+
+static void *aligned_alloc_host(const ocl_runtime *rt, size_t size)
+{
+	size_t align = HOST_MEM_ALIGN;
+	void *p = NULL;
+
+	/* CL_DEVICE_MEM_BASE_ADDR_ALIGN is in bits */
+	if (rt->memBaseAlign / 8 > align)
+		align = rt->memBaseAlign / 8;
+	size = (size + HOST_MEM_SIZE_ALIGN - 1) / HOST_MEM_SIZE_ALIGN * HOST_MEM_SIZE_ALIGN;
+#ifdef _WIN32
+	p = _aligned_malloc(size, align);
+#else
+	if (posix_memalign(&p, align, size) != 0)
+		p = NULL;
+#endif
+	return p;
+}
+
+static void aligned_free_host(void *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/* Frees the page-aligned copy behind a CL_MEM_USE_HOST_PTR object once the runtime is done with it */
+static void CL_CALLBACK free_host_ptr(cl_mem memobj, void *hostPtr)
+{
+	(void)memobj;
+	aligned_free_host(hostPtr);
+}
+
+cl_mem oclCreateHostBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, const void *hostData, cl_int *err)
+{
+	cl_mem buf;
+	cl_int clErr;
+	int mode = oclHostMemMode();
+
+	if (mode == OCL_MEM_USE)
+	{
+		void *host = aligned_alloc_host(rt, size);
+		if (host == NULL)
+		{
+			printf("Error: %lu bytes of aligned host memory could not be allocated! \n", (unsigned long)size);
+			exit(1);
+		}
+		if (hostData)
+			memcpy(host, hostData, size);
+		else
+			memset(host, 0, size);
+		buf = clCreateBuffer(rt->context, flags | CL_MEM_USE_HOST_PTR, size, host, &clErr);
+		if (clErr == CL_SUCCESS)
+			clSetMemObjectDestructorCallback(buf, free_host_ptr, host);
+		else
+			aligned_free_host(host);
+	}
+	else if (mode == OCL_MEM_ALLOC)
+	{
+		buf = clCreateBuffer(rt->context, flags | CL_MEM_ALLOC_HOST_PTR, size, NULL, &clErr);
+		if (clErr == CL_SUCCESS && hostData)
+		{
+			void *p = clEnqueueMapBuffer(rt->queue, buf, CL_TRUE, CL_MAP_WRITE, 0, size, 0, NULL, oclTraceEvent("map initial data"), &clErr);
+			if (clErr == CL_SUCCESS)
+			{
+				memcpy(p, hostData, size);
+				clEnqueueUnmapMemObject(rt->queue, buf, p, 0, NULL, oclTraceEvent("unmap initial data"));
+				clFinish(rt->queue);
+			}
+		}
+	}
+	else
+		buf = clCreateBuffer(rt->context, flags, size, NULL, &clErr);
+
+	if (clErr != CL_SUCCESS)
+		printf("Error in creating %s buffer!, clErr=%i \n", oclHostMemModeName(mode), clErr);
+	if (err)
+		*err = clErr;
+	return buf;
+}
+
+cl_mem oclCreateHostImage2D(ocl_runtime *rt, cl_mem_flags flags, const cl_image_format *format,
+							size_t width, size_t height, size_t pixelSize, const void *hostData, cl_int *err)
+{
+	cl_mem img;
+	cl_int clErr;
+	int mode = oclHostMemMode();
+	size_t rowBytes = width * pixelSize;
+
+	if (mode == OCL_MEM_USE)
+	{
+		void *host = aligned_alloc_host(rt, rowBytes * height);
+		if (host == NULL)
+		{
+			printf("Error: %lu bytes of aligned host memory could not be allocated! \n", (unsigned long)(rowBytes * height));
+			exit(1);
+		}
+		if (hostData)
+			memcpy(host, hostData, rowBytes * height);
+		else
+			memset(host, 0, rowBytes * height);
+		img = clCreateImage2D(rt->context, flags | CL_MEM_USE_HOST_PTR, format, width, height, rowBytes, host, &clErr);
+		if (clErr == CL_SUCCESS)
+			clSetMemObjectDestructorCallback(img, free_host_ptr, host);
+		else
+			aligned_free_host(host);
+	}
+	else if (mode == OCL_MEM_ALLOC)
+	{
+		img = clCreateImage2D(rt->context, flags | CL_MEM_ALLOC_HOST_PTR, format, width, height, 0, NULL, &clErr);
+		if (clErr == CL_SUCCESS && hostData)
+		{
+			size_t origin[3] = {0, 0, 0};
+			size_t region[3] = {width, height, 1};
+			size_t rowPitch = 0;
+			char *p = (char *)clEnqueueMapImage(rt->queue, img, CL_TRUE, CL_MAP_WRITE, origin, region, &rowPitch, NULL,
+												0, NULL, oclTraceEvent("map initial data"), &clErr);
+			if (clErr == CL_SUCCESS)
+			{
+				for (size_t y=0; y<height; y++)
+					memcpy(p + y * rowPitch, (const char *)hostData + y * rowBytes, rowBytes);
+				clEnqueueUnmapMemObject(rt->queue, img, p, 0, NULL, oclTraceEvent("unmap initial data"));
+				clFinish(rt->queue);
+			}
+		}
+	}
+	else
+		img = clCreateImage2D(rt->context, flags, format, width, height, 0, NULL, &clErr);
+
+	if (clErr != CL_SUCCESS)
+		printf("Error in creating %s image!, clErr=%i \n", oclHostMemModeName(mode), clErr);
+	if (err)
+		*err = clErr;
+	return img;
+}
+
+void oclHandOverBuffer(ocl_runtime *rt, cl_mem buf, cl_map_flags flags, size_t size)
+{
+	cl_int clErr;
+	void *p = clEnqueueMapBuffer(rt->queue, buf, CL_TRUE, flags, 0, size, 0, NULL, oclTraceEvent("map hand-over"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping buffer!, clErr=%i \n", clErr);
+		return;
+	}
+	clEnqueueUnmapMemObject(rt->queue, buf, p, 0, NULL, oclTraceEvent("unmap hand-over"));
+	clFinish(rt->queue);
+}
+
+void oclHandOverImage2D(ocl_runtime *rt, cl_mem img, cl_map_flags flags, size_t width, size_t height)
+{
+	cl_int clErr;
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {width, height, 1};
+	size_t rowPitch = 0;
+	void *p = clEnqueueMapImage(rt->queue, img, CL_TRUE, flags, origin, region, &rowPitch, NULL, 0, NULL, oclTraceEvent("map hand-over"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping image!, clErr=%i \n", clErr);
+		return;
+	}
+	clEnqueueUnmapMemObject(rt->queue, img, p, 0, NULL, oclTraceEvent("unmap hand-over"));
+	clFinish(rt->queue);
+}
+
+void oclReadHostBuffer(ocl_runtime *rt, cl_mem buf, void *dst, size_t size)
+{
+	cl_int clErr;
+	void *p = clEnqueueMapBuffer(rt->queue, buf, CL_TRUE, CL_MAP_READ, 0, size, 0, NULL, oclTraceEvent("map read-back"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping buffer!, clErr=%i \n", clErr);
+		return;
+	}
+	memcpy(dst, p, size);
+	clEnqueueUnmapMemObject(rt->queue, buf, p, 0, NULL, oclTraceEvent("unmap read-back"));
+	clFinish(rt->queue);
+}
+
+void oclReadHostImage2D(ocl_runtime *rt, cl_mem img, void *dst, size_t width, size_t height, size_t pixelSize)
+{
+	cl_int clErr;
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {width, height, 1};
+	size_t rowPitch = 0;
+	char *p = (char *)clEnqueueMapImage(rt->queue, img, CL_TRUE, CL_MAP_READ, origin, region, &rowPitch, NULL,
+										0, NULL, oclTraceEvent("map read-back"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping image!, clErr=%i \n", clErr);
+		return;
+	}
+	for (size_t y=0; y<height; y++)
+		memcpy((char *)dst + y * width * pixelSize, p + y * rowPitch, width * pixelSize);
+	clEnqueueUnmapMemObject(rt->queue, img, p, 0, NULL, oclTraceEvent("unmap read-back"));
+	clFinish(rt->queue);
+}
+
+void oclWriteHostBuffer(ocl_runtime *rt, cl_mem buf, const void *src, size_t size)
+{
+	cl_int clErr;
+	void *p = clEnqueueMapBuffer(rt->queue, buf, CL_TRUE, CL_MAP_WRITE, 0, size, 0, NULL, oclTraceEvent("map initial data"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping buffer!, clErr=%i \n", clErr);
+		return;
+	}
+	memcpy(p, src, size);
+	clEnqueueUnmapMemObject(rt->queue, buf, p, 0, NULL, oclTraceEvent("unmap initial data"));
+	clFinish(rt->queue);
+}
+
+void oclWriteHostImage2D(ocl_runtime *rt, cl_mem img, const void *src, size_t width, size_t height, size_t pixelSize)
+{
+	cl_int clErr;
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {width, height, 1};
+	size_t rowPitch = 0;
+	char *p = (char *)clEnqueueMapImage(rt->queue, img, CL_TRUE, CL_MAP_WRITE, origin, region, &rowPitch, NULL,
+										0, NULL, oclTraceEvent("map initial data"), &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in mapping image!, clErr=%i \n", clErr);
+		return;
+	}
+	for (size_t y=0; y<height; y++)
+		memcpy(p + y * rowPitch, (const char *)src + y * width * pixelSize, width * pixelSize);
+	clEnqueueUnmapMemObject(rt->queue, img, p, 0, NULL, oclTraceEvent("unmap initial data"));
+	clFinish(rt->queue);
+}
+
+void oclTimeCopyPath(ocl_runtime *rt, size_t writeBytes, size_t readBytes, int wrPhase, int rdPhase)
+{
+	cl_int clErr;
+	size_t size = (writeBytes > readBytes) ? writeBytes : readBytes;
+
+	if (oclHostMemMode() == OCL_MEM_COPY || size == 0)
+		return;
+
+	cl_mem buf = clCreateBuffer(rt->context, CL_MEM_READ_WRITE, size, NULL, &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating buffer for the copy path!, clErr=%i \n", clErr);
+		return;
+	}
+	char *host = (char *)calloc(size, 1);
+
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		int timed = (it >= benchWarmup());
+		if (writeBytes > 0)
+		{
+			if (timed)
+				benchStart(wrPhase);
+			clEnqueueWriteBuffer(rt->queue, buf, CL_TRUE, 0, writeBytes, host, 0, NULL, oclTraceEvent("copy path write"));
+			clFinish(rt->queue);
+			if (timed)
+				benchStop(wrPhase);
+		}
+		if (readBytes > 0)
+		{
+			if (timed)
+				benchStart(rdPhase);
+			clEnqueueReadBuffer(rt->queue, buf, CL_TRUE, 0, readBytes, host, 0, NULL, oclTraceEvent("copy path read"));
+			clFinish(rt->queue);
+			if (timed)
+				benchStop(rdPhase);
+		}
+	}
+	free(host);
+	clReleaseMemObject(buf);
+}
+
+static double median_of(int phase)
+{
+	const bench_stats *s = benchPhaseStats(phase);
+	return (s && s->n > 0) ? s->median : 0.0;
+}
+
+void oclPrintHostMemReport(FILE *fout, const ocl_runtime *rt, int wrPhase, int rdPhase, int wrCopyPhase, int rdCopyPhase)
+{
+	int mode = oclHostMemMode();
+	static const char *how[3] = {"clEnqueueWrite/Read copies", "CL_MEM_ALLOC_HOST_PTR + map/unmap",
+								 "CL_MEM_USE_HOST_PTR + map/unmap"};
+
+	fprintf(fout, "Host memory: %s (%s), unified host/device memory: %s \n", oclHostMemModeName(mode), how[mode],
+			rt->hostUnifiedMemory ? "yes" : "no");
+	if (mode == OCL_MEM_COPY)
+		return;
+
+	double zeroCopy = median_of(wrPhase) + median_of(rdPhase);
+	double copy = median_of(wrCopyPhase) + median_of(rdCopyPhase);
+	fprintf(fout, "Transfer time (WRDEV + RDDEV, median): zero-copy %.3f msecs, copy path %.3f msecs, saved %.3f msecs",
+			zeroCopy, copy, copy - zeroCopy);
+	if (copy > 0.0)
+		fprintf(fout, " (%.1f%%)", 100.0 * (copy - zeroCopy) / copy);
+	fprintf(fout, " \n");
+}
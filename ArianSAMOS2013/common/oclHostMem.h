@@ -0,0 +1,68 @@
+/*
+ * oclHostMem.h
+ *
+ *  Zero-copy host buffers for the SAMOS 2013 benchmarks.
+ *
+ *  The benchmarks copy their input into device buffers with blocking
+ *  clEnqueueWriteBuffer/clEnqueueWriteImage and copy the result back, which
+ *  is a large part of WRDEV/RDDEV. On the embedded SoCs host and GPU share
+ *  DRAM, so the data can stay where the host produced it:
+ *
+ *    --mem-mode copy    device buffers plus write/read copies (default)
+ *    --mem-mode alloc   CL_MEM_ALLOC_HOST_PTR, accessed with map/unmap
+ *    --mem-mode use     CL_MEM_USE_HOST_PTR on page-aligned host memory,
+ *                       accessed with map/unmap
+ *
+ *  or SAMOS_MEM_MODE in the environment. In the zero-copy modes the initial
+ *  contents are placed in the buffer once, when it is created, and WRDEV and
+ *  RDDEV only hand the memory over with a map/unmap pair. oclTimeCopyPath
+ *  times plain write/read copies of the same sizes into the WRDEV_COPY and
+ *  RDDEV_COPY phases, so log.txt can report the transfer time saved. A
+ *  --serve service (benchServe.h) always copies.
+ */
+
+#ifndef OCL_HOST_MEM_H_
+#define OCL_HOST_MEM_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_MEM_COPY		0
+#define OCL_MEM_ALLOC		1
+#define OCL_MEM_USE			2
+
+/* Consumes --mem-mode <copy|alloc|use>, called from oclParseArgs */
+int oclHostMemParseArg(int argc, char **argv, int *i);
+
+int oclHostMemMode();
+const char *oclHostMemModeName(int mode);
+
+/*
+ * Creates a buffer for the current mode. In the zero-copy modes hostData, if
+ * not NULL, becomes the initial contents; in copy mode it is ignored and the
+ * caller keeps writing the buffer itself.
+ */
+cl_mem oclCreateHostBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, const void *hostData, cl_int *err);
+/* Same for a 2D image; hostData holds width * height pixels without padding */
+cl_mem oclCreateHostImage2D(ocl_runtime *rt, cl_mem_flags flags, const cl_image_format *format,
+							size_t width, size_t height, size_t pixelSize, const void *hostData, cl_int *err);
+
+/* Blocking map/unmap pair, i.e. the hand-over that replaces a write (CL_MAP_WRITE) or read (CL_MAP_READ) */
+void oclHandOverBuffer(ocl_runtime *rt, cl_mem buf, cl_map_flags flags, size_t size);
+void oclHandOverImage2D(ocl_runtime *rt, cl_mem img, cl_map_flags flags, size_t width, size_t height);
+
+/* Copies a zero-copy buffer/image into dst through a read mapping, for checks outside the timed loop */
+void oclReadHostBuffer(ocl_runtime *rt, cl_mem buf, void *dst, size_t size);
+void oclReadHostImage2D(ocl_runtime *rt, cl_mem img, void *dst, size_t width, size_t height, size_t pixelSize);
+
+/* Fills a zero-copy buffer/image from src through a write mapping, e.g. when a pooled one is handed out again */
+void oclWriteHostBuffer(ocl_runtime *rt, cl_mem buf, const void *src, size_t size);
+void oclWriteHostImage2D(ocl_runtime *rt, cl_mem img, const void *src, size_t width, size_t height, size_t pixelSize);
+
+/* Times the copy path for the same transfer sizes; does nothing in copy mode */
+void oclTimeCopyPath(ocl_runtime *rt, size_t writeBytes, size_t readBytes, int wrPhase, int rdPhase);
+void oclPrintHostMemReport(FILE *fout, const ocl_runtime *rt, int wrPhase, int rdPhase, int wrCopyPhase, int rdCopyPhase);
+
+#endif /* OCL_HOST_MEM_H_ */
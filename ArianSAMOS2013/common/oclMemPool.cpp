@@ -0,0 +1,233 @@
+/*
+ * oclMemPool.cpp
+ *
+ *  Device buffer pool for the SAMOS 2013 benchmarks, see oclMemPool.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclMemPool.h"
+#include "oclHostMem.h"
+#include "benchArena.h"
+
+struct pool_entry
+{
+	cl_mem			mem;
+	int				image;
+	int				hostMem;		/* created for the memory mode, not as a plain device buffer */
+	cl_mem_flags	flags;
+	size_t			size;			/* bytes, the class size of a buffer */
+	cl_image_format	format;
+	size_t			width;
+	size_t			height;
+	int				inUse;
+};
+
+static pool_entry	entries[OCL_POOL_MAX_OBJECTS];
+static int			numEntries = 0;
+static size_t		heldBytes = 0;
+
+size_t oclPoolClassSize(size_t size)
+{
+	size_t p = OCL_POOL_MIN_CLASS;
+
+	if (size <= OCL_POOL_MIN_CLASS)
+		return OCL_POOL_MIN_CLASS;
+	while (p * 2 <= size)
+		p *= 2;
+	for (int q=4; q<8; q++)
+		if (p / 4 * q >= size)
+			return p / 4 * q;
+	return 2 * p;
+}
+
+static int find_free(int image, int hostMem, cl_mem_flags flags, size_t size, const cl_image_format *format, size_t width, size_t height)
+{
+	for (int e=0; e<numEntries; e++)
+	{
+		const pool_entry *p = &entries[e];
+		if (p->inUse || p->image != image || p->hostMem != hostMem || p->flags != flags || p->size != size)
+			continue;
+		if (image && (p->width != width || p->height != height
+					  || p->format.image_channel_order != format->image_channel_order
+					  || p->format.image_channel_data_type != format->image_channel_data_type))
+			continue;
+		return e;
+	}
+	return -1;
+}
+
+static void drop_entry(int e)
+{
+	clReleaseMemObject(entries[e].mem);
+	heldBytes -= entries[e].size;
+	entries[e] = entries[--numEntries];
+}
+
+/* A request that misses replaces the smaller kept objects of its kind, e.g. the previous size of a sweep */
+static void drop_smaller(int image, int hostMem, cl_mem_flags flags, size_t size)
+{
+	for (int e=numEntries-1; e>=0; e--)
+		if (!entries[e].inUse && entries[e].image == image && entries[e].hostMem == hostMem
+			&& entries[e].flags == flags && entries[e].size < size)
+			drop_entry(e);
+}
+
+static int free_entries()
+{
+	int n = 0;
+	for (int e=0; e<numEntries; e++)
+		n += !entries[e].inUse;
+	return n;
+}
+
+static void track(cl_mem mem, int image, int hostMem, cl_mem_flags flags, size_t size, const cl_image_format *format, size_t width, size_t height)
+{
+	if (numEntries == OCL_POOL_MAX_OBJECTS)
+	{
+		for (int e=0; e<numEntries; e++)
+			if (!entries[e].inUse)
+			{
+				drop_entry(e);
+				break;
+			}
+		if (numEntries == OCL_POOL_MAX_OBJECTS)
+			return;			// not kept, oclPoolRelease releases it
+	}
+	pool_entry *p = &entries[numEntries++];
+	memset(p, 0, sizeof(*p));
+	p->mem = mem;
+	p->image = image;
+	p->hostMem = hostMem;
+	p->flags = flags;
+	p->size = size;
+	if (format)
+		p->format = *format;
+	p->width = width;
+	p->height = height;
+	p->inUse = 1;
+	heldBytes += size;
+}
+
+static cl_mem create_buffer(ocl_runtime *rt, int hostMem, cl_mem_flags flags, size_t size, cl_int *err)
+{
+	if (hostMem)
+		return oclCreateHostBuffer(rt, flags, size, NULL, err);
+	cl_mem buf = clCreateBuffer(rt->context, flags, size, NULL, err);
+	if (*err != CL_SUCCESS)
+		printf("Error in creating buffer!, clErr=%i \n", *err);
+	return buf;
+}
+
+static cl_mem acquire_buffer(ocl_runtime *rt, int hostMem, cl_mem_flags flags, size_t size, const void *hostData, cl_int *err)
+{
+	size_t cls = benchPoolEnabled() ? oclPoolClassSize(size) : size;
+	cl_int clErr = CL_SUCCESS;
+	cl_mem buf;
+	int e = find_free(0, hostMem, flags, cls, NULL, 0, 0);
+
+	if (e >= 0)
+	{
+		entries[e].inUse = 1;
+		buf = entries[e].mem;
+		benchAllocNote(BENCH_ALLOC_DEVICE, 0, cls, heldBytes);
+	}
+	else
+	{
+		drop_smaller(0, hostMem, flags, cls);
+		// the initial contents are written below, the class can be larger than hostData
+		buf = create_buffer(rt, hostMem, flags, cls, &clErr);
+		if (clErr != CL_SUCCESS && free_entries() > 0)
+		{
+			printf("Releasing the buffer pool and trying again \n");
+			oclPoolDrain();
+			buf = create_buffer(rt, hostMem, flags, cls, &clErr);
+		}
+		if (clErr != CL_SUCCESS)
+		{
+			if (err)
+				*err = clErr;
+			return buf;
+		}
+		track(buf, 0, hostMem, flags, cls, NULL, 0, 0);
+		benchAllocNote(BENCH_ALLOC_DEVICE, 1, cls, heldBytes);
+	}
+	if (hostData && hostMem && oclHostMemMode() != OCL_MEM_COPY)
+		oclWriteHostBuffer(rt, buf, hostData, size);
+	if (err)
+		*err = clErr;
+	return buf;
+}
+
+cl_mem oclPoolBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, const void *hostData, cl_int *err)
+{
+	return acquire_buffer(rt, 1, flags, size, hostData, err);
+}
+
+cl_mem oclPoolDeviceBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, cl_int *err)
+{
+	return acquire_buffer(rt, 0, flags, size, NULL, err);
+}
+
+cl_mem oclPoolImage2D(ocl_runtime *rt, cl_mem_flags flags, const cl_image_format *format,
+					  size_t width, size_t height, size_t pixelSize, const void *hostData, cl_int *err)
+{
+	size_t bytes = width * height * pixelSize;
+	cl_int clErr = CL_SUCCESS;
+	cl_mem img;
+	int e = find_free(1, 1, flags, bytes, format, width, height);
+
+	if (e >= 0)
+	{
+		entries[e].inUse = 1;
+		img = entries[e].mem;
+		benchAllocNote(BENCH_ALLOC_DEVICE, 0, bytes, heldBytes);
+		if (hostData && oclHostMemMode() != OCL_MEM_COPY)
+			oclWriteHostImage2D(rt, img, hostData, width, height, pixelSize);
+	}
+	else
+	{
+		drop_smaller(1, 1, flags, bytes);
+		img = oclCreateHostImage2D(rt, flags, format, width, height, pixelSize, hostData, &clErr);
+		if (clErr != CL_SUCCESS && free_entries() > 0)
+		{
+			printf("Releasing the buffer pool and trying again \n");
+			oclPoolDrain();
+			img = oclCreateHostImage2D(rt, flags, format, width, height, pixelSize, hostData, &clErr);
+		}
+		if (clErr == CL_SUCCESS)
+		{
+			track(img, 1, 1, flags, bytes, format, width, height);
+			benchAllocNote(BENCH_ALLOC_DEVICE, 1, bytes, heldBytes);
+		}
+	}
+	if (err)
+		*err = clErr;
+	return img;
+}
+
+void oclPoolRelease(cl_mem mem)
+{
+	int e;
+
+	if (mem == NULL)
+		return;
+	for (e=0; e<numEntries; e++)
+		if (entries[e].mem == mem)
+			break;
+	if (e == numEntries)
+		clReleaseMemObject(mem);
+	else if (!benchPoolEnabled())
+		drop_entry(e);
+	else
+		entries[e].inUse = 0;
+}
+
+void oclPoolDrain()
+{
+	for (int e=numEntries-1; e>=0; e--)
+		if (!entries[e].inUse)
+			drop_entry(e);
+}
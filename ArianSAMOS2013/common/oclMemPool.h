@@ -0,0 +1,54 @@
+/*
+ * oclMemPool.h
+ *
+ *  Device buffer pool for the SAMOS 2013 benchmarks.
+ *
+ *  The benchmarks create their buffers in oclBuffer() and release them in
+ *  oclReleaseBuffers(), and a --sweep or a growing --serve request goes
+ *  through that pair again for every size. oclPoolBuffer and oclPoolImage2D
+ *  create the objects like oclCreateHostBuffer/oclCreateHostImage2D
+ *  (oclHostMem.h) and oclPoolDeviceBuffer like clCreateBuffer, but
+ *  oclPoolRelease keeps them, and a later request of the same flags and
+ *  size class gets a kept object back without a clCreateBuffer.
+ *
+ *  Buffer sizes are rounded up to classes of 1, 1.25, 1.5 and 1.75 times a
+ *  power of two, at least 4 KB, so at most a quarter of a buffer is unused;
+ *  images are kept by format and exact size. The kernels only touch the
+ *  range they are given, the rest of a buffer is never read. When a request
+ *  misses, the kept objects of the same flags that are smaller are released
+ *  first, so a sweep does not hold every size it went through. In the
+ *  zero-copy memory modes the initial contents are written through a map,
+ *  on creation and on reuse alike.
+ *
+ *  oclRelease (oclRuntime.h) releases what is left in the pool before the
+ *  context. Every request is counted in the allocation report of
+ *  benchArena.h; --no-pool releases the objects right away.
+ */
+
+#ifndef OCL_MEM_POOL_H_
+#define OCL_MEM_POOL_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_POOL_MAX_OBJECTS	128		/* objects beyond that are not kept */
+#define OCL_POOL_MIN_CLASS		4096
+
+/* The size class a request of size bytes is served from */
+size_t oclPoolClassSize(size_t size);
+
+/* Like oclCreateHostBuffer/oclCreateHostImage2D, but from the pool */
+cl_mem oclPoolBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, const void *hostData, cl_int *err);
+/* Like clCreateBuffer without a host pointer, a device buffer in every memory mode */
+cl_mem oclPoolDeviceBuffer(ocl_runtime *rt, cl_mem_flags flags, size_t size, cl_int *err);
+cl_mem oclPoolImage2D(ocl_runtime *rt, cl_mem_flags flags, const cl_image_format *format,
+					  size_t width, size_t height, size_t pixelSize, const void *hostData, cl_int *err);
+
+/* Hands an object of the pool back; NULL is ignored, objects not from the pool are released */
+void oclPoolRelease(cl_mem mem);
+/* Releases every kept object, called from oclRelease */
+void oclPoolDrain();
+
+#endif /* OCL_MEM_POOL_H_ */
@@ -0,0 +1,228 @@
+/*
+ * oclPipeline.cpp
+ *
+ *  Chunked copy/compute/readback pipeline, see oclPipeline.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclPipeline.h"
+#include "oclHostMem.h"
+#include "oclCoop.h"
+#include "oclTrace.h"
+#include "benchHarness.h"
+
+static int	pipeChunks = -1;
+static int	pipeQueues = -1;
+
+int oclPipelineParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--pipeline") == 0 && *i + 1 < argc)
+	{
+		pipeChunks = atoi(argv[++(*i)]);
+		return 1;
+	}
+	if (strcmp(argv[*i], "--queues") == 0 && *i + 1 < argc)
+	{
+		pipeQueues = atoi(argv[++(*i)]);
+		return 1;
+	}
+	return 0;
+}
+
+static int num_queues()
+{
+	if (pipeQueues < 0)
+		pipeQueues = getenv("SAMOS_QUEUES") ? atoi(getenv("SAMOS_QUEUES")) : 2;
+	if (pipeQueues < 1)
+		pipeQueues = 1;
+	if (pipeQueues > OCL_PIPE_MAX_QUEUES)
+		pipeQueues = OCL_PIPE_MAX_QUEUES;
+	return pipeQueues;
+}
+
+int oclPipelineChunks()
+{
+	static int warned = 0;
+
+	if (pipeChunks < 0)
+		pipeChunks = getenv("SAMOS_PIPELINE") ? atoi(getenv("SAMOS_PIPELINE")) : 0;
+	if (pipeChunks < 0)
+		pipeChunks = 0;
+	if (pipeChunks > 0 && oclHostMemMode() != OCL_MEM_COPY)
+	{
+		if (!warned)
+			printf("Pipelining needs --mem-mode copy, running the %s path unpipelined \n", oclHostMemModeName(oclHostMemMode()));
+		warned = 1;
+		return 0;
+	}
+	if (pipeChunks > 0 && oclCoopEnabled())
+	{
+		if (!warned)
+			printf("--pipeline is ignored in cooperative mode \n");
+		warned = 1;
+		return 0;
+	}
+	return pipeChunks;
+}
+
+const char *oclPipelineName()
+{
+	static char name[32];
+
+	if (oclPipelineChunks() == 0)
+		return NULL;
+	sprintf(name, "pipeline-%ix%i", oclPipelineChunks(), num_queues());
+	return name;
+}
+
+size_t oclPipelineChunkSize(size_t total, size_t granule)
+{
+	int chunks = oclPipelineChunks();
+	size_t size;
+
+	if (chunks < 1)
+		chunks = 1;
+	size = (total + chunks - 1) / chunks;
+	size = (size + granule - 1) / granule * granule;
+	return (size > 0) ? size : granule;
+}
+
+int oclPipelineCreate(ocl_runtime *rt, ocl_pipeline *p)
+{
+	cl_int clErr;
+
+	memset(p, 0, sizeof(*p));
+	if (oclPipelineChunks() == 0)
+		return 0;
+
+	p->numQueues = num_queues();
+	for (int q=0; q<p->numQueues; q++)
+	{
+		p->queues[q] = clCreateCommandQueue(rt->context, rt->device, CL_QUEUE_PROFILING_ENABLE, &clErr);
+		if (clErr != CL_SUCCESS)
+		{
+			printf("Error in creating pipeline queue %i!, clErr=%i \n", q, clErr);
+			return -1;
+		}
+	}
+	printf("%i pipeline queues created! \n", p->numQueues);
+	return 0;
+}
+
+static double event_ms(cl_event ev, cl_ulong *first, cl_ulong *last)
+{
+	cl_ulong start = 0, end = 0;
+
+	if (ev == NULL)
+		return 0.0;
+	clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	if (*first == 0 || start < *first)
+		*first = start;
+	if (end > *last)
+		*last = end;
+	return (end - start) * 1.0e-6;
+}
+
+int oclPipelineRun(ocl_pipeline *p, int numChunks, const ocl_pipe_stages *st)
+{
+	cl_int clErr = CL_SUCCESS;
+	int halo = (st->halo > 0) ? st->halo : 0;
+	cl_event *up = (cl_event *)calloc(3 * numChunks, sizeof(cl_event));
+	cl_event *ex = up + numChunks;
+	cl_event *rd = ex + numChunks;
+	cl_event *wait = (cl_event *)calloc(2 * halo + 1, sizeof(cl_event));
+	char name[32];
+
+	// upload runs halo chunks ahead so the neighbours an execute stage reads are already on their way
+	for (int t=0; t<numChunks+halo && clErr == CL_SUCCESS; t++)
+	{
+		if (t < numChunks && st->upload)
+		{
+			clErr = st->upload(st->user, p->queues[t % p->numQueues], t, 0, NULL, &up[t]);
+			clFlush(p->queues[t % p->numQueues]);
+			sprintf(name, "upload %i", t);
+			oclTraceKeep(name, up[t]);
+			if (clErr != CL_SUCCESS)
+				break;
+		}
+
+		int k = t - halo;
+		if (k < 0)
+			continue;
+		cl_command_queue q = p->queues[k % p->numQueues];
+		cl_uint numWait = 0;
+		for (int j=k-halo; j<=k+halo; j++)
+			if (j >= 0 && j < numChunks && up[j] != NULL)
+				wait[numWait++] = up[j];
+
+		if (st->execute)
+		{
+			clErr = st->execute(st->user, q, k, numWait, wait, &ex[k]);
+			if (clErr != CL_SUCCESS)
+				break;
+			sprintf(name, "execute %i", k);
+			oclTraceKeep(name, ex[k]);
+			numWait = 1;
+			wait[0] = ex[k];
+		}
+		if (st->readback)
+		{
+			clErr = st->readback(st->user, q, k, numWait, wait, &rd[k]);
+			sprintf(name, "readback %i", k);
+			oclTraceKeep(name, rd[k]);
+		}
+		clFlush(q);
+	}
+	if (clErr != CL_SUCCESS)
+		printf("Error in pipeline stage!, clErr=%i \n", clErr);
+
+	for (int q=0; q<p->numQueues; q++)
+		clFinish(p->queues[q]);
+
+	cl_ulong first = 0, last = 0;
+	p->numChunks = numChunks;
+	p->uploadMs = p->executeMs = p->readbackMs = 0.0;
+	for (int c=0; c<numChunks; c++)
+	{
+		p->uploadMs += event_ms(up[c], &first, &last);
+		p->executeMs += event_ms(ex[c], &first, &last);
+		p->readbackMs += event_ms(rd[c], &first, &last);
+	}
+	p->spanMs = (last > first) ? (last - first) * 1.0e-6 : 0.0;
+
+	for (int e=0; e<3*numChunks; e++)
+		if (up[e] != NULL)
+			clReleaseEvent(up[e]);
+	free(up);
+	free(wait);
+	return clErr;
+}
+
+void oclPipelineRelease(ocl_pipeline *p)
+{
+	for (int q=0; q<p->numQueues; q++)
+		clReleaseCommandQueue(p->queues[q]);
+}
+
+void oclPrintPipelineReport(FILE *fout, const ocl_pipeline *p, int pipePhase)
+{
+	if (p->numQueues == 0)
+	{
+		fprintf(fout, "Pipeline: off (sequential WRDEV, KERNEL_EXEC, RDDEV) \n");
+		return;
+	}
+
+	const bench_stats *s = benchPhaseStats(pipePhase);
+	double busy = p->uploadMs + p->executeMs + p->readbackMs;
+	fprintf(fout, "Pipeline: %i chunks on %i queues, %s %.3f msecs (median) \n", p->numChunks, p->numQueues,
+			benchPhaseName(pipePhase), (s && s->n > 0) ? s->median : 0.0);
+	fprintf(fout, "Pipeline stages (last run, device time): upload %.3f, execute %.3f, readback %.3f msecs, "
+			"span %.3f msecs", p->uploadMs, p->executeMs, p->readbackMs, p->spanMs);
+	if (p->spanMs > 0.0 && busy > p->spanMs)
+		fprintf(fout, ", overlap hid %.3f msecs (%.1f%%)", busy - p->spanMs, 100.0 * (busy - p->spanMs) / busy);
+	fprintf(fout, " \n");
+}
@@ -0,0 +1,87 @@
+/*
+ * oclPipeline.h
+ *
+ *  Chunked copy/compute/readback pipeline for the SAMOS 2013 benchmarks.
+ *
+ *  The benchmarks write the whole input, clFinish, run the kernel, clFinish
+ *  and read the whole result back, so the copies and the kernel never
+ *  overlap. With
+ *
+ *    --pipeline N   split the input into N chunks (0 = off, the default)
+ *    --queues Q     spread the chunks over Q command queues (default 2)
+ *
+ *  or SAMOS_PIPELINE / SAMOS_QUEUES in the environment, chunk c is enqueued
+ *  on queue c % Q as upload -> execute -> readback, chained with events, so
+ *  chunk c+1 uploads while chunk c executes and chunk c-1 is read back.
+ *  The chunks are ranges of the benchmark's normal full-size buffers (write
+ *  and read offsets plus a global work offset), no extra device memory is
+ *  needed. An execute stage that reads neighbouring chunks, like the
+ *  convolution halo rows, passes halo = 1 and then also waits for the
+ *  uploads of chunks c-1 and c+1.
+ *
+ *  Pipelining only applies to --mem-mode copy; the zero-copy modes have no
+ *  transfers to hide and keep the sequential path. --coop (oclCoop.h)
+ *  turns it off.
+ */
+
+#ifndef OCL_PIPELINE_H_
+#define OCL_PIPELINE_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_PIPE_MAX_QUEUES		8
+
+/*
+ * Enqueues one stage of chunk on q, after the numWait events in wait, and
+ * returns the event of its last command in *done.
+ */
+typedef cl_int (*ocl_pipe_stage)(void *user, cl_command_queue q, int chunk,
+								 cl_uint numWait, const cl_event *wait, cl_event *done);
+
+struct ocl_pipe_stages
+{
+	ocl_pipe_stage	upload;			/* any of the three may be NULL */
+	ocl_pipe_stage	execute;
+	ocl_pipe_stage	readback;
+	int				halo;			/* neighbouring chunks the execute stage reads */
+	void			*user;
+};
+
+struct ocl_pipeline
+{
+	int					numQueues;
+	cl_command_queue	queues[OCL_PIPE_MAX_QUEUES];
+
+	/* from the event profiling of the last run, in msecs */
+	int					numChunks;
+	double				uploadMs;		/* device busy time of each stage, summed over the chunks */
+	double				executeMs;
+	double				readbackMs;
+	double				spanMs;			/* first command start to last command end */
+};
+
+/* Consumes --pipeline <chunks> and --queues <n>, called from oclParseArgs */
+int oclPipelineParseArg(int argc, char **argv, int *i);
+
+/* Requested number of chunks, 0 when pipelining is off or the memory mode is not copy */
+int oclPipelineChunks();
+/* e.g. "pipeline-8x2" for the results records, NULL when off */
+const char *oclPipelineName();
+
+/* Chunk size for total units: total / chunks rounded up to a multiple of granule */
+size_t oclPipelineChunkSize(size_t total, size_t granule);
+
+/* Creates the queues with profiling enabled; does nothing when pipelining is off */
+int oclPipelineCreate(ocl_runtime *rt, ocl_pipeline *p);
+/* Enqueues numChunks chunks and waits for all of them */
+int oclPipelineRun(ocl_pipeline *p, int numChunks, const ocl_pipe_stages *st);
+/* Releases the queues; numQueues and the last run stay valid for oclPrintPipelineReport */
+void oclPipelineRelease(ocl_pipeline *p);
+
+/* pipePhase is the host time of oclPipelineRun, as timed by the benchmark */
+void oclPrintPipelineReport(FILE *fout, const ocl_pipeline *p, int pipePhase);
+
+#endif /* OCL_PIPELINE_H_ */
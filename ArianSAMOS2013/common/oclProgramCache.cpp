@@ -0,0 +1,322 @@
+/*
+ * oclProgramCache.cpp
+ *
+ *  On-disk cache of OpenCL program binaries, see oclProgramCache.h.
+ *
+ *  File layout of one entry (<dir>/<key>.bin):
+ *    "SAMOSBIN", uint32 version, float original build time in msecs,
+ *    uint32 length + key text, uint64 length + program binary
+ *  The key text is compared on load so a hash collision cannot hand out a
+ *  binary built for another device or source.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+ #include "gettime.h"
+ #include <direct.h>
+ #include <process.h>
+ #define mkdir(path, mode)	_mkdir(path)
+ #define getpid				_getpid
+#else
+ #include <unistd.h>
+ #include <sys/time.h>
+#endif
+
+#include "oclProgramCache.h"
+
+#define CACHE_MAGIC		"SAMOSBIN"
+#define CACHE_VERSION	1
+#define CACHE_PATH_LEN	1024
+#define CACHE_KEY_LEN	(4 * OCL_NAME_LEN + 64)
+
+static int				cacheDisabled = 0;
+static const char		*cacheDirArg = NULL;
+static int				specialize = -1;
+static ocl_cache_stats	stats = {0, 0, 0.0f, 0, 0};
+
+struct ocl_variant
+{
+	char		file[64];
+	char		options[OCL_OPTIONS_LEN];
+	cl_program	program;
+};
+
+static ocl_variant		variants[OCL_MAX_VARIANTS];
+
+/* Text that identifies a build: everything that can change the binary */
+static char				keyText[CACHE_KEY_LEN];
+
+int oclCacheParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--no-kernel-cache") == 0)
+	{
+		cacheDisabled = 1;
+		return 1;
+	}
+	if (strcmp(argv[*i], "--kernel-cache") == 0 && *i + 1 < argc)
+	{
+		cacheDirArg = argv[++*i];
+		return 1;
+	}
+	if (strcmp(argv[*i], "--no-specialize") == 0)
+	{
+		specialize = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static unsigned long long fnv1a(const char *data, size_t len, unsigned long long h)
+{
+	for (size_t i=0; i<len; i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static float elapsed_ms(struct timeval *t0)
+{
+	struct timeval t1;
+	gettimeofday(&t1, NULL);
+	return 1000 * ((float)(t1.tv_sec - t0->tv_sec) + 1.0e-6 * (t1.tv_usec - t0->tv_usec));
+}
+
+static int mkdir_p(char *path)
+{
+	for (char *p = path + 1; *p; p++)
+		if (*p == '/')
+		{
+			*p = '\0';
+			mkdir(path, 0755);
+			*p = '/';
+		}
+	return (mkdir(path, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+/* Resolves the cache directory, returns 0 when caching is disabled or the directory is unusable */
+static int cache_dir(char *dir)
+{
+	const char *env = getenv("SAMOS_KERNEL_CACHE");
+
+	if (cacheDisabled)
+		return 0;
+	if (cacheDirArg != NULL)
+		snprintf(dir, CACHE_PATH_LEN, "%s", cacheDirArg);
+	else if (env != NULL && *env != '\0')
+	{
+		if (strcmp(env, "off") == 0 || strcmp(env, "0") == 0)
+			return 0;
+		snprintf(dir, CACHE_PATH_LEN, "%s", env);
+	}
+	else if (getenv("XDG_CACHE_HOME") != NULL)
+		snprintf(dir, CACHE_PATH_LEN, "%s/samos-kernels", getenv("XDG_CACHE_HOME"));
+	else if (getenv("HOME") != NULL)
+		snprintf(dir, CACHE_PATH_LEN, "%s/.cache/samos-kernels", getenv("HOME"));
+	else
+		snprintf(dir, CACHE_PATH_LEN, ".kernel_cache");
+
+	return mkdir_p(dir) == 0;
+}
+
+static unsigned long long make_key(ocl_runtime *rt, const char *src, const char *options)
+{
+	unsigned long long srcHash = fnv1a(src, strlen(src), 14695981039346656037ULL);
+
+	snprintf(keyText, sizeof(keyText), "%s\n%s\n%s\n%s\n%016llx",
+			rt->deviceName, rt->deviceVersion, rt->driverVersion, options ? options : "", srcHash);
+	return fnv1a(keyText, strlen(keyText), 14695981039346656037ULL);
+}
+
+cl_program oclCacheLoad(ocl_runtime *rt, const char *src, const char *options, unsigned long long *key)
+{
+	char dir[CACHE_PATH_LEN];
+	char path[CACHE_PATH_LEN + 32];
+	char magic[8];
+	unsigned int version, keyLen;
+	unsigned long long binLen;
+	float buildMs;
+	struct timeval t0;
+
+	*key = make_key(rt, src, options);
+	if (!cache_dir(dir))
+		return NULL;
+
+	gettimeofday(&t0, NULL);
+	snprintf(path, sizeof(path), "%s/%016llx.bin", dir, *key);
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		stats.misses++;
+		printf("Kernel cache miss (%016llx) \n", *key);
+		return NULL;
+	}
+
+	char *storedKey = NULL;
+	unsigned char *binary = NULL;
+	cl_program program = NULL;
+	int ok = fread(magic, 1, 8, fp) == 8 && memcmp(magic, CACHE_MAGIC, 8) == 0
+			&& fread(&version, sizeof(version), 1, fp) == 1 && version == CACHE_VERSION
+			&& fread(&buildMs, sizeof(buildMs), 1, fp) == 1
+			&& fread(&keyLen, sizeof(keyLen), 1, fp) == 1 && keyLen < CACHE_KEY_LEN;
+	if (ok)
+	{
+		storedKey = (char *)calloc(keyLen + 1, 1);
+		ok = fread(storedKey, 1, keyLen, fp) == keyLen && strcmp(storedKey, keyText) == 0
+			&& fread(&binLen, sizeof(binLen), 1, fp) == 1 && binLen > 0;
+	}
+	if (ok)
+	{
+		binary = (unsigned char *)malloc(binLen);
+		ok = fread(binary, 1, binLen, fp) == binLen;
+	}
+	fclose(fp);
+
+	if (ok)
+	{
+		cl_int clErr, binStatus;
+		size_t len = (size_t)binLen;
+		program = clCreateProgramWithBinary(rt->context, 1, &rt->device, &len, (const unsigned char **)&binary, &binStatus, &clErr);
+		if (clErr != CL_SUCCESS || binStatus != CL_SUCCESS)
+			program = NULL;
+		else if (clBuildProgram(program, 1, &rt->device, options, NULL, NULL) != CL_SUCCESS)
+		{
+			clReleaseProgram(program);
+			program = NULL;
+		}
+	}
+	free(storedKey);
+	free(binary);
+
+	if (program == NULL)
+	{
+		/* stale or corrupt entry: drop it, the caller rebuilds from source and stores a fresh one */
+		remove(path);
+		stats.misses++;
+		printf("Kernel cache entry %016llx invalid, rebuilding \n", *key);
+		return NULL;
+	}
+
+	float loadMs = elapsed_ms(&t0);
+	stats.hits++;
+	stats.savedMs += (buildMs > loadMs) ? buildMs - loadMs : 0.0f;
+	printf("Kernel cache hit (%016llx), loaded in %.2f msecs instead of %.2f msecs \n", *key, loadMs, buildMs);
+	return program;
+}
+
+void oclCacheStore(cl_program program, unsigned long long key, float buildMs)
+{
+	char dir[CACHE_PATH_LEN];
+	char path[CACHE_PATH_LEN + 32];
+	char tmpPath[CACHE_PATH_LEN + 64];
+	size_t binLen = 0;
+
+	if (!cache_dir(dir))
+		return;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binLen), &binLen, NULL) != CL_SUCCESS || binLen == 0)
+		return;
+
+	unsigned char *binary = (unsigned char *)malloc(binLen);
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) != CL_SUCCESS)
+	{
+		free(binary);
+		return;
+	}
+
+	/* write to a private file first so concurrent runs never see half an entry */
+	snprintf(path, sizeof(path), "%s/%016llx.bin", dir, key);
+	snprintf(tmpPath, sizeof(tmpPath), "%s.%i.tmp", path, (int)getpid());
+	FILE *fp = fopen(tmpPath, "wb");
+	if (fp != NULL)
+	{
+		unsigned int version = CACHE_VERSION;
+		unsigned int keyLen = strlen(keyText);
+		unsigned long long len = binLen;
+		int ok = fwrite(CACHE_MAGIC, 1, 8, fp) == 8
+				&& fwrite(&version, sizeof(version), 1, fp) == 1
+				&& fwrite(&buildMs, sizeof(buildMs), 1, fp) == 1
+				&& fwrite(&keyLen, sizeof(keyLen), 1, fp) == 1
+				&& fwrite(keyText, 1, keyLen, fp) == keyLen
+				&& fwrite(&len, sizeof(len), 1, fp) == 1
+				&& fwrite(binary, 1, binLen, fp) == binLen;
+		ok = (fclose(fp) == 0) && ok;
+		if (!ok || rename(tmpPath, path) != 0)
+			remove(tmpPath);
+	}
+	free(binary);
+}
+
+void oclDefine(char *options, const char *name, long value)
+{
+	size_t len = strlen(options);
+	snprintf(options + len, OCL_OPTIONS_LEN - len, " -D %s=%li", name, value);
+}
+
+int oclSpecializeEnabled()
+{
+	if (specialize < 0)
+		specialize = (getenv("SAMOS_SPECIALIZE") == NULL || atoi(getenv("SAMOS_SPECIALIZE")) != 0);
+	return specialize;
+}
+
+cl_program oclBuildVariant(ocl_runtime *rt, const char *file, const char *options)
+{
+	const char *opts = options ? options : "";
+	int v;
+
+	for (v=0; v<stats.variants; v++)
+		if (strcmp(variants[v].file, file) == 0 && strcmp(variants[v].options, opts) == 0)
+		{
+			stats.reuses++;
+			clRetainProgram(variants[v].program);
+			return variants[v].program;
+		}
+
+	cl_program program = oclBuildProgram(rt, file, opts);
+	if (program == NULL || stats.variants == OCL_MAX_VARIANTS)
+		return program;
+	printf("Kernel variant %s%s \n", file, opts);
+	ocl_variant *var = &variants[stats.variants++];
+	snprintf(var->file, sizeof(var->file), "%s", file);
+	snprintf(var->options, sizeof(var->options), "%s", opts);
+	var->program = program;
+	clRetainProgram(program);
+	return program;
+}
+
+void oclReleaseVariants()
+{
+	for (int v=0; v<stats.variants; v++)
+		if (variants[v].program != NULL)
+		{
+			clReleaseProgram(variants[v].program);
+			variants[v].program = NULL;
+		}
+	// the programs went with the context, a runtime created after this builds its variants again
+	stats.variants = 0;
+	stats.reuses = 0;
+}
+
+const ocl_cache_stats *oclCacheStats()
+{
+	return &stats;
+}
+
+void oclPrintCacheStats(FILE *fout)
+{
+	fprintf(fout, "Kernel cache: %i hit(s), %i miss(es), saved %.2f msecs of build time \n",
+			stats.hits, stats.misses, stats.savedMs);
+	if (stats.variants > 0)
+	{
+		fprintf(fout, "Kernel variants: %i built, %i reused%s \n", stats.variants, stats.reuses,
+				oclSpecializeEnabled() ? "" : " (--no-specialize)");
+		for (int v=0; v<stats.variants; v++)
+			fprintf(fout, "\t%s%s \n", variants[v].file, variants[v].options);
+	}
+}
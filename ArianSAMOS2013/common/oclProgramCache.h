@@ -0,0 +1,67 @@
+/*
+ * oclProgramCache.h
+ *
+ *  On-disk cache of OpenCL program binaries.
+ *
+ *  clBuildProgram on kernel.cl dominates the PGM phase, especially on the
+ *  Vivante parts. After the first build the CL_PROGRAM_BINARIES are stored and
+ *  later runs load them with clCreateProgramWithBinary instead. Entries are
+ *  keyed by a hash of the kernel source, the build options, the device name,
+ *  the device version and the driver version, so any change to one of them
+ *  simply misses and rebuilds. An entry the driver refuses to load is deleted
+ *  and rebuilt as well.
+ *
+ *  The cache lives in $SAMOS_KERNEL_CACHE, else $XDG_CACHE_HOME/samos-kernels,
+ *  else ~/.cache/samos-kernels. SAMOS_KERNEL_CACHE=off or --no-kernel-cache
+ *  disables it, --kernel-cache <dir> overrides the location.
+ *
+ *  Kernel variants: sizes the kernels used to duplicate as #defines (GP,
+ *  PM) or read from an argument (AES rounds, Convolution filter width) are
+ *  handed to the build as -D options, so the compiler sees constants and
+ *  can unroll the loops over them. oclBuildVariant builds each distinct
+ *  (file, options) pair once per run and hands out the same program after
+ *  that; across runs the binaries above are keyed by the options as well.
+ *  --no-specialize (or SAMOS_SPECIALIZE=0) leaves out the optional values,
+ *  so the kernels fall back to their arguments, for comparison.
+ */
+
+#ifndef OCL_PROGRAM_CACHE_H_
+#define OCL_PROGRAM_CACHE_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_MAX_VARIANTS	32
+#define OCL_OPTIONS_LEN		512
+
+struct ocl_cache_stats
+{
+	int		hits;
+	int		misses;
+	float	savedMs;		/* original build time minus binary load time, summed over the hits */
+	int		variants;		/* distinct (file, options) programs built in this run */
+	int		reuses;			/* oclBuildVariant calls answered with an already built variant */
+};
+
+/* Consumes --no-kernel-cache, --kernel-cache <dir> and --no-specialize, called from oclParseArgs */
+int oclCacheParseArg(int argc, char **argv, int *i);
+
+/* Returns a built program or NULL on a miss; *key receives the hash used for oclCacheStore */
+cl_program oclCacheLoad(ocl_runtime *rt, const char *src, const char *options, unsigned long long *key);
+void oclCacheStore(cl_program program, unsigned long long key, float buildMs);
+
+/* Appends " -D name=value" to options, a buffer of OCL_OPTIONS_LEN chars */
+void oclDefine(char *options, const char *name, long value);
+/* 0 with --no-specialize: only the -D values the kernel cannot do without are passed */
+int oclSpecializeEnabled();
+/* oclBuildProgram once per distinct (file, options); every call returns a reference the caller releases */
+cl_program oclBuildVariant(ocl_runtime *rt, const char *file, const char *options);
+/* Drops the references the variant table holds and empties it; oclRelease calls it */
+void oclReleaseVariants();
+
+const ocl_cache_stats *oclCacheStats();
+void oclPrintCacheStats(FILE *fout);
+
+#endif /* OCL_PROGRAM_CACHE_H_ */
@@ -0,0 +1,230 @@
+/*
+ * oclRoofline.cpp
+ *
+ *  Roofline efficiency report, see oclRoofline.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclRoofline.h"
+#include "oclTrace.h"
+
+#define ROOF_ITERS			128							/* multiply-adds per chain */
+#define ROOF_OPS_PER_ITEM	(ROOF_ITERS * 4 * 4 * 2)	/* 4 chains of 4 lanes, 2 operations each */
+#define ROOF_COPY_BYTES		(32 * 1024 * 1024)			/* per buffer, well beyond the caches */
+#define ROOF_MAX_ITEMS		(4 * 1024 * 1024)
+
+static const char *roofSource =
+	"__kernel void roof_copy(__global const float4 *src, __global float4 *dst)\n"
+	"{\n"
+	"	size_t i = get_global_id(0);\n"
+	"	dst[i] = src[i];\n"
+	"}\n"
+	"__kernel void roof_flops(__global float *out, float a, float b)\n"
+	"{\n"
+	"	float4 x0 = (float4)(get_global_id(0) * 1.0e-7f), x1 = x0 + 0.1f, x2 = x0 + 0.2f, x3 = x0 + 0.3f;\n"
+	"	for (int i=0; i<ROOF_ITERS; i++)\n"
+	"	{\n"
+	"		x0 = mad(x0, a, b); x1 = mad(x1, a, b); x2 = mad(x2, a, b); x3 = mad(x3, a, b);\n"
+	"	}\n"
+	"	x0 += x1 + x2 + x3;\n"
+	"	out[get_global_id(0)] = x0.x + x0.y + x0.z + x0.w;\n"
+	"}\n"
+	"__kernel void roof_iops(__global uint *out, uint a, uint b)\n"
+	"{\n"
+	"	uint4 x0 = (uint4)(get_global_id(0)), x1 = x0 ^ 1u, x2 = x0 ^ 2u, x3 = x0 ^ 3u;\n"
+	"	for (int i=0; i<ROOF_ITERS; i++)\n"
+	"	{\n"
+	"		x0 = x0 * a + b; x1 = x1 * a + b; x2 = x2 * a + b; x3 = x3 * a + b;\n"
+	"	}\n"
+	"	x0 += x1 + x2 + x3;\n"
+	"	out[get_global_id(0)] = x0.x + x0.y + x0.z + x0.w;\n"
+	"}\n";
+
+static int					roofArg = -1;
+static int					measured = 0;
+static ocl_roofline_peaks	peaks;
+
+int oclRooflineParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--roofline") == 0)
+	{
+		roofArg = 1;
+		return 1;
+	}
+	return 0;
+}
+
+int oclRooflineEnabled()
+{
+	if (roofArg < 0)
+		roofArg = (getenv("SAMOS_ROOFLINE") && atoi(getenv("SAMOS_ROOFLINE")) > 0) ? 1 : 0;
+	return roofArg;
+}
+
+const ocl_roofline_peaks *oclRooflinePeaks()
+{
+	return &peaks;
+}
+
+/* Lowest kernel time of OCL_ROOF_REPS launches after one warm-up, negative when the launch fails */
+static double time_kernel(cl_command_queue q, cl_kernel k, size_t items)
+{
+	double best = -1.0;
+
+	for (int r=0; r<=OCL_ROOF_REPS; r++)
+	{
+		cl_event ev = NULL;
+		cl_ulong start = 0, end = 0;
+
+		if (clEnqueueNDRangeKernel(q, k, 1, NULL, &items, NULL, 0, NULL, &ev) != CL_SUCCESS || clWaitForEvents(1, &ev) != CL_SUCCESS)
+		{
+			if (ev)
+				clReleaseEvent(ev);
+			return -1.0;
+		}
+		clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		oclTraceKeep("roofline micro-benchmark", ev);
+		clReleaseEvent(ev);
+
+		double ms = (end - start) * 1.0e-6;
+		if (r > 0 && (best < 0.0 || ms < best))
+			best = ms;
+	}
+	return best;
+}
+
+/* Operations per second of the multiply-add kernel k in G/s; the launch grows until it is long enough to time */
+static double arith_peak(ocl_runtime *rt, cl_command_queue q, cl_program program, const char *name, cl_mem out, int isFloat)
+{
+	cl_int clErr;
+	cl_kernel k = clCreateKernel(program, name, &clErr);
+	cl_uint computeUnits = 1;
+	double ms = -1.0;
+	size_t items;
+
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating kernel %s!, clErr=%i \n", name, clErr);
+		return 0.0;
+	}
+	clSetKernelArg(k, 0, sizeof(cl_mem), &out);
+	if (isFloat)
+	{
+		cl_float a = 0.999f, b = 0.001f;
+		clSetKernelArg(k, 1, sizeof(cl_float), &a);
+		clSetKernelArg(k, 2, sizeof(cl_float), &b);
+	}
+	else
+	{
+		cl_uint a = 1664525u, b = 1013904223u;
+		clSetKernelArg(k, 1, sizeof(cl_uint), &a);
+		clSetKernelArg(k, 2, sizeof(cl_uint), &b);
+	}
+	clGetDeviceInfo(rt->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+	for (items = computeUnits * 256; items <= ROOF_MAX_ITEMS; items *= 2)
+	{
+		ms = time_kernel(q, k, items);
+		if (ms < 0.0 || ms >= OCL_ROOF_MIN_MS)
+			break;
+	}
+	clReleaseKernel(k);
+	if (items > ROOF_MAX_ITEMS)
+		items /= 2;
+	return (ms > 0.0) ? (double)items * ROOF_OPS_PER_ITEM / (ms * 1.0e6) : 0.0;
+}
+
+void oclRooflineMeasure(ocl_runtime *rt)
+{
+	cl_int clErr;
+	cl_ulong maxAlloc = 0;
+	char options[64];
+
+	if (!oclRooflineEnabled() || measured)
+		return;
+	measured = 1;
+	memset(&peaks, 0, sizeof(peaks));
+
+	cl_command_queue q = clCreateCommandQueue(rt->context, rt->device, CL_QUEUE_PROFILING_ENABLE, &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating the roofline queue!, clErr=%i \n", clErr);
+		return;
+	}
+	cl_program program = clCreateProgramWithSource(rt->context, 1, &roofSource, NULL, &clErr);
+	sprintf(options, "-D ROOF_ITERS=%i", ROOF_ITERS);
+	if (clErr != CL_SUCCESS || clBuildProgram(program, 1, &rt->device, options, NULL, NULL) != CL_SUCCESS)
+	{
+		printf("Error in building the roofline micro-benchmarks! \n");
+		if (program)
+			clReleaseProgram(program);
+		clReleaseCommandQueue(q);
+		return;
+	}
+
+	// the copy buffers double as the output of the arithmetic kernels, ROOF_MAX_ITEMS words fit in ROOF_COPY_BYTES
+	clGetDeviceInfo(rt->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, NULL);
+	size_t bytes = (maxAlloc > 0 && maxAlloc < ROOF_COPY_BYTES) ? (size_t)maxAlloc & ~(size_t)15 : ROOF_COPY_BYTES;
+	cl_mem src = clCreateBuffer(rt->context, CL_MEM_READ_WRITE, bytes, NULL, &clErr);
+	cl_mem dst = clCreateBuffer(rt->context, CL_MEM_READ_WRITE, bytes, NULL, &clErr);
+	if (src == NULL || dst == NULL)
+		printf("Error in creating the roofline buffers!, clErr=%i \n", clErr);
+	else
+	{
+		cl_kernel copy = clCreateKernel(program, "roof_copy", &clErr);
+		if (clErr == CL_SUCCESS)
+		{
+			clSetKernelArg(copy, 0, sizeof(cl_mem), &src);
+			clSetKernelArg(copy, 1, sizeof(cl_mem), &dst);
+			double ms = time_kernel(q, copy, bytes / 16);
+			peaks.gbps = (ms > 0.0) ? 2.0 * bytes / (ms * 1.0e6) : 0.0;
+			clReleaseKernel(copy);
+		}
+		if (bytes >= ROOF_MAX_ITEMS * sizeof(cl_uint))
+		{
+			peaks.gflops = arith_peak(rt, q, program, "roof_flops", dst, 1);
+			peaks.giops = arith_peak(rt, q, program, "roof_iops", dst, 0);
+		}
+	}
+	if (src)
+		clReleaseMemObject(src);
+	if (dst)
+		clReleaseMemObject(dst);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(q);
+
+	printf("Roofline peaks of %s: %.2f GB/s, %.2f GFLOPS, %.2f GIOPS \n", rt->deviceName, peaks.gbps, peaks.gflops, peaks.giops);
+}
+
+void oclPrintRooflineReport(FILE *fout, const ocl_kernel_cost *kernels, int numKernels)
+{
+	if (!oclRooflineEnabled() || !measured)
+		return;
+
+	fprintf(fout, "Roofline (peaks measured at start-up: %.2f GB/s copy, %.2f GFLOPS float, %.2f GIOPS int): \n",
+			peaks.gbps, peaks.gflops, peaks.giops);
+	fprintf(fout, "	%-20s %12s %10s %10s %10s %10s %8s %10s \n", "kernel", "work-items", "GB/s", "GOPS", "ops/byte",
+			"bound", "limit", "% of roof");
+	for (int i=0; i<numKernels; i++)
+	{
+		const ocl_kernel_cost *k = &kernels[i];
+		double peakOps = (k->opType == OCL_ROOF_INT) ? peaks.giops : peaks.gflops;
+		double bytes = k->items * k->bytesPerItem, ops = k->items * k->opsPerItem;
+		double intensity = (bytes > 0.0) ? ops / bytes : 0.0;
+
+		if (k->ms <= 0.0)
+		{
+			fprintf(fout, "	%-20s %12.0f  not timed on its own in this run \n", k->name, k->items);
+			continue;
+		}
+		double gbps = bytes / (k->ms * 1.0e6), gops = ops / (k->ms * 1.0e6);
+		double memBound = intensity * peaks.gbps;
+		double bound = (peakOps > 0.0 && (memBound <= 0.0 || peakOps < memBound)) ? peakOps : memBound;
+		fprintf(fout, "	%-20s %12.0f %10.2f %10.2f %10.3f %10.2f %8s %9.1f%% \n", k->name, k->items, gbps, gops, intensity, bound,
+				(bound == memBound) ? "memory" : "compute", (bound > 0.0) ? 100.0 * gops / bound : 0.0);
+	}
+	fprintf(fout, "	(bound in GOPS: the float or int peak of the kernel, or ops/byte times the bandwidth when lower) \n\n");
+}
@@ -0,0 +1,74 @@
+/*
+ * oclRoofline.h
+ *
+ *  Roofline efficiency report for the SAMOS 2013 benchmarks.
+ *
+ *  The execution times say how long a kernel took, not how far it is from
+ *  what the device can do. With
+ *
+ *    --roofline         or SAMOS_ROOFLINE=1
+ *
+ *  the device's peaks are measured at start-up by three micro-benchmarks on
+ *  a profiling queue: a float4 copy for the global memory bandwidth (bytes
+ *  read plus written), and chains of float and of int multiply-adds for the
+ *  arithmetic rates. Each is the best of OCL_ROOF_REPS launches, grown
+ *  until a launch takes OCL_ROOF_MIN_MS.
+ *
+ *  Every benchmark declares per kernel the bytes it moves and the
+ *  operations it does per work-item (ocl_kernel_cost). The bytes are the
+ *  global memory traffic a work-item cannot avoid, its share of the inputs
+ *  it reads and the outputs it writes, i.e. what the memory sees when the
+ *  caches catch all reuse; a multiply-add counts as 2 operations. log.txt
+ *  then lists per kernel the achieved GB/s and GOPS over the median kernel
+ *  time, the arithmetic intensity, the roofline bound
+ *  min(peak ops, intensity * peak bandwidth), which of the two limits it,
+ *  and the percentage of the bound the kernel reaches.
+ *
+ *  The kernel times are the KERNEL*_EXEC phases, so launch overhead is
+ *  included; kernels of a --pipeline or --coop run are not timed on their
+ *  own and are left out.
+ */
+
+#ifndef OCL_ROOFLINE_H_
+#define OCL_ROOFLINE_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_ROOF_REPS		5
+#define OCL_ROOF_MIN_MS		2.0
+
+#define OCL_ROOF_FLOAT		0
+#define OCL_ROOF_INT		1
+
+struct ocl_roofline_peaks
+{
+	double	gbps;			/* copy kernel, 0 when it could not be measured */
+	double	gflops;			/* float multiply-add chains */
+	double	giops;			/* int multiply-add chains */
+};
+
+struct ocl_kernel_cost
+{
+	const char	*name;
+	double		items;			/* work-items of the measured launches of one iteration */
+	double		bytesPerItem;	/* unavoidable global memory bytes, see above */
+	double		opsPerItem;		/* arithmetic operations */
+	int			opType;			/* OCL_ROOF_FLOAT or OCL_ROOF_INT, the peak the kernel is held to */
+	double		ms;				/* median kernel time of one iteration, 0 when not timed */
+};
+
+/* Consumes --roofline, called from oclParseArgs */
+int oclRooflineParseArg(int argc, char **argv, int *i);
+
+int oclRooflineEnabled();
+/* Runs the micro-benchmarks once the queue exists, outside the timed phases; nothing without --roofline */
+void oclRooflineMeasure(ocl_runtime *rt);
+const ocl_roofline_peaks *oclRooflinePeaks();
+
+/* One line per kernel against the measured peaks; nothing without --roofline */
+void oclPrintRooflineReport(FILE *fout, const ocl_kernel_cost *kernels, int numKernels);
+
+#endif /* OCL_ROOFLINE_H_ */
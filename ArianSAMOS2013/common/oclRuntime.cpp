@@ -0,0 +1,371 @@
+/*
+ * oclRuntime.cpp
+ *
+ *  Shared OpenCL start-up code for the SAMOS 2013 benchmarks.
+ *  See oclRuntime.h for the device selection rules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+ #include "gettime.h"
+#else
+ #include <sys/time.h>
+#endif
+
+#include "oclRuntime.h"
+#include "oclProgramCache.h"
+#include "oclHostMem.h"
+#include "oclMemPool.h"
+#include "oclPipeline.h"
+#include "oclCoop.h"
+#include "oclTune.h"
+#include "oclRoofline.h"
+#include "oclTrace.h"
+
+#define OCL_MAX_PLATFORMS	8
+
+static const char	*deviceSpec = NULL;
+static int			listDevices = 0;
+static const char	*kernelDir = NULL;
+static const ocl_kernel_source	*embedded = NULL;
+
+void oclParseArgs(int *argc, char **argv)
+{
+	int out = 1;
+	for (int i=1; i<*argc; i++)
+	{
+		if (strcmp(argv[i], "--device") == 0 && i + 1 < *argc)
+			deviceSpec = argv[++i];
+		else if (strncmp(argv[i], "--device=", 9) == 0)
+			deviceSpec = argv[i] + 9;
+		else if (strcmp(argv[i], "--list-devices") == 0)
+			listDevices = 1;
+		else if (strcmp(argv[i], "--kernel-dir") == 0 && i + 1 < *argc)
+			kernelDir = argv[++i];
+		else if (oclCacheParseArg(*argc, argv, &i))
+			continue;
+		else if (oclHostMemParseArg(*argc, argv, &i))
+			continue;
+		else if (oclPipelineParseArg(*argc, argv, &i))
+			continue;
+		else if (oclCoopParseArg(*argc, argv, &i))
+			continue;
+		else if (oclTuneParseArg(*argc, argv, &i))
+			continue;
+		else if (oclRooflineParseArg(*argc, argv, &i))
+			continue;
+		else
+			argv[out++] = argv[i];
+	}
+	argv[out] = NULL;
+	*argc = out;
+
+	if (deviceSpec == NULL)
+		deviceSpec = getenv("SAMOS_DEVICE");
+	if (kernelDir == NULL && getenv("SAMOS_KERNEL_DIR") != NULL && *getenv("SAMOS_KERNEL_DIR") != '\0')
+		kernelDir = getenv("SAMOS_KERNEL_DIR");
+}
+
+void oclEmbedKernelSources(const ocl_kernel_source *sources)
+{
+	embedded = sources;
+}
+
+const char *oclDeviceTypeName(cl_device_type type)
+{
+	if (type & CL_DEVICE_TYPE_GPU)
+		return "GPU";
+	if (type & CL_DEVICE_TYPE_CPU)
+		return "CPU";
+	if (type & CL_DEVICE_TYPE_ACCELERATOR)
+		return "ACCELERATOR";
+	return "OTHER";
+}
+
+int oclGetPlatforms(ocl_runtime *rt)
+{
+	cl_platform_id platforms[OCL_MAX_PLATFORMS];
+	cl_uint numPlatforms = 0;
+	cl_int clErr;
+
+	memset(rt, 0, sizeof(*rt));
+	clErr = clGetPlatformIDs(OCL_MAX_PLATFORMS, platforms, &numPlatforms);
+	if (clErr != CL_SUCCESS || numPlatforms == 0)
+	{
+		printf("Error in clGetPlatformID!, clErr=%i \n", clErr);
+		return 0;
+	}
+	if (numPlatforms > OCL_MAX_PLATFORMS)
+		numPlatforms = OCL_MAX_PLATFORMS;
+
+	for (cl_uint p=0; p<numPlatforms; p++)
+	{
+		char platformName[OCL_NAME_LEN] = "";
+		cl_device_id devices[OCL_MAX_DEVICES];
+		cl_uint numDevices = 0;
+
+		clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, sizeof(platformName), platformName, NULL);
+		if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, OCL_MAX_DEVICES, devices, &numDevices) != CL_SUCCESS)
+			continue;
+		if (numDevices > OCL_MAX_DEVICES)
+			numDevices = OCL_MAX_DEVICES;
+
+		for (cl_uint d=0; d<numDevices && rt->numDevices<OCL_MAX_DEVICES; d++)
+		{
+			ocl_device_desc *desc = &rt->devices[rt->numDevices++];
+			desc->platform = platforms[p];
+			desc->device = devices[d];
+			desc->platformIdx = p;
+			desc->deviceIdx = d;
+			strcpy(desc->platformName, platformName);
+			clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(desc->type), &desc->type, NULL);
+			clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(desc->name), desc->name, NULL);
+		}
+	}
+
+	if (listDevices)
+	{
+		for (int i=0; i<rt->numDevices; i++)
+			printf("%2i  %i:%i  %-11s %s (%s) \n", i, rt->devices[i].platformIdx, rt->devices[i].deviceIdx,
+					oclDeviceTypeName(rt->devices[i].type), rt->devices[i].name, rt->devices[i].platformName);
+		exit(0);
+	}
+	return rt->numDevices;
+}
+
+static int contains_nocase(const char *haystack, const char *needle)
+{
+	size_t n = strlen(needle);
+	for (; *haystack; haystack++)
+	{
+		size_t i = 0;
+		while (i < n && tolower((unsigned char)haystack[i]) == tolower((unsigned char)needle[i]))
+			i++;
+		if (i == n)
+			return 1;
+	}
+	return 0;
+}
+
+static int find_by_type(ocl_runtime *rt, cl_device_type type)
+{
+	for (int i=0; i<rt->numDevices; i++)
+		if (rt->devices[i].type & type)
+			return i;
+	return -1;
+}
+
+static int find_by_spec(ocl_runtime *rt, const char *spec)
+{
+	int p, d;
+	char tail;
+
+	if (strcmp(spec, "gpu") == 0)
+		return find_by_type(rt, CL_DEVICE_TYPE_GPU);
+	if (strcmp(spec, "cpu") == 0)
+		return find_by_type(rt, CL_DEVICE_TYPE_CPU);
+	if (strcmp(spec, "accelerator") == 0)
+		return find_by_type(rt, CL_DEVICE_TYPE_ACCELERATOR);
+	if (strcmp(spec, "any") == 0)
+		return rt->numDevices > 0 ? 0 : -1;
+
+	if (sscanf(spec, "%i:%i%c", &p, &d, &tail) == 2)
+	{
+		for (int i=0; i<rt->numDevices; i++)
+			if (rt->devices[i].platformIdx == p && rt->devices[i].deviceIdx == d)
+				return i;
+		return -1;
+	}
+	if (sscanf(spec, "%i%c", &d, &tail) == 1)
+		return (d >= 0 && d < rt->numDevices) ? d : -1;
+
+	for (int i=0; i<rt->numDevices; i++)
+		if (contains_nocase(rt->devices[i].name, spec))
+			return i;
+	for (int i=0; i<rt->numDevices; i++)
+		if (contains_nocase(rt->devices[i].platformName, spec))
+			return i;
+	return -1;
+}
+
+int oclSelectDevice(ocl_runtime *rt)
+{
+	int idx;
+
+	if (deviceSpec != NULL && *deviceSpec != '\0')
+	{
+		idx = find_by_spec(rt, deviceSpec);
+		if (idx < 0)
+		{
+			printf("Error: no OpenCL device matches \"%s\" (see --list-devices) \n", deviceSpec);
+			return -1;
+		}
+	}
+	else
+	{
+		idx = find_by_type(rt, CL_DEVICE_TYPE_GPU);
+		if (idx < 0)
+		{
+			idx = find_by_type(rt, CL_DEVICE_TYPE_CPU);
+			if (idx < 0 && rt->numDevices > 0)
+				idx = 0;
+			if (idx < 0)
+			{
+				printf("Error in clGetDeviceIDs! No OpenCL device found \n");
+				return -1;
+			}
+			printf("No GPU found, falling back to %s device \n", oclDeviceTypeName(rt->devices[idx].type));
+		}
+	}
+
+	ocl_device_desc *desc = &rt->devices[idx];
+	rt->platform = desc->platform;
+	rt->device = desc->device;
+	rt->deviceType = desc->type;
+	strcpy(rt->platformName, desc->platformName);
+	strcpy(rt->deviceName, desc->name);
+	clGetDeviceInfo(rt->device, CL_DEVICE_VERSION, sizeof(rt->deviceVersion), rt->deviceVersion, NULL);
+	clGetDeviceInfo(rt->device, CL_DRIVER_VERSION, sizeof(rt->driverVersion), rt->driverVersion, NULL);
+	clGetDeviceInfo(rt->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(rt->hostUnifiedMemory), &rt->hostUnifiedMemory, NULL);
+	clGetDeviceInfo(rt->device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(rt->memBaseAlign), &rt->memBaseAlign, NULL);
+
+	printf("Platform ID: %s \n", rt->platformName);
+	printf("Device name: %s (%s) \n", rt->deviceName, oclDeviceTypeName(rt->deviceType));
+	return 0;
+}
+
+int oclCreateContext(ocl_runtime *rt)
+{
+	cl_int clErr;
+	cl_context_properties props[3] = {CL_CONTEXT_PLATFORM, (cl_context_properties)rt->platform, 0};
+
+	rt->context = clCreateContext(props, 1, &rt->device, NULL, NULL, &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating context!, clErr=%i \n", clErr);
+		return -1;
+	}
+	printf("Context created! \n");
+	return 0;
+}
+
+int oclCreateQueue(ocl_runtime *rt, cl_command_queue_properties props)
+{
+	cl_int clErr;
+
+	// --trace reads the timestamps of every command
+	if (oclTraceEnabled())
+		props |= CL_QUEUE_PROFILING_ENABLE;
+	rt->queue = clCreateCommandQueue(rt->context, rt->device, props, &clErr);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating command queue!, clErr=%i \n", clErr);
+		return -1;
+	}
+	printf("Command queue created! \n");
+	return 0;
+}
+
+static char *read_source(const char *file)
+{
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	long filelen = ftell(fp);
+	rewind(fp);
+
+	char *src = (char *)malloc(filelen + 1);
+	size_t readlen = fread(src, 1, filelen, fp);
+	src[readlen] = '\0';
+	fclose(fp);
+	return src;
+}
+
+/* The embedded copy of file, or NULL when it is read from disk */
+static const char *embedded_source(const char *file)
+{
+	if (kernelDir != NULL || embedded == NULL)
+		return NULL;
+	for (const ocl_kernel_source *k = embedded; k->file != NULL; k++)
+		if (strcmp(k->file, file) == 0)
+			return k->src;
+	return NULL;
+}
+
+cl_program oclBuildProgram(ocl_runtime *rt, const char *file, const char *options)
+{
+	cl_int clErr;
+	unsigned long long key;
+	struct timeval t0, t1;
+	char path[1024];
+	char *owned = NULL;
+	const char *src = embedded_source(file);
+
+	if (src == NULL)
+	{
+		if (kernelDir != NULL)
+			snprintf(path, sizeof(path), "%s/%s", kernelDir, file);
+		else
+			snprintf(path, sizeof(path), "%s", file);
+		src = owned = read_source(path);
+		if (src == NULL)
+		{
+			printf("Error: kernel source %s could not be opened! \n", path);
+			return NULL;
+		}
+	}
+	else
+		snprintf(path, sizeof(path), "%s (embedded)", file);
+
+	cl_program program = oclCacheLoad(rt, src, options, &key);
+	if (program != NULL)
+	{
+		free(owned);
+		printf("Program %s loaded from cache! \n", path);
+		return program;
+	}
+
+	gettimeofday(&t0, NULL);
+	program = clCreateProgramWithSource(rt->context, 1, &src, NULL, &clErr);
+	free(owned);
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating program %s!, clErr=%i \n", path, clErr);
+		return NULL;
+	}
+
+	clErr = clBuildProgram(program, 1, &rt->device, options, NULL, NULL);
+	if (clErr != CL_SUCCESS)
+	{
+		char buff[4096];
+		printf("Error in building program %s!, clErr=%i \n", path, clErr);
+		clGetProgramBuildInfo(program, rt->device, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
+		printf("-----Build log------\n %s\n", buff);
+		clReleaseProgram(program);
+		return NULL;
+	}
+	gettimeofday(&t1, NULL);
+	printf("Program %s built! \n", path);
+
+	oclCacheStore(program, key, 1000 * ((float)(t1.tv_sec - t0.tv_sec) + 1.0e-6 * (t1.tv_usec - t0.tv_usec)));
+	return program;
+}
+
+void oclRelease(ocl_runtime *rt)
+{
+	oclTraceFlush();
+	oclReleaseVariants();
+	oclPoolDrain();
+	if (rt->queue)
+		clReleaseCommandQueue(rt->queue);
+	if (rt->context)
+		clReleaseContext(rt->context);
+	rt->queue = NULL;
+	rt->context = NULL;
+}
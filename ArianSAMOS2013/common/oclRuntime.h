@@ -0,0 +1,102 @@
+/*
+ * oclRuntime.h
+ *
+ *  Shared OpenCL start-up code for the SAMOS 2013 benchmarks.
+ *
+ *  Replaces the per-benchmark copies of oclInit() that picked the platform
+ *  through the FERMI/VIVANTE macros and always asked for CL_DEVICE_TYPE_GPU.
+ *  All platforms are enumerated and the device is chosen at run time:
+ *
+ *    --device <spec>      on the command line, or
+ *    SAMOS_DEVICE=<spec>  in the environment
+ *
+ *  where <spec> is one of
+ *    gpu | cpu | accelerator | any   first device of that type
+ *    N                               N-th device as printed by --list-devices
+ *    P:D                             device D of platform P
+ *    <text>                          first device whose device or platform
+ *                                    name contains <text> (case-insensitive)
+ *
+ *  Without a spec the first GPU is used and, when the machine has none, the
+ *  first CPU device (e.g. pocl) so the kernels also run on GPU-less boxes.
+ *  --list-devices prints every device found and exits.
+ *
+ *  The CMake build compiles the .cl files into the binaries (samosKernels.h,
+ *  generated by tools/embedKernels.cmake), so oclBuildProgram does not depend
+ *  on the working directory and does no file I/O. For kernel development
+ *
+ *    --kernel-dir <dir>      or SAMOS_KERNEL_DIR=<dir>
+ *
+ *  reads <dir>/<file> from disk instead. Builds without the generated header
+ *  read the file from the working directory as before.
+ *
+ *  oclBuildProgram goes through the binary cache in oclProgramCache.h, the
+ *  --mem-mode option is described in oclHostMem.h, the buffer pool in
+ *  oclMemPool.h, --pipeline/--queues in oclPipeline.h, --coop in oclCoop.h,
+ *  --tune in oclTune.h and --roofline in oclRoofline.h; the OpenCL side of
+ *  --trace is in oclTrace.h.
+ */
+
+#ifndef OCL_RUNTIME_H_
+#define OCL_RUNTIME_H_
+
+#include <CL/cl.h>
+
+#define OCL_MAX_DEVICES		32
+#define OCL_NAME_LEN		256
+
+struct ocl_device_desc
+{
+	cl_platform_id		platform;
+	cl_device_id		device;
+	cl_device_type		type;
+	int					platformIdx;
+	int					deviceIdx;
+	char				name[OCL_NAME_LEN];
+	char				platformName[OCL_NAME_LEN];
+};
+
+/* One entry per kernel file; a table ends with {NULL, NULL} */
+struct ocl_kernel_source
+{
+	const char			*file;
+	const char			*src;
+};
+
+struct ocl_runtime
+{
+	cl_platform_id		platform;
+	cl_device_id		device;
+	cl_context			context;
+	cl_command_queue	queue;
+	cl_device_type		deviceType;
+	char				platformName[OCL_NAME_LEN];
+	char				deviceName[OCL_NAME_LEN];
+	char				deviceVersion[OCL_NAME_LEN];
+	char				driverVersion[OCL_NAME_LEN];
+	cl_bool				hostUnifiedMemory;
+	cl_uint				memBaseAlign;		/* CL_DEVICE_MEM_BASE_ADDR_ALIGN, in bits */
+
+	int					numDevices;
+	ocl_device_desc		devices[OCL_MAX_DEVICES];
+};
+
+/* Consumes --device/--list-devices/--kernel-dir (and the cache, memory mode, pipeline, coop, tuning and roofline options) from argv so the benchmarks keep their own positional arguments */
+void oclParseArgs(int *argc, char **argv);
+
+/* Each step below maps onto one of the PLATFORM/DEVICE/CONTEXT/CMDQ/PGM phases the benchmarks time */
+int oclGetPlatforms(ocl_runtime *rt);
+int oclSelectDevice(ocl_runtime *rt);
+int oclCreateContext(ocl_runtime *rt);
+int oclCreateQueue(ocl_runtime *rt, cl_command_queue_properties props);
+cl_program oclBuildProgram(ocl_runtime *rt, const char *file, const char *options);
+
+/* Sources oclBuildProgram takes by file name instead of reading them, see above */
+void oclEmbedKernelSources(const ocl_kernel_source *sources);
+
+/* Flushes the trace events, drops the kernel variants and the pooled buffers, then releases the queue before the context; kernels, buffers and programs must be released by the caller first */
+void oclRelease(ocl_runtime *rt);
+
+const char *oclDeviceTypeName(cl_device_type type);
+
+#endif /* OCL_RUNTIME_H_ */
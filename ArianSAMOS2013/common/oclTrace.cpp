@@ -0,0 +1,204 @@
+/*
+ * oclTrace.cpp
+ *
+ *  OpenCL command events for the --trace file, see oclTrace.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oclTrace.h"
+#include "benchTrace.h"
+#include "benchHarness.h"
+
+#define TRACE_MAX_QUEUES	16
+
+struct trace_pending
+{
+	cl_event			ev;
+	char				name[BENCH_TRACE_NAME_LEN];
+	unsigned long long	hostNs;
+	int					before;		/* hostNs was taken before the enqueue */
+};
+
+struct trace_command
+{
+	char				name[BENCH_TRACE_NAME_LEN];
+	int					queue;
+	cl_command_type		type;
+	cl_ulong			queued, submit, start, end;
+};
+
+static trace_pending	*pending = NULL;
+static int				numPending = 0;
+static int				capPending = 0;
+static trace_command	*commands = NULL;
+static int				numCommands = 0;
+static int				capCommands = 0;
+static cl_command_queue	queues[TRACE_MAX_QUEUES];
+static int				numQueues = 0;
+
+static int				haveBefore = 0, haveAfter = 0;
+static long long		offsetBefore = 0, offsetAfter = 0;	/* host ns - device ns */
+static int				numFailed = 0;
+
+int oclTraceEnabled()
+{
+	return benchTraceEnabled();
+}
+
+static int queue_index(cl_command_queue q)
+{
+	for (int i=0; i<numQueues; i++)
+		if (queues[i] == q)
+			return i;
+	if (numQueues == TRACE_MAX_QUEUES)
+		return TRACE_MAX_QUEUES - 1;
+	queues[numQueues] = q;
+	return numQueues++;
+}
+
+/* Reads the timestamps of p->ev and releases it; 0 while the command is not complete yet */
+static int resolve(trace_pending *p, int wait)
+{
+	cl_int status = CL_COMPLETE;
+	cl_command_queue q = NULL;
+	trace_command c;
+
+	if (p->ev == NULL)
+		return 1;
+	if (wait)
+		clWaitForEvents(1, &p->ev);
+	else if (clGetEventInfo(p->ev, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL) != CL_SUCCESS || status > CL_COMPLETE)
+		return 0;
+
+	memset(&c, 0, sizeof(c));
+	memcpy(c.name, p->name, sizeof(c.name));
+	clGetEventInfo(p->ev, CL_EVENT_COMMAND_QUEUE, sizeof(q), &q, NULL);
+	clGetEventInfo(p->ev, CL_EVENT_COMMAND_TYPE, sizeof(c.type), &c.type, NULL);
+	c.queue = queue_index(q);
+	if (status == CL_COMPLETE
+		&& clGetEventProfilingInfo(p->ev, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &c.queued, NULL) == CL_SUCCESS
+		&& clGetEventProfilingInfo(p->ev, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &c.submit, NULL) == CL_SUCCESS
+		&& clGetEventProfilingInfo(p->ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &c.start, NULL) == CL_SUCCESS
+		&& clGetEventProfilingInfo(p->ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &c.end, NULL) == CL_SUCCESS)
+	{
+		long long offset = (long long)p->hostNs - (long long)c.queued;
+		if (p->before && (!haveBefore || offset > offsetBefore))
+			offsetBefore = offset;
+		if (!p->before && (!haveAfter || offset < offsetAfter))
+			offsetAfter = offset;
+		haveBefore |= p->before;
+		haveAfter |= !p->before;
+
+		if (numCommands == capCommands)
+		{
+			capCommands = capCommands ? 2 * capCommands : 1024;
+			commands = (trace_command *)realloc(commands, sizeof(trace_command) * capCommands);
+		}
+		commands[numCommands++] = c;
+	}
+	else
+		numFailed++;
+	clReleaseEvent(p->ev);
+	p->ev = NULL;
+	return 1;
+}
+
+/* Drops the completed events so the list does not grow with the iterations */
+static void compact()
+{
+	int n = 0;
+
+	for (int i=0; i<numPending; i++)
+		if (!resolve(&pending[i], 0))
+			pending[n++] = pending[i];
+	numPending = n;
+}
+
+static trace_pending *add_pending(const char *name, int before)
+{
+	if (numPending >= OCL_TRACE_PENDING)
+		compact();
+	if (numPending == capPending)
+	{
+		capPending = capPending ? 2 * capPending : 256;
+		pending = (trace_pending *)realloc(pending, sizeof(trace_pending) * capPending);
+	}
+	trace_pending *p = &pending[numPending++];
+	p->ev = NULL;
+	snprintf(p->name, sizeof(p->name), "%s", name);
+	p->hostNs = benchNowNs();
+	p->before = before;
+	return p;
+}
+
+cl_event *oclTraceEvent(const char *name)
+{
+	if (!oclTraceEnabled())
+		return NULL;
+	return &add_pending(name, 1)->ev;
+}
+
+void oclTraceKeep(const char *name, cl_event ev)
+{
+	if (!oclTraceEnabled() || ev == NULL)
+		return;
+	clRetainEvent(ev);
+	add_pending(name, 0)->ev = ev;
+}
+
+static const char *command_name(cl_command_type type)
+{
+	switch (type)
+	{
+	case CL_COMMAND_NDRANGE_KERNEL:		return "kernel";
+	case CL_COMMAND_WRITE_BUFFER:		return "write";
+	case CL_COMMAND_READ_BUFFER:		return "read";
+	case CL_COMMAND_WRITE_IMAGE:		return "write";
+	case CL_COMMAND_READ_IMAGE:			return "read";
+	case CL_COMMAND_MAP_BUFFER:			return "map";
+	case CL_COMMAND_MAP_IMAGE:			return "map";
+	case CL_COMMAND_UNMAP_MEM_OBJECT:	return "unmap";
+	case CL_COMMAND_COPY_BUFFER:		return "copy";
+	default:							return "command";
+	}
+}
+
+void oclTraceFlush()
+{
+	char args[BENCH_TRACE_ARGS_LEN], track[BENCH_TRACE_NAME_LEN];
+
+	if (!oclTraceEnabled())
+		return;
+	for (int i=0; i<numPending; i++)
+		resolve(&pending[i], 1);
+	numPending = 0;
+
+	// a host time taken before the enqueue bounds the offset from below, one taken after it from above
+	long long offset = haveBefore ? offsetBefore : offsetAfter;
+	for (int q=0; q<numQueues; q++)
+	{
+		sprintf(track, "queue %i", q);
+		benchTraceTrackName(BENCH_TRACE_DEVICE, 2 * q + 1, track);
+		sprintf(track, "queue %i waiting", q);
+		benchTraceTrackName(BENCH_TRACE_DEVICE, 2 * q + 2, track);
+	}
+	for (int i=0; i<numCommands; i++)
+	{
+		const trace_command *c = &commands[i];
+		snprintf(args, sizeof(args), "\"command\":\"%s\",\"queued_to_submit_us\":%.3f,\"submit_to_start_us\":%.3f",
+				 command_name(c->type), (c->submit - c->queued) * 1.0e-3, (c->start - c->submit) * 1.0e-3);
+		benchTraceSpan(BENCH_TRACE_DEVICE, 2 * c->queue + 1, c->name, command_name(c->type),
+					   c->start + offset, c->end + offset, args);
+		if (c->start > c->queued)
+			benchTraceSpan(BENCH_TRACE_DEVICE, 2 * c->queue + 2, c->name, "waiting",
+						   c->queued + offset, c->start + offset, NULL);
+	}
+	if (numFailed > 0)
+		printf("Trace: %i command(s) without profiling information left out \n", numFailed);
+	printf("Trace: %i OpenCL command(s) on %i queue(s) \n", numCommands, numQueues);
+	numCommands = 0;
+	numFailed = 0;
+}
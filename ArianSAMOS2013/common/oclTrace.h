@@ -0,0 +1,43 @@
+/*
+ * oclTrace.h
+ *
+ *  OpenCL command events for the --trace file of benchTrace.h.
+ *
+ *  Every enqueue passes an event to the trace, either a fresh one
+ *
+ *    clEnqueueWriteBuffer(q, buf, CL_TRUE, 0, size, host, 0, NULL, oclTraceEvent("WRDEV plaintext"));
+ *
+ *  (oclTraceEvent returns NULL when tracing is off, so the call is the same
+ *  as before), or one the code needs itself, handed over with oclTraceKeep
+ *  after the enqueue. When the trace is written the events are queried for
+ *  CL_PROFILING_COMMAND_QUEUED/SUBMIT/START/END: each command becomes a span
+ *  from START to END on the track of its queue, and the time from QUEUED to
+ *  START (the queue-to-start gap) a span on the "waiting" track next to it.
+ *
+ *  The device clock is mapped onto benchNowNs by taking the host time just
+ *  before each oclTraceEvent enqueue, which is no later than QUEUED; the
+ *  largest difference over all events is the offset. Queues are created with
+ *  CL_QUEUE_PROFILING_ENABLE while tracing (oclCreateQueue).
+ */
+
+#ifndef OCL_TRACE_H_
+#define OCL_TRACE_H_
+
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+/* Resolved events are dropped once this many are pending */
+#define OCL_TRACE_PENDING		4096
+
+int oclTraceEnabled();
+
+/* An event slot for the next enqueue, NULL when tracing is off; name is copied */
+cl_event *oclTraceEvent(const char *name);
+/* Retains ev, enqueued before this call, for the trace */
+void oclTraceKeep(const char *name, cl_event ev);
+
+/* Turns the pending events into spans and releases them; oclRelease calls it */
+void oclTraceFlush();
+
+#endif /* OCL_TRACE_H_ */
@@ -0,0 +1,311 @@
+/*
+ * oclTune.cpp
+ *
+ *  Launch geometry autotuner with per-device profiles, see oclTune.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+ #include <direct.h>
+ #define mkdir(path, mode)	_mkdir(path)
+#endif
+
+#include "oclTune.h"
+#include "oclTrace.h"
+
+#define TUNE_PATH_LEN		1024
+#define TUNE_LINE_LEN		256
+#define TUNE_MAX_LINES		256
+
+static int			tuneArg = -1;
+static const char	*tuneDirArg = NULL;
+static int			noProfile = 0;
+
+int oclTuneParseArg(int argc, char **argv, int *i)
+{
+	if (strcmp(argv[*i], "--tune") == 0)
+	{
+		tuneArg = 1;
+		return 1;
+	}
+	if (strcmp(argv[*i], "--tune-dir") == 0 && *i + 1 < argc)
+	{
+		tuneDirArg = argv[++(*i)];
+		return 1;
+	}
+	if (strcmp(argv[*i], "--no-tune-profile") == 0)
+	{
+		noProfile = 1;
+		return 1;
+	}
+	return 0;
+}
+
+int oclTuneRequested()
+{
+	if (tuneArg < 0)
+		tuneArg = (getenv("SAMOS_TUNE") && atoi(getenv("SAMOS_TUNE")) > 0) ? 1 : 0;
+	return tuneArg;
+}
+
+static int mkdir_p(char *path)
+{
+	for (char *p = path + 1; *p; p++)
+		if (*p == '/')
+		{
+			*p = '\0';
+			mkdir(path, 0755);
+			*p = '/';
+		}
+	return (mkdir(path, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+/* <dir>/<device name>-<hash>.tune; the directory is only created when create is set */
+static int profile_path(ocl_runtime *rt, char *path, int create)
+{
+	char dir[TUNE_PATH_LEN];
+	char name[64];
+	unsigned long long h = 14695981039346656037ULL;
+	const char *parts[3] = {rt->deviceName, rt->deviceVersion, rt->driverVersion};
+	int n = 0;
+
+	if (tuneDirArg != NULL)
+		snprintf(dir, sizeof(dir), "%s", tuneDirArg);
+	else if (getenv("SAMOS_TUNE_DIR") != NULL && *getenv("SAMOS_TUNE_DIR") != '\0')
+		snprintf(dir, sizeof(dir), "%s", getenv("SAMOS_TUNE_DIR"));
+	else if (getenv("XDG_CONFIG_HOME") != NULL)
+		snprintf(dir, sizeof(dir), "%s/samos-tune", getenv("XDG_CONFIG_HOME"));
+	else if (getenv("HOME") != NULL)
+		snprintf(dir, sizeof(dir), "%s/.config/samos-tune", getenv("HOME"));
+	else
+		snprintf(dir, sizeof(dir), ".tune");
+	if (create && mkdir_p(dir) != 0)
+		return 0;
+
+	for (int p=0; p<3; p++)
+		for (const char *c = parts[p]; *c; c++)
+		{
+			h ^= (unsigned char)*c;
+			h *= 1099511628211ULL;
+		}
+	for (const char *c = rt->deviceName; *c && n < (int)sizeof(name) - 1; c++)
+		name[n++] = isalnum((unsigned char)*c) ? *c : '_';
+	name[n] = '\0';
+
+	snprintf(path, TUNE_PATH_LEN + 96, "%s/%s-%08llx.tune", dir, name, h & 0xffffffffULL);
+	return 1;
+}
+
+static int same_launch(const ocl_launch *a, const ocl_launch *b)
+{
+	return a->local[0] == b->local[0] && a->local[1] == b->local[1] && a->fold == b->fold;
+}
+
+static int load_entry(ocl_runtime *rt, const char *key, ocl_launch *l)
+{
+	char path[TUNE_PATH_LEN + 96];
+	char line[TUNE_LINE_LEN], k[TUNE_LINE_LEN];
+	unsigned long l0, l1, fold;
+	double ms;
+	int found = 0;
+
+	if (!profile_path(rt, path, 0))
+		return 0;
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (line[0] != '#' && sscanf(line, "%255s %lu %lu %lu %lf", k, &l0, &l1, &fold, &ms) == 5 && strcmp(k, key) == 0)
+		{
+			l->local[0] = l0;
+			l->local[1] = l1;
+			l->fold = fold;
+			l->ms = ms;
+			found = 1;
+		}
+	fclose(fp);
+	return found;
+}
+
+/* Rewrites the profile with key replaced; the other entries are kept in their order */
+static void store_entry(ocl_runtime *rt, const char *key, const ocl_launch *l)
+{
+	char path[TUNE_PATH_LEN + 96], tmpPath[TUNE_PATH_LEN + 128];
+	char (*lines)[TUNE_LINE_LEN] = (char (*)[TUNE_LINE_LEN])malloc(TUNE_MAX_LINES * TUNE_LINE_LEN);
+	char k[TUNE_LINE_LEN];
+	int n = 0;
+
+	if (!profile_path(rt, path, 1))
+	{
+		printf("Cannot create the tuning profile directory for %s \n", rt->deviceName);
+		free(lines);
+		return;
+	}
+	FILE *fp = fopen(path, "r");
+	if (fp != NULL)
+	{
+		while (n < TUNE_MAX_LINES && fgets(lines[n], TUNE_LINE_LEN, fp) != NULL)
+			if (lines[n][0] == '#' || sscanf(lines[n], "%255s", k) != 1 || strcmp(k, key) != 0)
+				n++;
+		fclose(fp);
+	}
+
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	fp = fopen(tmpPath, "w");
+	if (fp == NULL)
+	{
+		printf("Cannot write the tuning profile %s \n", tmpPath);
+		free(lines);
+		return;
+	}
+	if (n == 0)
+		fprintf(fp, "# launch geometry for %s (%s, driver %s)\n# key local0 local1 fold msecs\n",
+				rt->deviceName, rt->deviceVersion, rt->driverVersion);
+	for (int i=0; i<n; i++)
+		fputs(lines[i], fp);
+	fprintf(fp, "%s %lu %lu %lu %.6f\n", key, (unsigned long)l->local[0], (unsigned long)l->local[1], (unsigned long)l->fold, l->ms);
+	fclose(fp);
+	remove(path);
+	if (rename(tmpPath, path) != 0)
+		printf("Cannot write the tuning profile %s \n", path);
+	else
+		printf("Tuning profile updated: %s \n", path);
+	free(lines);
+}
+
+size_t oclTuneMaxGroup(ocl_runtime *rt, cl_kernel k)
+{
+	size_t kernelMax = 0, deviceMax = 0;
+
+	clGetKernelWorkGroupInfo(k, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernelMax), &kernelMax, NULL);
+	clGetDeviceInfo(rt->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(deviceMax), &deviceMax, NULL);
+	if (kernelMax == 0 || (deviceMax > 0 && deviceMax < kernelMax))
+		kernelMax = deviceMax;
+	return kernelMax;
+}
+
+static int fits(ocl_runtime *rt, size_t maxGroup, const ocl_launch *l)
+{
+	size_t itemSizes[3] = {0, 0, 0};
+
+	clGetDeviceInfo(rt->device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(itemSizes), itemSizes, NULL);
+	if (l->local[0] * l->local[1] > maxGroup)
+		return 0;
+	if ((itemSizes[0] > 0 && l->local[0] > itemSizes[0]) || (itemSizes[1] > 0 && l->local[1] > itemSizes[1]))
+		return 0;
+	return 1;
+}
+
+/* Lowest kernel time of OCL_TUNE_REPS launches after one warm-up, negative when the launch fails */
+static double time_launch(cl_command_queue q, const ocl_launch *l, ocl_tune_fn launch, void *user)
+{
+	double best = -1.0;
+
+	for (int r=0; r<=OCL_TUNE_REPS; r++)
+	{
+		cl_event ev = NULL;
+		cl_ulong start = 0, end = 0;
+
+		if (launch(user, q, l, &ev) != CL_SUCCESS || clWaitForEvents(1, &ev) != CL_SUCCESS)
+		{
+			if (ev)
+				clReleaseEvent(ev);
+			return -1.0;
+		}
+		clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		oclTraceKeep("tuning launch", ev);
+		clReleaseEvent(ev);
+
+		double ms = (end - start) * 1.0e-6;
+		if (r > 0 && (best < 0.0 || ms < best))
+			best = ms;
+	}
+	return best;
+}
+
+static void sweep(ocl_runtime *rt, cl_kernel k, const char *key, const ocl_launch *cand, int numCand,
+				  ocl_tune_fn launch, void *user, ocl_launch *l)
+{
+	cl_int clErr;
+	cl_command_queue q = clCreateCommandQueue(rt->context, rt->device, CL_QUEUE_PROFILING_ENABLE, &clErr);
+	size_t maxGroup = oclTuneMaxGroup(rt, k);
+	int best = -1;
+	double bestMs = 0.0;
+
+	if (clErr != CL_SUCCESS)
+	{
+		printf("Error in creating the tuning queue!, clErr=%i \n", clErr);
+		return;
+	}
+	printf("Tuning %s, %i candidates, work-groups up to %lu \n", key, numCand, (unsigned long)maxGroup);
+	for (int c=0; c<numCand; c++)
+	{
+		if (!fits(rt, maxGroup, &cand[c]))
+			continue;
+		double ms = time_launch(q, &cand[c], launch, user);
+		printf("	local %lux%lu fold %lu: %s%.4f msecs \n", (unsigned long)cand[c].local[0], (unsigned long)cand[c].local[1],
+			   (unsigned long)cand[c].fold, (ms < 0.0) ? "failed " : "", (ms < 0.0) ? 0.0 : ms);
+		if (ms >= 0.0 && (best < 0 || ms < bestMs))
+		{
+			best = c;
+			bestMs = ms;
+		}
+	}
+	clReleaseCommandQueue(q);
+
+	if (best < 0)
+	{
+		printf("No candidate launched for %s, keeping the default \n", key);
+		return;
+	}
+	*l = cand[best];
+	l->ms = bestMs;
+	l->source = OCL_TUNE_SWEEP;
+	store_entry(rt, key, l);
+}
+
+void oclTuneLaunch(ocl_runtime *rt, cl_kernel k, const char *key, const ocl_launch *cand, int numCand,
+				   ocl_tune_fn launch, void *user, ocl_launch *l)
+{
+	ocl_launch stored;
+
+	l->source = OCL_TUNE_DEFAULT;
+	l->ms = 0.0;
+	if (oclTuneRequested())
+	{
+		sweep(rt, k, key, cand, numCand, launch, user, l);
+		return;
+	}
+	if (noProfile || !load_entry(rt, key, &stored))
+		return;
+
+	// an entry from another problem size or build may no longer be a valid candidate
+	for (int c=0; c<numCand; c++)
+		if (same_launch(&stored, &cand[c]) && fits(rt, oclTuneMaxGroup(rt, k), &stored))
+		{
+			*l = stored;
+			l->source = OCL_TUNE_PROFILE;
+			return;
+		}
+	printf("Tuning profile entry for %s does not fit this run, using the default \n", key);
+}
+
+void oclPrintTuneReport(FILE *fout, const char *key, const ocl_launch *l)
+{
+	static const char *sources[3] = {"default", "tuning profile", "autotuned"};
+
+	fprintf(fout, "Launch geometry (%s): local %lu * %lu", key, (unsigned long)l->local[0], (unsigned long)l->local[1]);
+	if (l->fold > 0)
+		fprintf(fout, ", 2D rows of %lu", (unsigned long)l->fold);
+	fprintf(fout, ", %s", sources[l->source]);
+	if (l->source != OCL_TUNE_DEFAULT)
+		fprintf(fout, " (%.4f msecs per launch when tuned)", l->ms);
+	fprintf(fout, " \n");
+}
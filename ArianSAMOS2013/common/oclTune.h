@@ -0,0 +1,71 @@
+/*
+ * oclTune.h
+ *
+ *  Launch geometry autotuner with per-device profiles for the SAMOS 2013
+ *  benchmarks.
+ *
+ *  The work-group sizes (AES 256, Convolution 8x8, BitCounter's 32*1024
+ *  wide 2D folding) were picked for the boards of the paper. With
+ *
+ *    --tune             sweep the candidate launches of every tuned kernel
+ *                       at start-up and store the fastest in the profile
+ *    --tune-dir <dir>   where the profiles live
+ *    --no-tune-profile  ignore the profile, run the compiled-in defaults
+ *
+ *  or SAMOS_TUNE=1 / SAMOS_TUNE_DIR in the environment, each candidate the
+ *  kernel and the device accept (CL_KERNEL_WORK_GROUP_SIZE,
+ *  CL_DEVICE_MAX_WORK_ITEM_SIZES) is launched OCL_TUNE_REPS times on a
+ *  profiling queue and the one with the lowest kernel time wins. Without
+ *  --tune the benchmarks load the winner from the profile, as long as it is
+ *  still one of their candidates (e.g. it divides the image size).
+ *
+ *  One profile per device: <dir>/<device name>-<hash>.tune, the hash covers
+ *  the device name, device version and driver version. Each line is
+ *    <key> <local0> <local1> <fold> <msecs>
+ *  with key "<benchmark>.<kernel>". The directory is $SAMOS_TUNE_DIR, else
+ *  $XDG_CONFIG_HOME/samos-tune, else ~/.config/samos-tune.
+ */
+
+#ifndef OCL_TUNE_H_
+#define OCL_TUNE_H_
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "oclRuntime.h"
+
+#define OCL_TUNE_REPS		5
+#define OCL_TUNE_MAX_CAND	64
+
+#define OCL_TUNE_DEFAULT	0
+#define OCL_TUNE_PROFILE	1
+#define OCL_TUNE_SWEEP		2
+
+struct ocl_launch
+{
+	size_t	local[2];		/* work-group size, local[1] is 1 for 1D launches */
+	size_t	fold;			/* 2D layout: rows of fold work-items; 0 for kernels launched 1D */
+	double	ms;				/* kernel time of the winner, 0 for the default */
+	int		source;			/* OCL_TUNE_DEFAULT, OCL_TUNE_PROFILE or OCL_TUNE_SWEEP */
+};
+
+/* Enqueues one launch of the kernel with geometry l on q and returns its event in *ev */
+typedef cl_int (*ocl_tune_fn)(void *user, cl_command_queue q, const ocl_launch *l, cl_event *ev);
+
+/* Consumes --tune, --tune-dir <dir> and --no-tune-profile, called from oclParseArgs */
+int oclTuneParseArg(int argc, char **argv, int *i);
+
+int oclTuneRequested();
+/* Largest work-group k accepts on the device */
+size_t oclTuneMaxGroup(ocl_runtime *rt, cl_kernel k);
+
+/*
+ * Picks the launch for key among the numCand candidates: swept with --tune,
+ * else taken from the profile, else *l keeps the default the caller put in.
+ */
+void oclTuneLaunch(ocl_runtime *rt, cl_kernel k, const char *key, const ocl_launch *cand, int numCand,
+				   ocl_tune_fn launch, void *user, ocl_launch *l);
+
+void oclPrintTuneReport(FILE *fout, const char *key, const ocl_launch *l);
+
+#endif /* OCL_TUNE_H_ */
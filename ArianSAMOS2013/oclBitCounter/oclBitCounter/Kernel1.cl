@@ -27,5 +27,5 @@ __kernel void BitCounter(__global const int * Src, __global int * Tmp)
 			values[lid_x] += values[lid_x + stride];
 	}
 	if (lid_x == 0) 
-		Tmp[get_group_id(1) * (gw/lw) + get_group_id(0)] = values[0];	
+		Tmp[gid_y * (gw/lw) + get_group_id(0)] = values[0];	// gid_y, not the group id, so a global offset (--pipeline) lands in the right row	
 }
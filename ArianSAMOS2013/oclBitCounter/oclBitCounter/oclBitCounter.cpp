@@ -12,10 +12,40 @@
 */
 
 #include <stdio.h>
-#include <CL/cl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#ifndef CPU_ONLY
+ #include <CL/cl.h>
+#endif
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
+
+#ifndef CPU_ONLY
+ #include "oclRuntime.h"
+ #include "oclProgramCache.h"
+ #include "oclHostMem.h"
+ #include "oclMemPool.h"
+ #include "oclPipeline.h"
+ #include "oclCoop.h"
+ #include "oclTune.h"
+ #include "oclRoofline.h"
+ #include "oclTrace.h"
+ #include "oclHandles.h"
+ #ifdef SAMOS_EMBED_KERNELS
+  #include "samosKernels.h"
+ #endif
+#endif
+#include "benchHarness.h"
+#include "benchResults.h"
+#include "benchEnergy.h"
+#include "benchTrace.h"
+#include "benchSweep.h"
+#include "benchServe.h"
+#include "benchArena.h"
+#include "benchScaling.h"
 
 // Include sys/time.h in Linux environments
 // #include <sys/time.h>
@@ -29,20 +59,7 @@
  #include <sys/time.h> // linux machines
 #endif
 
-// Its funny that OpenCL is touted as platform independent 
-// and yet it comes down to the following. What am I missing here?
-// #define FERMI
-
-#ifdef FERMI 
-
- #define PLATFORMS_IDS 3 // on the Fermi machine at IDA
- #define THIS_PLATFORM_ID 1
-#else
-
- #define PLATFORMS_IDS 1 // on Unmesh's local desktop
- #define THIS_PLATFORM_ID 0
-#endif
-
+// The platform and device are picked at run time, see ../../common/oclRuntime.h
 
 #define PLATFORM		0
 #define DEVICE			1
@@ -58,313 +75,724 @@
 #define WRDEV			11
 #define RDDEV			12
 #define CPU				13
+#define WRDEV_COPY		14		// copy path reference for --mem-mode alloc/use
+#define RDDEV_COPY		15
+#define PIPELINE		16		// WRDEV + KERNEL1_EXEC overlapped, with --pipeline
+#define COOP			17		// the elements shared by the device and the CPU, with --coop
+#define NUM_PHASES		18
+
+const char *phaseNames[NUM_PHASES] = {"PLATFORM", "DEVICE", "CONTEXT", "CMDQ", "PGM1", "PGM2", "KERNEL1", "KERNEL2",
+									  "KERNEL1_EXEC", "KERNEL2_EXEC", "BUFF", "WRDEV", "RDDEV", "CPU",
+									  "WRDEV_COPY", "RDDEV_COPY", "PIPELINE", "COOP"};
 
 // #define LOCALMEM    // use this #def if you want to check the version that does not uses local memory    
 
 #define WORK_GROUP_SIZE		32
 #define GLOBAL_SIZE_0		32*1024		
-struct timeval start[15];
-struct timeval stop[15];
-float timeRes[15] = {0};
+float timeRes[BENCH_MAX_PHASES] = {0};
+int finalResultGPU = 0;
+int finalResultCPU;
 
 
 void start_measure_per(int seg)
-{ 
-    gettimeofday(&start[seg], NULL);
+{
+	benchStart(seg);
 }
 
 void stop_measure_per(int seg)
 {
-    gettimeofday(&stop[seg], NULL);
-    timeRes[seg] = 1000 * ((float)(float)(stop[seg].tv_sec  - start[seg].tv_sec) + 1.0e-6 * (stop[seg].tv_usec - start[seg].tv_usec));
+	benchStop(seg);
+}
+
+// Counts the 1 bits of the input on numThreads OpenMP threads, the reference of every iteration
+static int bc_cpu(const int *idata, int numofElements, int numThreads)
+{
+	int total = 0;
+
+	benchSetThreads(numThreads);
+	#pragma omp parallel for reduction(+:total)
+	for(int i=0; i<numofElements; i++)
+	{
+		int inp = idata[i];
+		while(inp != 0)
+		{
+			total++;
+			inp = inp & (inp - 1);
+		}
+	}
+	return total;
+}
+
+#ifndef CPU_ONLY
+ocl_runtime			clRuntime;
+cl_context			clContext;
+ocl_handle<cl_kernel>	clKernel1;
+ocl_handle<cl_kernel>	clKernel2;
+cl_command_queue	clCommandQueue;
+ocl_handle<cl_program>	clProgram;
+ocl_handle<cl_program>	clProgram2;
+cl_device_id		clDeviceId;
+ocl_buffer<cl_int>	clBuffers[3];
+ocl_pipeline		clPipeline;
+ocl_coop			clCoop;
+
+// kernel1 is launched as rows of bcLaunch.fold work-items, GLOBAL_SIZE_0 unless tuned; its work-group stays
+// at WORK_GROUP_SIZE, the size of the kernel's local array. kernel2 keeps the GLOBAL_SIZE_0 folding.
+ocl_launch bcLaunch = {{WORK_GROUP_SIZE, 1}, GLOBAL_SIZE_0, 0.0, OCL_TUNE_DEFAULT};
+
+// one chunk of the pipelined path is a band of rowsPerChunk rows of bcLaunch.fold elements
+struct bc_pipe_job
+{
+	cl_kernel		kernel;
+	cl_mem			src;
+	const int		*idata;
+	int				rows;
+	int				rowsPerChunk;
+};
+
+static size_t chunk_rows(const bc_pipe_job *job, int chunk)
+{
+	int y0 = chunk * job->rowsPerChunk;
+	return (y0 + job->rowsPerChunk > job->rows) ? job->rows - y0 : job->rowsPerChunk;
+}
+
+static cl_int bc_upload(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	bc_pipe_job *job = (bc_pipe_job *)user;
+	size_t offset = (size_t)chunk * job->rowsPerChunk * bcLaunch.fold;
+	return clEnqueueWriteBuffer(q, job->src, CL_FALSE, sizeof(cl_int) * offset, sizeof(cl_int) * chunk_rows(job, chunk) * bcLaunch.fold,
+								job->idata + offset, numWait, wait, done);
+}
+
+static cl_int bc_execute(void *user, cl_command_queue q, int chunk, cl_uint numWait, const cl_event *wait, cl_event *done)
+{
+	bc_pipe_job *job = (bc_pipe_job *)user;
+	size_t clGlobalOffset[2] = {0, (size_t)chunk * job->rowsPerChunk};
+	size_t clGlobalSize[2] = {bcLaunch.fold, chunk_rows(job, chunk)};
+	size_t clGroupSize[2] = {WORK_GROUP_SIZE, 1};
+	return clEnqueueNDRangeKernel(q, job->kernel, 2, clGlobalOffset, clGlobalSize, clGroupSize, numWait, wait, done);
+}
+
+// Runs kernel2 after the commands of after until one sum is left and returns the buffer that holds it; done
+// gets the last pass, none when there is only one partial. partials holds the numofPartials kernel1 results,
+// spare is overwritten; with blocking every pass is waited for, as KERNEL2_EXEC times them.
+static const ocl_buffer<cl_int> *ocl_sum_partials(cl_command_queue clCommandQueue, cl_kernel clKernel2,
+												  const ocl_buffer<cl_int> *partials, const ocl_buffer<cl_int> *spare,
+												  int numofPartials, const ocl_after &after, int blocking, ocl_future *done)
+{
+	size_t clGlobalSize[2];
+	size_t clGroupSize[2] = {WORK_GROUP_SIZE, 1};
+	const ocl_buffer<cl_int> *clSrcBuffer = spare;		// the first swap below makes spare the output
+	const ocl_buffer<cl_int> *clIntermediateBuffer = partials;
+	ocl_future pass;
+	int numofElements_tmp = numofPartials;
+	int numofWorkItems = (numofElements_tmp + 1) / 2;	// numofWorkGroups in kernel1 becomes numofWorkItems in kernel2.
+
+	while (numofElements_tmp > 1)
+	{
+		const ocl_buffer<cl_int> *tmp;
+
+		tmp = clSrcBuffer;
+		clSrcBuffer = clIntermediateBuffer;
+		clIntermediateBuffer = tmp;
+
+		if (numofWorkItems >= GLOBAL_SIZE_0)
+		{
+			clGlobalSize[0] = GLOBAL_SIZE_0;
+			clGlobalSize[1] = (numofWorkItems % (GLOBAL_SIZE_0) == 0) ? numofWorkItems/(GLOBAL_SIZE_0) : numofWorkItems/(GLOBAL_SIZE_0) + 1;
+		}
+		else
+		{
+			clGlobalSize[0] = (numofWorkItems % WORK_GROUP_SIZE == 0) ? numofWorkItems : numofWorkItems + WORK_GROUP_SIZE - (numofWorkItems % WORK_GROUP_SIZE);
+			clGlobalSize[1] = 1;
+		}
+
+		oclSetArgs(clKernel2, *clSrcBuffer, *clIntermediateBuffer, numofElements_tmp);
+
+		// every pass reads what the one before wrote, the first one what after wrote
+		pass = oclLaunchAsync(clCommandQueue, clKernel2, 2, clGlobalSize, clGroupSize,
+							  (numofElements_tmp == numofPartials) ? after : ocl_after(pass), "kernel2 sum");
+		if (pass.ok() && blocking)
+			printf("Kernel2 launched successfully! \n");
+		if (blocking)
+			pass.wait();
+
+		numofElements_tmp = (numofElements_tmp % (2 * WORK_GROUP_SIZE) == 0) ? numofElements_tmp / (2 * WORK_GROUP_SIZE) : numofElements_tmp / (2 * WORK_GROUP_SIZE) + 1;
+		numofWorkItems = (numofElements_tmp + 1) / 2;
+	}
+	*done = std::move(pass);
+	return clIntermediateBuffer;
+}
+
+// Work-items of all the passes ocl_sum_partials runs on numofPartials partial sums, for the roofline report
+static double bc_sum_items(int numofPartials)
+{
+	double items = 0.0;
+
+	for (int n = numofPartials; n > 1; n = (n + 2 * WORK_GROUP_SIZE - 1) / (2 * WORK_GROUP_SIZE))
+		items += (n + 1) / 2;
+	return items;
+}
+
+// --coop: the device counts the first rows of bcLaunch.fold elements while the CPU threads count the rest
+static int coop_bitcount(ocl_coop *coop, cl_command_queue clCommandQueue, cl_kernel clKernel1, cl_kernel clKernel2,
+						 const ocl_buffer<cl_int> *clBuffers, const int *idata, int numofElements)
+{
+	ocl_future first, last;
+	int gpuRows = (int)oclCoopSplit(coop, numofElements / int(bcLaunch.fold), 1);
+	int gpuElements = gpuRows * int(bcLaunch.fold);
+	int gpuCount = 0, cpuCount;
+
+	start_measure_per(COOP);
+	if (gpuRows > 0)
+	{
+		size_t clGlobalSize[2] = {bcLaunch.fold, (size_t)gpuRows};
+		size_t clGroupSize[2] = {WORK_GROUP_SIZE, 1};
+
+		ocl_future exec, summed;
+
+		first = oclWriteAsync(clCommandQueue, clBuffers[0], idata, gpuElements, ocl_after(), "coop write input");
+		oclSetArgs(clKernel1, clBuffers[0], clBuffers[1]);
+		exec = oclLaunchAsync(clCommandQueue, clKernel1, 2, clGlobalSize, clGroupSize, ocl_after(first), "coop BitCounter");
+		const ocl_buffer<cl_int> *sum = ocl_sum_partials(clCommandQueue, clKernel2, &clBuffers[1], &clBuffers[2],
+														 gpuElements / WORK_GROUP_SIZE, ocl_after(exec), 0, &summed);
+		last = oclReadAsync(clCommandQueue, *sum, &gpuCount, 1, ocl_after(exec, summed), "coop read result");
+		clFlush(clCommandQueue);
+	}
+
+	unsigned long long cpuStart = benchNowNs();
+	cpuCount = bc_cpu(idata + gpuElements, numofElements - gpuElements, oclCoopThreads());
+	double cpuMs = (benchNowNs() - cpuStart) * 1.0e-6;
+
+	last.wait();
+	stop_measure_per(COOP);
+
+	oclCoopUpdate(coop, gpuElements, oclCoopEventMs(first.get(), last.get()), numofElements - gpuElements, cpuMs);
+	return gpuCount + cpuCount;
+}
+
+struct bc_tune_job
+{
+	cl_kernel		kernel;
+	int				numofElements;
+};
+
+static cl_int bc_tune_launch(void *user, cl_command_queue q, const ocl_launch *l, cl_event *ev)
+{
+	bc_tune_job *job = (bc_tune_job *)user;
+	size_t clGlobalSize[2] = {l->fold, job->numofElements / l->fold};
+	return clEnqueueNDRangeKernel(q, job->kernel, 2, NULL, clGlobalSize, l->local, 0, NULL, ev);
+}
+
+// Picks the row width of kernel1, see ../../common/oclTune.h. The rows have to tile the input exactly,
+// the widest candidate is the whole input in one row.
+static void bc_tune(ocl_runtime *rt, cl_kernel clKernel1, const ocl_buffer<cl_int> *clBuffers, const int *idata, int numofElements)
+{
+	ocl_launch cand[OCL_TUNE_MAX_CAND];
+	int numCand = 0;
+	bc_tune_job job = {clKernel1, numofElements};
+
+	for (size_t fold = 1024; fold <= (size_t)numofElements && numCand < OCL_TUNE_MAX_CAND; fold *= 2)
+		if (numofElements % fold == 0)
+		{
+			ocl_launch c = {{WORK_GROUP_SIZE, 1}, fold, 0.0, OCL_TUNE_DEFAULT};
+			cand[numCand++] = c;
+		}
+	// the kernel time depends on the bits set, so the sweep counts the real input
+	if (oclHostMemMode() == OCL_MEM_COPY)
+		oclWriteAsync(rt->queue, clBuffers[0], idata, numofElements, ocl_after(), "tuning input").wait();
+	oclSetArgs(clKernel1, clBuffers[0], clBuffers[1]);
+	oclTuneLaunch(rt, clKernel1, "bitcounter.BitCounter", cand, numCand, bc_tune_launch, &job, &bcLaunch);
+}
+
+// kernel2's first pass zero-fills its source up to the end of its launch, so the partial sums get room for a
+// whole launch; the 1M elements need no padding, sweep sizes can
+static int bc_partials_len(int numofPartials)
+{
+	int pad = (numofPartials >= 2 * GLOBAL_SIZE_0) ? 2 * GLOBAL_SIZE_0 : 2 * WORK_GROUP_SIZE;
+	return (numofPartials + pad - 1) / pad * pad;
 }
 
-int main(void)
+static void bc_buffers(const int *idata, int numofElements)
 {
-	cl_context clContext;
-	cl_kernel clKernel1;
-	cl_kernel clKernel2;
-	cl_command_queue clCommandQueue;
-	cl_program clProgram;
-	cl_platform_id clPlatformId[3];
-	cl_device_id clDeviceId;
-	cl_mem clSrcBuffer;
-	cl_mem clIntermediateBuffer;
+	int numofPartials = bc_partials_len(numofElements / WORK_GROUP_SIZE);
 	cl_int clErr;
-	cl_uint num_platforms;
+
+	start_measure_per(BUFF);
+	// with --mem-mode alloc/use idata is placed in host-visible memory here, once; kernel2 ping-pongs
+	// between clBuffers[1] and clBuffers[2] so the input in clBuffers[0] is never overwritten
+	clBuffers[0].reset(oclPoolBuffer(&clRuntime, 0, sizeof(cl_int) * numofElements, idata, &clErr), numofElements);
+	clBuffers[1].reset(oclPoolDeviceBuffer(&clRuntime, 0, sizeof(cl_int) * numofPartials, &clErr), numofPartials);
+	clBuffers[2].reset(oclPoolDeviceBuffer(&clRuntime, 0, sizeof(cl_int) * numofPartials, &clErr), numofPartials);
+	if (clErr != CL_SUCCESS)
+		printf("Error in creating buffer!, clErr=%i \n", clErr);
+	else
+		printf("Buffer created! \n");
+	stop_measure_per(BUFF);
+}
+
+static void bc_release_buffers()
+{
+	clBuffers[0].reset();
+	clBuffers[1].reset();
+	clBuffers[2].reset();
+}
+
+static void bc_clean()
+{
+	clKernel1.reset();
+	clKernel2.reset();
+	clProgram.reset();
+	clProgram2.reset();
+	oclPipelineRelease(&clPipeline);
+	oclRelease(&clRuntime);
+}
+#endif
+
+#ifndef CPU_ONLY
+// Counts the 1 bits of the input on the device, in clBuffers of at least numofElements elements
+static int bc_gpu(const int *idata, int numofElements)
+{
+	const ocl_buffer<cl_int> &clSrcBuffer = clBuffers[0];
+	const ocl_buffer<cl_int> *clIntermediateBuffer = &clBuffers[1];
+	ocl_future input, exec, summed;
 	size_t clGlobalSize[2];
-	size_t clGroupSize[2];
+	size_t clGroupSize[2] = {WORK_GROUP_SIZE, 1};
+	int numofWorkGroups = numofElements / WORK_GROUP_SIZE;
+	int result = 0;
+
+	if (oclCoopEnabled())
+		return coop_bitcount(&clCoop, clCommandQueue, clKernel1, clKernel2, clBuffers, idata, numofElements);
+
+	if (clPipeline.numQueues > 0)
+	{
+		// --pipeline: the input is written in bands, kernel1 counts band i while band i+1 is written
+		bc_pipe_job job = {clKernel1, clSrcBuffer, idata, numofElements / int(bcLaunch.fold), 0};
+		ocl_pipe_stages stages = {bc_upload, bc_execute, NULL, 0, &job};
+		job.rowsPerChunk = (int)oclPipelineChunkSize(job.rows, 1);
+
+		start_measure_per(PIPELINE);
+		oclSetArgs(clKernel1, clSrcBuffer, *clIntermediateBuffer);
+		oclPipelineRun(&clPipeline, (job.rows + job.rowsPerChunk - 1) / job.rowsPerChunk, &stages);
+		stop_measure_per(PIPELINE);
+	}
+	else
+	{
+		start_measure_per(WRDEV);
+		if (oclHostMemMode() == OCL_MEM_COPY)
+		{
+			input = oclWriteAsync(clCommandQueue, clSrcBuffer, idata, numofElements, ocl_after(), "WRDEV input");
+			if (input.wait() == CL_SUCCESS)
+				printf("Data transferred into device! \n");
+		}
+		else
+			oclHandOverBuffer(&clRuntime, clSrcBuffer, CL_MAP_WRITE, sizeof(cl_int) * numofElements);
+		stop_measure_per(WRDEV);
+		//=================================KERNEL1====================================//
+
+		start_measure_per(KERNEL1_EXEC);
+
+		oclSetArgs(clKernel1, clSrcBuffer, *clIntermediateBuffer);
+
+		clGlobalSize[0] = bcLaunch.fold;
+		clGlobalSize[1] = numofElements/int(bcLaunch.fold);
+
+		exec = oclLaunchAsync(clCommandQueue, clKernel1, 2, clGlobalSize, clGroupSize, ocl_after(input), "BitCounter");
+		if (exec.ok())
+			printf("Kernel 1 launched successfully! \n");
+
+		// finish executing this kernel before starting the other one
+		exec.wait();
+		stop_measure_per(KERNEL1_EXEC);
+	}
+	//=================================KERNEL2====================================//
+	// Kernel2 sums up the results of each WorkGroup generated in kernel1
+	start_measure_per(KERNEL2_EXEC);
+
+	clIntermediateBuffer = ocl_sum_partials(clCommandQueue, clKernel2, clIntermediateBuffer, &clBuffers[2], numofWorkGroups,
+											ocl_after(exec), 1, &summed);
+	stop_measure_per(KERNEL2_EXEC);
+
+	//=================================RDDEV_RES====================================//
+	start_measure_per(RDDEV);
+	oclReadAsync(clCommandQueue, *clIntermediateBuffer, &result, 1, ocl_after(exec, summed), "RDDEV result").wait();
+	stop_measure_per(RDDEV);
+	return result;
+}
+#endif
+
+// the measured loop, the same for the 1M elements and every sweep size
+static void bc_run(const int *idata, int numofElements)
+{
+	for (int it=0; it<benchTotalIterations(); it++)
+	{
+		benchBeginIteration(it);
+		//===================================CPU=======================================//
+		start_measure_per(CPU);
+		finalResultCPU = bc_cpu(idata, numofElements, benchCpuThreads());
+		stop_measure_per(CPU);
+		//===================================CPU=======================================//
+
+#ifndef CPU_ONLY
+		finalResultGPU = bc_gpu(idata, numofElements);
+#endif
+		benchEndIteration();
+	}
+}
+
+// --sweep: random inputs of every size instead of the 1M elements, see ../../common/benchSweep.h
+static void bc_sweep(const char *version)
+{
+	static const int setupPhases[] = {PLATFORM, DEVICE, CONTEXT, CMDQ, PGM1, PGM2, KERNEL1, KERNEL2};
+	long long sizes[BENCH_SWEEP_MAX];
+	// the smallest row of kernel1 is 1024 elements
+	int numSizes = benchSweepSizes(sizes, 1024, 64 * 1024 * 1024, 1024);
+	char buff[256];
+
+	for (int s=0; s<numSizes; s++)
+	{
+		int numofElements = (int)sizes[s];
+		int *idata = (int *) malloc(sizeof(int) * numofElements);
+		if (idata == NULL)
+		{
+			printf("Out of memory at a sweep size of %i elements \n", numofElements);
+			break;
+		}
+		for (int i=0; i<numofElements; i++)
+			idata[i] = rand();
+
+		benchResetPhases(setupPhases, sizeof(setupPhases) / sizeof(setupPhases[0]));
+#ifndef CPU_ONLY
+		// the widest row up to GLOBAL_SIZE_0 that tiles this size, unless the tuner finds a better one
+		bcLaunch.fold = GLOBAL_SIZE_0;
+		while (numofElements % bcLaunch.fold != 0)
+			bcLaunch.fold /= 2;
+		bc_buffers(idata, numofElements);
+		bc_tune(&clRuntime, clKernel1, clBuffers, idata, numofElements);
+#endif
+		bc_run(idata, numofElements);
+		benchSummary(timeRes);
+
+		float total_GPU_NOLM = timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+		float total_GPU_time = timeRes[PLATFORM] + timeRes[DEVICE] + timeRes[CONTEXT] + timeRes[CMDQ] + timeRes[PGM1] + timeRes[PGM2]
+							   + timeRes[KERNEL1] + timeRes[KERNEL2] + timeRes[BUFF] + total_GPU_NOLM;
+#ifdef CPU_ONLY
+		total_GPU_NOLM = total_GPU_time = 0.0f;
+#endif
+		benchSweepAdd(numofElements, timeRes[CPU], total_GPU_NOLM, total_GPU_time);
+
+		bench_result res;
+		char workGroup[16];
+		sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+		resultsInit(&res, "bitcounter");
+		res.description = version;
+		res.problemSize = numofElements;
+		res.problemUnit = "elements";
+		res.workGroup = workGroup;
+		res.cpuMs = timeRes[CPU];
+		res.cpuThroughput = numofElements * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+		res.throughputUnit = "Melements/s";
+#ifndef CPU_ONLY
+		res.device = clRuntime.deviceName;
+		res.platform = clRuntime.platformName;
+		res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+		res.driver = clRuntime.driverVersion;
+		res.variant = oclCoopName() ? oclCoopName() : oclPipelineName() ? oclPipelineName() : oclHostMemModeName(oclHostMemMode());
+		res.gpuMs = total_GPU_NOLM;
+		res.gpuTotalMs = total_GPU_time;
+		res.gpuThroughput = numofElements * 1.0e-6 / (total_GPU_NOLM * 1.0e-3);
+		res.speedup = timeRes[CPU] / total_GPU_NOLM;
+		res.verified = (finalResultCPU == finalResultGPU);
+		bc_release_buffers();
+#else
+		resultsSetHostDevice(&res);
+#endif
+		resultsWrite(&res);
+		free(idata);
+	}
+
+	FILE *fout = fopen("log.txt", "w+");
+	time_t t = time(NULL);
+	fprintf(fout, "Created on: %s", asctime(localtime(&t)));
+	fprintf(fout, "version: %s, size sweep on random input \n", version);
+#ifndef CPU_ONLY
+	fprintf(fout, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fout, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintSweepReport(fout, "elements", "Melements/s", 1.0e-6);
+	rewind(fout);
+	while(fgets(buff,sizeof buff,fout))
+		printf("%s", buff);
+	fclose(fout);
+}
+
+// --serve: every request is a run of int32 elements, the reply their number of 1 bits, see ../../common/benchServe.h
+static int		*serveData = NULL;			// the requests padded to whole rows of kernel1
+static int		serveDataCap = 0;
+#ifndef CPU_ONLY
+static int		serveCap = 0;				// elements clBuffers hold, they only grow
+#endif
+
+static int bc_serve_request(const bench_serve_request *req, const void *payload)
+{
+	if (req->length == 0 || req->length % sizeof(int) != 0)
+		return BENCH_SERVE_BAD_REQUEST;
+	int n = (int)(req->length / sizeof(int));
+	// the smallest row of kernel1 is 1024 elements, the zeros that fill the last one have no 1 bits
+	int numofElements = (n + 1023) / 1024 * 1024;
+	const int *idata = (const int *)payload;
+	unsigned int *count = (unsigned int *)benchServeReply(sizeof(unsigned int));
+
+	if (count == NULL)
+		return BENCH_SERVE_NO_MEMORY;
+	if (numofElements != n)
+	{
+		if (numofElements > serveDataCap)
+		{
+			int *p = (int *)realloc(serveData, sizeof(int) * numofElements);
+			if (p == NULL)
+				return BENCH_SERVE_NO_MEMORY;
+			serveData = p;
+			serveDataCap = numofElements;
+		}
+		memcpy(serveData, payload, sizeof(int) * n);
+		memset(serveData + n, 0, sizeof(int) * (numofElements - n));
+		idata = serveData;
+	}
+#ifndef CPU_ONLY
+	// the widest row up to GLOBAL_SIZE_0 that tiles this size, as in the sweep
+	bcLaunch.fold = GLOBAL_SIZE_0;
+	while (numofElements % bcLaunch.fold != 0)
+		bcLaunch.fold /= 2;
+	if (numofElements > serveCap)
+	{
+		if (serveCap > 0)
+			bc_release_buffers();
+		bc_buffers(NULL, numofElements);
+		serveCap = numofElements;
+	}
+	*count = (unsigned int)bc_gpu(idata, numofElements);
+#else
+	start_measure_per(CPU);
+	*count = (unsigned int)bc_cpu(idata, numofElements, benchCpuThreads());
+	stop_measure_per(CPU);
+#endif
+	return BENCH_SERVE_OK;
+}
+
+static void bc_serve(const char *version)
+{
+	char buff[256];
+
+	if (benchServe(BENCH_OP_BITCOUNT, bc_serve_request) < 0)
+		return;
+	benchSummary(timeRes);
+#ifndef CPU_ONLY
+	if (serveCap > 0)
+		bc_release_buffers();
+	serveCap = 0;
+#endif
+	free(serveData);
+	serveData = NULL;
+	serveDataCap = 0;
+
+	FILE *fout = fopen("log.txt", "w+");
+	time_t t = time(NULL);
+	fprintf(fout, "Created on: %s", asctime(localtime(&t)));
+	fprintf(fout, "version: %s, service of bit count requests \n", version);
+#ifndef CPU_ONLY
+	fprintf(fout, "Device: %s (%s) \n\n", clRuntime.deviceName, clRuntime.platformName);
+#else
+	fprintf(fout, "Device: none, CPU-only build \n\n");
+#endif
+	benchPrintServeReport(fout);
+	benchPrintAllocReport(fout);
+	benchPrintStats(fout);
+	rewind(fout);
+	while(fgets(buff,sizeof buff,fout))
+		printf("%s", buff);
+	fclose(fout);
+}
+
+// --scaling: the CPU path of the measured loop on every thread count, see ../../common/benchScaling.h
+struct bc_scaling_job
+{
+	const int	*idata;
+	int			numofElements;
+};
+
+static void bc_scaling_call(void *user, int numThreads)
+{
+	const bc_scaling_job *job = (const bc_scaling_job *)user;
+	finalResultCPU = bc_cpu(job->idata, job->numofElements, numThreads);
+}
+
+int main(int argc, char **argv)
+{
+#ifndef CPU_ONLY
+	cl_int clErr;
+#endif
 
 	char version[256] = "BitCounter, optimized, with synchronization";
-	int readlen;
 	int numofElements = 1*1024*1024;
 	int * idata;
-	int finalResultGPU;
-	int finalResultCPU;
 	char buff[256];
-	int numofWorkGroups;
 
-	clGroupSize[0] = WORK_GROUP_SIZE;		
-	clGroupSize[1] = 1;
-	numofWorkGroups = numofElements / WORK_GROUP_SIZE;
+#ifndef CPU_ONLY
+	oclParseArgs(&argc, argv);
+#endif
+	benchParseArgs(&argc, argv);
+	resultsParseArgs(&argc, argv);
+	benchInit(phaseNames, NUM_PHASES);
 	// generate input data
-	idata = (int *) malloc(sizeof(cl_int) * numofElements);
+	idata = (int *) malloc(sizeof(int) * numofElements);
 	
+	benchTraceBegin("generate input");
 	srand(time(NULL));
 	for (int i=0; i<numofElements; i++)
 		idata[i] = rand();
+	benchTraceEnd();
 
-	//===================================CPU=======================================//
-	start_measure_per(CPU);
-	finalResultCPU = 0;
-	cl_int inp;
-    
-	for(int i=0; i<numofElements; i++)
-	{
-		inp = idata[i];
-		int cntr = 0;
-		while(inp != 0)
-		{
-			cntr++;
-			inp = inp & (inp - 1);
-		}
-		finalResultCPU += cntr;
-	}
-	stop_measure_per(CPU);
-    //===================================CPU=======================================//
-
+#ifndef CPU_ONLY
 	//=================================PLATFORM=======================================//
 	start_measure_per(PLATFORM);
-	if (clGetPlatformIDs(PLATFORMS_IDS, (cl_platform_id *)&clPlatformId, &num_platforms) != CL_SUCCESS)
-		printf("Error in clGetPlatformID! \n");
-	else
-	{
-		clGetPlatformInfo(clPlatformId[THIS_PLATFORM_ID], CL_PLATFORM_NAME, 200, buff, NULL);
-		printf("Platform ID: %s \n", buff);
-		printf("The number of platforms is/are: %d\n", num_platforms);
-		printf("THIS_PLATFORM_ID: %d\n", THIS_PLATFORM_ID);
-	}
+	if (oclGetPlatforms(&clRuntime) == 0)
+		exit(1);
 	stop_measure_per(PLATFORM);
 	//==================================DEVICE=======================================//
 	start_measure_per(DEVICE);
-	clErr = clGetDeviceIDs(clPlatformId[THIS_PLATFORM_ID], CL_DEVICE_TYPE_GPU, 1, &clDeviceId, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in clGetDeviceIDs! clErr=%i \n", clErr);
-	else
-	{
-		clGetDeviceInfo(clDeviceId, CL_DEVICE_NAME, 200, buff, NULL);
-		printf("Device Name: %s \n", buff);
-	}
+	if (oclSelectDevice(&clRuntime) != 0)
+		exit(1);
+	clDeviceId = clRuntime.device;
 	stop_measure_per(DEVICE);
 	//=================================CONTEXT=======================================//
 	start_measure_per(CONTEXT);
-	clContext = clCreateContext(0, 1, &clDeviceId, NULL, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating context!, clErr=%i \n", clErr);
-	else
-		printf("Context created! \n");
+	oclCreateContext(&clRuntime);
+	clContext = clRuntime.context;
 	stop_measure_per(CONTEXT);
 	//===============================COMMAND QUEUE===================================//
 	start_measure_per(CMDQ);
-	clCommandQueue = clCreateCommandQueue(clContext, clDeviceId, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating command queue!, clErr=%i \n", clErr);
-	else
-		printf("Command queue created! \n");
+	// cooperative mode times the device share from event profiling
+	oclCreateQueue(&clRuntime, oclCoopEnabled() ? CL_QUEUE_PROFILING_ENABLE : 0);
+	clCommandQueue = clRuntime.queue;
+	if (oclPipelineCreate(&clRuntime, &clPipeline) != 0)
+		exit(1);
 	stop_measure_per(CMDQ);
 	//=========================PROGRAM & BUILD & KERNEL==============================//
+#ifdef SAMOS_EMBED_KERNELS
+	oclEmbedKernelSources(samosKernelSources);
+#endif
 	start_measure_per(PGM1);
-	char *kernelSrc;
-	FILE* fp;
-	int filelen;
-
-	fp = fopen("Kernel1.cl", "r");
-	// getting size of the file
-	fseek(fp, 0, SEEK_END);  //set position indicator to the end of file
-	filelen = ftell(fp);	//return the current value of position indicator
-	rewind(fp);	//set position indicator to the beginning
-
-	kernelSrc = (char*) malloc(sizeof(char) * (filelen));
-	readlen = fread(kernelSrc, 1, filelen, fp);
-	if (readlen < filelen)
-		kernelSrc[readlen] = '\0';
-	else
-		kernelSrc[filelen] = '\0';
-
-	clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program!, clErr=%i \n", clErr);
-	else
-		printf("Program 1 created! \n");
-
-	clErr = clBuildProgram(clProgram, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 1!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program 1 built! \n");
+	clProgram.reset(oclBuildProgram(&clRuntime, "Kernel1.cl", NULL));
+	if (clProgram == NULL)
+		exit(1);
 	stop_measure_per(PGM1);
 
 	start_measure_per(KERNEL1);
-	clKernel1 = clCreateKernel(clProgram, "BitCounter", &clErr);
+	clKernel1.reset(clCreateKernel(clProgram, "BitCounter", &clErr));
 	if (clErr != CL_SUCCESS)
 			printf("Error in creating kernel 1!, clErr=%i \n", clErr);
 	else printf("Kernel 1 created! \n");
-
-	free(kernelSrc);
-	fclose(fp);
 	stop_measure_per(KERNEL1);
 /**************************************************/
 	start_measure_per(PGM2);
-	cl_program clProgram2;
-	char *kernelSrc2;
-	FILE* fp2;
-
-	fp2 = fopen("Kernel2.cl", "r");
-	fseek(fp2, 0, SEEK_END);
-	filelen = ftell(fp2);
-	rewind(fp2);
-
-	kernelSrc2 = (char*) malloc(sizeof(char) * (filelen));
-	readlen = fread(kernelSrc2, 1, filelen, fp2);
-	if (readlen < filelen)
-		kernelSrc2[readlen] = '\0';
-	else
-		kernelSrc2[filelen] = '\0';
-	clProgram2 = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSrc2, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating program 2 (version with no use of local memory)!, clErr=%i \n", clErr);
-	else
-		printf("Program 2 (version with no use of local memory) Created! \n");
-
-	clErr = clBuildProgram(clProgram2, 0, NULL, NULL, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-	{
-		char buff[4096];
-		printf("Error in building program 2 (with no local memory)!, clErr=%i \n", clErr);
-		clGetProgramBuildInfo(clProgram2, clDeviceId, CL_PROGRAM_BUILD_LOG, sizeof(buff), buff, NULL);
-		printf("-----Build log------\n %s\n", buff);
-	}
-	else printf("Program 2 Built! \n");
+	clProgram2.reset(oclBuildProgram(&clRuntime, "Kernel2.cl", NULL));
+	if (clProgram2 == NULL)
+		exit(1);
 	stop_measure_per(PGM2);
 
 	start_measure_per(KERNEL2);
 #ifdef LOCALMEM
-	clKernel2 = clCreateKernel(clProgram2, "SumLM", &clErr);
+	clKernel2.reset(clCreateKernel(clProgram2, "SumLM", &clErr));
 #else
-	clKernel2 = clCreateKernel(clProgram2, "SumNoLM", &clErr);
+	clKernel2.reset(clCreateKernel(clProgram2, "SumNoLM", &clErr));
 #endif
 	if (clErr != CL_SUCCESS)
 		printf("Error in creating kernel2-NoLM!, clErr=%i \n", clErr);
 	else printf("Kernel2-No-LM Created! \n");
 	stop_measure_per(KERNEL2);
 
-	free(kernelSrc2);
-	fclose(fp2);
-	//==================================BUFFER===================================//
-	start_measure_per(BUFF);
-	clSrcBuffer = clCreateBuffer(clContext, 0, sizeof(cl_int) * numofElements, NULL, &clErr);
-	clIntermediateBuffer = clCreateBuffer(clContext, 0, sizeof(cl_int) * numofWorkGroups, NULL, &clErr);
-	if (clErr != CL_SUCCESS)
-		printf("Error in creating buffer!, clErr=%i \n", clErr);
-	else
-		printf("Buffer created! \n");
-	stop_measure_per(BUFF);
-	start_measure_per(WRDEV);
-	clErr = clEnqueueWriteBuffer(clCommandQueue, clSrcBuffer, true, 0, sizeof(cl_int) * numofElements, idata, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in clEnqueueWriteBuffer!, clErr=%i \n", clErr);
-	else
-		printf("Data transferred into device! \n");
-
-	clFinish(clCommandQueue);
-	stop_measure_per(WRDEV);
-	//=================================KERNEL1====================================//
-
-	start_measure_per(KERNEL1_EXEC);
+	oclCoopInit(&clCoop);
+	oclRooflineMeasure(&clRuntime);
+#endif
 
-	clSetKernelArg(clKernel1, 0, sizeof(cl_mem), (void *) &clSrcBuffer);
-	clSetKernelArg(clKernel1, 1, sizeof(cl_mem), (void *) &clIntermediateBuffer);
+	if (benchSweepEnabled())
+	{
+		free(idata);
+		bc_sweep(version);
+#ifndef CPU_ONLY
+		bc_clean();
+#endif
+		return 0;
+	}
+	if (benchServeEnabled())
+	{
+		free(idata);
+		bc_serve(version);
+#ifndef CPU_ONLY
+		bc_clean();
+#endif
+		return 0;
+	}
 
-	clGlobalSize[0] = GLOBAL_SIZE_0;
-	clGlobalSize[1] = numofElements/int(GLOBAL_SIZE_0);
+#ifndef CPU_ONLY
+	bc_buffers(idata, numofElements);
+	bc_tune(&clRuntime, clKernel1, clBuffers, idata, numofElements);
+#endif
 
-	clErr = clEnqueueNDRangeKernel(clCommandQueue, clKernel1, 2, NULL, clGlobalSize, clGroupSize, 0, NULL, NULL);
-	if (clErr != CL_SUCCESS)
-		printf("Error in launching kernel 1!, clErr=%i \n", clErr);
-	else
-		printf("Kernel 1 launched successfully! \n");
+	bc_run(idata, numofElements);
+	bc_scaling_job scalingJob = {idata, numofElements};
+	benchScalingRun(bc_scaling_call, &scalingJob);
+#ifndef CPU_ONLY
+	// the result is a single int and stays a plain read in every mode
+	oclTimeCopyPath(&clRuntime, sizeof(cl_int) * numofElements, sizeof(cl_int), WRDEV_COPY, RDDEV_COPY);
+#endif
+	benchSummary(timeRes);
 
-	// finish executing this kernel before starting the other one
-	clFinish(clCommandQueue);
-	stop_measure_per(KERNEL1_EXEC);
-	//=================================KERNEL2====================================//
-	// Kernel2 sums up the results of each WorkGroup generated in kernel1
-		start_measure_per(KERNEL2_EXEC);
-
-		int numofWorkItems;
-		int numofElements_tmp;
-		cl_mem Intermediate = clIntermediateBuffer;
-		numofElements_tmp = numofWorkGroups;
-		numofWorkItems = (numofElements_tmp + 1) / 2;	// numofWorkGroups in kernel1 becomes numofWorkItems in kernel2.
-		while (numofElements_tmp > 1)	
-		{
-			cl_mem tmp;
-		
-			tmp = clSrcBuffer;
-			clSrcBuffer = clIntermediateBuffer;
-			clIntermediateBuffer = tmp;
-
-			if (numofWorkItems >= GLOBAL_SIZE_0)
-			{
-				clGlobalSize[0] = GLOBAL_SIZE_0;
-				clGlobalSize[1] = (numofWorkItems % (GLOBAL_SIZE_0) == 0) ? numofWorkItems/(GLOBAL_SIZE_0) : numofWorkItems/(GLOBAL_SIZE_0) + 1;
-			}
-			else
-			{
-				clGlobalSize[0] = (numofWorkItems % WORK_GROUP_SIZE == 0) ? numofWorkItems : numofWorkItems + WORK_GROUP_SIZE - (numofWorkItems % WORK_GROUP_SIZE);
-				clGlobalSize[1] = 1;
-			}
-
-			clSetKernelArg(clKernel2, 0, sizeof(cl_mem), (void *) &clSrcBuffer);
-			clSetKernelArg(clKernel2, 1, sizeof(cl_mem), (void *) &clIntermediateBuffer);
-			clSetKernelArg(clKernel2, 2, sizeof(int), (void *) &numofElements_tmp);
-
-			clEnqueueNDRangeKernel(clCommandQueue, clKernel2, 2, NULL, clGlobalSize, clGroupSize, 0, NULL, NULL);
-			if (clErr != CL_SUCCESS)
-					printf("Error in launching kernel2! clErr=%i \n", clErr);
-			else
-				printf("Kernel2 launched successfully! \n");
-			clFinish(clCommandQueue);
-
-			numofElements_tmp = (numofElements_tmp % (2 * WORK_GROUP_SIZE) == 0) ? numofElements_tmp / (2 * WORK_GROUP_SIZE) : numofElements_tmp / (2 * WORK_GROUP_SIZE) + 1;
-			numofWorkItems = (numofElements_tmp + 1) / 2;
-		}
-		stop_measure_per(KERNEL2_EXEC);
-	
-		//=================================RDDEV_RES====================================//
-		start_measure_per(RDDEV);
-    	clEnqueueReadBuffer(clCommandQueue, clIntermediateBuffer, CL_TRUE, 0, sizeof(cl_int), (void *) &finalResultGPU, 0, NULL, NULL);
-		stop_measure_per(RDDEV);
-
-	clReleaseContext(clContext);
-	clReleaseCommandQueue(clCommandQueue);
-	clReleaseProgram(clProgram);
-	clReleaseMemObject(clSrcBuffer);
-	clReleaseMemObject(clIntermediateBuffer);
-	clReleaseKernel(clKernel1);
-	clReleaseKernel(clKernel2);
+#ifndef CPU_ONLY
+	bc_release_buffers();
+	bc_clean();
+#endif
 	free(idata);
 
 	//================================RESULT PRINT================================//
 	FILE * fout;
 	fout = fopen("log.txt", "w+");
 
-	float total_GPU_NOLM = timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV];
-	float total_GPU_LM = timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV];
+	float total_GPU_NOLM = timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+	double total_GPU_NOLM_J = benchPhaseJoules(KERNEL1_EXEC) + benchPhaseJoules(KERNEL2_EXEC) + benchPhaseJoules(WRDEV) + benchPhaseJoules(RDDEV) + benchPhaseJoules(PIPELINE) + benchPhaseJoules(COOP);
+	float total_GPU_LM = timeRes[KERNEL1_EXEC] + timeRes[KERNEL2_EXEC] + timeRes[WRDEV] + timeRes[RDDEV] + timeRes[PIPELINE] + timeRes[COOP];
+
+	bench_result res;
+	char workGroup[16];
+	sprintf(workGroup, "%i", WORK_GROUP_SIZE);
+	resultsInit(&res, "bitcounter");
+	res.description = version;
+	res.problemSize = numofElements;
+	res.problemUnit = "elements";
+	res.workGroup = workGroup;
+	res.cpuMs = timeRes[CPU];
+	res.cpuThroughput = numofElements * 1.0e-6 / (timeRes[CPU] * 1.0e-3);
+	res.throughputUnit = "Melements/s";
+#ifndef CPU_ONLY
+	res.device = clRuntime.deviceName;
+	res.platform = clRuntime.platformName;
+	res.deviceType = oclDeviceTypeName(clRuntime.deviceType);
+	res.driver = clRuntime.driverVersion;
+	res.variant = oclCoopName() ? oclCoopName() : oclPipelineName() ? oclPipelineName() : oclHostMemModeName(oclHostMemMode());
+	res.gpuMs = total_GPU_NOLM;
+	res.gpuThroughput = numofElements * 1.0e-6 / (total_GPU_NOLM * 1.0e-3);
+	res.speedup = timeRes[CPU] / total_GPU_NOLM;
+	res.verified = (finalResultCPU == finalResultGPU);
+#else
+	resultsSetHostDevice(&res);
+#endif
+	res.gpuJ = total_GPU_NOLM_J;
+	res.cpuJ = benchPhaseJoules(CPU);
+	res.energyOps = (double)sizeof(int) * numofElements;
+	res.energyOp = "byte";
+	resultsWrite(&res);
 
 	struct tm *local;
 	time_t t;
@@ -372,7 +800,15 @@ int main(void)
 	local = localtime(&t);
 
 	fprintf(fout, "Created on: %s", asctime(local));
-	fprintf(fout, "version: %s \n\n", version);
+	fprintf(fout, "version: %s \n", version);
+#ifndef CPU_ONLY
+	fprintf(fout, "Device: %s (%s) \n", clRuntime.deviceName, clRuntime.platformName);
+	oclPrintCacheStats(fout);
+	oclPrintHostMemReport(fout, &clRuntime, WRDEV, RDDEV, WRDEV_COPY, RDDEV_COPY);
+	oclPrintPipelineReport(fout, &clPipeline, PIPELINE);
+	oclPrintCoopReport(fout, &clCoop, COOP, "elements");
+	oclPrintTuneReport(fout, "bitcounter.BitCounter", &bcLaunch);
+	fprintf(fout, "\n");
 	fprintf(fout, "Result GPU-LM is: %u \n", finalResultGPU);
 	fprintf(fout, "Result CPU is: %u \n", finalResultCPU);
 	if (finalResultCPU != finalResultGPU)
@@ -384,14 +820,21 @@ int main(void)
 		fprintf(fout, "ERROR CPU results do not match with GPU with LM!!!!\n");
 		exit(1);
 	}
+#else
+	fprintf(fout, "Device: none, CPU-only build \n\n");
+	fprintf(fout, "Result CPU is: %u \n", finalResultCPU);
+#endif
+	fprintf(fout, "CPU threads: %i \n", benchCpuThreads());
 	fprintf(fout, "\n===========Performance Measurements=================\n");
 	fprintf(fout, "Work-Group size is %i \n", WORK_GROUP_SIZE);
 	fprintf(fout, "Problem size is %i \n\n", numofElements);
-	fprintf(fout, "GPU time breakdown: \n"
+#ifndef CPU_ONLY
+	fprintf(fout, "GPU time breakdown (median of %i iterations): \n"
 			   "	WRDEV (Data Transfer) = \t%10.2f msecs \n"
 			   "	KERNEL1_EXEC = \t\t\t%10.2f msecs \n"
 			   "	KERNEL2NoLM_EXEC = \t\t%10.2f msecs \n"
 			   "	RDDEV_RES (Data Transfer) = \t%10.2f msecs \n\n",
+			   benchIterations(),
 			   timeRes[WRDEV],
 			   timeRes[KERNEL1_EXEC],
 			   timeRes[KERNEL2_EXEC],
@@ -400,6 +843,20 @@ int main(void)
 			      "CPU time: %10.2f msecs \n\n",
 			total_GPU_NOLM, timeRes[CPU]);
 	fprintf(fout, "Speed Up : %10.2f \n\n", float(timeRes[CPU])/float(total_GPU_NOLM));
+	// kernel1 reads one int and shares a partial sum per work-group; its loop takes 4 operations per set bit
+	// plus the test that ends it, and the tree adds one per element. kernel2 reads two partials and adds them.
+	ocl_kernel_cost bcCost[2] = {
+		{"BitCounter", (double)numofElements, 4.0 + 4.0 / WORK_GROUP_SIZE, 4.0 * finalResultGPU / numofElements + 2.0, OCL_ROOF_INT,
+		 timeRes[KERNEL1_EXEC]},
+		{"SumNoLM", bc_sum_items(numofElements / WORK_GROUP_SIZE), 8.0 + 4.0 / WORK_GROUP_SIZE, 2.0, OCL_ROOF_INT, timeRes[KERNEL2_EXEC]}};
+	oclPrintRooflineReport(fout, bcCost, 2);
+#else
+	fprintf(fout, "CPU time (median of %i iterations): %10.2f msecs \n\n", benchIterations(), timeRes[CPU]);
+#endif
+	benchPrintEnergySummary(fout, total_GPU_NOLM_J, total_GPU_NOLM, benchPhaseJoules(CPU), timeRes[CPU], (double)sizeof(int) * numofElements, "byte");
+	benchPrintScalingReport(fout, numofElements, "Melements/s", 1.0e-6, total_GPU_NOLM);
+	benchPrintAllocReport(fout);
+	benchPrintStats(fout);
 
 	rewind(fout);
 	while(fgets(buff,sizeof buff,fout))
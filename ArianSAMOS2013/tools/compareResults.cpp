@@ -0,0 +1,546 @@
+/*
+ * compareResults.cpp
+ *
+ *  Compares two result sets written by the benchmarks (see
+ *  ../common/benchResults.h) and flags statistically significant slowdowns.
+ *
+ *  Usage: compareResults [--threshold <pct>] [--alpha <a>] [--phase <name>]... <baseline> <candidate>
+ *
+ *  Both files may be JSON lines or CSV. Records are matched on benchmark,
+ *  device, problem size, work-group size and variant; several runs of the same
+ *  configuration in one file are pooled. For every phase measured in both
+ *  sets Welch's t-test is run on the per-iteration mean and stddev. A phase
+ *  is a REGRESSION when the candidate mean is more than <pct> percent
+ *  (default 5) slower and the one-sided p-value is below <a> (default 0.05).
+ *  Phases with fewer than two samples on either side, typically the one-time
+ *  OpenCL set-up of a single run, are listed but not tested.
+ *
+ *  The exit code is 1 when at least one regression was found, so the tool
+ *  can gate a script, 2 on bad usage or unreadable input, 0 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/* Pooled statistics of one phase of one configuration */
+struct phase_stats
+{
+	int		n;
+	double	mean;
+	double	m2;			/* sum of squared deviations from the mean */
+};
+
+struct config_stats
+{
+	std::string							label;
+	std::map<std::string, phase_stats>	phases;
+	std::vector<std::string>			order;
+};
+
+typedef std::map<std::string, config_stats> result_set;
+
+static void add_phase(config_stats *cfg, const std::string &phase, int n, double mean, double stddev)
+{
+	if (n <= 0)
+		return;
+	if (cfg->phases.find(phase) == cfg->phases.end())
+	{
+		phase_stats empty = {0, 0.0, 0.0};
+		cfg->phases[phase] = empty;
+		cfg->order.push_back(phase);
+	}
+	phase_stats *p = &cfg->phases[phase];
+	double m2 = (n > 1) ? stddev * stddev * (n - 1) : 0.0;
+
+	/* Chan et al. parallel combination of two groups */
+	int total = p->n + n;
+	double delta = mean - p->mean;
+	p->m2 += m2 + delta * delta * ((double)p->n * n / total);
+	p->mean += delta * n / total;
+	p->n = total;
+}
+
+static config_stats *get_config(result_set *set, const std::string &benchmark, const std::string &device,
+								const std::string &size, const std::string &workGroup, const std::string &variant)
+{
+	std::string key = benchmark + "|" + device + "|" + size + "|" + workGroup + "|" + variant;
+	config_stats *cfg = &(*set)[key];
+	if (cfg->label.empty())
+	{
+		cfg->label = benchmark + " on " + device + ", size " + size + ", work-group " + workGroup;
+		if (!variant.empty())
+			cfg->label += ", " + variant;
+	}
+	return cfg;
+}
+
+/*------------------------------- JSON lines -------------------------------*/
+
+/* Just enough of a JSON reader for the records benchResults.cpp writes */
+struct json_value
+{
+	int											type;		/* 0 null, 1 number, 2 string, 3 object, 4 array, 5 bool */
+	double										num;
+	std::string									str;
+	std::vector<std::pair<std::string, json_value> >	members;
+	std::vector<json_value>						items;
+
+	const json_value *get(const char *name) const
+	{
+		for (size_t i=0; i<members.size(); i++)
+			if (members[i].first == name)
+				return &members[i].second;
+		return NULL;
+	}
+};
+
+static void skip_ws(const char **p)
+{
+	while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n')
+		(*p)++;
+}
+
+static int parse_value(const char **p, json_value *v);
+
+static int parse_string(const char **p, std::string *out)
+{
+	if (**p != '"')
+		return 0;
+	(*p)++;
+	while (**p && **p != '"')
+	{
+		if (**p == '\\')
+		{
+			(*p)++;
+			switch (**p)
+			{
+				case 'n': out->push_back('\n'); break;
+				case 't': out->push_back('\t'); break;
+				case 'r': out->push_back('\r'); break;
+				case 'b': out->push_back('\b'); break;
+				case 'f': out->push_back('\f'); break;
+				case 'u':
+				{
+					unsigned int c = 0;
+					if (sscanf(*p + 1, "%4x", &c) != 1)
+						return 0;
+					out->push_back(c < 0x80 ? (char)c : '?');
+					*p += 4;
+					break;
+				}
+				case '\0': return 0;
+				default: out->push_back(**p); break;
+			}
+		}
+		else
+			out->push_back(**p);
+		(*p)++;
+	}
+	if (**p != '"')
+		return 0;
+	(*p)++;
+	return 1;
+}
+
+static int parse_value(const char **p, json_value *v)
+{
+	skip_ws(p);
+	v->type = 0;
+	if (**p == '{')
+	{
+		v->type = 3;
+		(*p)++;
+		skip_ws(p);
+		if (**p == '}')
+		{
+			(*p)++;
+			return 1;
+		}
+		while (1)
+		{
+			std::pair<std::string, json_value> m;
+			skip_ws(p);
+			if (!parse_string(p, &m.first))
+				return 0;
+			skip_ws(p);
+			if (**p != ':')
+				return 0;
+			(*p)++;
+			if (!parse_value(p, &m.second))
+				return 0;
+			v->members.push_back(m);
+			skip_ws(p);
+			if (**p == ',')
+				(*p)++;
+			else if (**p == '}')
+			{
+				(*p)++;
+				return 1;
+			}
+			else
+				return 0;
+		}
+	}
+	if (**p == '[')
+	{
+		v->type = 4;
+		(*p)++;
+		skip_ws(p);
+		if (**p == ']')
+		{
+			(*p)++;
+			return 1;
+		}
+		while (1)
+		{
+			json_value item;
+			if (!parse_value(p, &item))
+				return 0;
+			v->items.push_back(item);
+			skip_ws(p);
+			if (**p == ',')
+				(*p)++;
+			else if (**p == ']')
+			{
+				(*p)++;
+				return 1;
+			}
+			else
+				return 0;
+		}
+	}
+	if (**p == '"')
+	{
+		v->type = 2;
+		return parse_string(p, &v->str);
+	}
+	if (strncmp(*p, "true", 4) == 0 || strncmp(*p, "null", 4) == 0)
+	{
+		v->type = (**p == 't') ? 5 : 0;
+		v->num = (**p == 't');
+		*p += 4;
+		return 1;
+	}
+	if (strncmp(*p, "false", 5) == 0)
+	{
+		v->type = 5;
+		v->num = 0;
+		*p += 5;
+		return 1;
+	}
+	char *end;
+	v->num = strtod(*p, &end);
+	if (end == *p)
+		return 0;
+	v->type = 1;
+	*p = end;
+	return 1;
+}
+
+static std::string field_text(const json_value *v)
+{
+	char buf[64];
+	if (v == NULL)
+		return "";
+	if (v->type == 2)
+		return v->str;
+	if (v->type == 1)
+	{
+		snprintf(buf, sizeof(buf), "%.0f", v->num);
+		return buf;
+	}
+	return "";
+}
+
+static int load_json_line(result_set *set, const char *line)
+{
+	json_value rec;
+	const char *p = line;
+	if (!parse_value(&p, &rec) || rec.type != 3)
+		return 0;
+
+	config_stats *cfg = get_config(set, field_text(rec.get("benchmark")), field_text(rec.get("device")),
+								   field_text(rec.get("problem_size")), field_text(rec.get("work_group")),
+								   field_text(rec.get("variant")));
+	const json_value *phases = rec.get("phases");
+	if (phases == NULL || phases->type != 3)
+		return 1;
+	for (size_t i=0; i<phases->members.size(); i++)
+	{
+		const json_value *ph = &phases->members[i].second;
+		const json_value *n = ph->get("n");
+		const json_value *mean = ph->get("mean");
+		const json_value *sd = ph->get("stddev");
+		if (n && mean && sd)
+			add_phase(cfg, phases->members[i].first, (int)n->num, mean->num, sd->num);
+	}
+	return 1;
+}
+
+/*----------------------------------- CSV -----------------------------------*/
+
+static void split_csv(const char *line, std::vector<std::string> *cols)
+{
+	std::string cur;
+	int quoted = 0;
+	cols->clear();
+	for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+	{
+		if (quoted)
+		{
+			if (*p == '"' && p[1] == '"')
+			{
+				cur.push_back('"');
+				p++;
+			}
+			else if (*p == '"')
+				quoted = 0;
+			else
+				cur.push_back(*p);
+		}
+		else if (*p == '"')
+			quoted = 1;
+		else if (*p == ',')
+		{
+			cols->push_back(cur);
+			cur.clear();
+		}
+		else
+			cur.push_back(*p);
+	}
+	cols->push_back(cur);
+}
+
+static int column(const std::vector<std::string> &header, const char *name)
+{
+	for (size_t i=0; i<header.size(); i++)
+		if (header[i] == name)
+			return (int)i;
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int load_results(const char *file, result_set *set)
+{
+	FILE *fp = fopen(file, "r");
+	if (fp == NULL)
+	{
+		printf("Error: %s could not be opened! \n", file);
+		return 0;
+	}
+
+	std::vector<std::string> header, cols;
+	std::string line;
+	char chunk[4096];
+	int lineNo = 0, records = 0;
+
+	while (fgets(chunk, sizeof(chunk), fp))
+	{
+		line += chunk;
+		if (line[line.size() - 1] != '\n' && !feof(fp))
+			continue;
+		lineNo++;
+
+		const char *p = line.c_str();
+		skip_ws(&p);
+		if (*p == '{')
+		{
+			if (load_json_line(set, p))
+				records++;
+			else
+				printf("Warning: %s:%i is not a valid record, skipped \n", file, lineNo);
+		}
+		else if (strncmp(p, "timestamp,", 10) == 0)
+			split_csv(p, &header);
+		else if (*p != '\0' && !header.empty())
+		{
+			split_csv(p, &cols);
+			int b = column(header, "benchmark"), d = column(header, "device"), s = column(header, "problem_size");
+			int w = column(header, "work_group"), ph = column(header, "phase"), n = column(header, "n");
+			int m = column(header, "mean"), sd = column(header, "stddev"), v = column(header, "variant");
+			if (b < 0 || d < 0 || s < 0 || w < 0 || ph < 0 || n < 0 || m < 0 || sd < 0 || (int)cols.size() != (int)header.size())
+				printf("Warning: %s:%i is not a valid record, skipped \n", file, lineNo);
+			else
+			{
+				config_stats *cfg = get_config(set, cols[b], cols[d], cols[s], cols[w], (v >= 0) ? cols[v] : "");
+				add_phase(cfg, cols[ph], atoi(cols[n].c_str()), atof(cols[m].c_str()), atof(cols[sd].c_str()));
+				records++;
+			}
+		}
+		line.clear();
+	}
+	fclose(fp);
+
+	if (records == 0)
+	{
+		printf("Error: no results found in %s \n", file);
+		return 0;
+	}
+	return 1;
+}
+
+/* Continued fraction of the regularized incomplete beta function (modified Lentz) */
+static double beta_cf(double a, double b, double x)
+{
+	const double tiny = 1.0e-300;
+	double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0);
+	if (fabs(d) < tiny)
+		d = tiny;
+	d = 1.0 / d;
+	double h = d;
+	for (int m=1; m<=300; m++)
+	{
+		double m2 = 2.0 * m;
+		double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+		d = 1.0 + aa * d;
+		if (fabs(d) < tiny)
+			d = tiny;
+		c = 1.0 + aa / c;
+		if (fabs(c) < tiny)
+			c = tiny;
+		d = 1.0 / d;
+		h *= d * c;
+		aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+		d = 1.0 + aa * d;
+		if (fabs(d) < tiny)
+			d = tiny;
+		c = 1.0 + aa / c;
+		if (fabs(c) < tiny)
+			c = tiny;
+		d = 1.0 / d;
+		double del = d * c;
+		h *= del;
+		if (fabs(del - 1.0) < 1.0e-12)
+			break;
+	}
+	return h;
+}
+
+static double incomplete_beta(double a, double b, double x)
+{
+	if (x <= 0.0)
+		return 0.0;
+	if (x >= 1.0)
+		return 1.0;
+	double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+	if (x < (a + 1.0) / (a + b + 2.0))
+		return front * beta_cf(a, b, x) / a;
+	return 1.0 - front * beta_cf(b, a, 1.0 - x) / b;
+}
+
+/* P(T > t) for Student's t with df degrees of freedom */
+static double t_upper_tail(double t, double df)
+{
+	double tail = 0.5 * incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+	return (t > 0) ? tail : 1.0 - tail;
+}
+
+int main(int argc, char **argv)
+{
+	double threshold = 5.0;
+	double alpha = 0.05;
+	std::vector<std::string> only;
+	const char *files[2] = {NULL, NULL};
+	int numFiles = 0;
+
+	for (int i=1; i<argc; i++)
+	{
+		if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+			threshold = atof(argv[++i]);
+		else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc)
+			alpha = atof(argv[++i]);
+		else if (strcmp(argv[i], "--phase") == 0 && i + 1 < argc)
+			only.push_back(argv[++i]);
+		else if (numFiles < 2 && argv[i][0] != '-')
+			files[numFiles++] = argv[i];
+		else
+			numFiles = 3;
+	}
+	if (numFiles != 2)
+	{
+		printf("Usage: %s [--threshold <pct>] [--alpha <a>] [--phase <name>]... <baseline> <candidate>\n", argv[0]);
+		return 2;
+	}
+
+	result_set base, cand;
+	if (!load_results(files[0], &base) || !load_results(files[1], &cand))
+		return 2;
+
+	int regressions = 0, improvements = 0, compared = 0;
+	for (result_set::iterator it = cand.begin(); it != cand.end(); ++it)
+	{
+		result_set::iterator bit = base.find(it->first);
+		if (bit == base.end())
+		{
+			printf("\n%s: not in baseline \n", it->second.label.c_str());
+			continue;
+		}
+		printf("\n%s \n", it->second.label.c_str());
+		printf("	%-14s %6s %6s %12s %12s %9s %9s  %s \n", "phase", "n(b)", "n(c)", "base msecs", "cand msecs", "delta", "p", "verdict");
+
+		config_stats *c = &it->second;
+		for (size_t i=0; i<c->order.size(); i++)
+		{
+			const std::string &name = c->order[i];
+			if (!only.empty())
+			{
+				size_t k = 0;
+				while (k < only.size() && only[k] != name)
+					k++;
+				if (k == only.size())
+					continue;
+			}
+			std::map<std::string, phase_stats>::iterator bp = bit->second.phases.find(name);
+			if (bp == bit->second.phases.end())
+				continue;
+
+			const phase_stats *pb = &bp->second;
+			const phase_stats *pc = &c->phases[name];
+			double delta = (pb->mean > 0.0) ? 100.0 * (pc->mean - pb->mean) / pb->mean : 0.0;
+			const char *verdict = "";
+			char pText[16] = "n/a";
+
+			if (pb->n > 1 && pc->n > 1)
+			{
+				double vb = pb->m2 / (pb->n - 1) / pb->n;
+				double vc = pc->m2 / (pc->n - 1) / pc->n;
+				double p;
+				if (vb + vc > 0.0)
+				{
+					/* Welch's t-test with the Welch-Satterthwaite degrees of freedom */
+					double t = (pc->mean - pb->mean) / sqrt(vb + vc);
+					double df = (vb + vc) * (vb + vc) / (vb * vb / (pb->n - 1) + vc * vc / (pc->n - 1));
+					p = t_upper_tail(fabs(t), df);
+				}
+				else
+					p = (pc->mean != pb->mean) ? 0.0 : 1.0;
+				snprintf(pText, sizeof(pText), "%.4f", p);
+				compared++;
+
+				if (p < alpha && delta > threshold)
+				{
+					verdict = "REGRESSION";
+					regressions++;
+				}
+				else if (p < alpha && delta < -threshold)
+				{
+					verdict = "improved";
+					improvements++;
+				}
+			}
+			printf("	%-14s %6i %6i %12.3f %12.3f %+8.1f%% %9s  %s \n",
+					name.c_str(), pb->n, pc->n, pb->mean, pc->mean, delta, pText, verdict);
+		}
+	}
+
+	printf("\n%i phase(s) compared, %i regression(s), %i improvement(s) (threshold %.1f%%, alpha %.3f) \n",
+			compared, regressions, improvements, threshold, alpha);
+	return regressions ? 1 : 0;
+}
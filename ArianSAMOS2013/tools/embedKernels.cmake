@@ -0,0 +1,27 @@
+#
+# Writes the OpenCL sources of a benchmark into a C++ header
+#
+#   cmake -DOUTPUT=<header> -DSOURCE_DIR=<dir> -DKERNELS=<a.cl,b.cl> -P embedKernels.cmake
+#
+# The header defines samosKernelSources, the table oclEmbedKernelSources()
+# takes (oclRuntime.h). The sources are written as byte arrays rather than
+# string literals, which some compilers limit in length.
+#
+
+string(REPLACE "," ";" kernels "${KERNELS}")
+
+set(body "/* Generated by tools/embedKernels.cmake from ${KERNELS}, do not edit */\n\n")
+string(APPEND body "#ifndef SAMOS_KERNELS_H_\n#define SAMOS_KERNELS_H_\n\n#include \"oclRuntime.h\"\n\n")
+set(table "")
+foreach(kernel ${kernels})
+	string(MAKE_C_IDENTIFIER "${kernel}" id)
+	file(READ ${SOURCE_DIR}/${kernel} hex HEX)
+	# 16 bytes per line
+	string(REGEX REPLACE "(................................)" "\\1\n\t" hex "${hex}")
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+	string(APPEND body "static const unsigned char samosKernel_${id}[] = {\n\t${bytes}0x00\n};\n\n")
+	string(APPEND table "\t{\"${kernel}\", (const char *)samosKernel_${id}},\n")
+endforeach()
+string(APPEND body "static const ocl_kernel_source samosKernelSources[] = {\n${table}\t{NULL, NULL}\n};\n\n#endif\n")
+
+file(WRITE ${OUTPUT} "${body}")
@@ -0,0 +1,384 @@
+/*
+ * serveClient.cpp
+ *
+ *  Load generator for a benchmark running with --serve (see
+ *  ../common/benchServe.h): measures the latency of every request and the
+ *  sustained throughput of the service.
+ *
+ *  Usage: serveClient --socket <path> --op <aes|conv|bitcount|pm|ping|shutdown>
+ *                     [--size <n>] [--width <w> --height <h>] [--requests <n>]
+ *                     [--clients <n>] [--warmup <n>] [--shutdown]
+ *
+ *  --size is the request size in the unit of the op, AES bytes (rounded to
+ *  whole blocks) and BitCounter elements, default 1M, with K/M suffixes;
+ *  Convolution takes --width and --height (default 512 x 512) and PM always
+ *  sends one 64-point profile. Every one of --clients connections (default 1,
+ *  one OpenMP thread each) sends --warmup requests that are not recorded
+ *  (default 2) and then its share of --requests (default 100) back to back
+ *  with random payloads, waiting for each reply before the next request.
+ *  The report has the latency percentiles seen by the clients, the service
+ *  time the server measured for the same requests, the difference being the
+ *  socket transfer and the wait behind other clients, and the requests and
+ *  megabytes per second over the whole run. BitCounter replies are checked
+ *  against a popcount on the client. --shutdown stops the service after
+ *  the run, --op shutdown does only that.
+ *
+ *  The exit code is 1 when a request failed or a result did not match, 2
+ *  on bad usage or when the service cannot be reached, 0 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef _OPENMP
+ #include <omp.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#include "benchServe.h"
+
+/* Results of one client connection */
+struct client_stats
+{
+	std::vector<double>	latencyMs;
+	std::vector<double>	serviceMs;
+	long				errors;
+	long				mismatches;
+};
+
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1.0e3 + ts.tv_nsec * 1.0e-6;
+}
+
+static int connect_to(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	unsigned char *p = (unsigned char *)buf;
+	while (len > 0)
+	{
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	while (len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Sends one request and reads the reply into *reply; -1 when the connection broke */
+static int round_trip(int fd, const bench_serve_request *req, const std::vector<unsigned char> &payload, bench_serve_reply *rep, std::vector<unsigned char> *reply)
+{
+	if (write_full(fd, req, sizeof(*req)) != 0 || (req->length > 0 && write_full(fd, &payload[0], req->length) != 0))
+		return -1;
+	if (read_full(fd, rep, sizeof(*rep)) != 0 || rep->magic != BENCH_SERVE_MAGIC)
+		return -1;
+	reply->resize(rep->length);
+	if (rep->length > 0 && read_full(fd, &(*reply)[0], rep->length) != 0)
+		return -1;
+	return 0;
+}
+
+static const char *opNames[] = {"ping", "shutdown", "aes", "conv", "bitcount", "pm"};
+
+static int parse_op(const char *s)
+{
+	for (int op=0; op<6; op++)
+		if (strcmp(s, opNames[op]) == 0)
+			return op;
+	return -1;
+}
+
+static long long parse_size(const char *s)
+{
+	char *e;
+	long long v = strtoll(s, &e, 10);
+	if (*e == 'K' || *e == 'k')
+		v <<= 10;
+	else if (*e == 'M' || *e == 'm')
+		v <<= 20;
+	return v;
+}
+
+static size_t payload_len(int op, long long size, int width, int height)
+{
+	if (op == BENCH_OP_AES)
+		return (size_t)(size + 15) / 16 * 16;
+	if (op == BENCH_OP_BITCOUNT)
+		return sizeof(int) * (size_t)size;
+	if (op == BENCH_OP_CONV)
+		return (size_t)width * height * 4;
+	if (op == BENCH_OP_PM)
+		return sizeof(float) * 64;
+	return 0;
+}
+
+/* A random payload for op and the request header that goes with it */
+static void make_request(int op, long long size, int width, int height, unsigned int seed, bench_serve_request *req, std::vector<unsigned char> *payload)
+{
+	size_t len = payload_len(op, size, width, height);
+
+	memset(req, 0, sizeof(*req));
+	req->magic = BENCH_SERVE_MAGIC;
+	req->op = op;
+	req->param[0] = (op == BENCH_OP_CONV) ? width : 0;
+	req->param[1] = (op == BENCH_OP_CONV) ? height : 0;
+	req->length = len;
+
+	// rand() is not thread-safe, every client draws from its own LCG
+	payload->resize(len);
+	if (op == BENCH_OP_PM)
+	{
+		// a profile in dB: a noise floor with a few peaks, like the data sets
+		float *p = (float *)&(*payload)[0];
+		for (int i=0; i<64; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			p[i] = 5.0f * (seed >> 8) / (1 << 24) + ((i % 16 == 8) ? 30.0f : 0.0f);
+		}
+	}
+	else
+		for (size_t i=0; i<len; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			(*payload)[i] = (unsigned char)(seed >> 24);
+		}
+}
+
+static unsigned int popcount_ints(const std::vector<unsigned char> &payload)
+{
+	unsigned int total = 0;
+	for (size_t i=0; i<payload.size(); i++)
+		for (unsigned int b = payload[i]; b != 0; b &= b - 1)
+			total++;
+	return total;
+}
+
+static double percentile(const std::vector<double> &sorted, double q)
+{
+	double pos = q * (sorted.size() - 1);
+	size_t lo = (size_t)pos;
+	if (lo + 1 >= sorted.size())
+		return sorted.back();
+	return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s --socket <path> --op <aes|conv|bitcount|pm|ping|shutdown> [--size <n>] [--width <w> --height <h>]\n"
+		   "       [--requests <n>] [--clients <n>] [--warmup <n>] [--shutdown]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = getenv("SAMOS_SERVE");
+	int op = -1, width = 512, height = 512, numClients = 1, warmup = 2, shutdownAfter = 0;
+	long long size = 1024 * 1024;
+	long numRequests = 100;
+
+	for (int i=1; i<argc; i++)
+	{
+		if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc)
+			op = parse_op(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			size = parse_size(argv[++i]);
+		else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+			width = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+			height = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+			numRequests = atol(argv[++i]);
+		else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc)
+			numClients = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+			warmup = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--shutdown") == 0)
+			shutdownAfter = 1;
+		else
+		{
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || op < 0 || size <= 0 || width <= 0 || height <= 0 || numRequests < 1 || numClients < 1 || warmup < 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+#ifndef _OPENMP
+	if (numClients > 1)
+		printf("Built without OpenMP, running one client instead of %i \n", numClients);
+	numClients = 1;
+#endif
+
+	std::vector<client_stats> clients(numClients);
+	long long payloadBytes = 0;
+	int unreachable = 0;
+	double wallMs = 0.0;
+
+	if (op != BENCH_OP_SHUTDOWN)
+	{
+		double start = 0.0;
+		#pragma omp parallel num_threads(numClients) reduction(+:unreachable)
+		{
+			int c = 0;
+#ifdef _OPENMP
+			c = omp_get_thread_num();
+#endif
+			{
+				client_stats *st = &clients[c];
+				bench_serve_request req;
+				bench_serve_reply rep;
+				std::vector<unsigned char> payload, reply;
+				long mine = numRequests / numClients + (c < numRequests % numClients ? 1 : 0);
+				int fd = connect_to(path);
+
+				st->errors = st->mismatches = 0;
+				if (fd < 0)
+				{
+					printf("Client %i cannot connect to %s: %s \n", c, path, strerror(errno));
+					unreachable++;
+				}
+				// the warm-ups of every client are done before the clock starts
+				for (int w=0; w<warmup && fd >= 0; w++)
+				{
+					make_request(op, size, width, height, 1000 * c + w, &req, &payload);
+					if (round_trip(fd, &req, payload, &rep, &reply) != 0)
+					{
+						close(fd);
+						fd = -1;
+						unreachable++;
+					}
+				}
+				#pragma omp barrier
+				#pragma omp single
+				start = now_ms();
+				for (long r=0; r<mine && fd >= 0; r++)
+				{
+					make_request(op, size, width, height, 1000003 * c + r, &req, &payload);
+					double t0 = now_ms();
+					if (round_trip(fd, &req, payload, &rep, &reply) != 0)
+					{
+						printf("Client %i lost the connection after %li requests \n", c, r);
+						st->errors += mine - r;
+						break;
+					}
+					st->latencyMs.push_back(now_ms() - t0);
+					st->serviceMs.push_back(rep.serviceNs * 1.0e-6);
+					if (rep.status != BENCH_SERVE_OK)
+						st->errors++;
+					else if (op == BENCH_OP_BITCOUNT && (reply.size() != sizeof(unsigned int) || *(unsigned int *)&reply[0] != popcount_ints(payload)))
+						st->mismatches++;
+					else if (op != BENCH_OP_BITCOUNT && op != BENCH_OP_PM && reply.size() != payload.size())
+						st->mismatches++;
+				}
+				if (fd >= 0)
+					close(fd);
+			}
+		}
+		wallMs = now_ms() - start;
+		payloadBytes = (long long)payload_len(op, size, width, height);
+	}
+
+	std::vector<double> latency, service;
+	long errors = 0, mismatches = 0;
+	for (int c=0; c<numClients; c++)
+	{
+		latency.insert(latency.end(), clients[c].latencyMs.begin(), clients[c].latencyMs.end());
+		service.insert(service.end(), clients[c].serviceMs.begin(), clients[c].serviceMs.end());
+		errors += clients[c].errors;
+		mismatches += clients[c].mismatches;
+	}
+
+	if (!latency.empty())
+	{
+		std::sort(latency.begin(), latency.end());
+		std::sort(service.begin(), service.end());
+		double sumL = 0.0, sumS = 0.0;
+		for (size_t i=0; i<latency.size(); i++)
+		{
+			sumL += latency[i];
+			sumS += service[i];
+		}
+		printf("%li %s requests of %lli bytes on %s, %i client(s), %i warm-up(s) each \n", (long)latency.size(), opNames[op], payloadBytes, path, numClients, warmup);
+		printf("	latency (ms):      min %9.3f  median %9.3f  mean %9.3f  p95 %9.3f  p99 %9.3f  max %9.3f \n",
+			   latency.front(), percentile(latency, 0.50), sumL / latency.size(), percentile(latency, 0.95), percentile(latency, 0.99), latency.back());
+		printf("	service time (ms): min %9.3f  median %9.3f  mean %9.3f  p95 %9.3f  p99 %9.3f  max %9.3f \n",
+			   service.front(), percentile(service, 0.50), sumS / service.size(), percentile(service, 0.95), percentile(service, 0.99), service.back());
+		printf("	transfer and queueing: %.3f ms per request (mean latency - mean service time) \n", (sumL - sumS) / latency.size());
+		printf("	throughput: %.1f requests/s, %.2f MB/s of request payload over %.2f s \n", latency.size() / (wallMs * 1.0e-3),
+			   latency.size() * payloadBytes / (1024.0 * 1024.0) / (wallMs * 1.0e-3), wallMs * 1.0e-3);
+		printf("	%li error(s), %li mismatch(es) \n", errors, mismatches);
+	}
+
+	if (op == BENCH_OP_SHUTDOWN || shutdownAfter)
+	{
+		bench_serve_request req;
+		bench_serve_reply rep;
+		std::vector<unsigned char> payload, reply;
+		int fd = connect_to(path);
+
+		memset(&req, 0, sizeof(req));
+		req.magic = BENCH_SERVE_MAGIC;
+		req.op = BENCH_OP_SHUTDOWN;
+		if (fd < 0 || round_trip(fd, &req, payload, &rep, &reply) != 0)
+		{
+			printf("The service on %s could not be shut down \n", path);
+			unreachable++;
+		}
+		else
+			printf("Service on %s shut down \n", path);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	if (unreachable)
+		return 2;
+	return (errors || mismatches) ? 1 : 0;
+}